@@ -47,6 +47,16 @@
 	The extension defines the uniform *terBlockParams* and the attribute *terHeight* that can be used
 	in a shader to render the terrain. To see how this is working in detail, have a look at the included
 	sample shader.
+
+	Large terrains can be split into a square grid of height map tiles that are paged in and out around
+	the camera. The tiles are Texture resources named after a base name with the tile coordinates
+	appended, e.g. the tile (2, 3) of "terrain/height.png" is "terrain/height_2_3.png". All tiles must
+	have the same power-of-two size. The extension adds the tile resources when they are needed, and the
+	application is expected to load them like any other resource (e.g. by calling h3dutLoadResourcesFromDisk
+	each frame or using its own background loader). Tiles farther from the camera are paged out when the
+	memory budget is exceeded. After a tile is decoded, its texture is no longer referenced and is removed
+	with the next call to h3dReleaseUnusedResources. Tiles that are not resident are not rendered and
+	are ignored by ray queries.
 */
 
 
@@ -67,6 +77,10 @@ struct H3DEXTTerrain
 		MeshQualityF   - Constant controlling the overall resolution of the terrain mesh (default: 50.0)
 		SkirtHeightF   - Height of the skirts used to hide cracks (default: 0.1)
 		BlockSizeI     - Size of a terrain block that is drawn in a single render call; must be 2^n+1 (default: 17)
+		TileNameStr    - Base name of the height map tiles of a tiled terrain; an empty string switches back to a flat
+		                 terrain
+		TileCountI     - Number of tiles per side of a tiled terrain; can only be set after TileNameStr (default: 1)
+		TileMemBudgetI - Memory budget in Mb for the decoded height data of resident tiles (default: 64)
 	*/
 	enum List
 	{
@@ -74,7 +88,10 @@ struct H3DEXTTerrain
 		MatResI,
 		MeshQualityF,
 		SkirtHeightF,
-		BlockSizeI
+		BlockSizeI,
+		TileNameStr,
+		TileCountI,
+		TileMemBudgetI
 	};
 };
 
@@ -97,6 +114,51 @@ struct H3DEXTTerrain
 DLL H3DNode h3dextAddTerrainNode( H3DNode parent, const char *name, H3DRes heightMapRes, H3DRes materialRes );
 
 
+/* Function: h3dextAddTiledTerrainNode
+		Adds a Terrain node with a tiled height map to the scene.
+	
+	Details:
+		This function creates a new Terrain node whose height map is split into tileCount x tileCount tiles which
+		are paged in and out around the camera (see the introduction for the naming of the tiles).
+	
+	Parameters:
+		parent       - handle to parent node to which the new node will be attached
+		name         - name of the node
+		tileName     - base name of the height map tile Texture resources
+		tileCount    - number of tiles per side
+		materialRes  - handle to the Material resource used for rendering the terrain
+
+	Returns:
+		 handle to the created node or 0 in case of failure
+*/
+DLL H3DNode h3dextAddTiledTerrainNode( H3DNode parent, const char *name, const char *tileName, int tileCount,
+                                       H3DRes materialRes );
+
+
+/* Function: h3dextUpdateTerrainHeights
+		Updates a rectangular region of the height data of a Terrain node.
+	
+	Details:
+		This function overwrites the height samples of the specified region and recalculates the level of detail
+		information of the affected terrain blocks, which is much cheaper than recreating the node with a modified
+		height map. The region is given in samples of the complete height map and clipped to its size. For tiled
+		terrains, samples of tiles that are not resident are ignored and the changes of a tile are lost when it
+		is paged out. The height map Texture resource is not modified.
+	
+	Parameters:
+		node     - handle to terrain node that will be modified
+		x, y     - position of the upper left corner of the region in samples
+		width    - width of the region in samples
+		height   - height of the region in samples
+		heights  - width * height 16 bit height values, row by row
+		
+	Returns:
+		 true in case of success, otherwise false
+*/
+DLL bool h3dextUpdateTerrainHeights( H3DNode node, int x, int y, int width, int height,
+                                     const unsigned short *heights );
+
+
 /* Function: h3dextCreateTerrainGeoRes
 		Creates a Geometry resource from a specified Terrain node.
 			
@@ -105,6 +167,7 @@ DLL H3DNode h3dextAddTerrainNode( H3DNode parent, const char *name, H3DRes heigh
 		To reduce the amount of data, it is possible to specify a quality value which controls the overall resolution
 		of the terrain mesh. The algorithm will automatically create a higher resoultion in regions where the
 		geometrical complexity is higher and optimize the vertex count for flat regions.
+		For tiled terrains, only the tiles that are currently resident are included.
 	
 	Parameters:
 		node         - handle to terrain node that will be accessed
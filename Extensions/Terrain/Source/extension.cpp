@@ -89,6 +89,37 @@ DLLEXP NodeHandle h3dextAddTerrainNode( NodeHandle parent, const char *name, Res
 }
 
 
+DLLEXP NodeHandle h3dextAddTiledTerrainNode( NodeHandle parent, const char *name, const char *tileName,
+                                             int tileCount, ResHandle materialRes )
+{
+	SceneNode *parentNode = Modules::sceneMan().resolveNodeHandle( parent );
+	if( parentNode == 0x0 ) return 0;
+
+	if( safeStr( tileName ) == "" || tileCount <= 0 ) return 0;
+	
+	Resource *matRes =  Modules::resMan().resolveResHandle( materialRes );
+	if( matRes == 0x0 || matRes->getType() != ResourceTypes::Material ) return 0;
+	
+	Modules::log().writeInfo( "Adding tiled Terrain node '%s'", safeStr( name ).c_str() );
+	
+	TerrainNodeTpl tpl( safeStr( name ), 0x0, (MaterialResource *)matRes );
+	tpl.tileName = tileName;
+	tpl.tileCount = tileCount;
+	SceneNode *sn = Modules::sceneMan().findType( SNT_TerrainNode )->factoryFunc( tpl );
+	return Modules::sceneMan().addNode( sn, *parentNode );
+}
+
+
+DLLEXP bool h3dextUpdateTerrainHeights( NodeHandle node, int x, int y, int width, int height,
+                                       const unsigned short *heights )
+{
+	SceneNode *sn = Modules::sceneMan().resolveNodeHandle( node );
+	if( sn == 0x0 || sn->getType() != SNT_TerrainNode ) return false;
+	
+	return ((TerrainNode *)sn)->updateHeights( x, y, width, height, heights );
+}
+
+
 DLLEXP ResHandle h3dextCreateTerrainGeoRes( NodeHandle node, const char *name, float meshQuality )
 {	
 	SceneNode *sn = Modules::sceneMan().resolveNodeHandle( node );
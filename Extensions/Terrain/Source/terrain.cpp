@@ -15,6 +15,10 @@
 #include "egRenderer.h"
 #include "egMaterial.h"
 #include "egCamera.h"
+#include "utThreads.h"
+#include <sstream>
+#include <algorithm>
+#include <cstring>
 
 #include "utDebug.h"
 
@@ -50,19 +54,25 @@ ShaderCombination TerrainNode::debugViewShader;
 TerrainNode::TerrainNode( const TerrainNodeTpl &terrainTpl ) :
 	SceneNode( terrainTpl ), _materialRes( terrainTpl.matRes ), _blockSize( terrainTpl.blockSize ),
 	_skirtHeight( terrainTpl.skirtHeight ), _lodThreshold( 1.0f / terrainTpl.meshQuality ),
-	_hmapSize( 0 ), _heightData( 0x0 ), _maxLevel( 0 ), _heightArray( 0x0 ), _vertexBuffer( 0 ),
-	_indexBuffer( 0 )
+	_hmapSize( 0 ), _maxLevel( 0 ), _heightArray( 0x0 ), _vertexBuffer( 0 ), _indexBuffer( 0 ),
+	_tileCount( 0 ), _tileSize( 0 ), _tileShift( 0 ), _tileMemBudget( terrainTpl.tileMemBudget ),
+	_streamDirty( true )
 {
 	_renderable = true;
-	if( terrainTpl.hmapRes != 0x0 ) updateHeightData( *terrainTpl.hmapRes );
+	if( !terrainTpl.tileName.empty() && terrainTpl.tileCount > 0 )
+		setupTiles( terrainTpl.tileName, terrainTpl.tileCount );
+	else if( terrainTpl.hmapRes != 0x0 )
+		updateHeightData( *terrainTpl.hmapRes );
+	else
+		initDefaultHeightData();
 	
 	// Ensure correct block size
-	if( _hmapSize % (_blockSize - 1) != 0 )
+	if( _tileSize % (_blockSize - 1) != 0 )
 		_blockSize = 17;
 
 	recreateVertexBuffer();
 	calcMaxLevel();
-	createBlockTree();
+	createBlockTrees();
 
 	_localBBox.min = Vec3f( 0, 0, 0 );
 	_localBBox.max = Vec3f( 1, 1, 1 );
@@ -71,7 +81,7 @@ TerrainNode::TerrainNode( const TerrainNodeTpl &terrainTpl ) :
 
 TerrainNode::~TerrainNode()
 {
-	delete[] _heightData;
+	releaseTiles();
 	delete[] _heightArray;
 }
 
@@ -89,6 +99,21 @@ SceneNodeTpl *TerrainNode::parsingFunc( map< string, string > &attribs )
 		if( res != 0 )
 			terrainTpl->hmapRes = (TextureResource *)Modules::resMan().resolveResHandle( res );
 	}
+	itr = attribs.find( "heightmapTiles" );
+	if( itr != attribs.end() )
+	{
+		terrainTpl->tileName = itr->second;
+	}
+	itr = attribs.find( "tileCount" );
+	if( itr != attribs.end() )
+	{
+		terrainTpl->tileCount = atoi( itr->second.c_str() );
+	}
+	itr = attribs.find( "tileMemBudget" );
+	if( itr != attribs.end() )
+	{
+		terrainTpl->tileMemBudget = atoi( itr->second.c_str() );
+	}
 	itr = attribs.find( "material" );
 	if( itr != attribs.end() )
 	{
@@ -131,7 +156,7 @@ void TerrainNode::onPostUpdate()
 }
 
 
-void TerrainNode::drawTerrainBlock( TerrainNode *terrain, float minU, float minV, float maxU, float maxV,
+void TerrainNode::drawTerrainBlock( TerrainNode *terrain, TerrainTile &tile, float minU, float minV, float maxU, float maxV,
                                     int level, float scale, const Vec3f &localCamPos, const Frustum *frust1,
                                     const Frustum *frust2, int uni_terBlockParams )
 {
@@ -142,10 +167,15 @@ void TerrainNode::drawTerrainBlock( TerrainNode *terrain, float minU, float minV
 	for( int i = 0; i < level; ++i ) offset += (1 << i) * (1 << i);
 	
 	const uint32 blockIndex = offset + ftoi_t( minV * (1 << level) ) * (1 << level) + ftoi_t( minU * (1 << level) );
-	BlockInfo &block = terrain->_blockTree[blockIndex];
+	BlockInfo &block = tile.blockTree[blockIndex];
+
+	// Block coordinates are local to the tile, convert them to terrain space
+	const float invTiles = 1.0f / terrain->_tileCount;
+	const float terMinU = (tile.x + minU) * invTiles, terMinV = (tile.y + minV) * invTiles;
+	const float terMaxU = (tile.x + maxU) * invTiles, terMaxV = (tile.y + maxV) * invTiles;
 
 	// Create AABB for block
-	Vec3f bBMin( minU, block.minHeight - terrain->_skirtHeight, minV), bBMax( maxU, block.maxHeight, maxV );
+	Vec3f bBMin( terMinU, block.minHeight - terrain->_skirtHeight, terMinV ), bBMax( terMaxU, block.maxHeight, terMaxV );
 	
 	// Frustum culling
 	BoundingBox bb;
@@ -163,7 +193,7 @@ void TerrainNode::drawTerrainBlock( TerrainNode *terrain, float minU, float minV
 		// Render terrain block
 		if( uni_terBlockParams >= 0 )
 		{
-			float values[4] = { minU, minV, scale, scale };
+			float values[4] = { terMinU, terMinV, scale * invTiles, scale * invTiles };
 			gRDI->setShaderConst( uni_terBlockParams, CONST_FLOAT4, values );  // Bias and scale
 		}
 	
@@ -181,11 +211,11 @@ void TerrainNode::drawTerrainBlock( TerrainNode *terrain, float minU, float minV
 				if( u == 0 ) s = 0.0f; else if( u == size - 1 ) s = 1.0f;	// Skirt
 				
 				float *vertHeight = &terrain->_heightArray[v * size + u];
-				const float newU = (s * scale + minU) * (terrain->_hmapSize) + 0.5f;
-				const float newV = (t * scale + minV) * (terrain->_hmapSize) + 0.5f;
-				uint32 index = ftoi_t( newV ) * (terrain->_hmapSize + 1) + ftoi_t( newU );
+				const float newU = (s * scale + minU + tile.x) * terrain->_tileSize + 0.5f;
+				const float newV = (t * scale + minV + tile.y) * terrain->_tileSize + 0.5f;
 				
-				*vertHeight = terrain->_heightData[index] / 65535.0f;
+				// Samples on the far border of the tile are taken from the neighbor tile
+				*vertHeight = terrain->getSampleHeight( ftoi_t( newU ), ftoi_t( newV ) );
 				
 				// Create skirt
 				if( v == 0 || v == size - 1 || u == 0 || u == size - 1 )
@@ -218,12 +248,13 @@ void TerrainNode::drawTerrainBlock( TerrainNode *terrain, float minU, float minV
 		};
 		
 		// Sort blocks by distance from camera
-		if( localCamPos.x > halfU )
+		const float terHalfU = (tile.x + halfU) * invTiles, terHalfV = (tile.y + halfV) * invTiles;
+		if( localCamPos.x > terHalfU )
 		{
 			std::swap( blocks[0], blocks[1] );
 			std::swap( blocks[2], blocks[3] );
 		}
-		if( localCamPos.z > halfV )
+		if( localCamPos.z > terHalfV )
 		{
 			std::swap( blocks[0], blocks[2] );
 			std::swap( blocks[1], blocks[3] );
@@ -231,14 +262,14 @@ void TerrainNode::drawTerrainBlock( TerrainNode *terrain, float minU, float minV
 
 		for( uint32 i = 0; i < 4; ++i )
 		{
-			drawTerrainBlock( terrain, blocks[i].x, blocks[i].y, blocks[i].z, blocks[i].w,
+			drawTerrainBlock( terrain, tile, blocks[i].x, blocks[i].y, blocks[i].z, blocks[i].w,
 			                  level + 1, scale, localCamPos, frust1, frust2, uni_terBlockParams );
 		}
 	}
 }
 
 
-void TerrainNode::renderFunc( uint32 firstItem, uint32 lastItem, const string &shaderContext, const string &theClass,
+void TerrainNode::renderFunc( uint32 firstItem, uint32 lastItem, uint32 shaderContext, int theClass,
                               bool debugView, const Frustum *frust1, const Frustum *frust2, RenderingOrder::List order,
                               int occSet )
 {
@@ -270,6 +301,9 @@ void TerrainNode::renderFunc( uint32 firstItem, uint32 lastItem, const string &s
 
 		Vec3f localCamPos( curCam->getAbsTrans().x[12], curCam->getAbsTrans().x[13], curCam->getAbsTrans().x[14] );
 		localCamPos = terrain->_absTrans.inverted() * localCamPos;
+
+		// Page tiles in and out around the camera
+		terrain->updateTiles( localCamPos );
 		
 		// Bind geometry and apply vertex layout
 		gRDI->setIndexBuffer( terrain->_indexBuffer, IDXFMT_16 );
@@ -297,7 +331,14 @@ void TerrainNode::renderFunc( uint32 firstItem, uint32 lastItem, const string &s
 			gRDI->setShaderConst( curShader->uni_nodeId, CONST_FLOAT, &id );
 		}
 
-		drawTerrainBlock( terrain, 0.0f, 0.0f, 1.0f, 1.0f, 0, 1.0f, localCamPos, frust1, frust2, uni_terBlockParams );
+		for( size_t j = 0, s = terrain->_tiles.size(); j < s; ++j )
+		{
+			TerrainTile &tile = terrain->_tiles[j];
+			if( tile.heightData == 0x0 || tile.blockTree.empty() ) continue;
+			
+			drawTerrainBlock( terrain, tile, 0.0f, 0.0f, 1.0f, 1.0f, 0, 1.0f, localCamPos,
+			                  frust1, frust2, uni_terBlockParams );
+		}
 
 		gRDI->setVertexLayout( 0 );
 	}
@@ -310,63 +351,246 @@ bool TerrainNode::canAttach( SceneNode &parent )
 }
 
 
+const uint16 *TerrainNode::findSample( int x, int y ) const
+{
+	if( _hmapSize == 0 ) return 0x0;
+	
+	// Clamp to border (repeats last row and column)
+	if( x < 0 ) x = 0; else if( x >= (int)_hmapSize ) x = (int)_hmapSize - 1;
+	if( y < 0 ) y = 0; else if( y >= (int)_hmapSize ) y = (int)_hmapSize - 1;
+
+	const TerrainTile &tile = _tiles[(y >> _tileShift) * _tileCount + (x >> _tileShift)];
+	if( tile.heightData == 0x0 ) return 0x0;
+
+	return &tile.heightData[(y & (_tileSize - 1)) * _tileSize + (x & (_tileSize - 1))];
+}
+
+
+bool TerrainNode::decodeTile( TerrainTile &tile, TextureResource &hmap )
+{
+	const uint32 size = hmap.getWidth();
+	
+	if( hmap.getTexFormat() != TextureFormats::BGRA8 || hmap.getHeight() != size ||
+	    size < 32 || size > 8192 || (size & (size - 1)) != 0 )
+		return false;
+
+	// All tiles must have the same size
+	if( _tileSize != 0 && size != _tileSize ) return false;
+
+	unsigned char *pixels = (unsigned char *)hmap.mapStream(
+		TextureResData::ImageElem, 0, TextureResData::ImgPixelStream, true, false );
+	if( pixels == 0x0 ) return false;
+
+	delete[] tile.heightData;
+	tile.heightData = new uint16[size * size];
+	
+	for( uint32 i = 0; i < size * size; ++i )
+	{
+		// Decode 16 bit data from red and green channels
+		tile.heightData[i] = pixels[i * 4 + 2] * 256 + pixels[i * 4 + 1];
+	}
+	
+	hmap.unmapStream();
+	tile.state = TerrainTileStates::Resident;
+
+	if( _tileSize == 0 )
+	{
+		_tileSize = size;
+		for( _tileShift = 0; (1u << _tileShift) < size; ++_tileShift ) {}
+		_hmapSize = _tileSize * _tileCount;
+	}
+	
+	return true;
+}
+
+
 bool TerrainNode::updateHeightData( TextureResource &hmap )
 {
-	delete[] _heightData; _heightData = 0x0;
+	releaseTiles();
+	_tileName = "";
+	_tileCount = 1;
+	_tileSize = 0;
+	_hmapSize = 0;
+	_tiles.resize( 1 );
+	
+	if( decodeTile( _tiles[0], hmap ) ) return true;
 
-	if( hmap.getTexFormat() == TextureFormats::BGRA8 &&
-	    hmap.getWidth() == hmap.getHeight() &&
-	    (hmap.getWidth() == 32 || hmap.getWidth() == 64 || hmap.getWidth() == 128 ||
-	    hmap.getWidth() == 256 || hmap.getWidth() == 512 || hmap.getWidth() == 1024 ||
-	    hmap.getWidth() == 2048 || hmap.getWidth() == 4096 || hmap.getWidth() == 8192) )
+	initDefaultHeightData();
+	return false;
+}
+
+
+void TerrainNode::initDefaultHeightData()
+{
+	releaseTiles();
+	_tileName = "";
+	_tileCount = 1;
+	_tileSize = 32;
+	_tileShift = 5;
+	_hmapSize = 32;
+	_tiles.resize( 1 );
+
+	TerrainTile &tile = _tiles[0];
+	tile.heightData = new uint16[_tileSize * _tileSize];
+	memset( tile.heightData, 0, _tileSize * _tileSize * sizeof( uint16 ) );
+	tile.state = TerrainTileStates::Resident;
+}
+
+
+void TerrainNode::releaseTiles()
+{
+	for( size_t i = 0, s = _tiles.size(); i < s; ++i )
 	{
-		_hmapSize = hmap.getWidth();
-		_heightData = new uint16[(_hmapSize+1) * (_hmapSize+1)];
-		
-		unsigned char *pixels = (unsigned char *)hmap.mapStream(
-			TextureResData::ImageElem, 0, TextureResData::ImgPixelStream, true, false );
-		ASSERT( pixels != 0x0 );
-		
-		for( uint32 i = 0; i < _hmapSize; ++i )
+		delete[] _tiles[i].heightData;
+	}
+	_tiles.clear();
+}
+
+
+void TerrainNode::setupTiles( const string &tileName, uint32 tileCount )
+{
+	releaseTiles();
+	_tileName = tileName;
+	_tileCount = tileCount;
+	_tileSize = 0;
+	_tileShift = 0;
+	_hmapSize = 0;
+	_streamDirty = true;
+
+	// Tile size is not known before the first tile is loaded
+	_tiles.resize( tileCount * tileCount );
+	for( uint32 y = 0; y < tileCount; ++y )
+	{
+		for( uint32 x = 0; x < tileCount; ++x )
+		{
+			_tiles[y * tileCount + x].x = x;
+			_tiles[y * tileCount + x].y = y;
+		}
+	}
+}
+
+
+uint32 TerrainNode::getTileMem()
+{
+	uint32 numBlocks = 0;
+	for( uint32 i = 0; i <= _maxLevel; ++i ) numBlocks += (1 << i) * (1 << i);
+	
+	uint32 numCells = 0;
+	for( uint32 i = 0, s = getNumCachedErrorLevels(); i < s; ++i )
+		numCells += ((1 << i) * (_blockSize - 1)) * ((1 << i) * (_blockSize - 1));
+
+	return _tileSize * _tileSize * sizeof( uint16 ) + numBlocks * sizeof( BlockInfo ) + numCells * sizeof( float );
+}
+
+
+void TerrainNode::updateTiles( const Vec3f &localCamPos )
+{
+	if( _tileName.empty() ) return;
+	
+	// Process tiles that were loaded by the application in the meantime
+	for( size_t i = 0, s = _tiles.size(); i < s; ++i )
+	{
+		TerrainTile &tile = _tiles[i];
+		if( tile.state != TerrainTileStates::Requested || !tile.hmapRes->isLoaded() ) continue;
+
+		const bool firstTile = _tileSize == 0;
+		if( decodeTile( tile, *tile.hmapRes ) )
 		{
-			for( uint32 j = 0; j < _hmapSize; ++j )
+			// First tile determines tile size and thus number of quad tree levels
+			if( firstTile )
 			{
-				// Decode 16 bit data from red and green channels
-				_heightData[i*(_hmapSize+1)+j] =
-					pixels[(i*_hmapSize+j)*4+2] * 256 + pixels[(i*_hmapSize+j)*4+1];
+				if( _tileSize % (_blockSize - 1) != 0 || _blockSize > _tileSize )
+				{
+					_blockSize = 17;
+					recreateVertexBuffer();
+				}
+				calcMaxLevel();
+				_streamDirty = true;
 			}
+			createBlockTree( tile );
 		}
-		
-		// Fill in last rows (just repeat last texture pixels)
-		for( uint32 i = 0; i < _hmapSize; ++i )
+		else
 		{
-			// Decode 16 bit data from red and green channels
-			_heightData[i*(_hmapSize+1)+_hmapSize] =
-				pixels[(i*_hmapSize+_hmapSize-1)*4+2] * 256 + pixels[(i*_hmapSize+_hmapSize-1)*4+1];
+			Modules::log().writeWarning( "Terrain node '%s': Invalid height map tile '%s'",
+				_name.c_str(), tile.hmapRes->getName().c_str() );
+			tile.state = TerrainTileStates::Failed;
 		}
 
-		for( uint32 i = 0; i < _hmapSize + 1; ++i )
-		{
-			_heightData[_hmapSize*(_hmapSize+1)+i] = _heightData[(_hmapSize-1)*(_hmapSize+1)+i];
-		}
+		// Texture is not required anymore, it is removed when unused resources are released
+		tile.hmapRes = 0x0;
+	}
 
-		hmap.unmapStream();
-		return true;
+	// Only update paging when camera has moved noticeably
+	const float tileExtent = 1.0f / _tileCount;
+	if( !_streamDirty && fabsf( localCamPos.x - _streamPos.x ) < tileExtent * 0.25f &&
+	    fabsf( localCamPos.z - _streamPos.z ) < tileExtent * 0.25f ) return;
+	
+	_streamPos = localCamPos;
+	_streamDirty = false;
+	
+	// Sort tiles by distance to camera
+	static vector< pair< float, uint32 > > tileOrder;
+	tileOrder.resize( _tiles.size() );
+	for( uint32 i = 0; i < (uint32)_tiles.size(); ++i )
+	{
+		const float dx = maxf( maxf( _tiles[i].x * tileExtent - localCamPos.x,
+		                             localCamPos.x - (_tiles[i].x + 1) * tileExtent ), 0 );
+		const float dz = maxf( maxf( _tiles[i].y * tileExtent - localCamPos.z,
+		                             localCamPos.z - (_tiles[i].y + 1) * tileExtent ), 0 );
+		tileOrder[i] = pair< float, uint32 >( dx * dx + dz * dz, i );
 	}
-	else
+	std::sort( tileOrder.begin(), tileOrder.end() );
+
+	// Page in nearest tiles as long as they fit into the memory budget and page out the rest;
+	// as long as tile size is unknown, only the nearest tile is requested
+	const uint32 tileMem = getTileMem();
+	const uint32 budget = _tileMemBudget * 1024 * 1024;
+	uint32 usedMem = 0;
+	
+	for( uint32 i = 0; i < (uint32)tileOrder.size(); ++i )
 	{
-		// Init default data
-		_hmapSize = 32;
-		_heightData = new uint16[ (_hmapSize + 1) * (_hmapSize + 1)];
-		memset( _heightData, 0, (_hmapSize + 1) * (_hmapSize + 1) );
-		return false;
+		TerrainTile &tile = _tiles[tileOrder[i].second];
+		if( tile.state == TerrainTileStates::Failed ) continue;
+
+		if( usedMem == 0 || (_tileSize != 0 && usedMem + tileMem <= budget) )
+		{
+			usedMem += tileMem > 0 ? tileMem : 1;
+			if( tile.state != TerrainTileStates::Unloaded ) continue;
+			
+			stringstream ss;
+			size_t extPos = _tileName.find_last_of( '.' );
+			if( extPos == string::npos || _tileName.find_first_of( "/\\", extPos ) != string::npos )
+				extPos = _tileName.length();
+			ss << _tileName.substr( 0, extPos ) << "_" << tile.x << "_" << tile.y << _tileName.substr( extPos );
+			
+			ResHandle res = Modules::resMan().addResource( ResourceTypes::Texture, ss.str(),
+				ResourceFlags::NoTexCompression | ResourceFlags::NoTexMipmaps, false );
+			Resource *resObj = Modules::resMan().resolveResHandle( res );
+			if( resObj != 0x0 && resObj->getType() == ResourceTypes::Texture )
+			{
+				tile.hmapRes = (TextureResource *)resObj;
+				tile.state = TerrainTileStates::Requested;
+			}
+			else
+			{
+				tile.state = TerrainTileStates::Failed;
+			}
+		}
+		else if( tile.state != TerrainTileStates::Unloaded )
+		{
+			delete[] tile.heightData; tile.heightData = 0x0;
+			tile.blockTree.clear();
+			tile.cellErrors.clear();
+			tile.hmapRes = 0x0;
+			tile.state = TerrainTileStates::Unloaded;
+		}
 	}
 }
 
 
 void TerrainNode::calcMaxLevel()
 {
-	const uint32 pow2 = _hmapSize / (_blockSize - 1);
+	const uint32 pow2 = _tileSize / (_blockSize - 1);
 	
 	_maxLevel = 0;
 	for( uint32 i = 1; i < pow2; i *= 2 ) ++_maxLevel;
@@ -461,73 +685,327 @@ void TerrainNode::recreateVertexBuffer()
 }
 
 
-void TerrainNode::buildBlockInfo( BlockInfo &block, float minU, float minV, float maxU, float maxV )
+void TerrainNode::calcBlockMinMax( TerrainTile &tile, uint32 x, uint32 y, uint32 size, BlockInfo &block )
 {
-	const float pixelStep = 1.0f / _hmapSize;
-	const float stepU = (maxU - minU) / (_blockSize - 1);
-	const float stepV = (maxV - minV) / (_blockSize - 1);
-	
-	for( uint32 v = 0; v < _blockSize - 1; ++v )
+	// Block covers the tile-local samples [x, x + size] x [y, y + size]
+	uint16 minHeight = 65535, maxHeight = 0;
+
+	// Inner samples are contiguous in tile memory; keep the loop simple so that it gets vectorized
+	for( uint32 v = y; v < y + size; ++v )
 	{
-		for( uint32 u = 0; u < _blockSize - 1; ++u )
+		const uint16 *row = &tile.heightData[v * _tileSize + x];
+		for( uint32 u = 0; u < size; ++u )
 		{
-			Vec3f corner0( minU + u * stepU, 0, minV + v * stepV);
-			Vec3f corner1( minU + u * stepU, 0, minV + (v + 1) * stepV);
-			Vec3f corner2( minU + (u + 1) * stepU, 0, minV + v * stepV);
-			Vec3f corner3( minU + (u + 1) * stepU, 0, minV + (v + 1) * stepV);
+			minHeight = row[u] < minHeight ? row[u] : minHeight;
+			maxHeight = row[u] > maxHeight ? row[u] : maxHeight;
+		}
+	}
 
-			corner0.y = getHeight( corner0.x, corner0.z );
-			corner1.y = getHeight( corner1.x, corner1.z );
-			corner2.y = getHeight( corner2.x, corner2.z );
-			corner3.y = getHeight( corner3.x, corner3.z );
+	// Last row and column can belong to neighbor tiles
+	const int tileX = tile.x * _tileSize + x, tileY = tile.y * _tileSize + y;
+	for( uint32 i = 0; i <= size; ++i )
+	{
+		const uint16 *sample0 = findSample( tileX + size, tileY + i );
+		const uint16 *sample1 = findSample( tileX + i, tileY + size );
+		if( sample0 != 0x0 )
+		{
+			minHeight = std::min( *sample0, minHeight );
+			maxHeight = std::max( *sample0, maxHeight );
+		}
+		if( sample1 != 0x0 )
+		{
+			minHeight = std::min( *sample1, minHeight );
+			maxHeight = std::max( *sample1, maxHeight );
+		}
+	}
+
+	block.minHeight = minHeight / 65535.0f;
+	block.maxHeight = maxHeight / 65535.0f;
+}
+
+
+float TerrainNode::calcCellError( const TerrainTile &tile, int x, int y, uint32 cellSize, bool mainDiagonal,
+                                  bool lastCol, bool lastRow ) const
+{
+	// Maximum distance of the height samples of a cell of a block mesh from the planes of the two
+	// mesh triangles covering them; the far column and row are shared with the next cells and are
+	// only included at the block border. Distances are measured in terrain space, so that the
+	// error is independent of the tile size like the camera distance it is compared with.
+	const int tileX = tile.x * _tileSize + x, tileY = tile.y * _tileSize + y;
+	const float invCell = 1.0f / cellSize, invMax = 1.0f / 65535.0f;
+	const float h00 = getSampleHeight( tileX, tileY ), h10 = getSampleHeight( tileX + cellSize, tileY );
+	const float h01 = getSampleHeight( tileX, tileY + cellSize );
+	const float h11 = getSampleHeight( tileX + cellSize, tileY + cellSize );
+
+	// Triangles as height h0 + gx * u + gy * v over the sample offsets u, v within the cell; the
+	// rows of the index strip alternate between the two diagonals (see createIndices)
+	float h0[2], gx[2], gy[2], w[2];
+	if( mainDiagonal )
+	{
+		// First triangle for u >= v
+		h0[0] = h00; gx[0] = (h10 - h00) * invCell; gy[0] = (h11 - h10) * invCell;
+		h0[1] = h00; gx[1] = (h11 - h01) * invCell; gy[1] = (h01 - h00) * invCell;
+	}
+	else
+	{
+		// First triangle for u + v <= cellSize
+		h0[0] = h00; gx[0] = (h10 - h00) * invCell; gy[0] = (h01 - h00) * invCell;
+		h0[1] = h01 + h10 - h11; gx[1] = (h11 - h01) * invCell; gy[1] = (h11 - h10) * invCell;
+	}
+	for( uint32 i = 0; i < 2; ++i )
+	{
+		// Vertical distance times the y component of the plane normal gives the plane distance
+		const float slopeX = gx[i] * _hmapSize, slopeY = gy[i] * _hmapSize;
+		w[i] = 1.0f / sqrtf( 1.0f + slopeX * slopeX + slopeY * slopeY );
+	}
+
+	const uint32 numCols = lastCol ? cellSize + 1 : cellSize;
+	const uint32 numRows = lastRow ? cellSize + 1 : cellSize;
+	float error = 0;
+
+	for( uint32 v = 0; v < numRows; ++v )
+	{
+		const float rowH0 = h0[0] + gy[0] * v, rowH1 = h0[1] + gy[1] * v;
+		
+		// The far column and the rows of neighbor tiles are not part of the contiguous tile row
+		uint32 u = 0;
+		if( y + v < _tileSize )
+		{
+			const uint16 *row = &tile.heightData[(y + v) * _tileSize + x];
+#if defined( H3D_SIMD_SSE2 )
+			const __m128 absMask = _mm_castsi128_ps( _mm_set1_epi32( 0x7FFFFFFF ) );
+			const __m128 splitU = _mm_set1_ps( mainDiagonal ? (float)v : (float)(cellSize - v) );
+			const __m128 rowH0v = _mm_set1_ps( rowH0 ), rowH1v = _mm_set1_ps( rowH1 );
+			const __m128 gx0 = _mm_set1_ps( gx[0] ), gx1 = _mm_set1_ps( gx[1] );
+			const __m128 w0 = _mm_set1_ps( w[0] ), w1 = _mm_set1_ps( w[1] );
+			const __m128 scale = _mm_set1_ps( invMax ), four = _mm_set1_ps( 4.0f );
+			const __m128i zero = _mm_setzero_si128();
+			__m128 uv = _mm_set_ps( 3.0f, 2.0f, 1.0f, 0.0f );
+			__m128 maxErr = _mm_setzero_ps();
+			
+			for( ; u + 4 <= cellSize; u += 4 )
+			{
+				__m128i samples = _mm_unpacklo_epi16( _mm_loadl_epi64( (const __m128i *)&row[u] ), zero );
+				__m128 h = _mm_mul_ps( _mm_cvtepi32_ps( samples ), scale );
+				__m128 d0 = _mm_mul_ps( _mm_and_ps( _mm_sub_ps( h, _mm_add_ps( rowH0v, _mm_mul_ps( gx0, uv ) ) ),
+				                                    absMask ), w0 );
+				__m128 d1 = _mm_mul_ps( _mm_and_ps( _mm_sub_ps( h, _mm_add_ps( rowH1v, _mm_mul_ps( gx1, uv ) ) ),
+				                                    absMask ), w1 );
+				__m128 first = mainDiagonal ? _mm_cmpge_ps( uv, splitU ) : _mm_cmple_ps( uv, splitU );
+				maxErr = _mm_max_ps( maxErr, _mm_or_ps( _mm_and_ps( first, d0 ), _mm_andnot_ps( first, d1 ) ) );
+				uv = _mm_add_ps( uv, four );
+			}
 			
-			Plane tri0( corner0, corner1, corner2 );
-			Plane tri1( corner1, corner2, corner3 );
+			float errors[4];
+			_mm_storeu_ps( errors, maxErr );
+			error = maxf( error, maxf( maxf( errors[0], errors[1] ), maxf( errors[2], errors[3] ) ) );
+#endif
+			for( ; u < cellSize; ++u )
+			{
+				const float h = row[u] * invMax;
+				const bool first = mainDiagonal ? u >= v : u + v <= cellSize;
+				const float d = first ? fabsf( h - (rowH0 + gx[0] * u) ) * w[0] : fabsf( h - (rowH1 + gx[1] * u) ) * w[1];
+				error = maxf( error, d );
+			}
+		}
+		
+		for( ; u < numCols; ++u )
+		{
+			const float h = getSampleHeight( tileX + u, tileY + v );
+			const bool first = mainDiagonal ? u >= v : u + v <= cellSize;
+			const float d = first ? fabsf( h - (rowH0 + gx[0] * u) ) * w[0] : fabsf( h - (rowH1 + gx[1] * u) ) * w[1];
+			error = maxf( error, d );
+		}
+	}
+
+	return error;
+}
 
-			for( float vv = 0; vv <= stepV; vv += pixelStep )
+
+uint32 TerrainNode::getNumCachedErrorLevels()
+{
+	// The errors of the cells of coarse levels are kept, so that updates only need to recalculate
+	// the cells in the modified region instead of the large blocks containing it; finer levels
+	// have many cells but small blocks which are cheap to recalculate completely
+	uint32 level = 0;
+	while( level < _maxLevel && (_tileSize >> level) / (_blockSize - 1) >= MinCachedCellSize ) ++level;
+	
+	return level;
+}
+
+
+float TerrainNode::calcBlockError( TerrainTile &tile, uint32 level, int x, int y )
+{
+	// The error of a block is the maximum error of the cells of its mesh
+	const int numCells = (int)_blockSize - 1;
+	const uint32 cellSize = (_tileSize >> level) / numCells;
+	float error = 0;
+
+	if( level < getNumCachedErrorLevels() )
+	{
+		const int cellsPerRow = (1 << level) * numCells;
+		uint32 offset = 0;
+		for( uint32 i = 0; i < level; ++i ) offset += ((1 << i) * numCells) * ((1 << i) * numCells);
+		
+		for( int v = 0; v < numCells; ++v )
+		{
+			const float *errors = &tile.cellErrors[offset + (y * numCells + v) * cellsPerRow + x * numCells];
+			for( int u = 0; u < numCells; ++u ) error = maxf( error, errors[u] );
+		}
+	}
+	else
+	{
+		for( int v = 0; v < numCells; ++v )
+		{
+			for( int u = 0; u < numCells; ++u )
 			{
-				for( float uu = 0; uu <= stepU; uu += pixelStep )
-				{
-					Plane &curTri = uu <= vv ? tri0 : tri1;
-					
-					Vec3f point( minU + u * stepU + uu, 0, minV + v * stepV + vv );
-					point.y = getHeight( point.x, point.z );
-					
-					block.minHeight = minf( point.y, block.minHeight );
-					block.maxHeight = maxf( point.y, block.maxHeight );
-					block.geoError = maxf( block.geoError, fabsf( curTri.distToPoint( point ) ));
-				}
-			}			
+				error = maxf( error, calcCellError( tile, (x * numCells + u) * cellSize, (y * numCells + v) * cellSize,
+				                                    cellSize, v % 2 == 0, u == numCells - 1, v == numCells - 1 ) );
+			}
 		}
 	}
+
+	return error;
 }
 
 
-void TerrainNode::createBlockTree()
+struct TerrainUpdateJob
 {
-	// The block tree contains the renderable blocks for each quad tree level, starting at the
-	// lowest resolution level 0 (just one block for the complete terrain)
+	TerrainNode  *terrain;
+	TerrainTile  *tile;
+	uint32       level;
+	int          x0, y0, x1, y1;  // Range of blocks or cells
+};
 
-	uint32 size = 0, index = 0;
-	for( uint32 i = 0; i <= _maxLevel; ++i ) size += (1 << i) * (1 << i);
-	_blockTree.resize( size );
+void TerrainNode::updateCellRowJob( void *userData, uint32 jobIndex )
+{
+	TerrainUpdateJob &job = *(TerrainUpdateJob *)userData;
+	TerrainNode &terrain = *job.terrain;
+	const int numCells = (int)terrain._blockSize - 1;
+	const int cellsPerRow = (1 << job.level) * numCells;
+	const uint32 cellSize = (terrain._tileSize >> job.level) / numCells;
+	const int v = job.y0 + (int)jobIndex;
+	
+	uint32 offset = 0;
+	for( uint32 i = 0; i < job.level; ++i ) offset += ((1 << i) * numCells) * ((1 << i) * numCells);
 
-	for( uint32 i = 0; i <= _maxLevel; ++i )
+	for( int u = job.x0; u <= job.x1; ++u )
 	{
-		uint32 numBlocks = 1 << i;
+		job.tile->cellErrors[offset + v * cellsPerRow + u] = terrain.calcCellError( *job.tile, u * cellSize,
+			v * cellSize, cellSize, v % numCells % 2 == 0, u % numCells == numCells - 1, v % numCells == numCells - 1 );
+	}
+}
 
-		for( uint32 y = 0; y < numBlocks; ++y )
+
+void TerrainNode::updateBlockRowJob( void *userData, uint32 jobIndex )
+{
+	TerrainUpdateJob &job = *(TerrainUpdateJob *)userData;
+	TerrainNode &terrain = *job.terrain;
+	TerrainTile &tile = *job.tile;
+	const int y = job.y0 + (int)jobIndex;
+	
+	uint32 offset = 0;
+	for( uint32 i = 0; i < job.level; ++i ) offset += (1 << i) * (1 << i);
+	
+	for( int x = job.x0; x <= job.x1; ++x )
+	{
+		BlockInfo &block = tile.blockTree[offset + y * (1 << job.level) + x];
+		
+		if( job.level == terrain._maxLevel )
 		{
-			for( uint32 x = 0; x < numBlocks; ++x )
+			// The finest level is calculated from the height data
+			const uint32 size = terrain._tileSize >> job.level;
+			terrain.calcBlockMinMax( tile, x * size, y * size, size, block );
+			block.geoError = 0;  // All samples are vertices
+		}
+		else
+		{
+			// Coarser levels are derived from their children
+			const uint32 childOffset = offset + (1 << job.level) * (1 << job.level);
+			const int numChildBlocks = 1 << (job.level + 1);
+			block = BlockInfo();
+			
+			for( int i = 0; i < 4; ++i )
 			{
-				buildBlockInfo( _blockTree[index++], (float)x / numBlocks, (float)y / numBlocks,
-				                (float)(x + 1) / numBlocks, (float)(y + 1) / numBlocks );
+				const BlockInfo &child = tile.blockTree[childOffset + (y * 2 + i / 2) * numChildBlocks + x * 2 + i % 2];
+				block.minHeight = minf( block.minHeight, child.minHeight );
+				block.maxHeight = maxf( block.maxHeight, child.maxHeight );
 			}
+			block.geoError = terrain.calcBlockError( tile, job.level, x, y );
 		}
 	}
 }
 
 
+void TerrainNode::updateBlockTree( TerrainTile &tile, int minX, int minY, int maxX, int maxY )
+{
+	// Recalculates all blocks that contain a sample of the tile-local region [minX, maxX] x [minY, maxY],
+	// starting at the finest level; the rows of blocks and cached cells are distributed over the workers
+	const int numCells = (int)_blockSize - 1;
+	const uint32 numCachedLevels = getNumCachedErrorLevels();
+	TerrainUpdateJob job;
+	job.terrain = this;
+	job.tile = &tile;
+	
+	for( int level = (int)_maxLevel; level >= 0; --level )
+	{
+		job.level = (uint32)level;
+		
+		// Cell i covers the samples [i * cellSize, (i + 1) * cellSize], as its corners are shared
+		if( job.level < numCachedLevels )
+		{
+			const int cellSize = (int)(_tileSize >> level) / numCells;
+			const int cellsPerRow = (1 << level) * numCells;
+			job.x0 = minX <= 0 ? 0 : std::max( (minX + cellSize - 1) / cellSize - 1, 0 );
+			job.y0 = minY <= 0 ? 0 : std::max( (minY + cellSize - 1) / cellSize - 1, 0 );
+			job.x1 = std::min( maxX / cellSize, cellsPerRow - 1 );
+			job.y1 = std::min( maxY / cellSize, cellsPerRow - 1 );
+			if( job.x0 > job.x1 || job.y0 > job.y1 ) return;
+
+			Modules::jobMan().run( updateCellRowJob, &job, (uint32)(job.y1 - job.y0 + 1) );
+		}
+		
+		// Block i covers the samples [i * blockSize, (i + 1) * blockSize]
+		const int blockSize = (int)_tileSize >> level;
+		const int numBlocks = 1 << level;
+		job.x0 = minX <= 0 ? 0 : std::max( (minX + blockSize - 1) / blockSize - 1, 0 );
+		job.y0 = minY <= 0 ? 0 : std::max( (minY + blockSize - 1) / blockSize - 1, 0 );
+		job.x1 = std::min( maxX / blockSize, numBlocks - 1 );
+		job.y1 = std::min( maxY / blockSize, numBlocks - 1 );
+		if( job.x0 > job.x1 || job.y0 > job.y1 ) return;
+
+		Modules::jobMan().run( updateBlockRowJob, &job, (uint32)(job.y1 - job.y0 + 1) );
+	}
+}
+
+
+void TerrainNode::createBlockTree( TerrainTile &tile )
+{
+	// The block tree contains the renderable blocks for each quad tree level, starting at the
+	// lowest resolution level 0 (just one block for the complete tile)
+	const uint32 numCells = _blockSize - 1;
+
+	uint32 size = 0;
+	for( uint32 i = 0; i <= _maxLevel; ++i ) size += (1 << i) * (1 << i);
+	tile.blockTree.assign( size, BlockInfo() );
+
+	size = 0;
+	for( uint32 i = 0, s = getNumCachedErrorLevels(); i < s; ++i ) size += ((1 << i) * numCells) * ((1 << i) * numCells);
+	tile.cellErrors.assign( size, 0.0f );
+
+	updateBlockTree( tile, 0, 0, _tileSize, _tileSize );
+}
+
+
+void TerrainNode::createBlockTrees()
+{
+	for( size_t i = 0, s = _tiles.size(); i < s; ++i )
+	{
+		if( _tiles[i].heightData != 0x0 ) createBlockTree( _tiles[i] );
+	}
+}
+
+
 int TerrainNode::getParamI( int param )
 {
 	switch( param )
@@ -536,6 +1014,10 @@ int TerrainNode::getParamI( int param )
 		return _materialRes != 0x0 ? _materialRes->getHandle() : 0;
 	case TerrainNodeParams::BlockSizeI:
 		return _blockSize;
+	case TerrainNodeParams::TileCountI:
+		return _tileName.empty() ? 0 : _tileCount;
+	case TerrainNodeParams::TileMemBudgetI:
+		return _tileMemBudget;
 	}
 
 	return SceneNode::getParamI( param );
@@ -555,7 +1037,7 @@ void TerrainNode::setParamI( int param, int value )
 			bool result = updateHeightData( *((TextureResource *)res) );
 			recreateVertexBuffer();
 			calcMaxLevel();
-			createBlockTree();
+			createBlockTrees();
 			if( result ) return;
 		}
 		Modules::setError( "Invalid texture in h3dSetNodeParamI for H3DLight::HeightTexResI" );
@@ -568,18 +1050,38 @@ void TerrainNode::setParamI( int param, int value )
 			Modules::setError( "Invalid handle in h3dSetNodeParamI for H3DEXTTerrain::MatResI" );
 		return;
 	case TerrainNodeParams::BlockSizeI:
-		if( _hmapSize % (value - 1) == 0 && (unsigned)value <= _hmapSize )
+		if( _tileSize % (value - 1) == 0 && (unsigned)value <= _tileSize )
 		{
 			if( _blockSize == value ) return;
 
 			_blockSize = value;
 			recreateVertexBuffer();
 			calcMaxLevel();
-			createBlockTree();
+			createBlockTrees();
 		}
 		else
 			Modules::setError( "Invalid value in h3dSetNodeParamI for H3DEXTTerrain::BlockSizeI (must be 2^x + 1)" );	
 		return;
+	case TerrainNodeParams::TileCountI:
+		if( !_tileName.empty() && value > 0 )
+		{
+			if( (unsigned)value == _tileCount ) return;
+			
+			setupTiles( _tileName, value );
+			calcMaxLevel();
+		}
+		else
+			Modules::setError( "Invalid value in h3dSetNodeParamI for H3DEXTTerrain::TileCountI" );
+		return;
+	case TerrainNodeParams::TileMemBudgetI:
+		if( value > 0 )
+		{
+			_tileMemBudget = value;
+			_streamDirty = true;
+		}
+		else
+			Modules::setError( "Invalid value in h3dSetNodeParamI for H3DEXTTerrain::TileMemBudgetI" );
+		return;
 	}
 
 	SceneNode::setParamI( param, value );
@@ -616,8 +1118,45 @@ void TerrainNode::setParamF( int param, int compIdx, float value )
 }
 
 
+const char *TerrainNode::getParamStr( int param )
+{
+	switch( param )
+	{
+	case TerrainNodeParams::TileNameStr:
+		return _tileName.c_str();
+	}
+
+	return SceneNode::getParamStr( param );
+}
+
+
+void TerrainNode::setParamStr( int param, const char *value )
+{
+	switch( param )
+	{
+	case TerrainNodeParams::TileNameStr:
+		if( value != 0x0 && value[0] != '\0' )
+			setupTiles( value, _tileName.empty() ? 1 : _tileCount );
+		else
+			initDefaultHeightData();
+		
+		if( _tileSize % (_blockSize - 1) != 0 || _blockSize > _tileSize )
+		{
+			_blockSize = 17;
+			recreateVertexBuffer();
+		}
+		calcMaxLevel();
+		createBlockTrees();
+		return;
+	}
+
+	SceneNode::setParamStr( param, value );
+}
+
+
 bool TerrainNode::checkIntersection( const Vec3f &rayOrig, const Vec3f &rayDir, Vec3f &intsPos ) const
 {
+	if( _hmapSize == 0 ) return false;
 	if( !rayAABBIntersection( rayOrig, rayDir, _bBox.min, _bBox.max ) ) return false;
 	
 	// Transform ray to local space
@@ -690,7 +1229,10 @@ bool TerrainNode::checkIntersection( const Vec3f &rayOrig, const Vec3f &rayDir,
 	// Init error
 	err = err_step_slow / 2;		
 	
-	float height1 = _heightData[y * (_hmapSize + 1) + x] / 65535.0f, height2;
+	// Samples are taken across tile borders; samples of tiles that are not resident are skipped
+	const uint16 *sample = findSample( x, y );
+	bool resident1 = sample != 0x0, resident2;
+	float height1 = resident1 ? *sample / 65535.0f : 0.0f, height2;
 
 	Vec3f pos;
 	Vec3f prevPos;
@@ -698,6 +1240,7 @@ bool TerrainNode::checkIntersection( const Vec3f &rayOrig, const Vec3f &rayDir,
 	// Check for perpendicular ray
 	if( fabs(dir.z) <= Math::Epsilon && fabs(dir.x) <= Math::Epsilon )
 	{
+		if( !resident1 ) return false;
 		if( (height1 < orig.y && height1 > dir.y) || (height1 > orig.y && height1 < dir.y) )
 		{
 			intsPos = _absTrans * Vec3f(orig.x, height1, orig.z);
@@ -728,7 +1271,9 @@ bool TerrainNode::checkIntersection( const Vec3f &rayOrig, const Vec3f &rayDir,
 			x += pdx;
 			y += pdy;
 		}					
-		height2 = _heightData[y * (_hmapSize + 1) + x] / 65535.0f;
+		sample = findSample( x, y );
+		resident2 = sample != 0x0;
+		height2 = resident2 ? *sample / 65535.0f : 0.0f;
 
 		pos.x = x / (float)_hmapSize;
 		pos.z = y / (float)_hmapSize;
@@ -738,17 +1283,21 @@ bool TerrainNode::checkIntersection( const Vec3f &rayOrig, const Vec3f &rayDir,
 		else
 			pos.y = (dir.y * (pos.z - orig.z) + dir.z * orig.y) / dir.z;
 
-		if( prevPos.y >= pos.y && prevPos.y >= height1 && pos.y <= height2 ) 
+		if( resident1 && resident2 )
 		{
-			intsPos = _absTrans * pos;
-			return true;
-		}
-		if( prevPos.y <= pos.y && prevPos.y <= height1 && pos.y >= height2 )
-		{
-			intsPos = _absTrans * pos;
-			return true;
+			if( prevPos.y >= pos.y && prevPos.y >= height1 && pos.y <= height2 ) 
+			{
+				intsPos = _absTrans * pos;
+				return true;
+			}
+			if( prevPos.y <= pos.y && prevPos.y <= height1 && pos.y >= height2 )
+			{
+				intsPos = _absTrans * pos;
+				return true;
+			}
 		}
 		height1 = height2;
+		resident1 = resident2;
 		prevPos = pos;	
 	}
 	
@@ -756,7 +1305,7 @@ bool TerrainNode::checkIntersection( const Vec3f &rayOrig, const Vec3f &rayDir,
 }
 
 
-uint32 TerrainNode::calculateGeometryBlockCount( float lodThreshold, float minU, float minV,
+uint32 TerrainNode::calculateGeometryBlockCount( TerrainTile &tile, float lodThreshold, float minU, float minV,
                                                  float maxU, float maxV, int level, float scale)
 {
 	int blockCount = 0;
@@ -767,7 +1316,7 @@ uint32 TerrainNode::calculateGeometryBlockCount( float lodThreshold, float minU,
 	for( int i = 0; i < level; ++i ) offset += (1 << i) * (1 << i);
 
 	const uint32 blockIndex = offset + ftoi_t( minV * (1 << level) ) * (1 << level) + ftoi_t( minU * (1 << level) );
-	BlockInfo &block = _blockTree[blockIndex];
+	BlockInfo &block = tile.blockTree[blockIndex];
 	
 	const float p = block.geoError;
 
@@ -789,7 +1338,7 @@ uint32 TerrainNode::calculateGeometryBlockCount( float lodThreshold, float minU,
 
 		for( uint32 i = 0; i < 4; ++i )
 		{
-			blockCount += calculateGeometryBlockCount( lodThreshold, blocks[i].x, blocks[i].y,
+			blockCount += calculateGeometryBlockCount( tile, lodThreshold, blocks[i].x, blocks[i].y,
 			                                           blocks[i].z, blocks[i].w, level + 1, scale );
 		}
 	}
@@ -797,7 +1346,7 @@ uint32 TerrainNode::calculateGeometryBlockCount( float lodThreshold, float minU,
 }
 
 
-void TerrainNode::createGeometryVertices( float lodThreshold, float minU, float minV, float maxU,
+void TerrainNode::createGeometryVertices( TerrainTile &tile, float lodThreshold, float minU, float minV, float maxU,
 	float maxV, int level, float scale, float *&vertData, unsigned int *&indexData, uint32 &indexOffset )
 {
 	const float halfU = (minU + maxU) / 2.0f;
@@ -807,7 +1356,8 @@ void TerrainNode::createGeometryVertices( float lodThreshold, float minU, float
 	for( int i = 0; i < level; ++i ) offset += (1 << i) * (1 << i);
 
 	const uint32 blockIndex =  offset + ftoi_t( minV * (1 << level) ) * (1 << level) + ftoi_t( minU * (1 << level) );
-	BlockInfo &block = _blockTree[blockIndex];
+	BlockInfo &block = tile.blockTree[blockIndex];
+	const float invTiles = 1.0f / _tileCount;
 
 	// Determine level of detail
 	const float p = block.geoError;
@@ -827,18 +1377,18 @@ void TerrainNode::createGeometryVertices( float lodThreshold, float minU, float
 				float s = (u - 1) * invScale;
 				if( u == 0 ) s = 0.0f; else if( u == size - 1 ) s = 1.0f;	// Skirt
 
-				const float newU = (s * scale + minU) * _hmapSize + 0.5f;
-				const float newV = (t * scale + minV) * _hmapSize + 0.5f;
-				uint32 index = ftoi_t( newV ) * (_hmapSize + 1) + ftoi_t( newU );
+				const float newU = (s * scale + minU + tile.x) * _tileSize + 0.5f;
+				const float newV = (t * scale + minV + tile.y) * _tileSize + 0.5f;
+				const float height = getSampleHeight( ftoi_t( newU ), ftoi_t( newV ) );
 
-				*vertData++ = (s * scale + minU);
+				*vertData++ = (s * scale + minU + tile.x) * invTiles;
 
 				if( v == 0 || v == size - 1 || u == 0 || u == size - 1 )
-					*vertData++ = maxf( _heightData[index] / 65535.0f - _skirtHeight, 0 );
+					*vertData++ = maxf( height - _skirtHeight, 0 );
 				else
-					*vertData++ = _heightData[index] / 65535.0f;
+					*vertData++ = height;
 
-				*vertData++ = (t * scale + minV);
+				*vertData++ = (t * scale + minV + tile.y) * invTiles;
 			}
 		}
 
@@ -871,13 +1421,60 @@ void TerrainNode::createGeometryVertices( float lodThreshold, float minU, float
 
 		for( uint32 i = 0; i < 4; ++i )
 		{
-			createGeometryVertices( lodThreshold, blocks[i].x, blocks[i].y, blocks[i].z, blocks[i].w,
+			createGeometryVertices( tile, lodThreshold, blocks[i].x, blocks[i].y, blocks[i].z, blocks[i].w,
 			                        level + 1, scale, vertData, indexData, indexOffset );
 		}
 	}
 }
 
 
+bool TerrainNode::updateHeights( int x, int y, int width, int height, const uint16 *heights )
+{
+	if( _hmapSize == 0 || heights == 0x0 || width <= 0 || height <= 0 ) return false;
+	
+	// Clip region to height map
+	const int x0 = std::max( x, 0 ), y0 = std::max( y, 0 );
+	const int x1 = std::min( x + width, (int)_hmapSize ) - 1;
+	const int y1 = std::min( y + height, (int)_hmapSize ) - 1;
+	if( x0 > x1 || y0 > y1 ) return false;
+
+	// Copy samples to resident tiles, samples of other tiles are discarded
+	for( int v = y0; v <= y1; ++v )
+	{
+		const uint16 *srcRow = &heights[(v - y) * width];
+		
+		for( int u = x0; u <= x1; )
+		{
+			TerrainTile &tile = _tiles[(v >> _tileShift) * _tileCount + (u >> _tileShift)];
+			const int spanEnd = std::min( (u | (int)(_tileSize - 1)), x1 );
+			
+			if( tile.heightData != 0x0 )
+			{
+				memcpy( &tile.heightData[(v & (_tileSize - 1)) * _tileSize + (u & (_tileSize - 1))],
+				        &srcRow[u - x], (spanEnd - u + 1) * sizeof( uint16 ) );
+			}
+			u = spanEnd + 1;
+		}
+	}
+
+	// Update blocks of all tiles touching the region, including the blocks that share the
+	// last row or column with a neighbor tile
+	for( uint32 i = 0; i < _tiles.size(); ++i )
+	{
+		TerrainTile &tile = _tiles[i];
+		if( tile.state != TerrainTileStates::Resident ) continue;
+		
+		const int tileX = tile.x * _tileSize, tileY = tile.y * _tileSize;
+		if( tileX > x1 || tileX + (int)_tileSize < x0 || tileY > y1 || tileY + (int)_tileSize < y0 )
+			continue;
+
+		updateBlockTree( tile, x0 - tileX, y0 - tileY, x1 - tileX, y1 - tileY );
+	}
+
+	return true;
+}
+
+
 ResHandle TerrainNode::createGeometryResource( const string &name, float lodThreshold )
 {
 	if( name == "" ) return 0;
@@ -889,7 +1486,13 @@ ResHandle TerrainNode::createGeometryResource( const string &name, float lodThre
 		return 0;
 	}
 
-	uint32 blockCount = calculateGeometryBlockCount( lodThreshold, 0.0f, 0.0f, 1.0f, 1.0f, 0, 1.0f );
+	// Only resident tiles are exported
+	uint32 blockCount = 0;
+	for( size_t i = 0, s = _tiles.size(); i < s; ++i )
+	{
+		if( _tiles[i].blockTree.empty() ) continue;
+		blockCount += calculateGeometryBlockCount( _tiles[i], lodThreshold, 0.0f, 0.0f, 1.0f, 1.0f, 0, 1.0f );
+	}
 	// Calculate number of vertices 
 	const uint32 streamSize = blockCount * getVertexCount();
 	// Calculate size of elements in stream
@@ -929,7 +1532,11 @@ ResHandle TerrainNode::createGeometryResource( const string &name, float lodThre
 	//const unsigned int* const refIndexData = (unsigned int*)(pData + streamSize * streamElementSize + sizeof( uint32 ));
 	uint32 *indexData = (uint32 *)(pData + streamSize * streamElementSize + sizeof( uint32 ));
 	
-	createGeometryVertices( lodThreshold, 0.0f, 0.0f, 1.0f, 1.0f, 0, 1.0f, vertexData, indexData, index );
+	for( size_t i = 0, s = _tiles.size(); i < s; ++i )
+	{
+		if( _tiles[i].blockTree.empty() ) continue;
+		createGeometryVertices( _tiles[i], lodThreshold, 0.0f, 0.0f, 1.0f, 1.0f, 0, 1.0f, vertexData, indexData, index );
+	}
 	
 	// Skip vertex data
 	pData += streamSize * streamElementSize;
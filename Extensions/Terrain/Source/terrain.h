@@ -33,13 +33,16 @@ struct TerrainNodeTpl : public SceneNodeTpl
 {
 	PTextureResource   hmapRes;
 	PMaterialResource  matRes;
+	std::string        tileName;
+	int                tileCount;
+	int                tileMemBudget;
 	float              meshQuality;
 	float              skirtHeight;
 	int                blockSize;
 
 	TerrainNodeTpl( const std::string &name, TextureResource *hmapRes, MaterialResource *matRes ) :
 		SceneNodeTpl( SNT_TerrainNode, name ), hmapRes( hmapRes ), matRes( matRes ),
-		meshQuality( 50.0f ), skirtHeight( 0.1f ), blockSize( 17 )
+		tileCount( 0 ), tileMemBudget( 64 ), meshQuality( 50.0f ), skirtHeight( 0.1f ), blockSize( 17 )
 	{
 	}
 };
@@ -53,7 +56,10 @@ struct TerrainNodeParams
 		MatResI,
 		MeshQualityF,
 		SkirtHeightF,
-		BlockSizeI
+		BlockSizeI,
+		TileNameStr,
+		TileCountI,
+		TileMemBudgetI
 	};
 };
 
@@ -66,6 +72,31 @@ struct BlockInfo
 	BlockInfo() : minHeight( 1.0f ), maxHeight( 0.0f ), geoError( 0.0f ) {}
 };
 
+struct TerrainTileStates
+{
+	enum List
+	{
+		Unloaded = 0,
+		Requested,  // Height map resource added and waiting to be loaded by the application
+		Resident,
+		Failed
+	};
+};
+
+const uint32 MinCachedCellSize = 8;  // Smallest mesh cell in samples whose geometric error is cached
+
+struct TerrainTile
+{
+	PTextureResource          hmapRes;  // Only referenced while tile is requested
+	uint16                    *heightData;  // tileSize * tileSize samples
+	std::vector< BlockInfo >  blockTree;  // Block tree of tile in tile-local coordinates
+	std::vector< float >      cellErrors;  // Geometric errors of the mesh cells of the coarse levels
+	uint32                    x, y;
+	int                       state;
+
+	TerrainTile() : heightData( 0x0 ), x( 0 ), y( 0 ), state( TerrainTileStates::Unloaded ) {}
+};
+
 class TerrainNode : public SceneNode
 {
 public:
@@ -73,7 +104,7 @@ public:
 
 	static SceneNodeTpl *parsingFunc( std::map< std::string, std::string > &attribs );
 	static SceneNode *factoryFunc( const SceneNodeTpl &nodeTpl );
-	static void renderFunc(uint32 firstItem, uint32 lastItem, const std::string &shaderContext, const std::string &theClass,
+	static void renderFunc(uint32 firstItem, uint32 lastItem, uint32 shaderContext, int theClass,
 		bool debugView, const Frustum *frust1, const Frustum *frust2, RenderingOrder::List order, int occSet );
 
 	bool canAttach( SceneNode &parent );
@@ -81,13 +112,19 @@ public:
 	void setParamI( int param, int value );
 	float getParamF( int param, int compIdx );
 	void setParamF( int param, int compIdx, float value );
+	const char *getParamStr( int param );
+	void setParamStr( int param, const char* value );
 
 	bool checkIntersection( const Vec3f &rayOrig, const Vec3f &rayDir, Vec3f &intsPos ) const;
 
 	ResHandle createGeometryResource( const std::string &name, float lodThreshold );
+	bool updateHeights( int x, int y, int width, int height, const uint16 *heights );
 	
-	float getHeight( float x, float y )
-		{ return _heightData[ftoi_r( y * _hmapSize ) * (_hmapSize + 1) + ftoi_r( x * _hmapSize ) ] / 65535.0f; }
+	float getHeight( float x, float y ) const
+		{ return getSampleHeight( ftoi_r( x * _hmapSize ), ftoi_r( y * _hmapSize ) ); }
+	float getSampleHeight( int x, int y ) const
+		{ const uint16 *sample = findSample( x, y ); return sample != 0x0 ? *sample / 65535.0f : 0.0f; }
+	const uint16 *findSample( int x, int y ) const;
 
 public:
 	static uint32 vlTerrain;
@@ -99,6 +136,12 @@ protected:
 	void onPostUpdate();
 	
 	bool updateHeightData( TextureResource &hmap );
+	void initDefaultHeightData();
+	bool decodeTile( TerrainTile &tile, TextureResource &hmap );
+	void releaseTiles();
+	void setupTiles( const std::string &tileName, uint32 tileCount );
+	void updateTiles( const Vec3f &localCamPos );
+	uint32 getTileMem();
 	void calcMaxLevel();
 	
 	uint32 getVertexCount();
@@ -107,16 +150,24 @@ protected:
 	uint16 *createIndices();
 	void recreateVertexBuffer();
 	
-	void buildBlockInfo( BlockInfo &block, float minU, float minV, float maxU, float maxV );
-	void createBlockTree();
-
-	static void drawTerrainBlock( TerrainNode *terrain, float minU, float minV, float maxU, float maxV,
+	void calcBlockMinMax( TerrainTile &tile, uint32 x, uint32 y, uint32 size, BlockInfo &block );
+	float calcCellError( const TerrainTile &tile, int x, int y, uint32 cellSize, bool mainDiagonal,
+	                     bool lastCol, bool lastRow ) const;
+	uint32 getNumCachedErrorLevels();
+	float calcBlockError( TerrainTile &tile, uint32 level, int x, int y );
+	static void updateCellRowJob( void *userData, uint32 jobIndex );
+	static void updateBlockRowJob( void *userData, uint32 jobIndex );
+	void updateBlockTree( TerrainTile &tile, int minX, int minY, int maxX, int maxY );
+	void createBlockTree( TerrainTile &tile );
+	void createBlockTrees();
+
+	static void drawTerrainBlock( TerrainNode *terrain, TerrainTile &tile, float minU, float minV, float maxU, float maxV,
 	                              int level, float scale, const Vec3f &localCamPos, const Frustum *frust1,
 	                              const Frustum *frust2, int uni_terBlockParams );
 
-	uint32 calculateGeometryBlockCount( float lodThreshold, float minU, float minV,
+	uint32 calculateGeometryBlockCount( TerrainTile &tile, float lodThreshold, float minU, float minV,
 	                                    float maxU, float maxV, int level, float scale);
-	void createGeometryVertices( float lodThreshold, float minU, float minV,
+	void createGeometryVertices( TerrainTile &tile, float lodThreshold, float minU, float minV,
 	                             float maxU, float maxV, int level, float scale, 
 	                             float *&vertData, unsigned int *&indexData, uint32 &indexOffset );
 
@@ -126,14 +177,20 @@ protected:
 	float              _skirtHeight;
 	float              _lodThreshold;
 	
-	uint32             _hmapSize;
-	uint16             *_heightData;
+	uint32             _hmapSize;  // Total number of height samples per side over all tiles
 	uint32             _maxLevel;
 	float              *_heightArray;
 	uint32             _vertexBuffer, _indexBuffer;
 	BoundingBox        _localBBox;
 
-	std::vector< BlockInfo >  _blockTree;
+	// Tiles; a terrain created from a single height map has exactly one tile that is never paged out
+	std::vector< TerrainTile >  _tiles;
+	std::string                 _tileName;  // Base name of tile height maps; empty if terrain is not paged
+	uint32                      _tileCount;  // Number of tiles per side
+	uint32                      _tileSize, _tileShift;  // Samples per tile side
+	uint32                      _tileMemBudget;  // In Mb
+	Vec3f                       _streamPos;  // Camera position of last paging update
+	bool                        _streamDirty;
 };
 
 }  // namespace
@@ -33,7 +33,10 @@ namespace Horde3DNET
         ///       The available engine option parameters.        		
         ///   MaxLogLevel         - Defines the maximum log level; only messages which are smaller or equal to this value
         ///                         (hence more important) are published in the message queue. (Default: 4)
-        ///   MaxNumMessages      - Defines the maximum number of messages that can be stored in the message queue (Default: 512)
+        ///   MaxNumMessages      - Defines the maximum number of messages that can be stored in the message queue; the
+        ///                         queue memory is allocated when the option is set, so it should not be changed while
+        ///                         other threads are writing messages. Messages that do not fit are counted and reported
+        ///                         once the queue has been emptied. (Default: 512)
         ///   TrilinearFiltering  - Enables or disables trilinear filtering for textures. (Values: 0, 1; Default: 1)
         ///   MaxAnisotropy       - Sets the maximum quality for anisotropic filtering. (Values: 1, 2, 4, 8; Default: 1)
         ///   TexCompression      - Enables or disables texture compression; only affects textures that are
@@ -51,6 +54,40 @@ namespace Horde3DNET
         ///   DumpFailedShaders   - Enables or disables storing of shader code that failed to compile in a text file; this can be
         ///                         useful in combination with the line numbers given back by the shader compiler. (Values: 0, 1; Default: 0)
         ///   GatherTimeStats     - Enables or disables gathering of time stats that are useful for profiling (Values: 0, 1; Default: 1)
+        ///   QueryGridCellSize   - Sets the cell size of the grid used for spatial node queries; should be in the order of
+        ///                         the typical query radius. (Values: > 0; Default: 5.0)
+        ///   PoseCacheStep       - Time quantization step in frames for the pose cache that shares sampled animation poses between
+        ///                         model instances; 0 disables the cache. Not used for the fast animation path with a single
+        ///                         active stage. (Values: >= 0; Default: 0)
+        ///   PoseCacheMaxMem     - Memory budget of the pose cache in Mb; the cache is flushed when it is exceeded. (Default: 16)
+        ///   WorkerThreads       - Number of worker threads used for culling and recording the render queues of light and
+        ///                         shadow passes; 0 does all work on the rendering thread. (Values: 0-15;
+        ///                         Default: number of CPU cores - 1)
+        ///   TexStreamingBudget  - Video memory budget for streamed textures in Mb; DDS textures with a complete mipmap chain
+        ///                         that are loaded while the budget is not 0 are streamed, so that only the mip levels
+        ///                         required by the projected size of visible meshes are resident. 0 disables streaming for
+        ///                         new textures and removes the limit for already streamed ones. (Values: >= 0; Default: 0)
+        ///   ResourceMemBudget   - Memory budget for loaded resources in Mb; at the end of each frame, least recently used
+        ///                         resources that are not referenced (or are textures with the TexEvictable flag) are
+        ///                         unloaded until the budget is met. Evicted resources are reported by
+        ///                         h3dQueryUnloadedResource again. 0 disables eviction. (Values: >= 0; Default: 0)
+        ///   CoherentCullMargin  - Margin in world units for temporally coherent culling of the camera render queue. Nodes
+        ///                         that are further than the margin inside or outside the view frustum keep their cached
+        ///                         visibility until they move; only nodes close to the frustum planes are tested again.
+        ///                         When the camera frustum has moved by more than the margin, all nodes are culled again.
+        ///                         The result is identical to regular culling. 0 disables coherent culling.
+        ///                         (Values: >= 0; Default: 0)
+        ///   ReleaseGeoCPUData   - Enables or disables releasing the main memory copy of tangent space and static vertex
+        ///                         data of Geometry resources after upload, like the GeoReleaseCPUData resource flag; only
+        ///                         affects resources that are loaded after setting the option. Positions and indices are
+        ///                         kept for ray queries, and geometry with morph targets keeps all data. Released data is
+        ///                         read back from video memory when it is needed again, e.g. when a stream is mapped or
+        ///                         software skinning is enabled. (Values: 0, 1; Default: 0)
+        ///   CheckCoherentCulling - Enables or disables checking coherent culling (see CoherentCullMargin) against regular
+        ///                         culling of all nodes. Each camera render queue is built both ways and nodes that are
+        ///                         missing or superfluous are reported as warnings and counted in the CullMismatches
+        ///                         statistic. This doubles the culling work and is meant for debugging only.
+        ///                         (Values: 0, 1; Default: 0)
         /// </summary>
         public enum H3DOptions
         {
@@ -67,7 +104,16 @@ namespace Horde3DNET
             WireframeMode,
             DebugViewMode,
             DumpFailedShaders,
-            GatherTimeStats
+            GatherTimeStats,
+            QueryGridCellSize,
+            PoseCacheStep,
+            PoseCacheMaxMem,
+            WorkerThreads,
+            TexStreamingBudget,
+            ResourceMemBudget,
+            CoherentCullMargin,
+            ReleaseGeoCPUData,
+            CheckCoherentCulling
         }
 
        /// <summary>
@@ -81,12 +127,27 @@ namespace Horde3DNET
        ///    AnimationTime     - CPU time in ms spent for animation
        ///    GeoUpdateTime     - CPU time in ms spent for software skinning and morphing
        ///    ParticleSimTime   - CPU time in ms spent for particle simulation and updates
+       ///    MaterialSetTime   - CPU time in ms spent for applying materials (shader setup, texture and uniform bindings)
 	   ///	  FwdLightsGPUTime  - GPU time in ms spent for forward lighting passes
        ///    DefLightsGPUTime  - GPU time in ms spent for drawing deferred light volumes
 	   ///    ShadowsGPUTime    - GPU time in ms spent for generating shadow maps
        ///    ParticleGPUTime   - GPU time in ms spent for drawing particles
        ///    TextureVMem       - Estimated amount of video memory used by textures (in Mb)
        ///    GeometryVMem      - Estimated amount of video memory used by geometry (in Mb)
+       ///    PoseCacheHitRate  - Fraction of animation pose lookups served by the pose cache (0..1)
+       ///    PoseCacheMem      - Memory used by the animation pose cache (in Mb)
+       ///    StateCallCount    - Number of GL state calls (bindings and uniforms) issued by the render device
+       ///    ElidedStateCalls  - Number of redundant GL state calls skipped by the render device
+       ///    GeometrySharedMem - Memory saved by sharing index and static vertex streams between cloned geometry
+       ///                        resources, e.g. of morphed or software skinned models; the amount is saved both in
+       ///                        main and in video memory (in Mb)
+       ///    GeoUploadBytes    - Number of bytes uploaded to existing geometry buffers, e.g. for morph targets and
+       ///                        software skinning; only the modified vertex ranges are transferred
+       ///    GeometryCPUMem    - Amount of main memory used by geometry resources (in Mb)
+       ///    CullingTime       - CPU time in ms spent for culling and render queue generation, including the
+       ///                        search for shadow casters
+       ///    CullMismatches    - Number of nodes for which coherent culling gave a different result than regular culling
+       ///                        (only counted if the CheckCoherentCulling option is enabled)
        /// </summary>
         public enum H3DStats
         {
@@ -102,7 +163,17 @@ namespace Horde3DNET
             ShadowsGPUTime,
             ParticleGPUTime,
             TextureVMem,
-            GeometryVMem
+            GeometryVMem,
+            PoseCacheHitRate,
+            PoseCacheMem,
+            MaterialSetTime,
+            StateCallCount,
+            ElidedStateCalls,
+            GeometrySharedMem,
+            GeoUploadBytes,
+            GeometryCPUMem,
+            CullingTime,
+            CullMismatches
         }
 
         /// <summary>
@@ -145,6 +216,10 @@ namespace Horde3DNET
         /// TexRenderable     - Makes Texture resource usable as render target.
         /// TexSRGB           - Indicates that Texture resource is in sRGB color space and should be converted
         ///                    to linear space when being sampled.
+        /// TexEvictable      - Allows Texture resource to be evicted by the resource memory budget even if it is
+        ///                    still referenced; materials use the default texture until it is loaded again.
+        /// GeoReleaseCPUData - Releases the main memory copy of the tangent space and static vertex data of a
+        ///                    Geometry resource after it has been uploaded (see ReleaseGeoCPUData option).
         /// </summary>
         public enum H3DResFlags
         {
@@ -154,7 +229,9 @@ namespace Horde3DNET
             TexCubemap = 8,
             TexDynamic = 16,
             TexRenderable = 32,
-            TexSRGB = 64
+            TexSRGB = 64,
+            TexEvictable = 128,
+            GeoReleaseCPUData = 256
         }
 
         /// <summary>
@@ -423,6 +500,16 @@ namespace Horde3DNET
         ///               (may not be smaller than LodDist2) (default: infinite)
         /// LodDist4F    - Distance to camera from which on LOD4 is used
         ///               (may not be smaller than LodDist3) (default: infinite)
+        /// AnimLodInterval1I      - Number of frames between animation updates while LOD1 is used;
+        ///                          skipped updates are caught up with the latest animation
+        ///                          parameters (default: 1)
+        /// AnimLodInterval2I      - Number of frames between animation updates while LOD2 is used (default: 1)
+        /// AnimLodInterval3I      - Number of frames between animation updates while LOD3 is used (default: 1)
+        /// AnimLodInterval4I      - Number of frames between animation updates while LOD4 is used (default: 1)
+        /// AnimOffscreenIntervalI - Number of frames between animation updates while the model was not
+        ///                          visible in the last rendered frame (default: 1)
+        /// AnimLodJointDepthI     - Maximum depth of the joint hierarchy that is animated while LOD1 or
+        ///                          higher is used or the model is not visible; 0 animates all joints (default: 0)
         /// </summary>
         public enum H3DModel
         {
@@ -431,7 +518,13 @@ namespace Horde3DNET
             LodDist1F,
             LodDist2F,
             LodDist3F,
-            LodDist4F
+            LodDist4F,
+            AnimLodInterval1I,
+            AnimLodInterval2I,
+            AnimLodInterval3I,
+            AnimLodInterval4I,
+            AnimOffscreenIntervalI,
+            AnimLodJointDepthI
         }
 
         /// <summary>
@@ -656,6 +749,21 @@ namespace Horde3DNET
             NativeMethodsEngine.h3dRender(node);
         }
 
+        /// <summary>
+        /// Renders the scene from several cameras.
+        /// </summary>
+        /// <remarks>This renders the cameras in the given order like calling render for each of them, but the scene
+        /// is culled for all views in a single pass. Lights with a single shadow map that are visible in several views get
+        /// one shadow map that covers all of these views and is rendered only once. Such a shared shadow map is fitted
+        /// to the union of the views, so each view gets less shadow resolution than with separate render calls.</remarks>
+        /// <param name="nodes">array of camera nodes used for rendering the scene (at most 16)</param>
+        public static void renderViews(int[] nodes)
+        {
+            if (nodes == null) throw new ArgumentNullException("nodes");
+
+            NativeMethodsEngine.h3dRenderViews(nodes, nodes.Length);
+        }
+
         /// <summary>
         /// This function tells the engine that the current frame is finished and that all
         /// subsequent rendering operations will be for the next frame.
@@ -933,6 +1041,45 @@ namespace Horde3DNET
             return result;
         }
 
+        /// <summary>
+        /// Loads several resources at once.
+        /// </summary>
+        /// <remarks>
+        /// This function does the same as calling loadResource for each element of the arrays, in the given order.
+        /// Texture images are decoded in parallel on the worker threads of the engine before the resources are created.
+        /// Entries where data is null behave like loadResource for a file that was not found.
+        /// </remarks>
+        /// <param name="resources">array of resource handles</param>
+        /// <param name="data">array with the data of each resource</param>
+        /// <returns>true if all resources were loaded successfully, otherwise false</returns>
+        public static bool loadResourceBatch(int[] resources, byte[][] data)
+        {
+            if (resources == null) throw new ArgumentNullException("resources");
+            if (data == null || data.Length < resources.Length) throw new ArgumentException(Resources.LoadResourceArgumentExceptionString, "data");
+
+            IntPtr[] ptrs = new IntPtr[resources.Length];
+            int[] sizes = new int[resources.Length];
+            for (int i = 0; i < resources.Length; ++i)
+            {
+                if (data[i] == null) continue;
+
+                // copy data into NULL-terminated blocks like loadResource
+                sizes[i] = data[i].Length;
+                ptrs[i] = Marshal.AllocHGlobal(sizes[i] + 1);
+                Marshal.Copy(data[i], 0, ptrs[i], sizes[i]);
+                Marshal.WriteByte(ptrs[i], sizes[i], 0x00);
+            }
+
+            bool result = NativeMethodsEngine.h3dLoadResourceBatch(resources.Length, resources, ptrs, sizes);
+
+            for (int i = 0; i < ptrs.Length; ++i)
+            {
+                if (ptrs[i] != IntPtr.Zero) Marshal.FreeHGlobal(ptrs[i]);
+            }
+
+            return result;
+        }
+
         /// <summary>
         /// This function unloads a previously loaded resource and restores the default values it had before loading. The state is set back to unloaded which makes it possible to load the resource again.
         /// </summary>
@@ -1122,6 +1269,33 @@ namespace Horde3DNET
             NativeMethodsEngine.h3dReleaseUnusedResources();
         }
 
+        /// <summary>
+        /// This function sums up the main memory and video memory used by all resources of the specified type.
+        /// Unloaded resources use no memory.
+        /// </summary>
+        /// <param name="type">type of resources (H3DResTypes.Undefined for all types)</param>
+        /// <param name="cpuMem">variable where the used main memory in Mb will be stored</param>
+        /// <param name="gpuMem">variable where the used video memory in Mb will be stored</param>
+        public static void getResMemUsage(H3DResTypes type, out float cpuMem, out float gpuMem)
+        {
+            NativeMethodsEngine.h3dGetResMemUsage((int)type, out cpuMem, out gpuMem);
+        }
+
+        /// <summary>
+        /// This function sorts the resources of the specified type by the sum of used main and video memory
+        /// and returns the resource at the specified index. The sorted list is created when index is 0 and
+        /// reused for higher indices, so the function should be called with increasing indices starting at 0.
+        /// </summary>
+        /// <param name="type">type of resources (H3DResTypes.Undefined for all types)</param>
+        /// <param name="index">index of resource within the sorted list (starting with 0)</param>
+        /// <param name="cpuMem">variable where the main memory used by the resource in Mb will be stored</param>
+        /// <param name="gpuMem">variable where the video memory used by the resource in Mb will be stored</param>
+        /// <returns>handle to resource or 0</returns>
+        public static int queryResMemConsumer(H3DResTypes type, int index, out float cpuMem, out float gpuMem)
+        {
+            return NativeMethodsEngine.h3dQueryResMemConsumer((int)type, index, out cpuMem, out gpuMem);
+        }
+
         /// <summary>
         /// Adds a Texture2D resource.
         /// </summary>
@@ -1156,6 +1330,35 @@ namespace Horde3DNET
             NativeMethodsEngine.h3dSetShaderPreambles(vertPreamble, fragPreamble);
         }
 
+        /// <summary>
+        /// Returns the shader combinations used so far.
+        /// </summary>
+        /// This function returns a manifest of all shader combinations that were used for rendering since
+        /// the engine was started. Each line of the manifest contains the flag mask of a combination, followed
+        /// by a space and the name of the Shader resource. An application can save the manifest at the end of
+        /// a session and pass it to precompileShaders in the next session, so that the combinations are
+        /// compiled at load time instead of when they are first needed during rendering.
+        /// <returns>manifest text</returns>
+        public static string getShaderManifest()
+        {
+            return Marshal.PtrToStringAnsi(NativeMethodsEngine.h3dGetShaderManifest());
+        }
+
+        /// <summary>
+        /// Compiles the shader combinations of a manifest.
+        /// </summary>
+        /// This function compiles the shader combinations listed in a manifest returned by getShaderManifest.
+        /// Shader resources that are not in the resource manager are added. Combinations of shaders that
+        /// are already loaded are compiled immediately, the combinations of all other shaders are compiled
+        /// when the shader is loaded. Lines that cannot be parsed are ignored.
+        /// <param name="manifest">manifest text</param>
+        public static void precompileShaders(string manifest)
+        {
+            if (manifest == null) throw new ArgumentNullException("manifest", Resources.StringNullExceptionString);
+
+            NativeMethodsEngine.h3dPrecompileShaders(manifest);
+        }
+
         // Material specific
         /// <summary>
         /// This function sets the specified shader uniform of the specified material to the specified values.
@@ -1363,6 +1566,38 @@ namespace Horde3DNET
 
             NativeMethodsEngine.h3dSetNodeTransMat(node, mat4x4);
         }
+
+        /// <summary>
+        /// Sets the relative transformation matrices of several nodes at once.
+        /// </summary>
+        /// <remarks>The dirty state of the modified nodes is propagated only once after all matrices have been set.</remarks>
+        /// <param name="nodes">array of scene node handles</param>
+        /// <param name="mat4x4s">array of 4x4 matrices in column major order, 16 floats per node</param>
+        public static void setNodeTransMatBatch(int[] nodes, float[] mat4x4s)
+        {
+            if (nodes == null) throw new ArgumentNullException("nodes");
+            if (mat4x4s == null || mat4x4s.Length < nodes.Length * 16) throw new ArgumentOutOfRangeException("mat4x4s", Resources.MatrixOutOfRangeExceptionString);
+
+            NativeMethodsEngine.h3dSetNodeTransMatBatch(nodes.Length, nodes, mat4x4s);
+        }
+
+        /// <summary>
+        /// Sets the relative translation, rotation (as quaternion x, y, z, w) and scale of several nodes at once.
+        /// </summary>
+        /// <remarks>The dirty state of the modified nodes is propagated only once after all transformations have been set.</remarks>
+        /// <param name="nodes">array of scene node handles</param>
+        /// <param name="positions">array of translation vectors, 3 floats per node</param>
+        /// <param name="rotations">array of rotation quaternions, 4 floats per node</param>
+        /// <param name="scales">array of scale vectors, 3 floats per node (can be null for unit scale)</param>
+        public static void setNodeTransformBatch(int[] nodes, float[] positions, float[] rotations, float[] scales)
+        {
+            if (nodes == null) throw new ArgumentNullException("nodes");
+            if (positions == null || positions.Length < nodes.Length * 3) throw new ArgumentOutOfRangeException("positions");
+            if (rotations == null || rotations.Length < nodes.Length * 4) throw new ArgumentOutOfRangeException("rotations");
+            if (scales != null && scales.Length < nodes.Length * 3) throw new ArgumentOutOfRangeException("scales");
+
+            NativeMethodsEngine.h3dSetNodeTransformBatch(nodes.Length, nodes, positions, rotations, scales);
+        }
    
         /// <summary>
         /// Gets a property of a scene node.
@@ -1517,6 +1752,40 @@ namespace Horde3DNET
             return NativeMethodsEngine.h3dGetNodeFindResult(index);
         }
 
+        /// <summary>
+        /// Finds scene nodes whose position lies inside an axis aligned box.
+        /// </summary>
+        /// <remarks>The results are stored in the same list as the results of findNodes and can be accessed
+        /// with getNodeFindResult. Mesh and Joint nodes are not considered.</remarks>
+        /// <param name="minX">minimum x-coordinate of the box</param>
+        /// <param name="minY">minimum y-coordinate of the box</param>
+        /// <param name="minZ">minimum z-coordinate of the box</param>
+        /// <param name="maxX">maximum x-coordinate of the box</param>
+        /// <param name="maxY">maximum y-coordinate of the box</param>
+        /// <param name="maxZ">maximum z-coordinate of the box</param>
+        /// <param name="type">type of nodes to be searched (H3DNodeTypes.Undefined for all types)</param>
+        /// <returns>number of search results</returns>
+        public static int queryNodesInBox(float minX, float minY, float minZ, float maxX, float maxY, float maxZ, int type)
+        {
+            return NativeMethodsEngine.h3dQueryNodesInBox(minX, minY, minZ, maxX, maxY, maxZ, type);
+        }
+
+        /// <summary>
+        /// Finds scene nodes whose position lies inside a sphere.
+        /// </summary>
+        /// <remarks>The results are stored in the same list as the results of findNodes and can be accessed
+        /// with getNodeFindResult. Mesh and Joint nodes are not considered.</remarks>
+        /// <param name="cx">x-coordinate of the sphere center</param>
+        /// <param name="cy">y-coordinate of the sphere center</param>
+        /// <param name="cz">z-coordinate of the sphere center</param>
+        /// <param name="radius">radius of the sphere</param>
+        /// <param name="type">type of nodes to be searched (H3DNodeTypes.Undefined for all types)</param>
+        /// <returns>number of search results</returns>
+        public static int queryNodesInSphere(float cx, float cy, float cz, float radius, int type)
+        {
+            return NativeMethodsEngine.h3dQueryNodesInSphere(cx, cy, cz, radius, type);
+        }
+
         /// <summary>
         /// Sets per-instance uniform data for a node.
         /// </summary>
@@ -1532,6 +1801,20 @@ namespace Horde3DNET
         {
             NativeMethodsEngine.h3dSetNodeUniforms(node, uniformData, count);
         }
+
+        /// <summary>
+        /// Sets per-instance uniform data for several nodes.
+        /// </summary>
+        /// <param name="nodes">nodes for which data will be set</param>
+        /// <param name="uniformData">float array with stride elements per node</param>
+        /// <param name="stride">number of floats to be copied for each node</param>
+        public static void setNodeUniformsBatch(int[] nodes, float[] uniformData, int stride)
+        {
+            if (nodes == null) throw new ArgumentNullException("nodes");
+            if (uniformData == null || uniformData.Length < nodes.Length * stride) throw new ArgumentOutOfRangeException("uniformData");
+
+            NativeMethodsEngine.h3dSetNodeUniformsBatch(nodes.Length, nodes, uniformData, stride);
+        }
         
         /// <summary>
         /// This function checks recursively if the specified ray intersects the specified node or one of its children.
@@ -1574,13 +1857,14 @@ namespace Horde3DNET
         /// </summary>
         /// <remarks>This function checks if a specified node is visible from the perspective of a specified
         /// camera. The function always checks if the node is in the camera's frustum. If checkOcclusion
-        /// is true, the function will take into account the occlusion culling information from the previous
-        /// frame (if occlusion culling is disabled the flag is ignored). The flag calcLod determines whether the
-        /// detail level for the node should be returned in case it is visible. The function returns -1 if the node
-        /// is not visible, otherwise 0 (base LOD level) or the computed LOD level.</remarks>
+        /// is true, the function will take into account the latest occlusion culling information that was read
+        /// back from the GPU, which is usually one or two frames old (if occlusion culling is disabled the flag
+        /// is ignored). The flag calcLod determines whether the detail level for the node should be returned in
+        /// case it is visible. The function returns -1 if the node is not visible, otherwise 0 (base LOD level)
+        /// or the computed LOD level.</remarks>
         /// <param name="node">node to be checked for visibility</param>
         /// <param name="cameraNode">camera node from which the visibility test is done</param>
-        /// <param name="checkOcclusion">specifies if occlusion info from previous frame should be taken into account</param>
+        /// <param name="checkOcclusion">specifies if occlusion info from previous frames should be taken into account</param>
         /// <param name="calcLod">specifies if LOD level should be computed</param>
         /// <returns>computed LOD level or -1 if node is not visible</returns>
         public static int checkNodeVisibility(int node, int cameraNode, bool checkOcclusion, bool calcLod)
@@ -1667,6 +1951,21 @@ namespace Horde3DNET
             NativeMethodsEngine.h3dSetModelAnimParams(node, stage, time, weight);
         }
 
+        /// <summary>
+        /// Sets the animation time and weight of the same stage for several Model nodes.</summary>
+        /// <param name="nodes">handles to the Model nodes to be modified</param>
+        /// <param name="stage">index of the animation stage to be modified</param>
+        /// <param name="times">new animation times, one per node</param>
+        /// <param name="weights">new animation weights, one per node (can be null for a weight of 1.0)</param>
+        public static void setModelAnimParamsBatch(int[] nodes, int stage, float[] times, float[] weights)
+        {
+            if (nodes == null) throw new ArgumentNullException("nodes");
+            if (times == null || times.Length < nodes.Length) throw new ArgumentOutOfRangeException("times");
+            if (weights != null && weights.Length < nodes.Length) throw new ArgumentOutOfRangeException("weights");
+
+            NativeMethodsEngine.h3dSetModelAnimParamsBatch(nodes.Length, nodes, stage, times, weights);
+        }
+
         /// <summary>
         /// This function sets the weight of a specified morph target. If the target parameter is an empty string the weight of all morph targets in the specified Model node is modified. The function operates on Model nodes but accepts also Group nodes in which case the call is passed recursively to the Model child nodes. If the specified morph target is not found the function returns false.
         /// </summary>
@@ -1697,6 +1996,21 @@ namespace Horde3DNET
             NativeMethodsEngine.h3dUpdateModel(modelNode, flags);
         }
 
+        /// <summary>
+        /// Applies animation and/or geometry updates to several Model nodes.
+        /// <remarks>
+        /// This function does the same as updateModel for an array of models. The geometry updates of
+        /// the models are computed in parallel on the engine's worker threads.
+        /// </remarks>
+        /// <param name="modelNodes">handles to the Model nodes to be updated</param>
+        /// <param name="flags">combination of H3DModelUpdateFlags flags</param>
+        public static void updateModelBatch(int[] modelNodes, int flags)
+        {
+            if (modelNodes == null) throw new ArgumentNullException("modelNodes");
+
+            NativeMethodsEngine.h3dUpdateModelBatch(modelNodes.Length, modelNodes, flags);
+        }
+
 
 
         // Mesh specific
@@ -23,6 +23,19 @@ namespace Horde3DNET.Utils
         /// </summary>
         public const int MaxStatMode = 2;
 
+        /// <summary>
+        /// The available formats for log files.
+        ///   HTML  - HTML page with a table of all messages, colored by log level
+        ///   Text  - Plain text with one line per message, containing time, log level and text separated by tabs
+        ///   JSON  - JSON Lines; every line is an object with the fields time, level and text
+        /// </summary>
+        public enum LogFormats
+        {
+            HTML = 0,
+            Text,
+            JSON
+        }
+
         // Utilities functions
         /// <summary>
         /// FreeMem is not supported. The purpose is to free memory allocated by the h3d library.
@@ -33,7 +46,21 @@ namespace Horde3DNET.Utils
         }
         
         /// <summary>
-        /// This utility function pops all messages from the message queue and writes them to a HTML formated log file 'EngineLog.html'.
+        /// This utility function closes the current log file and creates the specified one, which is used by all subsequent calls of dumpMessages.
+        /// If filename is null, the current log file is only closed; this should be done before the native library is unloaded.
+        /// </summary>
+        /// <param name="filename">name of the log file or null to close the current file</param>
+        /// <param name="format">format of the log file; ignored if filename is null</param>
+        /// <returns>true in case of success, otherwise false</returns>
+        public static bool setLogFile(string filename, LogFormats format)
+        {
+            return NativeMethodsUtils.h3dutSetLogFile(filename, (int)format);
+        }
+
+        /// <summary>
+        /// This utility function pops all messages from the message queue and writes them to the log file set with setLogFile.
+        /// If no log file was set, the HTML formated file 'Horde3D_Log.html' is created. The file is written by a background thread
+        /// and completed by setLogFile(null, 0).
         /// </summary>
         /// <returns>true in case of success, otherwise false</returns>
         public static bool dumpMessages()
@@ -27,6 +27,10 @@ namespace Horde3DNET.Utils
         [DllImport(UTILS_DLL), SuppressUnmanagedCodeSecurity]
         internal static extern void h3dutFreeMem(IntPtr ptr);
 
+        [DllImport(UTILS_DLL), SuppressUnmanagedCodeSecurity]
+        [return: MarshalAs(UnmanagedType.U1)]   // represents C++ bool type 
+        internal static extern bool h3dutSetLogFile(string filename, int format);
+
         [DllImport(UTILS_DLL), SuppressUnmanagedCodeSecurity]
         [return: MarshalAs(UnmanagedType.U1)]   // represents C++ bool type 
         internal static extern bool h3dutDumpMessages();
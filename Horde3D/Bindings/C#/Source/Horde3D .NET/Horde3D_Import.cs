@@ -51,6 +51,9 @@ namespace Horde3DNET
         //horde3d 1.0
         [DllImport(ENGINE_DLL), SuppressUnmanagedCodeSecurity]        
         internal static extern void h3dRender(int node);
+
+        [DllImport(ENGINE_DLL), SuppressUnmanagedCodeSecurity]
+        internal static extern void h3dRenderViews(int[] nodes, int count);
         /////
 
         [DllImport(ENGINE_DLL), SuppressUnmanagedCodeSecurity]        
@@ -111,6 +114,10 @@ namespace Horde3DNET
         [return: MarshalAs(UnmanagedType.U1)]   // represents C++ bool type 
         internal static extern bool h3dLoadResource(int name, IntPtr data, int size);
 
+        [DllImport(ENGINE_DLL), SuppressUnmanagedCodeSecurity]
+        [return: MarshalAs(UnmanagedType.U1)]   // represents C++ bool type 
+        internal static extern bool h3dLoadResourceBatch(int count, int[] resources, IntPtr[] data, int[] sizes);
+
         [DllImport(ENGINE_DLL), SuppressUnmanagedCodeSecurity]        
         internal static extern void h3dUnloadResource(int res);
 
@@ -150,6 +157,12 @@ namespace Horde3DNET
         [DllImport(ENGINE_DLL), SuppressUnmanagedCodeSecurity]
         internal static extern void h3dReleaseUnusedResources();
 
+        [DllImport(ENGINE_DLL), SuppressUnmanagedCodeSecurity]
+        internal static extern void h3dGetResMemUsage(int type, out float cpuMem, out float gpuMem);
+
+        [DllImport(ENGINE_DLL), SuppressUnmanagedCodeSecurity]
+        internal static extern int h3dQueryResMemConsumer(int type, int index, out float cpuMem, out float gpuMem);
+
         [DllImport(ENGINE_DLL), SuppressUnmanagedCodeSecurity]
         internal static extern int h3dCreateTexture(string name, int width, int height, int fmt, int flags);
 
@@ -157,6 +170,12 @@ namespace Horde3DNET
         [DllImport(ENGINE_DLL), SuppressUnmanagedCodeSecurity]        
         internal static extern void h3dSetShaderPreambles( string vertPreamble, string fragPreamble );
 
+        [DllImport(ENGINE_DLL), SuppressUnmanagedCodeSecurity]
+        internal static extern IntPtr h3dGetShaderManifest();
+
+        [DllImport(ENGINE_DLL), SuppressUnmanagedCodeSecurity]
+        internal static extern void h3dPrecompileShaders( string manifest );
+
         // --- Material specific ---
         [DllImport(ENGINE_DLL), SuppressUnmanagedCodeSecurity]
         [return: MarshalAs(UnmanagedType.U1)]   // represents C++ bool type 
@@ -211,6 +230,12 @@ namespace Horde3DNET
         [DllImport(ENGINE_DLL), SuppressUnmanagedCodeSecurity]        
         internal static extern void h3dSetNodeTransMat(int node, float[] mat4x4);
 
+        [DllImport(ENGINE_DLL), SuppressUnmanagedCodeSecurity]
+        internal static extern void h3dSetNodeTransMatBatch(int count, int[] nodes, float[] mat4x4s);
+
+        [DllImport(ENGINE_DLL), SuppressUnmanagedCodeSecurity]
+        internal static extern void h3dSetNodeTransformBatch(int count, int[] nodes, float[] positions, float[] rotations, float[] scales);
+
         [DllImport(ENGINE_DLL), SuppressUnmanagedCodeSecurity]
         internal static extern int h3dGetNodeParamI(int node, int param);
 
@@ -238,10 +263,19 @@ namespace Horde3DNET
 
         [DllImport(ENGINE_DLL), SuppressUnmanagedCodeSecurity]
         internal static extern int h3dGetNodeFindResult(int index);
+
+        [DllImport(ENGINE_DLL), SuppressUnmanagedCodeSecurity]
+        internal static extern int h3dQueryNodesInBox(float minX, float minY, float minZ, float maxX, float maxY, float maxZ, int type);
+
+        [DllImport(ENGINE_DLL), SuppressUnmanagedCodeSecurity]
+        internal static extern int h3dQueryNodesInSphere(float cx, float cy, float cz, float radius, int type);
         
         [DllImport(ENGINE_DLL), SuppressUnmanagedCodeSecurity]
         internal static extern void h3dSetNodeUniforms(int node, float[] uniformData, int count);
 
+        [DllImport(ENGINE_DLL), SuppressUnmanagedCodeSecurity]
+        internal static extern void h3dSetNodeUniformsBatch(int count, int[] nodes, float[] uniformData, int stride);
+
         [DllImport(ENGINE_DLL), SuppressUnmanagedCodeSecurity]
         internal static extern int h3dCastRay(int node, float ox, float oy, float oz, float dx, float dy, float dz, int numNearest);
 
@@ -267,6 +301,9 @@ namespace Horde3DNET
         [DllImport(ENGINE_DLL), SuppressUnmanagedCodeSecurity]        
         internal static extern void h3dSetModelAnimParams(int node, int stage, float time, float weight);
 
+        [DllImport(ENGINE_DLL), SuppressUnmanagedCodeSecurity]
+        internal static extern void h3dSetModelAnimParamsBatch(int count, int[] nodes, int stage, float[] times, float[] weights);
+
         [DllImport(ENGINE_DLL), SuppressUnmanagedCodeSecurity]
         [return: MarshalAs(UnmanagedType.U1)]   // represents C++ bool type 
         internal static extern bool h3dSetModelMorpher(int node, string target, float weight);
@@ -274,6 +311,9 @@ namespace Horde3DNET
         [DllImport(ENGINE_DLL), SuppressUnmanagedCodeSecurity]
         internal static extern void h3dUpdateModel(int modelNode, int flags);
 
+        [DllImport(ENGINE_DLL), SuppressUnmanagedCodeSecurity]
+        internal static extern void h3dUpdateModelBatch(int count, int[] modelNodes, int flags);
+
         // Mesh specific
         [DllImport(ENGINE_DLL), SuppressUnmanagedCodeSecurity]
         internal static extern int h3dAddMeshNode(int parent, string name, int matRes, 
@@ -67,7 +67,10 @@ struct H3DOptions
 		
 		MaxLogLevel         - Defines the maximum log level; only messages which are smaller or equal to this value
 		                      (hence more important) are published in the message queue. (Default: 4)
-		MaxNumMessages      - Defines the maximum number of messages that can be stored in the message queue (Default: 512)
+		MaxNumMessages      - Defines the maximum number of messages that can be stored in the message queue; the
+		                      queue memory is allocated when the option is set, so it should not be changed while
+		                      other threads are writing messages. Messages that do not fit are counted and reported
+		                      once the queue has been emptied. (Default: 512)
 		TrilinearFiltering  - Enables or disables trilinear filtering for textures. (Values: 0, 1; Default: 1)
 		MaxAnisotropy       - Sets the maximum quality for anisotropic filtering. (Values: 1, 2, 4, 8; Default: 1)
 		TexCompression      - Enables or disables texture compression; only affects textures that are
@@ -85,6 +88,41 @@ struct H3DOptions
 		DumpFailedShaders   - Enables or disables storing of shader code that failed to compile in a text file; this can be
 		                      useful in combination with the line numbers given back by the shader compiler. (Values: 0, 1; Default: 0)
 		GatherTimeStats     - Enables or disables gathering of time stats that are useful for profiling (Values: 0, 1; Default: 1)
+		QueryGridCellSize   - Sets the cell size of the grid used for spatial node queries; should be in the order of
+		                      the typical query radius. (Values: > 0; Default: 5.0)
+		PoseCacheStep       - Time quantization step in frames for the pose cache that shares sampled animation poses between
+		                      model instances; 0 disables the cache. Not used for the fast animation path with a single
+		                      active stage. (Values: >= 0; Default: 0)
+		PoseCacheMaxMem     - Memory budget of the pose cache in Mb; the cache is flushed when it is exceeded. (Default: 16)
+		WorkerThreads       - Number of worker threads used for culling, recording the render queues of light and
+		                      shadow passes and decoding images in h3dLoadResourceBatch; 0 does all work on the
+		                      calling thread. (Values: 0-15;
+		                      Default: number of CPU cores - 1)
+		TexStreamingBudget  - Video memory budget for streamed textures in Mb; DDS textures with a complete mipmap chain
+		                      that are loaded while the budget is not 0 are streamed, so that only the mip levels
+		                      required by the projected size of visible meshes are resident. 0 disables streaming for
+		                      new textures and removes the limit for already streamed ones. (Values: >= 0; Default: 0)
+		ResourceMemBudget   - Memory budget for loaded resources in Mb; at the end of each frame, least recently used
+		                      resources that are not referenced (or are textures with the TexEvictable flag) are
+		                      unloaded until the budget is met. Evicted resources are reported by
+		                      h3dQueryUnloadedResource again. 0 disables eviction. (Values: >= 0; Default: 0)
+		CoherentCullMargin  - Margin in world units for temporally coherent culling of the camera render queue. Nodes
+		                      that are further than the margin inside or outside the view frustum keep their cached
+		                      visibility until they move; only nodes close to the frustum planes are tested again.
+		                      When the camera frustum has moved by more than the margin, all nodes are culled again.
+		                      The result is identical to regular culling. 0 disables coherent culling.
+		                      (Values: >= 0; Default: 0)
+		ReleaseGeoCPUData   - Enables or disables releasing the main memory copy of tangent space and static vertex
+		                      data of Geometry resources after upload, like the GeoReleaseCPUData resource flag; only
+		                      affects resources that are loaded after setting the option. Positions and indices are
+		                      kept for ray queries, and geometry with morph targets keeps all data. Released data is
+		                      read back from video memory when it is needed again, e.g. when a stream is mapped or
+		                      software skinning is enabled. (Values: 0, 1; Default: 0)
+		CheckCoherentCulling - Enables or disables checking coherent culling (see CoherentCullMargin) against regular
+		                      culling of all nodes. Each camera render queue is built both ways and nodes that are
+		                      missing or superfluous are reported as warnings and counted in the CullMismatches
+		                      statistic. This doubles the culling work and is meant for debugging only.
+		                      (Values: 0, 1; Default: 0)
 	*/
 	enum List
 	{
@@ -101,7 +139,16 @@ struct H3DOptions
 		WireframeMode,
 		DebugViewMode,
 		DumpFailedShaders,
-		GatherTimeStats
+		GatherTimeStats,
+		QueryGridCellSize,
+		PoseCacheStep,
+		PoseCacheMaxMem,
+		WorkerThreads,
+		TexStreamingBudget,
+		ResourceMemBudget,
+		CoherentCullMargin,
+		ReleaseGeoCPUData,
+		CheckCoherentCulling
 	};
 };
 
@@ -117,12 +164,27 @@ struct H3DStats
 		AnimationTime     - CPU time in ms spent for animation
 		GeoUpdateTime     - CPU time in ms spent for software skinning and morphing
 		ParticleSimTime   - CPU time in ms spent for particle simulation and updates
+		MaterialSetTime   - CPU time in ms spent for applying materials (shader setup, texture and uniform bindings)
 		FwdLightsGPUTime  - GPU time in ms spent for forward lighting passes
 		DefLightsGPUTime  - GPU time in ms spent for drawing deferred light volumes
 		ShadowsGPUTime    - GPU time in ms spent for generating shadow maps
 		ParticleGPUTime   - GPU time in ms spent for drawing particles
 		TextureVMem       - Estimated amount of video memory used by textures (in Mb)
 		GeometryVMem      - Estimated amount of video memory used by geometry (in Mb)
+		PoseCacheHitRate  - Fraction of animation pose lookups served by the pose cache (0..1)
+		PoseCacheMem      - Memory used by the animation pose cache (in Mb)
+		StateCallCount    - Number of GL state calls (bindings and uniforms) issued by the render device
+		ElidedStateCalls  - Number of redundant GL state calls skipped by the render device
+		GeometrySharedMem - Memory saved by sharing index and static vertex streams between cloned geometry
+		                    resources, e.g. of morphed or software skinned models; the amount is saved both in
+		                    main and in video memory (in Mb)
+		GeoUploadBytes    - Number of bytes uploaded to existing geometry buffers, e.g. for morph targets and
+		                    software skinning; only the modified vertex ranges are transferred
+		GeometryCPUMem    - Amount of main memory used by geometry resources (in Mb)
+		CullingTime       - CPU time in ms spent for culling and render queue generation, including the
+		                    search for shadow casters
+		CullMismatches    - Number of nodes for which coherent culling gave a different result than regular culling
+		                    (only counted if the CheckCoherentCulling option is enabled)
 	*/
 	enum List
 	{
@@ -138,7 +200,17 @@ struct H3DStats
 		ShadowsGPUTime,
 		ParticleGPUTime,
 		TextureVMem,
-		GeometryVMem
+		GeometryVMem,
+		PoseCacheHitRate,
+		PoseCacheMem,
+		MaterialSetTime,
+		StateCallCount,
+		ElidedStateCalls,
+		GeometrySharedMem,
+		GeoUploadBytes,
+		GeometryCPUMem,
+		CullingTime,
+		CullMismatches
 	};
 };
 
@@ -186,6 +258,10 @@ struct H3DResFlags
 		TexRenderable     - Makes Texture resource usable as render target.
 		TexSRGB           - Indicates that Texture resource is in sRGB color space and should be converted
 		                    to linear space when being sampled.
+		TexEvictable      - Allows Texture resource to be evicted by the resource memory budget even if it is
+		                    still referenced; materials use the default texture until it is loaded again.
+		GeoReleaseCPUData - Releases the main memory copy of the tangent space and static vertex data of a
+		                    Geometry resource after it has been uploaded (see ReleaseGeoCPUData option).
 	*/
 	enum Flags
 	{
@@ -195,7 +271,9 @@ struct H3DResFlags
 		TexCubemap = 8,
 		TexDynamic = 16,
 		TexRenderable = 32,
-		TexSRGB = 64
+		TexSRGB = 64,
+		TexEvictable = 128,
+		GeoReleaseCPUData = 256
 	};
 };
 
@@ -495,6 +573,16 @@ struct H3DModel
 		               (may not be smaller than LodDist2) (default: infinite)
 		LodDist4F    - Distance to camera from which on LOD4 is used
 		               (may not be smaller than LodDist3) (default: infinite)
+		AnimLodInterval1I      - Number of frames between animation updates while LOD1 is used;
+		                         skipped updates are caught up with the latest animation
+		                         parameters (default: 1)
+		AnimLodInterval2I      - Number of frames between animation updates while LOD2 is used (default: 1)
+		AnimLodInterval3I      - Number of frames between animation updates while LOD3 is used (default: 1)
+		AnimLodInterval4I      - Number of frames between animation updates while LOD4 is used (default: 1)
+		AnimOffscreenIntervalI - Number of frames between animation updates while the model was not
+		                         visible in the last rendered frame (default: 1)
+		AnimLodJointDepthI     - Maximum depth of the joint hierarchy that is animated while LOD1 or
+		                         higher is used or the model is not visible; 0 animates all joints (default: 0)
 	*/
 	enum List
 	{
@@ -503,7 +591,13 @@ struct H3DModel
 		LodDist1F,
 		LodDist2F,
 		LodDist3F,
-		LodDist4F
+		LodDist4F,
+		AnimLodInterval1I,
+		AnimLodInterval2I,
+		AnimLodInterval3I,
+		AnimLodInterval4I,
+		AnimOffscreenIntervalI,
+		AnimLodJointDepthI
 	};
 };
 
@@ -759,6 +853,33 @@ DLL void h3dRelease();
 */
 DLL void h3dRender( H3DNode cameraNode );
 
+/* Function: h3dRenderViews
+		Renders the scene from several cameras.
+	
+	Details:
+		This function renders the cameras in the given order like calling h3dRender for each of them, but it
+		is faster for views that show the same scene, like split-screen views, reflections or a mini-map.
+		The scene is culled for all views in a single pass, and the pipelines of the views take their render
+		queues from the results instead of traversing the scene again. Lights with a single shadow map that
+		are visible in several views get one shadow map that covers all of these views; it is rendered only
+		once and used by all of them. The render buffers of these shared shadow maps are allocated on demand
+		and kept for subsequent calls.
+		
+		The output is only identical to separate h3dRender calls if no shadow map is shared. A shared shadow
+		map is fitted to the union of the views instead of a single view, so every view gets less shadow map
+		resolution, the more so the further apart the views are. Views that need full shadow quality and
+		show different parts of the scene should be rendered with h3dRender or use lights with several
+		shadow map splits, which are never shared.
+	
+	Parameters:
+		cameraNodes  - array of camera nodes used for rendering the scene
+		count        - number of cameras in the array (at most 16)
+		
+	Returns:
+		nothing
+*/
+DLL void h3dRenderViews( const H3DNode *cameraNodes, int count );
+
 /* Function: h3dFinalizeFrame
 		Marker for end of frame.
 	
@@ -1052,6 +1173,28 @@ DLL bool h3dIsResLoaded( H3DRes res );
 */
 DLL bool h3dLoadResource( H3DRes res, const char *data, int size );
 
+/* Function: h3dLoadResourceBatch
+		Loads several resources at once.
+	
+	Details:
+		This function does the same as calling h3dLoadResource for each element of the arrays, in the given
+		order. Data that is expensive to decode, like compressed texture images, is decoded in parallel
+		on the worker threads (see the WorkerThreads engine option) before the resources are created,
+		so loading many textures with one call is considerably faster than loading them one by one.
+		Entries with a NULL data pointer behave like h3dLoadResource with NULL data. Invalid
+		resource handles are skipped and set the error flag.
+	
+	Parameters:
+		count      - number of resources to be loaded
+		resources  - array of resource handles
+		data       - array of pointers to the data of each resource
+		sizes      - array of data block sizes
+		
+	Returns:
+		true if all resources were loaded successfully, otherwise false
+*/
+DLL bool h3dLoadResourceBatch( int count, const H3DRes *resources, const char **data, const int *sizes );
+
 /* Function: h3dUnloadResource
 		Unloads a resource.
 	
@@ -1293,6 +1436,43 @@ DLL H3DRes h3dQueryUnloadedResource( int index );
 */
 DLL void h3dReleaseUnusedResources();
 
+/* Function: h3dGetResMemUsage
+		Returns the memory used by resources of a specific type.
+	
+	Details:
+		This function sums up the main memory and video memory used by all resources of the specified type.
+		Unloaded resources use no memory.
+	
+	Parameters:
+		type    - type of resources (H3DResTypes::Undefined for all types)
+		cpuMem  - pointer to variable for storing the used main memory in Mb (can be NULL)
+		gpuMem  - pointer to variable for storing the used video memory in Mb (can be NULL)
+		
+	Returns:
+		nothing
+*/
+DLL void h3dGetResMemUsage( int type, float *cpuMem, float *gpuMem );
+
+/* Function: h3dQueryResMemConsumer
+		Returns handle to one of the resources using the most memory.
+	
+	Details:
+		This function sorts the resources of the specified type by the sum of used main and video memory
+		and returns the resource at the specified index. The sorted list is created when index is 0 and
+		reused for higher indices, so the function should be called with increasing indices starting at 0.
+		If the index is greater than the number of resources using memory, 0 is returned.
+	
+	Parameters:
+		type    - type of resources (H3DResTypes::Undefined for all types)
+		index   - index of resource within the sorted list (starting with 0)
+		cpuMem  - pointer to variable for storing the main memory used by the resource in Mb (can be NULL)
+		gpuMem  - pointer to variable for storing the video memory used by the resource in Mb (can be NULL)
+		
+	Returns:
+		handle to resource or 0
+*/
+DLL H3DRes h3dQueryResMemConsumer( int type, int index, float *cpuMem, float *gpuMem );
+
 
 /* Group: Specific resource management functions */
 /* Function: h3dCreateTexture
@@ -1335,6 +1515,41 @@ DLL H3DRes h3dCreateTexture( const char *name, int width, int height, int fmt, i
 */
 DLL void h3dSetShaderPreambles( const char *vertPreamble, const char *fragPreamble );
 
+/* Function: h3dGetShaderManifest
+		Returns the shader combinations used so far.
+	
+	Details:
+		This function returns a manifest of all shader combinations that were used for rendering since
+		the engine was started. Each line of the manifest contains the flag mask of a combination, followed
+		by a space and the name of the Shader resource. An application can save the manifest at the end of
+		a session and pass it to h3dPrecompileShaders in the next session, so that the combinations are
+		compiled at load time instead of when they are first needed during rendering.
+	
+	Parameters:
+		none
+		
+	Returns:
+		manifest text
+*/
+DLL const char *h3dGetShaderManifest();
+
+/* Function: h3dPrecompileShaders
+		Compiles the shader combinations of a manifest.
+	
+	Details:
+		This function compiles the shader combinations listed in a manifest returned by h3dGetShaderManifest.
+		Combinations of shaders that are already loaded are compiled immediately. The combinations of all
+		other shaders are remembered and compiled when a Shader resource with the same name is loaded;
+		the function does not add any resources. Lines that cannot be parsed are ignored.
+	
+	Parameters:
+		manifest  - manifest text
+		
+	Returns:
+		nothing
+*/
+DLL void h3dPrecompileShaders( const char *manifest );
+
 /* Function: h3dSetMaterialUniform
 		Sets a shader uniform of a Material resource.
 	
@@ -1592,6 +1807,47 @@ DLL void h3dGetNodeTransMats( H3DNode node, const float **relMat, const float **
 */
 DLL void h3dSetNodeTransMat( H3DNode node, const float *mat4x4 );
 
+/* Function: h3dSetNodeTransMatBatch
+		Sets the relative transformation matrices of several nodes at once.
+	
+	Details:
+		This function does the same as h3dSetNodeTransMat for an array of nodes. The dirty state of
+		the modified nodes is propagated through the scene graph only once after all matrices have been set,
+		which makes the function considerably faster than individual calls when many nodes are updated.
+		Invalid node handles are skipped and set the error flag.
+	
+	Parameters:
+		count    - number of nodes to be modified
+		nodes    - array of node handles
+		mat4x4s  - array of count 4x4 matrices in column major order
+		
+	Returns:
+		nothing
+*/
+DLL void h3dSetNodeTransMatBatch( int count, const H3DNode *nodes, const float *mat4x4s );
+
+/* Function: h3dSetNodeTransformBatch
+		Sets the relative transformation of several nodes using quaternions.
+	
+	Details:
+		This function sets the relative translation, rotation and scale of an array of nodes. In contrast
+		to h3dSetNodeTransform the rotation is specified as a quaternion which avoids the Euler angle
+		conversion. Like h3dSetNodeTransMatBatch, the dirty state of the nodes is propagated only once.
+		Invalid node handles are skipped and set the error flag.
+	
+	Parameters:
+		count      - number of nodes to be modified
+		nodes      - array of node handles
+		positions  - array of count translation vectors (x, y, z)
+		rotations  - array of count rotation quaternions (x, y, z, w)
+		scales     - array of count scale vectors (x, y, z) or NULL for unit scale
+		
+	Returns:
+		nothing
+*/
+DLL void h3dSetNodeTransformBatch( int count, const H3DNode *nodes, const float *positions,
+                                   const float *rotations, const float *scales );
+
 /* Function: h3dGetNodeParamI
 		Gets a property of a scene node.
 	
@@ -1780,6 +2036,43 @@ DLL int h3dFindNodes( H3DNode startNode, const char *name, int type );
 */
 DLL H3DNode h3dGetNodeFindResult( int index );
 
+/* Function: h3dQueryNodesInBox
+		Finds scene nodes whose position lies inside an axis aligned box.
+	
+	Details:
+		This function adds all nodes of the specified type whose absolute position lies inside the specified
+		box to the internal result list that is also used by h3dFindNodes. The results can be accessed with
+		h3dGetNodeFindResult. The query is accelerated by a spatial hash grid that is updated
+		incrementally when nodes are transformed (see H3DOptions::QueryGridCellSize). Mesh and Joint nodes
+		are parts of models and are not considered; the parent Model nodes should be queried instead.
+	
+	Parameters:
+		minX, minY, minZ  - minimum coordinates of the box in world space
+		maxX, maxY, maxZ  - maximum coordinates of the box in world space
+		type              - type of nodes to be searched (H3DNodeTypes::Undefined for all types)
+		
+	Returns:
+		number of search results
+*/
+DLL int h3dQueryNodesInBox( float minX, float minY, float minZ, float maxX, float maxY, float maxZ, int type );
+
+/* Function: h3dQueryNodesInSphere
+		Finds scene nodes whose position lies inside a sphere.
+	
+	Details:
+		This function works like h3dQueryNodesInBox but uses a sphere as query volume. It can be used
+		for efficient neighbourhood searches, for example in crowd simulations.
+	
+	Parameters:
+		cx, cy, cz  - center of the sphere in world space
+		radius      - radius of the sphere
+		type        - type of nodes to be searched (H3DNodeTypes::Undefined for all types)
+		
+	Returns:
+		number of search results
+*/
+DLL int h3dQueryNodesInSphere( float cx, float cy, float cz, float radius, int type );
+
 /* Function: h3dSetNodeUniforms
 		Sets per-instance uniform data for a node.
 
@@ -1798,6 +2091,25 @@ DLL H3DNode h3dGetNodeFindResult( int index );
 */
 DLL void h3dSetNodeUniforms( H3DNode node, float *uniformData, int count );
 
+/* Function: h3dSetNodeUniformsBatch
+		Sets per-instance uniform data for several nodes.
+
+	Details:
+		This function does the same as h3dSetNodeUniforms for an array of nodes. The data for
+		the nodes is expected to be tightly packed with stride floats per node.
+		Invalid node handles are skipped and set the error flag.
+
+	Parameters:
+		count        - number of nodes to be modified
+		nodes        - array of node handles
+		uniformData  - pointer to float array of count * stride elements
+		stride       - number of floats to be copied for each node
+		
+	Returns:
+		nothing
+*/
+DLL void h3dSetNodeUniformsBatch( int count, const H3DNode *nodes, float *uniformData, int stride );
+
 /* Function: h3dCastRay
 		Performs a recursive ray collision query.
 	
@@ -1843,15 +2155,16 @@ DLL bool h3dGetCastRayResult( int index, H3DNode *node, float *distance, float *
 	Details:
 		This function checks if a specified node is visible from the perspective of a specified
 		camera. The function always checks if the node is in the camera's frustum. If checkOcclusion
-		is true, the function will take into account the occlusion culling information from the previous
-		frame (if occlusion culling is disabled the flag is ignored). The flag calcLod determines whether the
-		detail level for the node should be returned in case it is visible. The function returns -1 if the node
-		is not visible, otherwise 0 (base LOD level) or the computed LOD level.
+		is true, the function will take into account the latest occlusion culling information that was read
+		back from the GPU, which is usually one or two frames old (if occlusion culling is disabled the flag
+		is ignored). The flag calcLod determines whether the detail level for the node should be returned in
+		case it is visible. The function returns -1 if the node is not visible, otherwise 0 (base LOD level)
+		or the computed LOD level.
 
 	Parameters:
 		node            - node to be checked for visibility
 		cameraNode      - camera node from which the visibility test is done
-		checkOcclusion  - specifies if occlusion info from previous frame should be taken into account
+		checkOcclusion  - specifies if occlusion info from previous frames should be taken into account
 		calcLod         - specifies if LOD level should be computed
 
 	Returns:
@@ -1954,6 +2267,27 @@ DLL void h3dSetupModelAnimStage( H3DNode modelNode, int stage, H3DRes animationR
 */
 DLL void h3dSetModelAnimParams( H3DNode modelNode, int stage, float time, float weight );
 
+/* Function: h3dSetModelAnimParamsBatch
+		Sets the animation stage parameters of several Model nodes.
+	
+	Details:
+		This function does the same as h3dSetModelAnimParams for the same stage of an array of
+		models. The dirty state of the models is propagated only once after all parameters have been set.
+		Handles that do not reference a Model node are skipped and set the error flag.
+	
+	Parameters:
+		count       - number of models to be modified
+		modelNodes  - array of Model node handles
+		stage       - index of the animation stage to be modified
+		times       - array of count animation times/frames
+		weights     - array of count blend weights or NULL for a weight of 1.0
+		
+	Returns:
+		nothing
+*/
+DLL void h3dSetModelAnimParamsBatch( int count, const H3DNode *modelNodes, int stage,
+                                     const float *times, const float *weights );
+
 /* Function: h3dSetModelMorpher
 		Sets the weight of a morph target.
 	
@@ -1991,6 +2325,25 @@ DLL bool h3dSetModelMorpher( H3DNode modelNode, const char *target, float weight
 */
 DLL void h3dUpdateModel( H3DNode modelNode, int flags );
 
+/* Function: h3dUpdateModelBatch
+		Applies animation and/or geometry updates to several Model nodes.
+	
+	Details:
+		This function does the same as h3dUpdateModel for an array of models. The geometry updates of
+		the models are computed in parallel on the engine's worker threads, so this function should be
+		preferred when many morphed or software skinned models are updated per frame.
+		Handles that do not reference a Model node are skipped and set the error flag.
+	
+	Parameters:
+		count       - number of models to be updated
+		modelNodes  - array of Model node handles
+		flags       - combination of H3DModelUpdate flags
+		
+	Returns:
+		nothing
+*/
+DLL void h3dUpdateModelBatch( int count, const H3DNode *modelNodes, int flags );
+
 
 /* Group: Mesh-specific scene graph functions */
 /* Function: h3dAddMeshNode
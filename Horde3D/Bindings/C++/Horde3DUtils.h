@@ -46,6 +46,23 @@
 */
 const int H3DUTMaxStatMode = 2;
 
+/*	Enum: H3DUTLogFormats
+		The available formats for log files.
+		
+	HTML  - HTML page with a table of all messages, colored by log level
+	Text  - Plain text with one line per message, containing time, log level and text separated by tabs
+	JSON  - JSON Lines; every line is an object with the fields time, level and text
+*/
+struct H3DUTLogFormats
+{
+	enum List
+	{
+		HTML = 0,
+		Text,
+		JSON
+	};
+};
+
 
 /*	Group: General functions */
 /*	Function: h3dutFreeMem
@@ -62,12 +79,34 @@ const int H3DUTMaxStatMode = 2;
 */
 DLL void h3dutFreeMem( char **ptr );
 
+/*	Function: h3dutSetLogFile
+		Sets the file to which messages are written.
+	
+	Details:
+		This utility function closes the current log file and creates the specified one, which is used
+		by all subsequent calls of dumpMessages. If filename is NULL, the current log file is only closed;
+		this should be done before the Utility Library is unloaded, since the background thread that
+		writes the file can not be waited for while the library is detached.
+	
+	Parameters:
+		filename  - name of the log file or NULL to close the current file
+		format    - format of the log file (see H3DUTLogFormats); ignored if filename is NULL
+		
+	Returns:
+		true in case of success, otherwise false
+*/
+DLL bool h3dutSetLogFile( const char *filename, int format );
+
 /*	Function: h3dutDumpMessages
 		Writes all messages in the queue to a log file.
 	
 	Details:
-		This utility function pops all messages from the message queue and writes them to a HTML formated
-		log file 'Horde3D_Log.html'.
+		This utility function pops all messages from the message queue and writes them to the log file.
+		If no log file was set with setLogFile, the HTML formated file 'Horde3D_Log.html' is created.
+		
+		The messages are written by a background thread, so this function does not wait for disk I/O.
+		The log file is completed by setLogFile( NULL, 0 ) or, as far as possible, when the Utility
+		Library is unloaded.
 	
 	Parameters:
 		none
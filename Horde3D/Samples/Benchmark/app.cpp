@@ -0,0 +1,256 @@
+// *************************************************************************************************
+//
+// Horde3D
+//   Next-Generation Graphics Engine
+//
+// Sample Application
+// --------------------------------------
+// Copyright (C) 2006-2011 Nicolas Schulz
+//
+//
+// This sample source file is not covered by the EPL as the rest of the SDK
+// and may be used without any restrictions. However, the EPL's disclaimer of
+// warranty and liability shall be in effect for this file.
+//
+// *************************************************************************************************
+
+#include "app.h"
+#include "Horde3D.h"
+#include "Horde3DUtils.h"
+#include "glfw.h"
+#include <math.h>
+#include <cstdio>
+#include <fstream>
+
+using namespace std;
+
+
+Application::Application( const std::string &appPath )
+{
+	_contentDir = appPath + "../Content";
+	_defaultWorkers = 0;
+	_width = 0; _height = 0;
+	_randSeed = 1;
+}
+
+
+bool Application::init()
+{
+	// Initialize engine
+	if( !h3dInit() )
+	{
+		h3dutDumpMessages();
+		return false;
+	}
+
+	// Set options
+	h3dSetOption( H3DOptions::LoadTextures, 1 );
+	h3dSetOption( H3DOptions::TexCompression, 0 );
+	_defaultWorkers = (int)h3dGetOption( H3DOptions::WorkerThreads );
+
+	// Add the content of all samples; no scene nodes are created, so the resources can be
+	// unloaded and loaded again freely
+	h3dAddResource( H3DResTypes::Material, "overlays/font.material.xml", 0 );
+	h3dAddResource( H3DResTypes::Material, "overlays/panel.material.xml", 0 );
+	h3dAddResource( H3DResTypes::Material, "overlays/logo.material.xml", 0 );
+	h3dAddResource( H3DResTypes::SceneGraph, "models/knight/knight.scene.xml", 0 );
+	h3dAddResource( H3DResTypes::SceneGraph, "models/man/man.scene.xml", 0 );
+	h3dAddResource( H3DResTypes::SceneGraph, "models/platform/platform.scene.xml", 0 );
+	h3dAddResource( H3DResTypes::SceneGraph, "models/skybox/skybox.scene.xml", 0 );
+	h3dAddResource( H3DResTypes::SceneGraph, "models/sphere/sphere.scene.xml", 0 );
+	h3dAddResource( H3DResTypes::SceneGraph, "particles/particleSys1/particleSys1.scene.xml", 0 );
+	h3dAddResource( H3DResTypes::Animation, "animations/knight_order.anim", 0 );
+	h3dAddResource( H3DResTypes::Animation, "animations/knight_attack.anim", 0 );
+	h3dAddResource( H3DResTypes::Animation, "animations/man.anim", 0 );
+
+	// Load resources
+	bool result = h3dutLoadResourcesFromDisk( _contentDir.c_str() );
+	h3dutDumpMessages();
+
+	return result;
+}
+
+
+void Application::release()
+{
+	// Release engine
+	h3dRelease();
+
+	// Complete the log file while the writer thread can still be joined
+	h3dutSetLogFile( 0x0, 0 );
+}
+
+
+void Application::resize( int width, int height )
+{
+	_width = width;
+	_height = height;
+}
+
+
+void Application::benchmarkLoading( int runs )
+{
+	printf( "Loading the sample content %i times per resource type\n", runs );
+
+	// Decoding runs on the worker threads, so compare a serial load with the default setting
+	for( int i = 0; i < (_defaultWorkers > 0 ? 2 : 1); ++i )
+	{
+		int workers = i == 0 ? 0 : _defaultWorkers;
+		h3dSetOption( H3DOptions::WorkerThreads, (float)workers );
+		printf( "\n%i worker thread(s):\n", workers );
+
+		benchmarkResType( H3DResTypes::Geometry, "Geometry", runs );
+		benchmarkResType( H3DResTypes::Animation, "Animation", runs );
+		benchmarkResType( H3DResTypes::Texture, "Texture", runs );
+	}
+
+	h3dSetOption( H3DOptions::WorkerThreads, (float)_defaultWorkers );
+}
+
+
+void Application::benchmarkResType( int resType, const char *typeName, int runs )
+{
+	// Only resources that come from a file can be reloaded
+	vector< H3DRes > resources;
+	double fileBytes = 0, pixels = 0;
+
+	for( H3DRes res = h3dGetNextResource( resType, 0 ); res != 0; res = h3dGetNextResource( resType, res ) )
+	{
+		int size = getFileSize( resType, h3dGetResName( res ) );
+		if( size <= 0 || !h3dIsResLoaded( res ) ) continue;
+
+		resources.push_back( res );
+		fileBytes += size;
+
+		// Count all decoded faces and mipmaps of textures
+		if( resType == H3DResTypes::Texture )
+		{
+			for( int i = 0, s = h3dGetResElemCount( res, H3DTexRes::ImageElem ); i < s; ++i )
+			{
+				pixels += (double)h3dGetResParamI( res, H3DTexRes::ImageElem, i, H3DTexRes::ImgWidthI ) *
+				          h3dGetResParamI( res, H3DTexRes::ImageElem, i, H3DTexRes::ImgHeightI );
+			}
+		}
+	}
+
+	if( resources.empty() || runs <= 0 ) return;
+
+	// Time the whole loading step including file reading, as seen by an application
+	double time = 0;
+	for( int i = 0; i < runs; ++i )
+	{
+		for( size_t j = 0; j < resources.size(); ++j )
+			h3dUnloadResource( resources[j] );
+
+		double t0 = glfwGetTime();
+		h3dutLoadResourcesFromDisk( _contentDir.c_str() );
+		time += glfwGetTime() - t0;
+	}
+
+	double timePerLoad = time / runs;
+	printf( "  %-10s %3i files %6.2f MB  %8.3f ms/load  %8.1f MB/s", typeName, (int)resources.size(),
+	        fileBytes / (1024 * 1024), timePerLoad * 1000.0, fileBytes / (1024 * 1024) / timePerLoad );
+	if( pixels > 0 ) printf( "  %8.1f Mpix/s", pixels / 1000000 / timePerLoad );
+	printf( "\n" );
+}
+
+
+int Application::getFileSize( int resType, const char *name )
+{
+	string fileName = _contentDir + "/" + h3dutGetResourcePath( resType ) + "/" + name;
+	ifstream inf( fileName.c_str(), ios::binary );
+	if( !inf.good() ) return 0;
+
+	inf.seekg( 0, ios::end );
+	return (int)inf.tellg();
+}
+
+
+int Application::checkCulling( int frames )
+{
+	printf( "Comparing coherent culling with regular culling over %i frames\n", frames );
+	
+	H3DRes pipeRes = h3dAddResource( H3DResTypes::Pipeline, "pipelines/forward.pipeline.xml", 0 );
+	H3DRes modelRes[2];
+	modelRes[0] = h3dFindResource( H3DResTypes::SceneGraph, "models/man/man.scene.xml" );
+	modelRes[1] = h3dFindResource( H3DResTypes::SceneGraph, "models/sphere/sphere.scene.xml" );
+	h3dutLoadResourcesFromDisk( _contentDir.c_str() );
+	h3dResizePipelineBuffers( pipeRes, _width, _height );
+
+	// The first camera flies around, the second one only jumps from time to time, so that both
+	// small frustum changes and cache rebuilds are covered
+	H3DNode cams[2];
+	for( int i = 0; i < 2; ++i )
+	{
+		cams[i] = h3dAddCameraNode( H3DRootNode, i == 0 ? "Camera1" : "Camera2", pipeRes );
+		h3dSetNodeParamI( cams[i], H3DCamera::ViewportWidthI, _width );
+		h3dSetNodeParamI( cams[i], H3DCamera::ViewportHeightI, _height );
+		h3dSetupCameraView( cams[i], 45.0f, (float)_width / _height, 0.5f, 100.0f );
+	}
+	h3dSetNodeTransform( cams[1], 0, 5, 50, 0, 0, 0, 1, 1, 1 );
+
+	// Grid of models
+	vector< H3DNode > nodes;
+	for( int i = 0; i < 400; ++i )
+	{
+		H3DNode node = h3dAddNodes( H3DRootNode, modelRes[i % 2] );
+		h3dSetNodeTransform( node, (i % 20) * 4.0f - 40.0f, 0, (i / 20) * 4.0f - 40.0f, 0, 0, 0, 1, 1, 1 );
+		nodes.push_back( node );
+	}
+
+	h3dSetOption( H3DOptions::CoherentCullMargin, 2.0f );
+	h3dSetOption( H3DOptions::CheckCoherentCulling, 1 );
+	h3dGetStat( H3DStats::CullMismatches, true );
+
+	for( int i = 0; i < frames; ++i )
+	{
+		float t = i * 0.01f;
+		h3dSetNodeTransform( cams[0], sinf( t ) * 45.0f, 5, cosf( t ) * 45.0f, -5, t * 57.29578f, 0, 1, 1, 1 );
+		if( i % 97 == 0 )
+		{
+			h3dSetNodeTransform( cams[1], random( -40, 40 ), 5, random( -40, 40 ),
+			                     0, random( 0, 360 ), 0, 1, 1, 1 );
+		}
+
+		// Move some nodes by small and some by large distances
+		for( int j = 0; j < 20; ++j )
+		{
+			H3DNode node = nodes[(size_t)random( 0, (float)nodes.size() - 0.5f )];
+			const float *m;
+			h3dGetNodeTransMats( node, &m, 0x0 );
+			float dist = j < 15 ? 0.5f : 20.0f;
+			h3dSetNodeTransform( node, m[12] + random( -dist, dist ), 0, m[14] + random( -dist, dist ),
+			                     0, 0, 0, 1, 1, 1 );
+		}
+
+		// Replace a node
+		if( i % 5 == 0 )
+		{
+			size_t index = (size_t)random( 0, (float)nodes.size() - 0.5f );
+			h3dRemoveNode( nodes[index] );
+			nodes[index] = h3dAddNodes( H3DRootNode, modelRes[i % 2] );
+			h3dSetNodeTransform( nodes[index], random( -40, 40 ), 0, random( -40, 40 ), 0, 0, 0, 1, 1, 1 );
+		}
+
+		h3dRender( cams[0] );
+		h3dRender( cams[1] );
+		h3dFinalizeFrame();
+		h3dutDumpMessages();
+	}
+
+	int mismatches = (int)h3dGetStat( H3DStats::CullMismatches, true );
+	h3dSetOption( H3DOptions::CheckCoherentCulling, 0 );
+	h3dSetOption( H3DOptions::CoherentCullMargin, 0 );
+
+	printf( "  %i nodes, %i mismatches\n", (int)nodes.size(), mismatches );
+	
+	return mismatches;
+}
+
+
+float Application::random( float min, float max )
+{
+	// Fixed sequence so that runs are reproducible
+	_randSeed = _randSeed * 1103515245 + 12345;
+	return min + (max - min) * ((_randSeed >> 8) & 0xFFFF) / 65535.0f;
+}
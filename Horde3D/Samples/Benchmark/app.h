@@ -0,0 +1,51 @@
+// *************************************************************************************************
+//
+// Horde3D
+//   Next-Generation Graphics Engine
+//
+// Sample Application
+// --------------------------------------
+// Copyright (C) 2006-2011 Nicolas Schulz
+//
+//
+// This sample source file is not covered by the EPL as the rest of the SDK
+// and may be used without any restrictions. However, the EPL's disclaimer of
+// warranty and liability shall be in effect for this file.
+//
+// *************************************************************************************************
+
+#ifndef _app_H_
+#define _app_H_
+
+#include "Horde3D.h"
+#include <string>
+#include <vector>
+
+
+class Application
+{
+public:
+	Application( const std::string &appPath );
+
+	const char *getTitle() { return "Benchmark - Horde3D Sample"; }
+
+	bool init();
+	void release();
+	void resize( int width, int height );
+
+	void benchmarkLoading( int runs );
+	int checkCulling( int frames );
+
+private:
+	void benchmarkResType( int resType, const char *typeName, int runs );
+	int getFileSize( int resType, const char *name );
+	float random( float min, float max );
+
+private:
+	std::string        _contentDir;
+	int                _defaultWorkers;
+	int                _width, _height;
+	unsigned int       _randSeed;
+};
+
+#endif // _app_H_
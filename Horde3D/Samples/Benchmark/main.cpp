@@ -0,0 +1,106 @@
+// *************************************************************************************************
+//
+// Horde3D
+//   Next-Generation Graphics Engine
+//
+// Sample Application
+// --------------------------------------
+// Copyright (C) 2006-2011 Nicolas Schulz
+//
+//
+// This sample source file is not covered by the EPL as the rest of the SDK
+// and may be used without any restrictions. However, the EPL's disclaimer of
+// warranty and liability shall be in effect for this file.
+//
+// *************************************************************************************************
+
+#define _CRT_SECURE_NO_WARNINGS
+
+#include <iostream>
+#include <cstdlib>
+#include <cstring>
+#include <cstdio>
+#include "glfw.h"
+#include "app.h"
+
+// Configuration
+const int appWidth = 320;
+const int appHeight = 240;
+static int loadRuns = 20;
+static int cullFrames = 1000;
+
+
+std::string extractAppPath( char *fullPath )
+{
+#ifdef __APPLE__
+	std::string s( fullPath );
+	for( int i = 0; i < 4; ++i )
+		s = s.substr( 0, s.rfind( "/" ) );
+	return s + "/../";
+#else
+	const std::string s( fullPath );
+	if( s.find( "/" ) != std::string::npos )
+		return s.substr( 0, s.rfind( "/" ) ) + "/";
+	else if( s.find( "\\" ) != std::string::npos )
+		return s.substr( 0, s.rfind( "\\" ) ) + "\\";
+	else
+		return "";
+#endif
+}
+
+
+int main( int argc, char** argv )
+{
+	// Parse command line; a count can follow the mode switch, without a mode everything is run
+	bool load = true, cull = true;
+	if( argc > 1 && strcmp( argv[1], "-load" ) == 0 )
+	{
+		cull = false;
+		if( argc > 2 ) loadRuns = atoi( argv[2] );
+	}
+	else if( argc > 1 && strcmp( argv[1], "-cull" ) == 0 )
+	{
+		load = false;
+		if( argc > 2 ) cullFrames = atoi( argv[2] );
+	}
+	else if( argc > 1 )
+	{
+		std::cout << "Usage: Benchmark [-load [runs] | -cull [frames]]" << std::endl;
+		return -1;
+	}
+
+	// Initialize GLFW; the window is only needed for the OpenGL context
+	glfwInit();
+	if( !glfwOpenWindow( appWidth, appHeight, 8, 8, 8, 8, 24, 8, GLFW_WINDOW ) )
+	{
+		glfwTerminate();
+		return -1;
+	}
+
+	// Initialize application and engine
+	Application *app = new Application( extractAppPath( argv[0] ) );
+	glfwSetWindowTitle( app->getTitle() );
+
+	if( !app->init() )
+	{
+		std::cout << "Unable to initalize engine" << std::endl;
+		std::cout << "Make sure you have an OpenGL 2.0 compatible graphics card";
+		delete app;
+		glfwTerminate();
+		return -1;
+	}
+
+	app->resize( appWidth, appHeight );
+
+	int result = 0;
+	if( load ) app->benchmarkLoading( loadRuns );
+	if( load && cull ) std::cout << std::endl;
+	if( cull && app->checkCulling( cullFrames ) != 0 ) result = 1;
+
+	// Quit
+	app->release();
+	delete app;
+	glfwTerminate();
+
+	return result;
+}
@@ -19,6 +19,7 @@
 #include "Horde3DUtils.h"
 #include <math.h>
 #include <iomanip>
+#include <sstream>
 
 using namespace std;
 
@@ -42,7 +43,13 @@ Application::Application( const std::string &appPath )
 
 	_statMode = 0;
 	_freezeMode = 0; _debugViewMode = false; _wireframeMode = false;
+	_viewMode = 0;
+	_width = 0; _height = 0;
+	_cullTime = 0; _cullTimeSum = 0; _cullFrames = 0;
 	_cam = 0;
+	for( unsigned int i = 0; i < 4; ++i ) _viewCams[i] = 0;
+	_crowdSim = 0x0;
+	_numCharacters = 100;
 
 	_contentDir = appPath + "../Content";
 }
@@ -86,6 +93,13 @@ bool Application::init()
 	// Add camera
 	_cam = h3dAddCameraNode( H3DRootNode, "Camera", _forwardPipeRes );
 	//h3dSetNodeParamI( _cam, H3DCamera::OccCullingI, 1 );
+	// Add fixed cameras for the split-screen mode
+	_viewCams[0] = _cam;
+	for( unsigned int i = 1; i < 4; ++i )
+		_viewCams[i] = h3dAddCameraNode( H3DRootNode, "ViewCamera", _forwardPipeRes );
+	h3dSetNodeTransform( _viewCams[1], -15, 3, 20, -10, -60, 0, 1, 1, 1 );
+	h3dSetNodeTransform( _viewCams[2], 0, 40, 40, -45, 0, 0, 1, 1, 1 );
+	h3dSetNodeTransform( _viewCams[3], 0, 3, -25, -10, 180, 0, 1, 1, 1 );
 	// Add environment
 	H3DNode env = h3dAddNodes( H3DRootNode, envRes );
 	h3dSetNodeTransform( env, 0, 0, 0, 0, 0, 0, 0.23f, 0.23f, 0.23f );
@@ -105,7 +119,7 @@ bool Application::init()
 	h3dSetNodeParamF( light, H3DLight::ColorF3, 1, 0.7f );
 	h3dSetNodeParamF( light, H3DLight::ColorF3, 2, 0.75f );
 
-	_crowdSim = new CrowdSim( _contentDir );
+	_crowdSim = new CrowdSim( _contentDir, _numCharacters );
 	_crowdSim->init();
 
 	return true;
@@ -135,6 +149,28 @@ void Application::mainLoop( float fps )
 			h3dutShowText( "Pipeline: forward", 0.03f, 0.24f, 0.026f, 1, 1, 1, _fontMatRes );
 		else
 			h3dutShowText( "Pipeline: deferred", 0.03f, 0.24f, 0.026f, 1, 1, 1, _fontMatRes );
+
+		// Show time spent on crowd simulation and on passing the crowd state to the engine
+		stringstream text;
+		text << fixed << setprecision( 3 ) << "Crowd simulation (" << _crowdSim->getNumCharacters() << " characters, "
+		     << (_crowdSim->getGridQueries() ? "grid queries" : "brute force") << "): "
+		     << _crowdSim->getSimTime() << " ms";
+		h3dutShowText( text.str().c_str(), 0.03f, 0.28f, 0.026f, 1, 1, 1, _fontMatRes );
+		
+		text.str( "" );
+		text << "Crowd node updates (" << (_crowdSim->getBatchUpdate() ? "batched" : "per node") << "): "
+		     << _crowdSim->getSceneUpdateTime() << " ms";
+		h3dutShowText( text.str().c_str(), 0.03f, 0.32f, 0.026f, 1, 1, 1, _fontMatRes );
+
+		text.str( "" );
+		text << "Animation update-rate LOD: " << (_crowdSim->getAnimLod() ? "on" : "off");
+		h3dutShowText( text.str().c_str(), 0.03f, 0.36f, 0.026f, 1, 1, 1, _fontMatRes );
+
+		// Compare the culling time of separate render calls with the one of h3dRenderViews
+		static const char *viewModes[3] = { "single view", "4 views, h3dRender", "4 views, h3dRenderViews" };
+		text.str( "" );
+		text << "Views (" << viewModes[_viewMode] << "): culling " << _cullTime << " ms";
+		h3dutShowText( text.str().c_str(), 0.03f, 0.40f, 0.026f, 1, 1, 1, _fontMatRes );
 	}
 
 	// Show logo
@@ -144,7 +180,26 @@ void Application::mainLoop( float fps )
 	h3dShowOverlays( ovLogo, 4, 1.f, 1.f, 1.f, 1.f, _logoMatRes, 0 );
 	
 	// Render scene
-	h3dRender( _cam );
+	h3dGetStat( H3DStats::CullingTime, true );
+	if( _viewMode == 0 )
+	{
+		h3dRender( _cam );
+	}
+	else if( _viewMode == 1 )
+	{
+		for( unsigned int i = 0; i < 4; ++i ) h3dRender( _viewCams[i] );
+	}
+	else
+	{
+		h3dRenderViews( _viewCams, 4 );
+	}
+	
+	_cullTimeSum += h3dGetStat( H3DStats::CullingTime, true );
+	if( ++_cullFrames == 30 )
+	{
+		_cullTime = _cullTimeSum / _cullFrames;
+		_cullTimeSum = 0; _cullFrames = 0;
+	}
 
 	// Finish rendering of frame
 	h3dFinalizeFrame();
@@ -163,24 +218,46 @@ void Application::release()
 	
 	// Release engine
 	h3dRelease();
+
+	// Complete the log file while the writer thread can still be joined
+	h3dutSetLogFile( 0x0, 0 );
 }
 
 
 void Application::resize( int width, int height )
 {
-	// Resize viewport
-	h3dSetNodeParamI( _cam, H3DCamera::ViewportXI, 0 );
-	h3dSetNodeParamI( _cam, H3DCamera::ViewportYI, 0 );
-	h3dSetNodeParamI( _cam, H3DCamera::ViewportWidthI, width );
-	h3dSetNodeParamI( _cam, H3DCamera::ViewportHeightI, height );
+	_width = width;
+	_height = height;
 	
-	// Set virtual camera parameters
-	h3dSetupCameraView( _cam, 45.0f, (float)width / height, 0.1f, 1000.0f );
+	setupViews();
 	h3dResizePipelineBuffers( _deferredPipeRes, width, height );
 	h3dResizePipelineBuffers( _forwardPipeRes, width, height );
 }
 
 
+void Application::setupViews()
+{
+	// Resize viewports, in split-screen mode each camera gets a quarter of the window
+	for( unsigned int i = 0; i < 4; ++i )
+	{
+		int x = 0, y = 0, width = _width, height = _height;
+		if( _viewMode != 0 )
+		{
+			width = _width / 2; height = _height / 2;
+			x = (i % 2) * width; y = (1 - i / 2) * height;
+		}
+		
+		h3dSetNodeParamI( _viewCams[i], H3DCamera::ViewportXI, x );
+		h3dSetNodeParamI( _viewCams[i], H3DCamera::ViewportYI, y );
+		h3dSetNodeParamI( _viewCams[i], H3DCamera::ViewportWidthI, width );
+		h3dSetNodeParamI( _viewCams[i], H3DCamera::ViewportHeightI, height );
+		
+		// Set virtual camera parameters
+		h3dSetupCameraView( _viewCams[i], 45.0f, (float)width / height, 0.1f, 1000.0f );
+	}
+}
+
+
 void Application::keyStateHandler()
 {
 	// ----------------
@@ -199,6 +276,21 @@ void Application::keyStateHandler()
 			h3dSetNodeParamI( _cam, H3DCamera::PipeResI, _forwardPipeRes );
 	}
 	
+	if( _keys[261] && !_prevKeys[261] )  // F4
+		_crowdSim->setBatchUpdate( !_crowdSim->getBatchUpdate() );
+
+	if( _keys[262] && !_prevKeys[262] )  // F5
+		_crowdSim->setGridQueries( !_crowdSim->getGridQueries() );
+
+	if( _keys[266] && !_prevKeys[266] )  // F9
+		_crowdSim->setAnimLod( !_crowdSim->getAnimLod() );
+
+	if( _keys[267] && !_prevKeys[267] )  // F10
+	{
+		if( ++_viewMode == 3 ) _viewMode = 0;
+		setupViews();
+	}
+	
 	if( _keys[264] && !_prevKeys[264] )  // F7
 		_debugViewMode = !_debugViewMode;
 
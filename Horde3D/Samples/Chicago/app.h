@@ -28,6 +28,8 @@ public:
 	
 	void setKeyState( int key, bool state ) { _prevKeys[key] = _keys[key]; _keys[key] = state; }
 
+	void setNumCharacters( unsigned int numCharacters ) { _numCharacters = numCharacters; }
+
 	const char *getTitle() { return "Chicago - Horde3D Sample"; }
 	
 	bool init();
@@ -40,6 +42,7 @@ public:
 
 private:
 	void keyHandler();
+	void setupViews();
 
 private:
 	bool         _keys[320], _prevKeys[320];
@@ -51,13 +54,19 @@ private:
 	int          _statMode;
 	int          _freezeMode;
 	bool         _debugViewMode, _wireframeMode;
+	int          _viewMode;  // 0: single view, 1: four views with h3dRender, 2: four views with h3dRenderViews
+	int          _width, _height;
+	float        _cullTime, _cullTimeSum;  // Culling time per frame, averaged over _cullFrames frames
+	int          _cullFrames;
 	
 	CrowdSim     *_crowdSim;
+	unsigned int _numCharacters;
 	
 	// Engine objects
 	H3DRes       _fontMatRes, _panelMatRes;
 	H3DRes       _logoMatRes, _forwardPipeRes, _deferredPipeRes;
 	H3DNode      _cam;
+	H3DNode      _viewCams[4];  // The first one is _cam
 
 	std::string  _contentDir;
 };
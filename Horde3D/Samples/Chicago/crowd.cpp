@@ -19,19 +19,57 @@
 #include <stdlib.h>
 #include <time.h>
 #include "Horde3DUtils.h"
+#include "glfw.h"
+
+
+// Parameters for three repulsion zones
+static const float d1 = 0.25f, d2 = 2.0f, d3 = 4.5f;
+static const float f1 = 3.0f, f2 = 1.0f, f3 = 0.1f;
 
 
 void CrowdSim::chooseDestination( Particle &p )
 {
 	// Choose random destination within a circle
 	float ang = ((rand() % 360) / 360.0f) * 6.28f;
-	float rad = (rand() % 20) * 1.0f;
+	float rad = (rand() % 20) * _areaScale;
 
 	p.dx = sinf( ang ) * rad;
 	p.dz = cosf( ang ) * rad;
 }
 
 
+void CrowdSim::addRepulsionForce( Particle &p, const Particle &p2 )
+{
+	float dist2 = sqrtf( (p.px - p2.px)*(p.px - p2.px) + (p.pz - p2.pz)*(p.pz - p2.pz) );
+	float strength = 0;
+
+	float rfx = (p.px - p2.px) / dist2;
+	float rfz = (p.pz - p2.pz) / dist2;
+	
+	// Use three zones with different repulsion strengths
+	if( dist2 <= d3 && dist2 > d2 )
+	{
+		float m = (f3 - 0) / (d2 - d3);
+		float t = 0 - m * d3;
+		strength = m * dist2 + t;
+	}
+	else if( dist2 <= d2 && dist2 > d1 )
+	{
+		float m = (f2 - f3) / (d1 - d2);
+		float t = f3 - m * d2;
+		strength = m * dist2 + t;
+	}
+	else if( dist2 <= d1 )
+	{
+		float m = (f1 - f2) / (0 - d1);
+		float t = f2 - m * d1;
+		strength = m * dist2 + t;
+	}
+
+	p.fx += rfx * strength; p.fz += rfz * strength;
+}
+
+
 void CrowdSim::init()
 {
 	// Init random generator
@@ -43,8 +81,11 @@ void CrowdSim::init()
 	H3DRes characterWalkRes = h3dAddResource( H3DResTypes::Animation, "animations/man.anim", 0 );
 	h3dutLoadResourcesFromDisk( _contentDir.c_str() );
 	
+	// Keep density of crowd constant
+	_areaScale = sqrtf( _numCharacters / 100.0f );
+	
 	// Add characters
-	for( unsigned int i = 0; i < 100; ++i )
+	for( unsigned int i = 0; i < _numCharacters; ++i )
 	{
 		Particle p;
 		
@@ -53,23 +94,51 @@ void CrowdSim::init()
 		h3dSetupModelAnimStage( p.node, 0, characterWalkRes, 0, "", false );
 		
 		// Characters start in a circle formation
-		p.px = sinf( (i / 100.0f) * 6.28f ) * 10.0f;
-		p.pz = cosf( (i / 100.0f) * 6.28f ) * 10.0f;
+		p.px = sinf( ((float)i / _numCharacters) * 6.28f ) * 10.0f * _areaScale;
+		p.pz = cosf( ((float)i / _numCharacters) * 6.28f ) * 10.0f * _areaScale;
 
 		chooseDestination( p );
 
 		h3dSetNodeTransform( p.node, p.px, 0.02f, p.pz, 0, 0, 0, 1, 1, 1 );
 
+		if( (unsigned int)p.node >= _nodeToParticle.size() ) _nodeToParticle.resize( p.node + 1, -1 );
+		_nodeToParticle[p.node] = (int)_particles.size();
+
 		_particles.push_back( p );
+		_nodes.push_back( p.node );
+	}
+
+	_positions.resize( _particles.size() * 3 );
+	_rotations.resize( _particles.size() * 4 );
+	_animTimes.resize( _particles.size() );
+
+	// Cell size of the engine's query grid should match the neighbourhood radius
+	h3dSetOption( H3DOptions::QueryGridCellSize, d3 );
+
+	setAnimLod( _animLod );
+}
+
+
+void CrowdSim::setAnimLod( bool animLod )
+{
+	_animLod = animLod;
+
+	// Characters in the distance and outside of the view are animated only every few frames,
+	// the engine spreads the updates of the characters over the frames
+	for( unsigned int i = 0; i < _nodes.size(); ++i )
+	{
+		h3dSetNodeParamI( _nodes[i], H3DModel::AnimLodInterval1I, animLod ? 2 : 1 );
+		h3dSetNodeParamI( _nodes[i], H3DModel::AnimLodInterval2I, animLod ? 3 : 1 );
+		h3dSetNodeParamI( _nodes[i], H3DModel::AnimLodInterval3I, animLod ? 4 : 1 );
+		h3dSetNodeParamI( _nodes[i], H3DModel::AnimLodInterval4I, animLod ? 4 : 1 );
+		h3dSetNodeParamI( _nodes[i], H3DModel::AnimOffscreenIntervalI, animLod ? 8 : 1 );
 	}
 }
 
 
 void CrowdSim::update( float fps )
 {
-	// Parameters for three repulsion zones
-	float d1 = 0.25f, d2 = 2.0f, d3 = 4.5f;
-	float f1 = 3.0f, f2 = 1.0f, f3 = 0.1f;
+	double t0 = glfwGetTime();
 	
 	for( unsigned int i = 0; i < _particles.size(); ++i )
 	{
@@ -91,39 +160,30 @@ void CrowdSim::update( float fps )
 			p.fx += afx * 0.035f; p.fz += afz * 0.035f;
 
 			// Repulsion forces from other particles
-			for( unsigned int j = 0; j < _particles.size(); ++j )
+			if( _gridQueries )
 			{
-				if( j == i ) continue;
-				
-				Particle &p2 = _particles[j];
-				
-				float dist2 = sqrtf( (p.px - p2.px)*(p.px - p2.px) + (p.pz - p2.pz)*(p.pz - p2.pz) );
-				float strength = 0;
-
-				float rfx = (p.px - p2.px) / dist2;
-				float rfz = (p.pz - p2.pz) / dist2;
+				// Node positions in the engine are from the last frame, so use a small safety margin
+				int numNeighbours = h3dQueryNodesInSphere( p.px, 0.02f, p.pz, d3 + 0.5f, H3DNodeTypes::Model );
 				
-				// Use three zones with different repulsion strengths
-				if( dist2 <= d3 && dist2 > d2 )
+				for( int k = 0; k < numNeighbours; ++k )
 				{
-					float m = (f3 - 0) / (d2 - d3);
-					float t = 0 - m * d3;
-					strength = m * dist2 + t;
-				}
-				else if( dist2 <= d2 && dist2 > d1 )
-				{
-					float m = (f2 - f3) / (d1 - d2);
-					float t = f3 - m * d2;
-					strength = m * dist2 + t;
+					H3DNode node = h3dGetNodeFindResult( k );
+					if( (unsigned int)node >= _nodeToParticle.size() ) continue;
+					
+					int j = _nodeToParticle[node];
+					if( j < 0 || j == (int)i ) continue;
+
+					addRepulsionForce( p, _particles[j] );
 				}
-				else if( dist2 <= d1 )
+			}
+			else
+			{
+				for( unsigned int j = 0; j < _particles.size(); ++j )
 				{
-					float m = (f1 - f2) / (0 - d1);
-					float t = f2 - m * d1;
-					strength = m * dist2 + t;
+					if( j == i ) continue;
+					
+					addRepulsionForce( p, _particles[j] );
 				}
-
-				p.fx += rfx * strength; p.fz += rfz * strength;
 			}
 		}
 		else
@@ -147,14 +207,48 @@ void CrowdSim::update( float fps )
 		// Get rotation from orientation
 		float ry = 0;
 		if( p.oz != 0 ) ry = atan2( p.ox, p.oz );
-		ry *= 180 / 3.1415f;	// Convert from radians to degrees
 		
-		// Update character scene node position
-		h3dSetNodeTransform( p.node, p.px, 0.02f, p.pz, 0, ry, 0, 1, 1, 1 );
+		// Store new character position, orientation (as quaternion around y axis) and animation time
+		_positions[i * 3 + 0] = p.px; _positions[i * 3 + 1] = 0.02f; _positions[i * 3 + 2] = p.pz;
+		_rotations[i * 4 + 0] = 0; _rotations[i * 4 + 1] = sinf( ry * 0.5f );
+		_rotations[i * 4 + 2] = 0; _rotations[i * 4 + 3] = cosf( ry * 0.5f );
 		
-		// Update animation
 		p.animTime += vel * 35.0f;
-		h3dSetModelAnimParams( p.node, 0, p.animTime, 1.0f );
-		h3dUpdateModel( p.node, H3DModelUpdateFlags::Animation | H3DModelUpdateFlags::Geometry );
+		_animTimes[i] = p.animTime;
+	}
+
+	_simTime = (float)((glfwGetTime() - t0) * 1000.0);
+
+	// Update character scene nodes, either with a single batched call or with one call per
+	// character for comparing the throughput of both paths
+	t0 = glfwGetTime();
+	
+	if( _batchUpdate && !_nodes.empty() )
+	{
+		h3dSetNodeTransformBatch( (int)_nodes.size(), &_nodes[0], &_positions[0], &_rotations[0], 0x0 );
+		h3dSetModelAnimParamsBatch( (int)_nodes.size(), &_nodes[0], 0, &_animTimes[0], 0x0 );
+	}
+	else
+	{
+		for( unsigned int i = 0; i < _nodes.size(); ++i )
+		{
+			float ry = atan2( _rotations[i * 4 + 1], _rotations[i * 4 + 3] ) * 2 * 180 / 3.1415f;
+			h3dSetNodeTransform( _nodes[i], _positions[i * 3], _positions[i * 3 + 1], _positions[i * 3 + 2],
+			                     0, ry, 0, 1, 1, 1 );
+			h3dSetModelAnimParams( _nodes[i], 0, _animTimes[i], 1.0f );
+		}
+	}
+
+	_sceneUpdateTime = (float)((glfwGetTime() - t0) * 1000.0);
+
+	if( _batchUpdate && !_nodes.empty() )
+	{
+		h3dUpdateModelBatch( (int)_nodes.size(), &_nodes[0],
+		                     H3DModelUpdateFlags::Animation | H3DModelUpdateFlags::Geometry );
+	}
+	else
+	{
+		for( unsigned int i = 0; i < _nodes.size(); ++i )
+			h3dUpdateModel( _nodes[i], H3DModelUpdateFlags::Animation | H3DModelUpdateFlags::Geometry );
 	}
 }
@@ -44,17 +44,42 @@ struct Particle
 class CrowdSim
 {
 public:
-	CrowdSim( const std::string& contentDir ) : _contentDir( contentDir ) {}
+	CrowdSim( const std::string& contentDir, unsigned int numCharacters = 100 ) :
+		_contentDir( contentDir ), _numCharacters( numCharacters ), _areaScale( 1 ),
+		_batchUpdate( true ), _gridQueries( true ), _animLod( true ), _sceneUpdateTime( 0 ), _simTime( 0 ) {}
 
 	void init();
 	void update( float fps );
 
+	bool getBatchUpdate() { return _batchUpdate; }
+	void setBatchUpdate( bool batchUpdate ) { _batchUpdate = batchUpdate; }
+	float getSceneUpdateTime() { return _sceneUpdateTime; }
+	bool getGridQueries() { return _gridQueries; }
+	void setGridQueries( bool gridQueries ) { _gridQueries = gridQueries; }
+	bool getAnimLod() { return _animLod; }
+	void setAnimLod( bool animLod );
+	float getSimTime() { return _simTime; }
+	unsigned int getNumCharacters() { return _numCharacters; }
+
 private:
 	void chooseDestination( Particle &p );
+	void addRepulsionForce( Particle &p, const Particle &p2 );
 
 private:
 	std::string              _contentDir;
 	std::vector< Particle >  _particles;
+	std::vector< int >       _nodeToParticle;  // Maps node handles to particle indices
+	unsigned int             _numCharacters;
+	float                    _areaScale;  // Scale of walking area, grows with number of characters
+
+	// Per-frame data passed to the engine in batches
+	std::vector< H3DNode >   _nodes;
+	std::vector< float >     _positions, _rotations, _animTimes;
+	bool                     _batchUpdate;
+	bool                     _gridQueries;  // Use engine neighbourhood queries instead of brute force search
+	bool                     _animLod;  // Animate distant and invisible characters at a lower rate
+	float                    _sceneUpdateTime;  // Time in ms spent on passing node updates to the engine
+	float                    _simTime;  // Time in ms spent on the simulation step
 };
 
 #endif // _crowd_H_
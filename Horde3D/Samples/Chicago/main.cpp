@@ -165,14 +165,24 @@ int main( int argc, char** argv )
 
 	// Check if benchmark mode is requested
 	bool benchmark = false;
-	if( argc > 1 && strcmp( argv[1], "-bm" ) == 0 )
-	{	
-		benchmark = true;
-		glfwDisable( GLFW_AUTO_POLL_EVENTS );
+	unsigned int numCharacters = 100;
+	for( int i = 1; i < argc; ++i )
+	{
+		if( strcmp( argv[i], "-bm" ) == 0 )
+		{	
+			benchmark = true;
+			glfwDisable( GLFW_AUTO_POLL_EVENTS );
+		}
+		else if( strcmp( argv[i], "-crowd" ) == 0 && i + 1 < argc )
+		{
+			// Number of characters, e.g. for timing the crowd simulation with large crowds
+			numCharacters = (unsigned int)atoi( argv[++i] );
+		}
 	}
 	
 	// Initialize application and engine
 	app = new Application( extractAppPath( argv[0] ) );
+	app->setNumCharacters( numCharacters );
 	if( !fullScreen ) glfwSetWindowTitle( app->getTitle() );
 	
 	if ( !app->init() )
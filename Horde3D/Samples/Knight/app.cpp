@@ -184,6 +184,9 @@ void Application::release()
 {
 	// Release engine
 	h3dRelease();
+
+	// Complete the log file while the writer thread can still be joined
+	h3dutSetLogFile( 0x0, 0 );
 }
 
 
@@ -890,8 +890,9 @@ bool Converter::writeGeometry( const string &assetPath, const string &assetName
 	fwrite( &count, sizeof( int ), 1, f );
 
 	// Write default identity matrix
+	Matrix4f identity;
 	for( unsigned int j = 0; j < 16; ++j )
-		fwrite( &Matrix4f().x[j], sizeof( float ), 1, f );
+		fwrite( &identity.x[j], sizeof( float ), 1, f );
 
 	for( unsigned int i = 0; i < _joints.size(); ++i )
 	{
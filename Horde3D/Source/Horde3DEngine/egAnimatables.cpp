@@ -31,7 +31,7 @@ MeshNode::MeshNode( const MeshNodeTpl &meshTpl ) :
 	SceneNode( meshTpl ),
 	_materialRes( meshTpl.matRes ), _batchStart( meshTpl.batchStart ), _batchCount( meshTpl.batchCount ),
 	_vertRStart( meshTpl.vertRStart ), _vertREnd( meshTpl.vertREnd ), _lodLevel( meshTpl.lodLevel ),
-	_parentModel( 0x0 )
+	_parentModel( 0x0 ), _normalMatDirty( true )
 {
 	_renderable = true;
 	
@@ -43,11 +43,6 @@ MeshNode::MeshNode( const MeshNodeTpl &meshTpl ) :
 MeshNode::~MeshNode()
 {
 	_materialRes = 0x0;
-	for( uint32 i = 0; i < _occQueries.size(); ++i )
-	{
-		if( _occQueries[i] != 0 )
-			gRDI->destroyQuery( _occQueries[i] );
-	}
 }
 
 
@@ -242,6 +237,24 @@ void MeshNode::onPostUpdate()
 {
 	_bBox = _localBBox;
 	_bBox.transform( _absTrans );
+
+	_normalMatDirty = true;
+}
+
+
+const float *MeshNode::getNormalMat()
+{
+	if( _normalMatDirty )
+	{
+		Matrix4f normalMat4 = _absTrans.inverted().transposed();
+		
+		_normalMat[0] = normalMat4.x[0]; _normalMat[1] = normalMat4.x[1]; _normalMat[2] = normalMat4.x[2];
+		_normalMat[3] = normalMat4.x[4]; _normalMat[4] = normalMat4.x[5]; _normalMat[5] = normalMat4.x[6];
+		_normalMat[6] = normalMat4.x[8]; _normalMat[7] = normalMat4.x[9]; _normalMat[8] = normalMat4.x[10];
+		_normalMatDirty = false;
+	}
+
+	return _normalMat;
 }
 
 
@@ -88,6 +88,7 @@ public:
 	uint32 getVertREnd() { return _vertREnd; }
 	uint32 getLodLevel() { return _lodLevel; }
 	ModelNode *getParentModel() { return _parentModel; }
+	const float *getNormalMat();
 
 protected:
 	MeshNode( const MeshNodeTpl &meshTpl );
@@ -101,9 +102,8 @@ protected:
 	
 	ModelNode           *_parentModel;
 	BoundingBox         _localBBox;
-
-	std::vector< uint32 >  _occQueries;
-	std::vector< uint32 >  _lastVisited;
+	float               _normalMat[9];  // Upper 3x3 of inverse transpose of _absTrans
+	bool                _normalMatDirty;
 
 	friend class SceneManager;
 	friend class SceneNode;
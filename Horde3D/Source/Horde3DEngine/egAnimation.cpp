@@ -13,7 +13,9 @@
 #include "egAnimation.h"
 #include "egModules.h"
 #include "egCom.h"
+#include "utThreads.h"
 #include <cstring>
+#include <cmath>
 #include <algorithm>
 
 #include "utDebug.h"
@@ -59,6 +61,9 @@ void AnimationResource::initDefault()
 
 void AnimationResource::release()
 {
+	// Cached poses and layouts reference the entities
+	if( !_entities.empty() ) AnimationController::getPoseCache().clear();
+	
 	_entities.clear();
 }
 
@@ -81,40 +86,121 @@ struct AnimEntCompFunc  // Functor for std::sort (can't be nested directly in fu
 		{ return a.nameId < b.nameId; }
 };
 
-bool AnimationResource::load( const char *data, int size )
+
+struct DecodedAnimation
+{
+	std::vector< AnimResEntity >  entities;
+	uint32                        numFrames;
+	std::string                   error;  // Empty if decoding succeeded
+
+	DecodedAnimation() : numFrames( 0 ) {}
+};
+
+
+struct AnimDecodeJob
 {
-	if( !Resource::load( data, size ) ) return false;
+	DecodedAnimation             *anim;
+	std::vector< const char * >  frameData;  // Frames of each entity in file
+	std::vector< uint32 >        frameCounts;
+};
+
+
+static void decodeAnimEntityJob( void *userData, uint32 jobIndex )
+{
+	AnimDecodeJob &job = *(AnimDecodeJob *)userData;
+	AnimResEntity &entity = job.anim->entities[jobIndex];
+	const char *pData = job.frameData[jobIndex];
+	
+	entity.frames.resize( job.frameCounts[jobIndex] );
+	for( uint32 i = 0; i < job.frameCounts[jobIndex]; ++i )
+	{
+		Frame &frame = entity.frames[i];
+
+		memcpy( &frame.rotQuat.x, pData, 4 * sizeof( float ) ); pData += 4 * sizeof( float );
+		memcpy( &frame.transVec.x, pData, 3 * sizeof( float ) ); pData += 3 * sizeof( float );
+		memcpy( &frame.scaleVec.x, pData, 3 * sizeof( float ) ); pData += 3 * sizeof( float );
 
+		// Prebake transformation matrix for fast animation path; this is the same as scaling,
+		// rotating and translating an identity matrix without the full matrix products
+		Matrix4f &m = frame.bakedTransMat;
+		m = Matrix4f( frame.rotQuat );
+		for( uint32 j = 0; j < 3; ++j )
+		{
+			m.c[0][j] *= frame.scaleVec.x;
+			m.c[1][j] *= frame.scaleVec.y;
+			m.c[2][j] *= frame.scaleVec.z;
+		}
+		m.c[3][0] = frame.transVec.x;
+		m.c[3][1] = frame.transVec.y;
+		m.c[3][2] = frame.transVec.z;
+	}
+
+	if( !entity.frames.empty() )
+		entity.firstFrameInvTrans = entity.frames[0].bakedTransMat.inverted();
+}
+
+
+static void decodeAnimation( const char *data, int size, DecodedAnimation &anim, bool parallel )
+{
+	// Note: Batch loads call this on worker threads, so the job manager is the only engine module used
+	static const uint32 frameSize = 10 * sizeof( float );
+	
 	// Make sure header is available
-	if( size < 8 )
-		return raiseError( "Invalid animation resource" );
+	if( data == 0x0 || size < 16 )
+	{
+		anim.error = "Invalid animation resource";
+		return;
+	}
 	
-	char *pData = (char *)data;
+	const char *pData = data, *dataEnd = data + size;
 	
 	// Check header and version
-	char id[4];
-	memcpy( &id, pData, 4 ); pData += 4;
-	if( id[0] != 'H' || id[1] != '3' || id[2] != 'D' || id[3] != 'A' )
-		return raiseError( "Invalid animation resource" );
+	if( pData[0] != 'H' || pData[1] != '3' || pData[2] != 'D' || pData[3] != 'A' )
+	{
+		anim.error = "Invalid animation resource";
+		return;
+	}
+	pData += 4;
 	
 	uint32 version;
 	memcpy( &version, pData, sizeof( uint32 ) ); pData += sizeof( uint32 );
 	if( version != 2 && version != 3 )
-		return raiseError( "Unsupported version of animation resource" );
+	{
+		anim.error = "Unsupported version of animation resource";
+		return;
+	}
 	
-	// Load animation data
+	// Find animation data of all entities, the frames are decoded afterwards
 	uint32 numEntities;
 	memcpy( &numEntities, pData, sizeof( uint32 ) ); pData += sizeof( uint32 );
-	memcpy( &_numFrames, pData, sizeof( uint32 ) ); pData += sizeof( uint32 );
+	memcpy( &anim.numFrames, pData, sizeof( uint32 ) ); pData += sizeof( uint32 );
+
+	uint32 headerSize = version == 3 ? 257 : 256;
+	if( (uint64)numEntities * headerSize > (uint64)(dataEnd - pData) )
+	{
+		anim.error = "Invalid animation resource";
+		return;
+	}
 
-	_entities.resize( numEntities );
+	AnimDecodeJob job;
+	job.anim = &anim;
+	job.frameData.resize( numEntities );
+	job.frameCounts.resize( numEntities );
+	anim.entities.resize( numEntities );
 
 	for( uint32 i = 0; i < numEntities; ++i )
 	{
 		char name[256], compressed = 0;
-		AnimResEntity &entity = _entities[i];
+		AnimResEntity &entity = anim.entities[i];
+		
+		if( (uint64)(dataEnd - pData) < headerSize )
+		{
+			anim.error = "Invalid animation resource";
+			return;
+		}
 		
 		memcpy( name, pData, 256 ); pData += 256;
+		name[255] = '\0';
 		entity.nameId = AnimationController::hashName( name );
 		
 		// Animation compression
@@ -123,36 +209,72 @@ bool AnimationResource::load( const char *data, int size )
 			memcpy( &compressed, pData, sizeof( char ) ); pData += sizeof( char ); 
 		}
 
-		entity.frames.resize( compressed ? 1 : _numFrames );
-		for( uint32 j = 0; j < (compressed ? 1 : _numFrames); ++j )
+		uint32 numFrames = compressed ? 1 : anim.numFrames;
+		if( (uint64)numFrames * frameSize > (uint64)(dataEnd - pData) )
 		{
-			Frame &frame = entity.frames[j];
+			anim.error = "Invalid animation resource";
+			return;
+		}
+		
+		job.frameData[i] = pData;
+		job.frameCounts[i] = numFrames;
+		pData += numFrames * frameSize;
+	}
+
+	// Entities are independent, so each one is decoded by a separate job
+	if( parallel )
+		Modules::jobMan().run( decodeAnimEntityJob, &job, numEntities );
+	else
+		for( uint32 i = 0; i < numEntities; ++i ) decodeAnimEntityJob( &job, i );
 
-			memcpy( &frame.rotQuat.x, pData, sizeof( float ) ); pData += sizeof( float );
-			memcpy( &frame.rotQuat.y, pData, sizeof( float ) ); pData += sizeof( float );
-			memcpy( &frame.rotQuat.z, pData, sizeof( float ) ); pData += sizeof( float );
-			memcpy( &frame.rotQuat.w, pData, sizeof( float ) ); pData += sizeof( float );
+	// Sort entities by name id
+	std::sort( anim.entities.begin(), anim.entities.end(), AnimEntCompFunc() );
+}
 
-			memcpy( &frame.transVec.x, pData, sizeof( float ) ); pData += sizeof( float );
-			memcpy( &frame.transVec.y, pData, sizeof( float ) ); pData += sizeof( float );
-			memcpy( &frame.transVec.z, pData, sizeof( float ) ); pData += sizeof( float );
 
-			memcpy( &frame.scaleVec.x, pData, sizeof( float ) ); pData += sizeof( float );
-			memcpy( &frame.scaleVec.y, pData, sizeof( float ) ); pData += sizeof( float );
-			memcpy( &frame.scaleVec.z, pData, sizeof( float ) ); pData += sizeof( float );
+void *AnimationResource::decode( const char *data, int size )
+{
+	// Called from a decoding job of the resource manager, which can't run nested jobs
+	DecodedAnimation *anim = new DecodedAnimation();
+	decodeAnimation( data, size, *anim, false );
+	
+	return anim;
+}
 
-			// Prebake transformation matrix for fast animation path
-			frame.bakedTransMat.scale( frame.scaleVec.x, frame.scaleVec.y, frame.scaleVec.z );
-			frame.bakedTransMat = Matrix4f( frame.rotQuat ) * frame.bakedTransMat;
-			frame.bakedTransMat.translate( frame.transVec.x, frame.transVec.y, frame.transVec.z );
-		}
 
-		if( !entity.frames.empty() )
-			entity.firstFrameInvTrans = entity.frames[0].bakedTransMat.inverted();
+bool AnimationResource::load( const char *data, int size )
+{
+	DecodedAnimation *anim = 0x0;
+	if( !_loaded )
+	{
+		anim = new DecodedAnimation();
+		decodeAnimation( data, size, *anim, true );
 	}
+	
+	return loadDecoded( data, size, anim );
+}
 
-	// Sort entities by name id
-	std::sort( _entities.begin(), _entities.end(), AnimEntCompFunc() );
+
+bool AnimationResource::loadDecoded( const char *data, int size, void *decoded )
+{
+	DecodedAnimation *anim = (DecodedAnimation *)decoded;
+	
+	if( !Resource::load( data, size ) )
+	{
+		delete anim;
+		return false;
+	}
+	if( anim == 0x0 || !anim->error.empty() )
+	{
+		string msg = anim != 0x0 ? anim->error : "Invalid animation resource";
+		delete anim;
+		return raiseError( msg );
+	}
+
+	// Take over decoded data
+	_numFrames = anim->numFrames;
+	_entities.swap( anim->entities );
+	delete anim;
 	
 	return true;
 }
@@ -187,6 +309,15 @@ int AnimationResource::getElemParamI( int elem, int elemIdx, int param )
 }
 
 
+void AnimationResource::getMemUsage( uint32 &cpuMem, uint32 &gpuMem )
+{
+	cpuMem = (uint32)(_entities.size() * sizeof( AnimResEntity ));
+	for( size_t i = 0, s = _entities.size(); i < s; ++i )
+		cpuMem += (uint32)(_entities[i].frames.size() * sizeof( Frame ));
+	gpuMem = 0;
+}
+
+
 AnimResEntity *AnimationResource::findEntity( uint32 nameId )
 {
 	// Perform binary search (requires that _entities is sorted)
@@ -203,10 +334,146 @@ AnimResEntity *AnimationResource::findEntity( uint32 nameId )
 }
 
 
+// =================================================================================================
+// Pose Cache
+// =================================================================================================
+
+bool PoseCacheKey::operator<( const PoseCacheKey &k ) const
+{
+	if( layout != k.layout ) return layout < k.layout;
+	if( numStages != k.numStages ) return numStages < k.numStages;
+	if( interpolate != k.interpolate ) return interpolate < k.interpolate;
+	
+	for( uint32 i = 0; i < numStages; ++i )
+	{
+		if( times[i] != k.times[i] ) return times[i] < k.times[i];
+		if( weights[i] != k.weights[i] ) return weights[i] < k.weights[i];
+	}
+
+	return false;
+}
+
+
+AnimPoseCache::AnimPoseCache() :
+	_generation( 0 ), _hits( 0 ), _misses( 0 )
+{
+}
+
+
+void AnimPoseCache::clear()
+{
+	clearPoses();
+	_layouts.clear();
+
+	// Invalidate layout handles held by controllers
+	++_generation;
+}
+
+
+void AnimPoseCache::clearPoses()
+{
+	_poses.clear();
+	_poseMats.resize( 0 );
+	_poseUpdated.resize( 0 );
+}
+
+
+uint32 AnimPoseCache::getLayout( const PoseCacheLayout &layout )
+{
+	// Hash the layout so that comparisons are only required in case of a match
+	uint32 hash = layout.numNodes * 31 + layout.numStages;
+	for( uint32 i = 0; i < layout.numStages; ++i )
+		hash = hash * 31 + (uint32)layout.layers[i] * 2 + (layout.additive[i] ? 1 : 0);
+	for( size_t i = 0, s = layout.entities.size(); i < s; ++i )
+		hash = hash * 31 + (uint32)((size_t)layout.entities[i] >> 4);
+
+	for( uint32 i = 0, s = (uint32)_layouts.size(); i < s; ++i )
+	{
+		const PoseCacheLayout &cur = _layouts[i];
+		if( cur.hash != hash || cur.numNodes != layout.numNodes || cur.numStages != layout.numStages )
+			continue;
+
+		bool equal = cur.entities == layout.entities;
+		for( uint32 j = 0; equal && j < layout.numStages; ++j )
+		{
+			if( cur.layers[j] != layout.layers[j] || cur.additive[j] != layout.additive[j] )
+				equal = false;
+		}
+		if( equal ) return i;
+	}
+
+	_layouts.push_back( layout );
+	_layouts.back().hash = hash;
+	
+	return (uint32)_layouts.size() - 1;
+}
+
+
+bool AnimPoseCache::findPose( const PoseCacheKey &key, Matrix4f *&mats, unsigned char *&updated )
+{
+	map< PoseCacheKey, PoseCacheEntry >::iterator itr = _poses.find( key );
+	if( itr == _poses.end() )
+	{
+		++_misses;
+		return false;
+	}
+
+	++_hits;
+	mats = &_poseMats[itr->second.firstMat];
+	updated = &_poseUpdated[itr->second.firstMat];
+	return true;
+}
+
+
+void AnimPoseCache::addPose( const PoseCacheKey &key, uint32 numNodes, Matrix4f *&mats, unsigned char *&updated )
+{
+	// Flush cache when memory budget is exceeded
+	size_t maxMem = (size_t)Modules::config().poseCacheMaxMem * 1024 * 1024;
+	if( getMemUsage() + numNodes * (sizeof( Matrix4f ) + 1) > maxMem ) clearPoses();
+	
+	PoseCacheEntry entry;
+	entry.firstMat = (uint32)_poseMats.size();
+	_poses[key] = entry;
+
+	_poseMats.resize( _poseMats.size() + numNodes );
+	_poseUpdated.resize( _poseUpdated.size() + numNodes );
+	
+	// Avoid dereferencing the end of the pools for nodes without joints
+	mats = numNodes > 0 ? &_poseMats[entry.firstMat] : 0x0;
+	updated = numNodes > 0 ? &_poseUpdated[entry.firstMat] : 0x0;
+}
+
+
+float AnimPoseCache::getHitRate( bool reset )
+{
+	uint32 lookups = _hits + _misses;
+	float value = lookups > 0 ? (float)_hits / (float)lookups : 0.0f;
+
+	if( reset ) _hits = _misses = 0;
+	return value;
+}
+
+
+size_t AnimPoseCache::getMemUsage() const
+{
+	size_t mem = _poseMats.size() * sizeof( Matrix4f ) + _poseUpdated.size();
+	
+	// Approximate size of map nodes
+	mem += _poses.size() * (sizeof( PoseCacheKey ) + sizeof( PoseCacheEntry ) + 4 * sizeof( void * ));
+
+	for( size_t i = 0, s = _layouts.size(); i < s; ++i )
+		mem += sizeof( PoseCacheLayout ) + _layouts[i].entities.size() * sizeof( AnimResEntity * );
+
+	return mem;
+}
+
+
 // =================================================================================================
 // Animation Controller
 // =================================================================================================
 
+AnimPoseCache AnimationController::_poseCache;
+
 // TODO: Verify that name collisions are very unlikely
 uint32 AnimationController::hashName( const char *name )
 {
@@ -221,7 +488,7 @@ uint32 AnimationController::hashName( const char *name )
 
 
 AnimationController::AnimationController() :
-	_dirty( false )
+	_poseLayout( 0 ), _poseLayoutGen( 0 ), _maxNodeDepth( 0 ), _dirty( false ), _poseLayoutDirty( true )
 {
 	_animStages.resize( MaxNumAnimStages );
 	_activeStages.reserve( MaxNumAnimStages );
@@ -236,6 +503,7 @@ AnimationController::~AnimationController()
 void AnimationController::clearNodeList()
 {
 	_nodeList.clear();
+	_poseLayoutDirty = true;
 }
 
 
@@ -243,6 +511,9 @@ void AnimationController::registerNode( IAnimatableNode *node )
 {
 	AnimCtrlNode ctrlNode;
 	ctrlNode.node = node;
+	ctrlNode.depth = 1;
+	for( IAnimatableNode *parent = node->getANParent(); parent != 0x0; parent = parent->getANParent() )
+		++ctrlNode.depth;
 
 	_nodeList.push_back( ctrlNode );
 
@@ -258,6 +529,7 @@ void AnimationController::mapAnimRes( uint32 node, uint32 stage )
 	static std::string maskStart, maskEnd;
 	
 	_dirty = true;
+	_poseLayoutDirty = true;
 	
 	AnimationResource *animRes = _animStages[stage].anim;
 	if( animRes == 0x0 )
@@ -301,6 +573,7 @@ void AnimationController::mapAnimRes( uint32 node, uint32 stage )
 void AnimationController::updateActiveList()
 {
 	_activeStages.resize( 0 );
+	_poseLayoutDirty = true;
 	
 	// Create list of active blend stages that is sorted by layers (higher layers first)
 	for( uint32 i = 0, si = (uint32)_animStages.size(); i < si; ++i )
@@ -376,140 +649,247 @@ bool AnimationController::setAnimParams( int stage, float time, float weight )
 }
 
 
-bool AnimationController::animate()
+void AnimationController::setMaxNodeDepth( uint32 maxDepth )
 {
-	if( !_dirty || _activeStages.empty() ) return false;
+	if( maxDepth == _maxNodeDepth ) return;
+
+	// Nodes that were skipped need to be brought up to date
+	_maxNodeDepth = maxDepth;
+	_dirty = true;
+}
+
 
+bool AnimationController::sampleNode( uint32 node, const float *stageTimes, Matrix4f &relMat )
+{
 	Quaternion nodeRotQuat;
 	Vec3f nodeTransVec, nodeScaleVec;
-	
-	Timer *timer = Modules::stats().getTimer( EngineStats::AnimationTime );
-	if( Modules::config().gatherTimeStats ) timer->setEnabled( true );
-	
-	// Animate
-	for( size_t i = 0, si = _nodeList.size(); i < si; ++i )
+
+	bool nodeUpdated = false;
+	float layerWeightSum = 0.0f, remainingWeight = 1.0f;
+	int prevLayer = 0;
+
+	for( size_t j = 0, sj = _activeStages.size(); j < sj; ++j )
 	{
-		// Fast path
-		if( Modules::config().fastAnimation && _activeStages.size() == 1 )
+		uint32 stageIdx = _activeStages[j];
+		const AnimStage &curStage = _animStages[stageIdx];
+
+		// Check if layer has changed
+		if( j == 0 || curStage.layer != prevLayer )
 		{
-			uint32 firstStage = _activeStages[0];
-			AnimResEntity *animEnt = _nodeList[i].animEntities[firstStage];
-			if( animEnt != 0x0 && !animEnt->frames.empty() )
+			remainingWeight *= 1.0f - minf( layerWeightSum, 1.0f );
+			
+			// Find layer weight sum
+			layerWeightSum = curStage.weight;
+			for( size_t k = j + 1, sk = _activeStages.size(); k < sk; ++k )
 			{
-				uint32 frame = (uint32)ftoi_t( _animStages[firstStage].animTime ) % animEnt->frames.size();
-				if( animEnt->frames.size() == 1 ) frame = 0;  // Animation compression
-				_nodeList[i].node->getANRelTransRef() = animEnt->frames[frame].bakedTransMat;
+				if( _animStages[_activeStages[k]].layer == curStage.layer )
+					layerWeightSum += _animStages[_activeStages[k]].weight;
+				else
+					break;
 			}
-			continue;
+			
+			prevLayer = curStage.layer;
 		}
-
-		// Standard path
-		bool nodeUpdated = false;
-		float layerWeightSum = 0.0f, remainingWeight = 1.0f;
-		int prevLayer = 0;
-
-		for( size_t j = 0, sj = _activeStages.size(); j < sj; ++j )
+		
+		AnimResEntity *animEnt = _nodeList[node].animEntities[stageIdx];
+		if( animEnt == 0x0 || layerWeightSum < Math::Epsilon ) continue;
+		
+		uint32 numFrames = (uint32)animEnt->frames.size();
+		if( numFrames > 0 )
 		{
-			uint32 stageIdx = _activeStages[j];
-			const AnimStage &curStage = _animStages[stageIdx];
+			// Normalize weight and apply to remaining weight
+			float weight = (curStage.weight / layerWeightSum) * remainingWeight;
+
+			// Find frames
+			uint32 f0 = ftoi_t( stageTimes[stageIdx] );
+			float amount = stageTimes[stageIdx] - f0;
+			f0 = f0 % numFrames;
+			uint32 f1 = f0 + 1;
+			if( f1 > numFrames - 1 ) f1 = numFrames - 1;
+			if( numFrames == 1 ) f0 = f1 = 0;	// Animation compression
+
+			// Assign data of first frame
+			Frame &frame0 = animEnt->frames[f0];
+			Vec3f transVec( frame0.transVec );
+			Vec3f scaleVec( frame0.scaleVec );
+			Quaternion rotQuat( frame0.rotQuat );
+
+			// Inter-frame interpolation
+			if( !Modules::config().fastAnimation )
+			{
+				Frame &frame1 = animEnt->frames[f1];
+				transVec = transVec.lerp( frame1.transVec, amount );
+				scaleVec = scaleVec.lerp( frame1.scaleVec, amount );
+				rotQuat = rotQuat.nlerp( frame1.rotQuat, amount );
+			}
 
-			// Check if layer has changed
-			if( j == 0 || curStage.layer != prevLayer )
+			if( curStage.additive )
 			{
-				remainingWeight *= 1.0f - minf( layerWeightSum, 1.0f );
-				
-				// Find layer weight sum
-				layerWeightSum = curStage.weight;
-				for( size_t k = j + 1, sk = _activeStages.size(); k < sk; ++k )
+				// Additive animations are only applied if there is some other animation before
+				if( nodeUpdated )
 				{
-					if( _animStages[_activeStages[k]].layer == curStage.layer )
-						layerWeightSum += _animStages[_activeStages[k]].weight;
-					else
-						break;
+					// Add the difference to the first frame of the animation
+					Frame &firstFrame = animEnt->frames[0];
+					float w = curStage.weight;
+
+					Quaternion fullRotQuat = nodeRotQuat * (firstFrame.rotQuat.inverted() * rotQuat);
+					nodeRotQuat = nodeRotQuat.nlerp( fullRotQuat, w );
+					nodeTransVec += (transVec - firstFrame.transVec) * w;
+					Vec3f fullScaleVec( nodeScaleVec.x * (scaleVec.x / firstFrame.scaleVec.x),
+					                    nodeScaleVec.y * (scaleVec.y / firstFrame.scaleVec.y),
+					                    nodeScaleVec.z * (scaleVec.z / firstFrame.scaleVec.z) );
+					nodeScaleVec = nodeScaleVec.lerp( fullScaleVec, w );
 				}
-				
-				prevLayer = curStage.layer;
 			}
-			
-			AnimResEntity *animEnt = _nodeList[i].animEntities[stageIdx];
-			if( animEnt == 0x0 || layerWeightSum < Math::Epsilon ) continue;
-			
-			uint32 numFrames = (uint32)animEnt->frames.size();
-			if( numFrames > 0 )
+			else
 			{
-				// Normalize weight and apply to remaining weight
-				float weight = (curStage.weight / layerWeightSum) * remainingWeight;
-
-				// Find frames
-				uint32 f0 = ftoi_t( curStage.animTime );
-				float amount = curStage.animTime - f0;
-				f0 = f0 % numFrames;
-				uint32 f1 = f0 + 1;
-				if( f1 > numFrames - 1 ) f1 = numFrames - 1;
-				if( numFrames == 1 ) f0 = f1 = 0;	// Animation compression
-
-				// Assign data of first frame
-				Frame &frame0 = animEnt->frames[f0];
-				Vec3f transVec( frame0.transVec );
-				Vec3f scaleVec( frame0.scaleVec );
-				Quaternion rotQuat( frame0.rotQuat );
-
-				// Inter-frame interpolation
-				if( !Modules::config().fastAnimation )
+				if( !nodeUpdated )
 				{
-					Frame &frame1 = animEnt->frames[f1];
-					transVec = transVec.lerp( frame1.transVec, amount );
-					scaleVec = scaleVec.lerp( frame1.scaleVec, amount );
-					rotQuat = rotQuat.nlerp( frame1.rotQuat, amount );
-				}
-
-				if( curStage.additive )
-				{
-					// Additive animations are only applied if there is some other animation before
-					if( nodeUpdated )
-					{
-						// Add the difference to the first frame of the animation
-						Frame &firstFrame = animEnt->frames[0];
-						float w = curStage.weight;
-
-						Quaternion fullRotQuat = nodeRotQuat * (firstFrame.rotQuat.inverted() * rotQuat);
-						nodeRotQuat = nodeRotQuat.nlerp( fullRotQuat, w );
-						nodeTransVec += (transVec - firstFrame.transVec) * w;
-						Vec3f fullScaleVec( nodeScaleVec.x * (scaleVec.x / firstFrame.scaleVec.x),
-						                    nodeScaleVec.y * (scaleVec.y / firstFrame.scaleVec.y),
-						                    nodeScaleVec.z * (scaleVec.z / firstFrame.scaleVec.z) );
-						nodeScaleVec = nodeScaleVec.lerp( fullScaleVec, w );
-					}
+					nodeRotQuat = rotQuat;
+					nodeTransVec = transVec;
+					nodeScaleVec = scaleVec;
 				}
 				else
 				{
-					if( !nodeUpdated )
-					{
-						nodeRotQuat = rotQuat;
-						nodeTransVec = transVec;
-						nodeScaleVec = scaleVec;
-					}
-					else
-					{
-						// Interpolate between current state and animation
-						nodeRotQuat = nodeRotQuat.nlerp( rotQuat, weight );
-						nodeTransVec = nodeTransVec.lerp( transVec, weight );
-						nodeScaleVec = nodeScaleVec.lerp( scaleVec, weight );
-					}
+					// Interpolate between current state and animation
+					nodeRotQuat = nodeRotQuat.nlerp( rotQuat, weight );
+					nodeTransVec = nodeTransVec.lerp( transVec, weight );
+					nodeScaleVec = nodeScaleVec.lerp( scaleVec, weight );
 				}
-
-				nodeUpdated = true;
 			}
+
+			nodeUpdated = true;
 		}
+	}
+
+	// Build matrix from animation data
+	if( nodeUpdated )
+	{
+		Matrix4f mat( Math::NO_INIT );
+		Matrix4f::fastMult43( mat, Matrix4f( nodeRotQuat ),
+			Matrix4f::ScaleMat( nodeScaleVec.x, nodeScaleVec.y, nodeScaleVec.z ) );
+		Matrix4f::fastMult43( relMat,
+			Matrix4f::TransMat( nodeTransVec.x, nodeTransVec.y, nodeTransVec.z ), mat );
+	}
 
-		// Build matrix from animation data
-		if( nodeUpdated )
+	return nodeUpdated;
+}
+
+
+void AnimationController::animateCached()
+{
+	uint32 numNodes = (uint32)_nodeList.size();
+	uint32 numStages = (uint32)_activeStages.size();
+	
+	// Find shared layout of node to entity mapping
+	if( _poseLayoutDirty || _poseLayoutGen != _poseCache.getGeneration() )
+	{
+		PoseCacheLayout layout;
+		layout.numNodes = numNodes;
+		layout.numStages = numStages;
+		for( uint32 j = 0; j < numStages; ++j )
+		{
+			layout.layers[j] = _animStages[_activeStages[j]].layer;
+			layout.additive[j] = _animStages[_activeStages[j]].additive;
+		}
+		layout.entities.resize( numNodes * numStages );
+		for( uint32 i = 0; i < numNodes; ++i )
+		{
+			for( uint32 j = 0; j < numStages; ++j )
+				layout.entities[i * numStages + j] = _nodeList[i].animEntities[_activeStages[j]];
+		}
+
+		_poseLayout = _poseCache.getLayout( layout );
+		_poseLayoutGen = _poseCache.getGeneration();
+		_poseLayoutDirty = false;
+	}
+
+	// Build key from quantized stage times; times are wrapped so that all loops share the same poses
+	PoseCacheKey key;
+	key.layout = _poseLayout;
+	key.numStages = numStages;
+	key.interpolate = !Modules::config().fastAnimation;
+	
+	float stageTimes[MaxNumAnimStages];
+	float step = Modules::config().poseCacheStep;
+	
+	for( uint32 j = 0; j < numStages; ++j )
+	{
+		const AnimStage &curStage = _animStages[_activeStages[j]];
+		
+		float time = floorf( curStage.animTime / step ) * step;
+		uint32 numFrames = curStage.anim->getNumFrames();
+		if( numFrames > 0 )
+		{
+			time = fmodf( time, (float)numFrames );
+			if( time < 0 ) time += (float)numFrames;
+		}
+
+		stageTimes[_activeStages[j]] = time;
+		key.times[j] = time;
+		key.weights[j] = curStage.weight;
+	}
+
+	Matrix4f *mats;
+	unsigned char *updated;
+	
+	if( !_poseCache.findPose( key, mats, updated ) )
+	{
+		_poseCache.addPose( key, numNodes, mats, updated );
+		
+		for( uint32 i = 0; i < numNodes; ++i )
+			updated[i] = sampleNode( i, stageTimes, mats[i] ) ? 1 : 0;
+	}
+
+	for( uint32 i = 0; i < numNodes; ++i )
+	{
+		if( _maxNodeDepth != 0 && _nodeList[i].depth > _maxNodeDepth ) continue;
+		if( updated[i] ) _nodeList[i].node->getANRelTransRef() = mats[i];
+	}
+}
+
+
+bool AnimationController::animate()
+{
+	if( !_dirty || _activeStages.empty() ) return false;
+	
+	Timer *timer = Modules::stats().getTimer( EngineStats::AnimationTime );
+	if( Modules::config().gatherTimeStats ) timer->setEnabled( true );
+	
+	if( Modules::config().fastAnimation && _activeStages.size() == 1 )
+	{
+		// Fast path
+		uint32 firstStage = _activeStages[0];
+		
+		for( size_t i = 0, si = _nodeList.size(); i < si; ++i )
+		{
+			if( _maxNodeDepth != 0 && _nodeList[i].depth > _maxNodeDepth ) continue;
+			
+			AnimResEntity *animEnt = _nodeList[i].animEntities[firstStage];
+			if( animEnt != 0x0 && !animEnt->frames.empty() )
+			{
+				uint32 frame = (uint32)ftoi_t( _animStages[firstStage].animTime ) % animEnt->frames.size();
+				if( animEnt->frames.size() == 1 ) frame = 0;  // Animation compression
+				_nodeList[i].node->getANRelTransRef() = animEnt->frames[frame].bakedTransMat;
+			}
+		}
+	}
+	else if( Modules::config().poseCacheStep > 0 )
+	{
+		// Share sampled poses with other instances
+		animateCached();
+	}
+	else
+	{
+		// Standard path
+		float stageTimes[MaxNumAnimStages];
+		for( uint32 i = 0; i < MaxNumAnimStages; ++i )
+			stageTimes[i] = _animStages[i].animTime;
+		
+		for( size_t i = 0, si = _nodeList.size(); i < si; ++i )
 		{
-			Matrix4f mat( Math::NO_INIT );
-			Matrix4f::fastMult43( mat, Matrix4f( nodeRotQuat ),
-				Matrix4f::ScaleMat( nodeScaleVec.x, nodeScaleVec.y, nodeScaleVec.z ) );
-			Matrix4f::fastMult43( _nodeList[i].node->getANRelTransRef(),
-				Matrix4f::TransMat( nodeTransVec.x, nodeTransVec.y, nodeTransVec.z ), mat );
+			if( _maxNodeDepth != 0 && _nodeList[i].depth > _maxNodeDepth ) continue;
+			sampleNode( (uint32)i, stageTimes, _nodeList[i].node->getANRelTransRef() );
 		}
 	}
 
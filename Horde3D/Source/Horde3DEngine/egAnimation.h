@@ -16,6 +16,7 @@
 #include "egPrerequisites.h"
 #include "egResource.h"
 #include "utMath.h"
+#include <map>
 
 
 namespace Horde3D {
@@ -65,11 +66,15 @@ public:
 	void initDefault();
 	void release();
 	bool load( const char *data, int size );
+	void *decode( const char *data, int size );
+	bool loadDecoded( const char *data, int size, void *decoded );
 
 	int getElemCount( int elem );
 	int getElemParamI( int elem, int elemIdx, int param );
+	void getMemUsage( uint32 &cpuMem, uint32 &gpuMem );
 
 	AnimResEntity *findEntity( uint32 nameId );
+	uint32 getNumFrames() { return _numFrames; }
 
 private:
 	bool raiseError( const std::string &msg );
@@ -114,8 +119,65 @@ struct AnimCtrlNode
 {
 	IAnimatableNode  *node;
 	AnimResEntity    *animEntities[MaxNumAnimStages];
+	uint32           depth;  // Depth in hierarchy of animatable nodes, 1 for root nodes
 };
 
+// =================================================================================================
+
+struct PoseCacheLayout
+{
+	uint32                         hash;
+	uint32                         numNodes, numStages;
+	int                            layers[MaxNumAnimStages];
+	bool                           additive[MaxNumAnimStages];
+	std::vector< AnimResEntity * > entities;  // Entities of active stages for each node
+};
+
+struct PoseCacheKey
+{
+	uint32  layout;
+	uint32  numStages;
+	float   times[MaxNumAnimStages];  // Quantized times of active stages
+	float   weights[MaxNumAnimStages];
+	bool    interpolate;
+
+	bool operator<( const PoseCacheKey &k ) const;
+};
+
+struct PoseCacheEntry
+{
+	uint32  firstMat;  // Index of first node matrix in pose pool
+};
+
+
+class AnimPoseCache
+{
+public:
+	AnimPoseCache();
+
+	void clear();
+	void clearPoses();
+	uint32 getLayout( const PoseCacheLayout &layout );
+	const PoseCacheLayout &getLayoutData( uint32 layout ) const { return _layouts[layout]; }
+	uint32 getGeneration() const { return _generation; }
+
+	bool findPose( const PoseCacheKey &key, Matrix4f *&mats, unsigned char *&updated );
+	void addPose( const PoseCacheKey &key, uint32 numNodes, Matrix4f *&mats, unsigned char *&updated );
+	
+	float getHitRate( bool reset );
+	size_t getMemUsage() const;
+
+protected:
+	std::vector< PoseCacheLayout >              _layouts;
+	std::map< PoseCacheKey, PoseCacheEntry >    _poses;
+	std::vector< Matrix4f >                     _poseMats;  // Pool of local node matrices
+	std::vector< unsigned char >                _poseUpdated;  // Flags whether node was animated in pose
+	uint32                                      _generation;  // Incremented when layouts are invalidated
+	uint32                                      _hits, _misses;
+};
+
+// =================================================================================================
+
 class AnimationController
 {
 public:
@@ -130,17 +192,27 @@ public:
 	bool setupAnimStage( int stage, AnimationResource *anim, int layer,
 	                     const std::string &startNode, bool additive );
 	bool setAnimParams( int stage, float time, float weight );
+	void setMaxNodeDepth( uint32 maxDepth );
 	bool animate();
 
+	static AnimPoseCache &getPoseCache() { return _poseCache; }
+
 protected:
 	void mapAnimRes( uint32 node, uint32 stage );
 	void updateActiveList();
+	bool sampleNode( uint32 node, const float *stageTimes, Matrix4f &relMat );
+	void animateCached();
 
 protected:
 	std::vector< AnimStage >     _animStages;
 	std::vector< uint32 >        _activeStages;
 	std::vector< AnimCtrlNode >  _nodeList;
+	uint32                       _poseLayout, _poseLayoutGen;
+	uint32                       _maxNodeDepth;  // Deeper nodes are not animated, 0 if unlimited
 	bool                         _dirty;
+	bool                         _poseLayoutDirty;
+
+	static AnimPoseCache         _poseCache;  // Shared by all controllers
 };
 
 }
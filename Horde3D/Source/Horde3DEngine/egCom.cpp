@@ -14,8 +14,13 @@
 #include "utMath.h"
 #include "egModules.h"
 #include "egRenderer.h"
+#include "egAnimation.h"
+#include "egGeometry.h"
+#include "utThreads.h"
 #include <stdarg.h>
 #include <stdio.h>
+#include <cstring>
+#include <vector>
 
 #include "utDebug.h"
 
@@ -41,6 +46,15 @@ EngineConfig::EngineConfig()
 	debugViewMode = false;
 	dumpFailedShaders = false;
 	gatherTimeStats = true;
+	queryGridCellSize = 5.0f;
+	poseCacheStep = 0;
+	poseCacheMaxMem = 16;
+	workerThreads = (int)std::min( JobManager::getNumCPUs() - 1, MaxWorkerThreads );
+	texStreamingBudget = 0;
+	resourceMemBudget = 0;
+	coherentCullMargin = 0;
+	releaseGeoCPUData = false;
+	checkCoherentCulling = false;
 }
 
 
@@ -76,6 +90,24 @@ float EngineConfig::getOption( EngineOptions::List param )
 		return dumpFailedShaders ? 1.0f : 0.0f;
 	case EngineOptions::GatherTimeStats:
 		return gatherTimeStats ? 1.0f : 0.0f;
+	case EngineOptions::QueryGridCellSize:
+		return queryGridCellSize;
+	case EngineOptions::PoseCacheStep:
+		return poseCacheStep;
+	case EngineOptions::PoseCacheMaxMem:
+		return (float)poseCacheMaxMem;
+	case EngineOptions::WorkerThreads:
+		return (float)workerThreads;
+	case EngineOptions::TexStreamingBudget:
+		return texStreamingBudget;
+	case EngineOptions::ResourceMemBudget:
+		return resourceMemBudget;
+	case EngineOptions::CoherentCullMargin:
+		return coherentCullMargin;
+	case EngineOptions::ReleaseGeoCPUData:
+		return releaseGeoCPUData ? 1.0f : 0.0f;
+	case EngineOptions::CheckCoherentCulling:
+		return checkCoherentCulling ? 1.0f : 0.0f;
 	default:
 		Modules::setError( "Invalid param for h3dGetOption" );
 		return Math::NaN;
@@ -149,6 +181,45 @@ bool EngineConfig::setOption( EngineOptions::List param, float value )
 	case EngineOptions::GatherTimeStats:
 		gatherTimeStats = (value != 0);
 		return true;
+	case EngineOptions::QueryGridCellSize:
+		if( !(value > 0) ) return false;
+		queryGridCellSize = value;
+		Modules::sceneMan().setQueryGridCellSize( value );
+		return true;
+	case EngineOptions::PoseCacheStep:
+		if( value < 0 ) return false;
+		poseCacheStep = value;
+		return true;
+	case EngineOptions::PoseCacheMaxMem:
+		size = ftoi_r( value );
+		if( size < 1 ) return false;
+		poseCacheMaxMem = size;
+		return true;
+	case EngineOptions::WorkerThreads:
+		size = ftoi_r( value );
+		if( size < 0 || size > (int)MaxWorkerThreads ) return false;
+		if( size == workerThreads ) return true;
+		workerThreads = size;
+		Modules::jobMan().init( (uint32)size );
+		return true;
+	case EngineOptions::TexStreamingBudget:
+		if( value < 0 ) return false;
+		texStreamingBudget = value;
+		return true;
+	case EngineOptions::ResourceMemBudget:
+		if( value < 0 ) return false;
+		resourceMemBudget = value;
+		return true;
+	case EngineOptions::CoherentCullMargin:
+		if( value < 0 ) return false;
+		coherentCullMargin = value;
+		return true;
+	case EngineOptions::ReleaseGeoCPUData:
+		releaseGeoCPUData = (value != 0);
+		return true;
+	case EngineOptions::CheckCoherentCulling:
+		checkCoherentCulling = (value != 0);
+		return true;
 	default:
 		Modules::setError( "Invalid param for h3dSetOption" );
 		return false;
@@ -160,40 +231,130 @@ bool EngineConfig::setOption( EngineOptions::List param, float value )
 // Class EngineLog
 // *************************************************************************************************
 
-EngineLog::EngineLog()
+EngineLog::EngineLog() :
+	_slots( 0x0 ), _slotMask( 0 ), _writePos( 0 ), _readPos( 0 ), _numDroppedMessages( 0 )
 {
 	_timer.setEnabled( true );
-	_maxNumMessages = 512;
+	setMaxNumMessages( 512 );
+}
+
+
+EngineLog::~EngineLog()
+{
+	delete[] _slots;
+}
+
+
+void EngineLog::setMaxNumMessages( uint32 maxNumMessages )
+{
+	// Note: This reallocates the queue, so no other thread may log at the same time
+	std::vector< LogMessage > messages;
+	LogMessage msg;
+	while( _slots != 0x0 && popMessage( msg ) ) messages.push_back( msg );
+	
+	uint32 numSlots = 2;
+	while( numSlots < maxNumMessages ) numSlots *= 2;
+
+	delete[] _slots;
+	_slots = new LogSlot[numSlots];
+	_slotMask = numSlots - 1;
+	_maxNumMessages = maxNumMessages;
+	_writePos = 0;
+	_readPos = 0;
+	for( uint32 i = 0; i < numSlots; ++i ) _slots[i].sequence = i;
+
+	for( size_t i = 0; i < messages.size(); ++i )
+	{
+		if( !pushMessage( messages[i].text.c_str(), messages[i].level, messages[i].time ) )
+			atomicAdd( &_numDroppedMessages, 1 );
+	}
+}
+
+
+bool EngineLog::pushMessage( const char *text, int level, float time )
+{
+	// A slot is claimed by advancing the write position and published to readers by setting its
+	// sequence number; this is the bounded multi-producer multi-consumer queue by D. Vyukov
+	uint32 pos = atomicLoad( &_writePos );
+	for(;;)
+	{
+		if( pos - atomicLoad( &_readPos ) >= _maxNumMessages ) return false;
+		
+		LogSlot &slot = _slots[pos & _slotMask];
+		int diff = (int)(atomicLoad( &slot.sequence ) - pos);
+		if( diff == 0 )
+		{
+			if( atomicCompareExchange( &_writePos, pos, pos + 1 ) )
+			{
+				slot.level = level;
+				slot.time = time;
+				strncpy( slot.text, text, MaxLogMessageLength - 1 );
+				slot.text[MaxLogMessageLength - 1] = '\0';
+				atomicStore( &slot.sequence, pos + 1 );
+				return true;
+			}
+		}
+		else if( diff < 0 )
+		{
+			return false;  // Slot not yet read
+		}
+		
+		pos = atomicLoad( &_writePos );
+	}
+}
+
+
+bool EngineLog::popMessage( LogMessage &msg )
+{
+	uint32 pos = atomicLoad( &_readPos );
+	for(;;)
+	{
+		LogSlot &slot = _slots[pos & _slotMask];
+		int diff = (int)(atomicLoad( &slot.sequence ) - (pos + 1));
+		if( diff == 0 )
+		{
+			if( atomicCompareExchange( &_readPos, pos, pos + 1 ) )
+			{
+				msg.text = slot.text;
+				msg.level = slot.level;
+				msg.time = slot.time;
+				atomicStore( &slot.sequence, pos + _slotMask + 1 );
+				return true;
+			}
+		}
+		else if( diff < 0 )
+		{
+			return false;  // Queue empty or next message still being written
+		}
+		
+		pos = atomicLoad( &_readPos );
+	}
 }
 
 
 void EngineLog::pushMessage( int level, const char *msg, va_list args )
 {
-	float time = _timer.getElapsedTimeMS() / 1000.0f;
+	// Note: This is called from worker threads as well
+	char text[MaxLogMessageLength];
+	float time = _timer.peekElapsedTimeMS() / 1000.0f;
 
 #if defined( PLATFORM_WIN )
 #pragma warning( push )
 #pragma warning( disable:4996 )
-	vsnprintf( _textBuf, 2048, msg, args );
+	vsnprintf( text, MaxLogMessageLength, msg, args );
 #pragma warning( pop )
 #else
-	vsnprintf( _textBuf, 2048, msg, args );
+	vsnprintf( text, MaxLogMessageLength, msg, args );
 #endif
 	
-	if( _messages.size() < _maxNumMessages - 1 )
-	{
-		_messages.push( LogMessage( _textBuf, level, time ) );
-	}
-	else if( _messages.size() == _maxNumMessages - 1 )
-	{
-		_messages.push( LogMessage( "Message queue is full", 1, time ) );
-	}
+	if( !pushMessage( text, level, time ) )
+		atomicAdd( &_numDroppedMessages, 1 );
 
 #if defined( PLATFORM_WIN ) && defined( H3D_DEBUGGER_OUTPUT )
 	const TCHAR *headers[6] = { TEXT(""), TEXT("  [h3d-err] "), TEXT("  [h3d-warn] "), TEXT("[h3d] "), TEXT("  [h3d-dbg] "), TEXT("[h3d- ] ")};
 	
 	OutputDebugString( headers[std::min( (uint32)level, (uint32)5 )] );
-	OutputDebugStringA( _textBuf );
+	OutputDebugStringA( text );
 	OutputDebugString( TEXT("\r\n") );
 #endif
 }
@@ -245,14 +406,19 @@ void EngineLog::writeDebugInfo( const char *msg, ... )
 
 bool EngineLog::getMessage( LogMessage &msg )
 {
-	if( !_messages.empty() )
-	{
-		msg = _messages.front();
-		_messages.pop();
-		return true;
-	}
-	else
-		return false;
+	if( popMessage( msg ) ) return true;
+
+	// Report dropped messages once the queue has been emptied
+	uint32 numDropped = atomicLoad( &_numDroppedMessages );
+	while( numDropped > 0 && !atomicCompareExchange( &_numDroppedMessages, numDropped, 0 ) )
+		numDropped = atomicLoad( &_numDroppedMessages );
+	if( numDropped == 0 ) return false;
+
+	char text[64];
+	sprintf( text, "Message queue is full (%u messages dropped)", numDropped );
+	msg = LogMessage( text, 1, _timer.peekElapsedTimeMS() / 1000.0f );
+	
+	return true;
 }
 
 
@@ -265,6 +431,7 @@ StatManager::StatManager()
 	_statTriCount = 0;
 	_statBatchCount = 0;
 	_statLightPassCount = 0;
+	_statCullMismatches = 0;
 
 	_frameTime = 0;
 
@@ -287,6 +454,7 @@ StatManager::~StatManager()
 float StatManager::getStat( int param, bool reset )
 {
 	float value;	
+	uint64 cpuMem, gpuMem;
 	
 	switch( param )
 	{
@@ -302,6 +470,10 @@ float StatManager::getStat( int param, bool reset )
 		value = (float)_statLightPassCount;
 		if( reset ) _statLightPassCount = 0;
 		return value;
+	case EngineStats::CullMismatches:
+		value = (float)_statCullMismatches;
+		if( reset ) _statCullMismatches = 0;
+		return value;
 	case EngineStats::FrameTime:
 		value = _frameTime;
 		if( reset ) _frameTime = 0;
@@ -318,6 +490,14 @@ float StatManager::getStat( int param, bool reset )
 		value = _particleSimTimer.getElapsedTimeMS();
 		if( reset ) _particleSimTimer.reset();
 		return value;
+	case EngineStats::MaterialSetTime:
+		value = _materialSetTimer.getElapsedTimeMS();
+		if( reset ) _materialSetTimer.reset();
+		return value;
+	case EngineStats::CullingTime:
+		value = _cullingTimer.getElapsedTimeMS();
+		if( reset ) _cullingTimer.reset();
+		return value;
 	case EngineStats::FwdLightsGPUTime:
 		value = _fwdLightsGPUTimer->getTimeMS();
 		if( reset ) _fwdLightsGPUTimer->reset();
@@ -338,6 +518,21 @@ float StatManager::getStat( int param, bool reset )
 		return (gRDI->getTextureMem() / 1024) / 1024.0f;
 	case EngineStats::GeometryVMem:
 		return (gRDI->getBufferMem() / 1024) / 1024.0f;
+	case EngineStats::PoseCacheHitRate:
+		return AnimationController::getPoseCache().getHitRate( reset );
+	case EngineStats::PoseCacheMem:
+		return (AnimationController::getPoseCache().getMemUsage() / 1024) / 1024.0f;
+	case EngineStats::StateCallCount:
+		return (float)gRDI->getStateCallCount( false, reset );
+	case EngineStats::ElidedStateCalls:
+		return (float)gRDI->getStateCallCount( true, reset );
+	case EngineStats::GeometrySharedMem:
+		return (GeometryResource::getSharedMemSaving() / 1024) / 1024.0f;
+	case EngineStats::GeoUploadBytes:
+		return (float)gRDI->getUploadedBytes( reset );
+	case EngineStats::GeometryCPUMem:
+		Modules::resMan().getMemUsage( ResourceTypes::Geometry, cpuMem, gpuMem );
+		return (cpuMem / 1024) / 1024.0f;
 	default:
 		Modules::setError( "Invalid param for h3dGetStat" );
 		return Math::NaN;
@@ -358,6 +553,9 @@ void StatManager::incStat( int param, float value )
 	case EngineStats::LightPassCount:
 		_statLightPassCount += ftoi_r( value );
 		break;
+	case EngineStats::CullMismatches:
+		_statCullMismatches += ftoi_r( value );
+		break;
 	case EngineStats::FrameTime:
 		_frameTime += value;
 		break;
@@ -377,6 +575,10 @@ Timer *StatManager::getTimer( int param )
 		return &_geoUpdateTimer;
 	case EngineStats::ParticleSimTime:
 		return &_particleSimTimer;
+	case EngineStats::MaterialSetTime:
+		return &_materialSetTimer;
+	case EngineStats::CullingTime:
+		return &_cullingTimer;
 	default:
 		return 0x0;
 	}
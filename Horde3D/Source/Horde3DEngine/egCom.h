@@ -15,7 +15,6 @@
 
 #include "egPrerequisites.h"
 #include <string>
-#include <queue>
 #include <cstdarg>
 #include "utTimer.h"
 
@@ -45,7 +44,16 @@ struct EngineOptions
 		WireframeMode,
 		DebugViewMode,
 		DumpFailedShaders,
-		GatherTimeStats
+		GatherTimeStats,
+		QueryGridCellSize,
+		PoseCacheStep,
+		PoseCacheMaxMem,
+		WorkerThreads,
+		TexStreamingBudget,
+		ResourceMemBudget,
+		CoherentCullMargin,
+		ReleaseGeoCPUData,
+		CheckCoherentCulling
 	};
 };
 
@@ -64,6 +72,13 @@ public:
 	int   maxAnisotropy;
 	int   shadowMapSize;
 	int   sampleCount;
+	float queryGridCellSize;
+	float poseCacheStep;
+	int   poseCacheMaxMem;
+	int   workerThreads;
+	float texStreamingBudget;
+	float resourceMemBudget;
+	float coherentCullMargin;
 	bool  texCompression;
 	bool  sRGBLinearization;
 	bool  loadTextures;
@@ -73,6 +88,8 @@ public:
 	bool  debugViewMode;
 	bool  dumpFailedShaders;
 	bool  gatherTimeStats;
+	bool  releaseGeoCPUData;
+	bool  checkCoherentCulling;
 };
 
 
@@ -98,10 +115,23 @@ struct LogMessage
 
 // =================================================================================================
 
+const uint32 MaxLogMessageLength = 2048;  // Including terminating null
+
+struct LogSlot
+{
+	volatile uint32  sequence;  // Position in queue for which slot is writable or, plus one, readable
+	int              level;
+	float            time;
+	char             text[MaxLogMessageLength];
+};
+
+// =================================================================================================
+
 class EngineLog
 {
 public:
 	EngineLog();
+	~EngineLog();
 
 	void writeError( const char *msg, ... );
 	void writeWarning( const char *msg, ... );
@@ -111,17 +141,22 @@ public:
 	bool getMessage( LogMessage &msg );
 
 	uint32 getMaxNumMessages() { return _maxNumMessages; }
-	void setMaxNumMessages( uint32 maxNumMessages ) { _maxNumMessages = maxNumMessages; }
+	void setMaxNumMessages( uint32 maxNumMessages );
 	
 protected:
-	void pushMessage( const std::string &text, uint32 level );
+	bool pushMessage( const char *text, int level, float time );
 	void pushMessage( int level, const char *msg, va_list ap );
+	bool popMessage( LogMessage &msg );
 
 protected:
-	Timer                     _timer;
-	char                      _textBuf[2048];
-	uint32                    _maxNumMessages;
-	std::queue< LogMessage >  _messages;
+	// Bounded lock-free queue that can be used by several threads at once; the slots are
+	// preallocated, so logging does not allocate memory
+	Timer            _timer;
+	uint32           _maxNumMessages;
+	LogSlot          *_slots;
+	uint32           _slotMask;  // Number of slots (power of two) minus one
+	volatile uint32  _writePos, _readPos;
+	volatile uint32  _numDroppedMessages;
 };
 
 
@@ -145,7 +180,17 @@ struct EngineStats
 		ShadowsGPUTime,
 		ParticleGPUTime,
 		TextureVMem,
-		GeometryVMem
+		GeometryVMem,
+		PoseCacheHitRate,
+		PoseCacheMem,
+		MaterialSetTime,
+		StateCallCount,
+		ElidedStateCalls,
+		GeometrySharedMem,
+		GeoUploadBytes,
+		GeometryCPUMem,
+		CullingTime,
+		CullMismatches
 	};
 };
 
@@ -166,11 +211,14 @@ protected:
 	uint32    _statTriCount;
 	uint32    _statBatchCount;
 	uint32    _statLightPassCount;
+	uint32    _statCullMismatches;
 
 	Timer     _frameTimer;
 	Timer     _animTimer;
 	Timer     _geoUpdateTimer;
 	Timer     _particleSimTimer;
+	Timer     _materialSetTimer;
+	Timer     _cullingTimer;
 	float     _frameTime;
 
 	GPUTimer  *_fwdLightsGPUTimer;
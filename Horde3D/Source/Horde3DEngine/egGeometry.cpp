@@ -16,7 +16,9 @@
 #include "egModules.h"
 #include "egCom.h"
 #include "egRenderer.h"
+#include "utThreads.h"
 #include <cstring>
+#include <algorithm>
 
 #include "utDebug.h"
 
@@ -29,6 +31,7 @@ using namespace std;
 uint32 GeometryResource::defVertBuffer = 0;
 uint32 GeometryResource::defIndexBuffer = 0;
 int GeometryResource::mappedWriteStream = -1;
+uint64 GeometryResource::sharedMemSaving = 0;
 
 
 void GeometryResource::initializationFunc()
@@ -60,23 +63,49 @@ GeometryResource::~GeometryResource()
 
 Resource *GeometryResource::clone()
 {
+	// Released streams are needed by the private copy and by the model as base data
+	restoreCPUData();
+	
 	GeometryResource *res = new GeometryResource( "", _flags );
 
 	*res = *this;
 
-	// Make a deep copy of the data
-	res->_indexData = new char[_indexCount * (_16BitIndices ? 2 : 4)];
+	// Index and static streams are shared until one of the users maps them for writing,
+	// so only the dynamic streams need a deep copy
+	if( _indexData != 0x0 && _vertStaticData != 0x0 )
+	{
+		if( _sharedStreams == 0x0 )
+		{
+			_sharedStreams = new GeometrySharedStreams();
+			_sharedStreams->indexData = _indexData;
+			_sharedStreams->vertStaticData = _vertStaticData;
+			_sharedStreams->indexBuf = _indexBuf;
+			_sharedStreams->staticVBuf = _staticVBuf;
+			_sharedStreams->dataSize = getSharedDataSize();
+			_sharedStreams->refCount = 1;
+		}
+
+		++_sharedStreams->refCount;
+		sharedMemSaving += _sharedStreams->dataSize;
+		res->_sharedStreams = _sharedStreams;
+	}
+	else
+	{
+		res->_sharedStreams = 0x0;
+		res->_indexData = new char[_indexCount * (_16BitIndices ? 2 : 4)];
+		res->_vertStaticData = new VertexDataStatic[_vertCount];
+		memcpy( res->_indexData, _indexData, _indexCount * (_16BitIndices ? 2 : 4) );
+		memcpy( res->_vertStaticData, _vertStaticData, _vertCount * sizeof( VertexDataStatic ) );
+		res->_indexBuf = gRDI->createIndexBuffer( _indexCount * (_16BitIndices ? 2 : 4), _indexData );
+		res->_staticVBuf = gRDI->createVertexBuffer( _vertCount * sizeof( VertexDataStatic ), _vertStaticData );
+	}
+
 	res->_vertPosData = new Vec3f[_vertCount];
 	res->_vertTanData = new VertexDataTan[_vertCount];
-	res->_vertStaticData = new VertexDataStatic[_vertCount];
-	memcpy( res->_indexData, _indexData, _indexCount * (_16BitIndices ? 2 : 4) );
 	memcpy( res->_vertPosData, _vertPosData, _vertCount * sizeof( Vec3f ) );
 	memcpy( res->_vertTanData, _vertTanData, _vertCount * sizeof( VertexDataTan ) );
-	memcpy( res->_vertStaticData, _vertStaticData, _vertCount * sizeof( VertexDataStatic ) );
-	res->_indexBuf = gRDI->createIndexBuffer( _indexCount * (_16BitIndices ? 2 : 4), _indexData );
 	res->_posVBuf = gRDI->createVertexBuffer( _vertCount * sizeof( Vec3f ), _vertPosData );
 	res->_tanVBuf = gRDI->createVertexBuffer( _vertCount * sizeof( VertexDataTan ), _vertTanData );
-	res->_staticVBuf = gRDI->createVertexBuffer( _vertCount * sizeof( VertexDataStatic ), _vertStaticData );
 	
 	return res;
 }
@@ -90,6 +119,7 @@ void GeometryResource::initDefault()
 	_vertPosData = 0x0;
 	_vertTanData = 0x0;
 	_vertStaticData = 0x0;
+	_sharedStreams = 0x0;
 	_16BitIndices = false;
 	_indexBuf = defIndexBuffer;
 	_posVBuf = defVertBuffer;
@@ -103,6 +133,8 @@ void GeometryResource::initDefault()
 
 void GeometryResource::release()
 {
+	if( _sharedStreams != 0x0 ) releaseSharedStreams();
+	
 	if( _posVBuf != 0 && _posVBuf != defVertBuffer )
 	{
 		gRDI->destroyBuffer( _posVBuf );
@@ -131,6 +163,106 @@ void GeometryResource::release()
 	delete[] _vertStaticData; _vertStaticData = 0x0;
 	_joints.clear();
 	_morphTargets.clear();
+	_morphDeltas = MorphDeltaStreams();
+}
+
+
+uint32 GeometryResource::getSharedDataSize()
+{
+	return _indexCount * (_16BitIndices ? 2 : 4) + _vertCount * sizeof( VertexDataStatic );
+}
+
+
+void GeometryResource::releaseSharedStreams()
+{
+	// The shared data is destroyed together with the last reference
+	if( --_sharedStreams->refCount > 0 )
+	{
+		sharedMemSaving -= _sharedStreams->dataSize;
+	}
+	else
+	{
+		if( _sharedStreams->indexBuf != 0 && _sharedStreams->indexBuf != defIndexBuffer )
+			gRDI->destroyBuffer( _sharedStreams->indexBuf );
+		if( _sharedStreams->staticVBuf != 0 && _sharedStreams->staticVBuf != defVertBuffer )
+			gRDI->destroyBuffer( _sharedStreams->staticVBuf );
+		delete[] _sharedStreams->indexData;
+		delete[] _sharedStreams->vertStaticData;
+		delete _sharedStreams;
+	}
+
+	_sharedStreams = 0x0;
+	_indexData = 0x0;
+	_vertStaticData = 0x0;
+	_indexBuf = 0;
+	_staticVBuf = 0;
+}
+
+
+void GeometryResource::unshareStreams()
+{
+	if( _sharedStreams == 0x0 ) return;
+
+	// Last user can simply take over the data
+	if( _sharedStreams->refCount == 1 )
+	{
+		delete _sharedStreams; _sharedStreams = 0x0;
+		return;
+	}
+
+	bool hasBuffers = _indexBuf != defIndexBuffer;
+	uint32 indexDataSize = _indexCount * (_16BitIndices ? 2 : 4);
+	char *indexData = new char[indexDataSize];
+	VertexDataStatic *vertStaticData = new VertexDataStatic[_vertCount];
+	memcpy( indexData, _indexData, indexDataSize );
+	memcpy( vertStaticData, _vertStaticData, _vertCount * sizeof( VertexDataStatic ) );
+	
+	releaseSharedStreams();
+	
+	_indexData = indexData;
+	_vertStaticData = vertStaticData;
+	if( hasBuffers )
+	{
+		_indexBuf = gRDI->createIndexBuffer( indexDataSize, _indexData );
+		_staticVBuf = gRDI->createVertexBuffer( _vertCount * sizeof( VertexDataStatic ), _vertStaticData );
+	}
+	else
+	{
+		_indexBuf = defIndexBuffer;
+		_staticVBuf = defVertBuffer;
+	}
+}
+
+
+void GeometryResource::releaseCPUData()
+{
+	// Positions and indices are kept for ray queries and bounding box calculations
+	delete[] _vertTanData; _vertTanData = 0x0;
+	delete[] _vertStaticData; _vertStaticData = 0x0;
+}
+
+
+bool GeometryResource::restoreCPUData()
+{
+	if( _vertTanData != 0x0 && _vertStaticData != 0x0 ) return true;
+	if( _vertCount == 0 || _tanVBuf == defVertBuffer || _staticVBuf == defVertBuffer ) return false;
+	
+	// Read released streams back from the vertex buffers
+	VertexDataTan *vertTanData = new VertexDataTan[_vertCount];
+	VertexDataStatic *vertStaticData = new VertexDataStatic[_vertCount];
+	if( !gRDI->getBufferData( _tanVBuf, 0, _vertCount * sizeof( VertexDataTan ), vertTanData ) ||
+	    !gRDI->getBufferData( _staticVBuf, 0, _vertCount * sizeof( VertexDataStatic ), vertStaticData ) )
+	{
+		delete[] vertTanData;
+		delete[] vertStaticData;
+		Modules::log().writeError( "Geometry resource '%s': Failed to read back vertex data", _name.c_str() );
+		return false;
+	}
+
+	delete[] _vertTanData; _vertTanData = vertTanData;
+	delete[] _vertStaticData; _vertStaticData = vertStaticData;
+
+	return true;
 }
 
 
@@ -146,268 +278,593 @@ bool GeometryResource::raiseError( const string &msg )
 }
 
 
-bool GeometryResource::load( const char *data, int size )
+struct DecodedGeometry
+{
+	std::vector< Joint >        joints;
+	std::vector< MorphTarget >  morphTargets;
+	MorphDeltaStreams           morphDeltas;
+	Vec3f                       *vertPosData;
+	VertexDataTan               *vertTanData;
+	VertexDataStatic            *vertStaticData;
+	char                        *indexData;
+	uint32                      vertCount, indexCount;
+	bool                        tooManyJoints, unsupportedBaseStreams, unsupportedMorphStreams;
+	std::string                 error;  // Empty if decoding succeeded
+
+	DecodedGeometry() :
+		vertPosData( 0x0 ), vertTanData( 0x0 ), vertStaticData( 0x0 ), indexData( 0x0 ),
+		vertCount( 0 ), indexCount( 0 ), tooManyJoints( false ), unsupportedBaseStreams( false ),
+		unsupportedMorphStreams( false )
+	{
+	}
+
+	~DecodedGeometry()
+	{
+		delete[] vertPosData;
+		delete[] vertTanData;
+		delete[] vertStaticData;
+		delete[] indexData;
+	}
+};
+
+
+struct GeoDecodeJob
+{
+	DecodedGeometry  *geo;
+	const char       *streams[8];  // Vertex base streams by ID, NULL if not contained in file
+	const char       *indices;
+};
+
+
+struct MorphDecodeStreams
+{
+	const char  *indices;
+	const char  *streams[3];  // Position, normal and tangent deltas, NULL if not contained in file
+};
+
+
+struct MorphScatterJob
+{
+	DecodedGeometry           *geo;
+	const MorphDecodeStreams  *targetStreams;
+	const uint32              *diffSlots;  // Index of each delta in the grouped streams
+};
+
+
+static const uint32 GeoDecodeJobCount = 8;  // One job for each vertex attribute and the indices
+static const uint32 GeoHandednessBlockSize = 16384;
+
+
+static bool checkData( const char *pData, const char *dataEnd, uint32 count, uint32 elemSize )
+{
+	return (uint64)count * elemSize <= (uint64)(dataEnd - pData);
+}
+
+
+static void decodeShortVecs( const char *src, uint32 count, float *dst, uint32 dstStride )
+{
+	// Vectors of three normalized 16 bit integers
+	uint32 i = 0;
+#if defined( H3D_SIMD_SSE2 )
+	// Division gives the same results as the scalar path
+	const __m128 scale = _mm_set1_ps( 32767.0f );
+	float buf[24];
+	for( ; i + 8 <= count; i += 8 )
+	{
+		for( uint32 j = 0; j < 3; ++j )
+		{
+			__m128i v = _mm_loadu_si128( (const __m128i *)(src + i * 6 + j * 16) );
+			__m128i lo = _mm_srai_epi32( _mm_unpacklo_epi16( v, v ), 16 );
+			__m128i hi = _mm_srai_epi32( _mm_unpackhi_epi16( v, v ), 16 );
+			_mm_storeu_ps( &buf[j * 8], _mm_div_ps( _mm_cvtepi32_ps( lo ), scale ) );
+			_mm_storeu_ps( &buf[j * 8 + 4], _mm_div_ps( _mm_cvtepi32_ps( hi ), scale ) );
+		}
+		for( uint32 j = 0; j < 8; ++j )
+			memcpy( dst + (i + j) * dstStride, &buf[j * 3], 3 * sizeof( float ) );
+	}
+#endif
+	for( ; i < count; ++i )
+	{
+		short v[3];
+		memcpy( v, src + i * 6, sizeof( v ) );
+		
+		float *d = dst + i * dstStride;
+		d[0] = v[0] / 32767.0f;
+		d[1] = v[1] / 32767.0f;
+		d[2] = v[2] / 32767.0f;
+	}
+}
+
+
+static void decodeByteVecs( const char *src, uint32 count, float *dst, uint32 dstStride, bool normalize )
+{
+	// Vectors of four unsigned bytes, optionally normalized to [0, 1]
+	uint32 i = 0;
+#if defined( H3D_SIMD_SSE2 )
+	const __m128 scale = _mm_set1_ps( normalize ? 255.0f : 1.0f );
+	const __m128i zero = _mm_setzero_si128();
+	for( ; i + 4 <= count; i += 4 )
+	{
+		__m128i v = _mm_loadu_si128( (const __m128i *)(src + i * 4) );
+		__m128i lo = _mm_unpacklo_epi8( v, zero ), hi = _mm_unpackhi_epi8( v, zero );
+		__m128i w[4] = { _mm_unpacklo_epi16( lo, zero ), _mm_unpackhi_epi16( lo, zero ),
+		                 _mm_unpacklo_epi16( hi, zero ), _mm_unpackhi_epi16( hi, zero ) };
+		for( uint32 j = 0; j < 4; ++j )
+			_mm_storeu_ps( dst + (i + j) * dstStride, _mm_div_ps( _mm_cvtepi32_ps( w[j] ), scale ) );
+	}
+#endif
+	for( ; i < count; ++i )
+	{
+		const unsigned char *s = (const unsigned char *)src + i * 4;
+		float *d = dst + i * dstStride;
+		for( uint32 j = 0; j < 4; ++j )
+			d[j] = normalize ? s[j] / 255.0f : (float)s[j];
+	}
+}
+
+
+static void decodeHandedness( const char *bitangents, uint32 first, uint32 last, VertexDataTan *tanData )
+{
+	// Handedness of the tangent space basis is the sign of dot( cross( normal, tangent ), bitangent )
+	uint32 i = first;
+#if defined( H3D_SIMD_SSE2 )
+	// The last vertex is left to the scalar path since the bitangent load reads two bytes beyond it
+	const __m128 scale = _mm_set1_ps( 32767.0f );
+	for( ; i + 1 < last; ++i )
+	{
+		__m128i bi = _mm_loadl_epi64( (const __m128i *)(bitangents + i * 6) );
+		__m128 b = _mm_div_ps( _mm_cvtepi32_ps( _mm_srai_epi32( _mm_unpacklo_epi16( bi, bi ), 16 ) ), scale );
+		__m128 n = _mm_loadu_ps( &tanData[i].normal.x );
+		__m128 t = _mm_loadu_ps( &tanData[i].tangent.x );
+		__m128 c = _mm_sub_ps(
+			_mm_mul_ps( _mm_shuffle_ps( n, n, _MM_SHUFFLE( 3, 0, 2, 1 ) ), _mm_shuffle_ps( t, t, _MM_SHUFFLE( 3, 1, 0, 2 ) ) ),
+			_mm_mul_ps( _mm_shuffle_ps( n, n, _MM_SHUFFLE( 3, 1, 0, 2 ) ), _mm_shuffle_ps( t, t, _MM_SHUFFLE( 3, 0, 2, 1 ) ) ) );
+		__m128 p = _mm_mul_ps( c, b );
+		__m128 d = _mm_add_ss( _mm_add_ss( p, _mm_shuffle_ps( p, p, 1 ) ), _mm_movehl_ps( p, p ) );
+		tanData[i].handedness = _mm_cvtss_f32( d ) < 0 ? -1.0f : 1.0f;
+	}
+#endif
+	for( ; i < last; ++i )
+	{
+		short v[3];
+		memcpy( v, bitangents + i * 6, sizeof( v ) );
+		
+		Vec3f bitangent( v[0] / 32767.0f, v[1] / 32767.0f, v[2] / 32767.0f );
+		tanData[i].handedness = tanData[i].normal.cross( tanData[i].tangent ).dot( bitangent ) < 0 ? -1.0f : 1.0f;
+	}
+}
+
+
+static void decodeIndices( const char *src, uint32 count, char *dst, bool use16BitIndices )
+{
+	if( !use16BitIndices )
+	{
+		memcpy( dst, src, count * sizeof( uint32 ) );
+		return;
+	}
+	
+	uint16 *indices = (uint16 *)dst;
+	uint32 i = 0;
+#if defined( H3D_SIMD_SSE2 )
+	for( ; i + 8 <= count; i += 8 )
+	{
+		// Sign extension of the low halves prevents saturation when packing
+		__m128i a = _mm_loadu_si128( (const __m128i *)(src + i * 4) );
+		__m128i b = _mm_loadu_si128( (const __m128i *)(src + i * 4 + 16) );
+		a = _mm_srai_epi32( _mm_slli_epi32( a, 16 ), 16 );
+		b = _mm_srai_epi32( _mm_slli_epi32( b, 16 ), 16 );
+		_mm_storeu_si128( (__m128i *)(indices + i), _mm_packs_epi32( a, b ) );
+	}
+#endif
+	for( ; i < count; ++i )
+	{
+		uint32 index;
+		memcpy( &index, src + i * 4, sizeof( uint32 ) );
+		indices[i] = (uint16)index;
+	}
+}
+
+
+static void decodeGeoStreamJob( void *userData, uint32 jobIndex )
+{
+	GeoDecodeJob &job = *(GeoDecodeJob *)userData;
+	DecodedGeometry &geo = *job.geo;
+	uint32 count = geo.vertCount;
+	const uint32 tanStride = sizeof( VertexDataTan ) / sizeof( float );
+	const uint32 staticStride = sizeof( VertexDataStatic ) / sizeof( float );
+
+	// Each job writes one attribute; attributes without stream get their default values
+	switch( jobIndex )
+	{
+	case 0:		// Position
+		if( job.streams[0] != 0x0 )
+			memcpy( geo.vertPosData, job.streams[0], count * sizeof( Vec3f ) );
+		else
+			memset( geo.vertPosData, 0, count * sizeof( Vec3f ) );
+		break;
+	case 1:		// Normal
+		if( job.streams[1] != 0x0 && count > 0 )
+			decodeShortVecs( job.streams[1], count, &geo.vertTanData[0].normal.x, tanStride );
+		break;
+	case 2:		// Tangent
+		if( job.streams[2] != 0x0 && count > 0 )
+			decodeShortVecs( job.streams[2], count, &geo.vertTanData[0].tangent.x, tanStride );
+		break;
+	case 3:		// Joint indices
+		if( job.streams[4] != 0x0 && count > 0 )
+			decodeByteVecs( job.streams[4], count, geo.vertStaticData[0].jointVec, staticStride, false );
+		else
+			for( uint32 i = 0; i < count; ++i ) memset( geo.vertStaticData[i].jointVec, 0, 4 * sizeof( float ) );
+		break;
+	case 4:		// Weights
+		if( job.streams[5] != 0x0 && count > 0 )
+			decodeByteVecs( job.streams[5], count, geo.vertStaticData[0].weightVec, staticStride, true );
+		else
+			for( uint32 i = 0; i < count; ++i )
+			{
+				float *weights = geo.vertStaticData[i].weightVec;
+				weights[0] = 1; weights[1] = 0; weights[2] = 0; weights[3] = 0;
+			}
+		break;
+	case 5:		// Texture Coord Set 1
+		for( uint32 i = 0; i < count; ++i )
+		{
+			if( job.streams[6] != 0x0 )
+				memcpy( &geo.vertStaticData[i].u0, job.streams[6] + i * 8, 2 * sizeof( float ) );
+			else
+				geo.vertStaticData[i].u0 = geo.vertStaticData[i].v0 = 0;
+		}
+		break;
+	case 6:		// Texture Coord Set 2
+		for( uint32 i = 0; i < count; ++i )
+		{
+			if( job.streams[7] != 0x0 )
+				memcpy( &geo.vertStaticData[i].u1, job.streams[7] + i * 8, 2 * sizeof( float ) );
+			else
+				geo.vertStaticData[i].u1 = geo.vertStaticData[i].v1 = 0;
+		}
+		break;
+	case 7:		// Triangle indices
+		decodeIndices( job.indices, geo.indexCount, geo.indexData, geo.indexCount <= 65535 );
+		break;
+	}
+}
+
+
+static void decodeHandednessJob( void *userData, uint32 jobIndex )
+{
+	GeoDecodeJob &job = *(GeoDecodeJob *)userData;
+	DecodedGeometry &geo = *job.geo;
+	uint32 first = jobIndex * GeoHandednessBlockSize;
+	uint32 last = std::min( first + GeoHandednessBlockSize, geo.vertCount );
+
+	if( job.streams[3] != 0x0 )
+		decodeHandedness( job.streams[3], first, last, geo.vertTanData );
+	else
+		for( uint32 i = first; i < last; ++i ) geo.vertTanData[i].handedness = 1.0f;
+}
+
+
+static void scatterMorphDeltasJob( void *userData, uint32 jobIndex )
 {
-	if( !Resource::load( data, size ) ) return false;
+	// Job 0 writes the target indices, the other jobs the position, normal and tangent deltas
+	MorphScatterJob &job = *(MorphScatterJob *)userData;
+	MorphDeltaStreams &md = job.geo->morphDeltas;
+	float *deltas[3] = { &md.posDeltas[0], &md.normDeltas[0], &md.tanDeltas[0] };
+	const uint32 *slots = job.diffSlots;
+	
+	for( uint32 i = 0; i < (uint32)job.geo->morphTargets.size(); ++i )
+	{
+		const char *stream = jobIndex > 0 ? job.targetStreams[i].streams[jobIndex - 1] : 0x0;
+		uint32 numDiffs = job.geo->morphTargets[i].numDiffs;
+		
+		if( jobIndex == 0 )
+		{
+			for( uint32 j = 0; j < numDiffs; ++j ) md.targets[slots[j]] = i;
+		}
+		else if( stream != 0x0 )
+		{
+			for( uint32 j = 0; j < numDiffs; ++j )
+				memcpy( deltas[jobIndex - 1] + slots[j] * 3, stream + j * sizeof( Vec3f ), sizeof( Vec3f ) );
+		}
+		slots += numDiffs;
+	}
+}
+
 
-	// Make sure header is available
-	if( size < 8 )
-		return raiseError( "Invalid geometry resource" );
+static void decodeGeometry( const char *data, int size, DecodedGeometry &geo, bool parallel )
+{
+	// Note: Engine state may only be accessed for distributing the work if parallel is set, since
+	//       this is also run on worker threads when several resources are loaded at once
+	if( data == 0x0 || size < 8 )
+	{
+		geo.error = "Invalid geometry resource";
+		return;
+	}
 	
-	char *pData = (char *)data;
+	const char *pData = data, *dataEnd = data + size;
 	
 	// Check header and version
-	char id[4];
-	memcpy( &id, pData, 4 ); pData += 4;
-	if( id[0] != 'H' || id[1] != '3' || id[2] != 'D' || id[3] != 'G' )
-		return raiseError( "Invalid geometry resource" );
+	if( pData[0] != 'H' || pData[1] != '3' || pData[2] != 'D' || pData[3] != 'G' )
+	{
+		geo.error = "Invalid geometry resource";
+		return;
+	}
+	pData += 4;
 
 	uint32 version;
 	memcpy( &version, pData, sizeof( uint32 ) ); pData += sizeof( uint32 );
-	if( version != 5 ) return raiseError( "Unsupported version of geometry file" );
+	if( version != 5 )
+	{
+		geo.error = "Unsupported version of geometry file";
+		return;
+	}
 
 	// Load joints
 	uint32 count;
+	if( !checkData( pData, dataEnd, 1, sizeof( uint32 ) ) ) { geo.error = "Invalid geometry resource"; return; }
 	memcpy( &count, pData, sizeof( uint32 ) ); pData += sizeof( uint32 );
-
-	if( count > 75 )
-		Modules::log().writeWarning( "Geometry resource '%s': Model has more than 75 joints; this may cause defective behavior", _name.c_str() );
-
-	_joints.resize( count );
+	if( !checkData( pData, dataEnd, count, 16 * sizeof( float ) ) ) { geo.error = "Invalid geometry resource"; return; }
+	
+	geo.tooManyJoints = count > 75;
+	geo.joints.resize( count );
 	for( uint32 i = 0; i < count; ++i )
 	{
-		Joint &joint = _joints[i];
-		
 		// Inverse bind matrix
-		for( uint32 j = 0; j < 16; ++j )
-		{
-			memcpy( &joint.invBindMat.x[j], pData, sizeof( float ) ); pData += sizeof( float );
-		}
+		memcpy( geo.joints[i].invBindMat.x, pData, 16 * sizeof( float ) ); pData += 16 * sizeof( float );
 	}
+
+	// Find vertex streams, the data is decoded after all streams are known
+	GeoDecodeJob job;
+	job.geo = &geo;
+	for( uint32 i = 0; i < 8; ++i ) job.streams[i] = 0x0;
 	
-	// Load vertex stream data
 	uint32 streamSize;
+	if( !checkData( pData, dataEnd, 2, sizeof( uint32 ) ) ) { geo.error = "Invalid geometry resource"; return; }
 	memcpy( &count, pData, sizeof( uint32 ) ); pData += sizeof( uint32 );			// Number of streams
 	memcpy( &streamSize, pData, sizeof( uint32 ) ); pData += sizeof( uint32 );	// Number of vertices
 
-	_vertCount = streamSize;
-	_vertPosData = new Vec3f[_vertCount];
-	_vertTanData = new VertexDataTan[_vertCount];
-	_vertStaticData = new VertexDataStatic[_vertCount];
-	Vec3f *bitangents = new Vec3f[_vertCount];
-
-	// Init with default data
-	memset( _vertPosData, 0, _vertCount * sizeof( Vec3f ) );
-	memset( _vertTanData, 0, _vertCount * sizeof( VertexDataTan ) );
-	memset( _vertStaticData, 0, _vertCount * sizeof( VertexDataStatic ) );
-	for( uint32 i = 0; i < _vertCount; ++i ) _vertStaticData[i].weightVec[0] = 1;
-
 	for( uint32 i = 0; i < count; ++i )
 	{
-		unsigned char uc;
-		short sh;
+		static const uint32 elemSizes[8] = { 12, 6, 6, 6, 4, 4, 8, 8 };
+		static const char *errors[8] = { "Invalid position base stream", "Invalid normal base stream",
+			"Invalid tangent base stream", "Invalid bitangent base stream", "Invalid joint stream",
+			"Invalid weight stream", "Invalid texCoord1 stream", "Invalid texCoord2 stream" };
+		
 		uint32 streamID, streamElemSize;
+		if( !checkData( pData, dataEnd, 2, sizeof( uint32 ) ) ) { geo.error = "Invalid geometry resource"; return; }
 		memcpy( &streamID, pData, sizeof( uint32 ) ); pData += sizeof( uint32 );
 		memcpy( &streamElemSize, pData, sizeof( uint32 ) ); pData += sizeof( uint32 );
 
-		switch( streamID )
+		if( streamID < 8 && streamElemSize != elemSizes[streamID] )
 		{
-		case 0:		// Position
-			if( streamElemSize != 12 ) return raiseError( "Invalid position base stream" );
-			for( uint32 j = 0; j < streamSize; ++j )
-			{
-				memcpy( &_vertPosData[j].x, pData, sizeof( float ) ); pData += sizeof( float );
-				memcpy( &_vertPosData[j].y, pData, sizeof( float ) ); pData += sizeof( float );
-				memcpy( &_vertPosData[j].z, pData, sizeof( float ) ); pData += sizeof( float );
-			}
-			break;
-		case 1:		// Normal
-			if( streamElemSize != 6 ) return raiseError( "Invalid normal base stream" );
-			for( uint32 j = 0; j < streamSize; ++j )
-			{
-				memcpy( &sh, pData, sizeof( short ) ); pData += sizeof( short ); _vertTanData[j].normal.x = sh / 32767.0f;
-				memcpy( &sh, pData, sizeof( short ) ); pData += sizeof( short ); _vertTanData[j].normal.y = sh / 32767.0f;
-				memcpy( &sh, pData, sizeof( short ) ); pData += sizeof( short ); _vertTanData[j].normal.z = sh / 32767.0f;
-			}
-			break;
-		case 2:		// Tangent
-			if( streamElemSize != 6 ) return raiseError( "Invalid tangent base stream" );
-			for( uint32 j = 0; j < streamSize; ++j )
-			{
-				memcpy( &sh, pData, sizeof( short ) ); pData += sizeof( short ); _vertTanData[j].tangent.x = sh / 32767.0f;
-				memcpy( &sh, pData, sizeof( short ) ); pData += sizeof( short ); _vertTanData[j].tangent.y = sh / 32767.0f;
-				memcpy( &sh, pData, sizeof( short ) ); pData += sizeof( short ); _vertTanData[j].tangent.z = sh / 32767.0f;
-			}
-			break;
-		case 3:		// Bitangent
-			if( streamElemSize != 6 ) return raiseError( "Invalid bitangent base stream" );
-			for( uint32 j = 0; j < streamSize; ++j )
-			{
-				memcpy( &sh, pData, sizeof( short ) ); pData += sizeof( short ); bitangents[j].x = sh / 32767.0f;
-				memcpy( &sh, pData, sizeof( short ) ); pData += sizeof( short ); bitangents[j].y = sh / 32767.0f;
-				memcpy( &sh, pData, sizeof( short ) ); pData += sizeof( short ); bitangents[j].z = sh / 32767.0f;
-			}
-			break;
-		case 4:		// Joint indices
-			if( streamElemSize != 4 ) return raiseError( "Invalid joint stream" );
-			for( uint32 j = 0; j < streamSize; ++j )
-			{
-				memcpy( &uc, pData, sizeof( char ) ); pData += sizeof( char ); _vertStaticData[j].jointVec[0] = (float)uc;
-				memcpy( &uc, pData, sizeof( char ) ); pData += sizeof( char ); _vertStaticData[j].jointVec[1] = (float)uc;
-				memcpy( &uc, pData, sizeof( char ) ); pData += sizeof( char ); _vertStaticData[j].jointVec[2] = (float)uc;
-				memcpy( &uc, pData, sizeof( char ) ); pData += sizeof( char ); _vertStaticData[j].jointVec[3] = (float)uc;
-			}
-			break;
-		case 5:		// Weights
-			if( streamElemSize != 4 ) return raiseError( "Invalid weight stream" );
-			for( uint32 j = 0; j < streamSize; ++j )
-			{
-				memcpy( &uc, pData, sizeof( char ) ); pData += sizeof( char ); _vertStaticData[j].weightVec[0] = uc / 255.0f;
-				memcpy( &uc, pData, sizeof( char ) ); pData += sizeof( char ); _vertStaticData[j].weightVec[1] = uc / 255.0f;
-				memcpy( &uc, pData, sizeof( char ) ); pData += sizeof( char ); _vertStaticData[j].weightVec[2] = uc / 255.0f;
-				memcpy( &uc, pData, sizeof( char ) ); pData += sizeof( char ); _vertStaticData[j].weightVec[3] = uc / 255.0f;
-			}
-			break;
-		case 6:		// Texture Coord Set 1
-			if( streamElemSize != 8 ) return raiseError( "Invalid texCoord1 stream" );
-			for( uint32 j = 0; j < streamSize; ++j )
-			{
-				memcpy( &_vertStaticData[j].u0, pData, sizeof( float ) ); pData += sizeof( float );
-				memcpy( &_vertStaticData[j].v0, pData, sizeof( float ) ); pData += sizeof( float );
-			}
-			break;
-		case 7:		// Texture Coord Set 2
-			if( streamElemSize != 8 ) return raiseError( "Invalid texCoord2 stream" );
-			for( uint32 j = 0; j < streamSize; ++j )
-			{
-				memcpy( &_vertStaticData[j].u1, pData, sizeof( float ) ); pData += sizeof( float );
-				memcpy( &_vertStaticData[j].v1, pData, sizeof( float ) ); pData += sizeof( float );
-			}
-			break;
-		default:
-			pData += streamElemSize * streamSize;
-			Modules::log().writeWarning( "Geometry resource '%s': Ignoring unsupported vertex base stream", _name.c_str() );
-			continue;
+			geo.error = errors[streamID];
+			return;
 		}
-	}
+		if( !checkData( pData, dataEnd, streamSize, streamElemSize ) ) { geo.error = "Invalid geometry resource"; return; }
 
-	// Prepare bitangent data (TODO: Should be done in ColladaConv)
-	for( uint32 i = 0; i < _vertCount; ++i )
-	{
-		_vertTanData[i].handedness = _vertTanData[i].normal.cross( _vertTanData[i].tangent ).dot( bitangents[i] ) < 0 ? -1.0f : 1.0f;
+		if( streamID < 8 ) job.streams[streamID] = pData;
+		else geo.unsupportedBaseStreams = true;
+		pData += streamElemSize * streamSize;
 	}
-	delete[] bitangents;
-		
-	// Load triangle indices
+
+	// Find triangle indices
+	if( !checkData( pData, dataEnd, 1, sizeof( uint32 ) ) ) { geo.error = "Invalid geometry resource"; return; }
 	memcpy( &count, pData, sizeof( uint32 ) ); pData += sizeof( uint32 );
+	if( !checkData( pData, dataEnd, count, sizeof( uint32 ) ) ) { geo.error = "Invalid geometry resource"; return; }
+	job.indices = pData;
+	pData += count * sizeof( uint32 );
+	
+	// Decode streams; normals and tangents are zero-initialized by their constructors, all other
+	// data is completely written by the jobs
+	geo.vertCount = streamSize;
+	geo.indexCount = count;
+	geo.vertPosData = new Vec3f[streamSize];
+	geo.vertTanData = new VertexDataTan[streamSize];
+	geo.vertStaticData = new VertexDataStatic[streamSize];
+	geo.indexData = new char[count * (count <= 65535 ? 2 : 4)];
 
-	_indexCount = count;
-	_16BitIndices = count <= 65535;
-	_indexData = new char[count * (_16BitIndices ? 2 : 4)];
-	if( _16BitIndices )
+	uint32 numBlocks = (streamSize + GeoHandednessBlockSize - 1) / GeoHandednessBlockSize;
+	if( parallel )
 	{
-		uint32 index;
-		uint16 *pIndexData = (uint16 *)_indexData;
-		for( uint32 i = 0; i < count; ++i )
-		{
-			memcpy( &index, pData, sizeof( uint32 ) ); pData += sizeof( uint32 );
-			pIndexData[i] = (uint16)index;
-		}
+		Modules::jobMan().run( decodeGeoStreamJob, &job, GeoDecodeJobCount );
+		Modules::jobMan().run( decodeHandednessJob, &job, numBlocks );
 	}
 	else
 	{
-		uint32 *pIndexData = (uint32 *)_indexData;
-		for( uint32 i = 0; i < count; ++i )
-		{
-			memcpy( &pIndexData[i], pData, sizeof( uint32 ) ); pData += sizeof( uint32 );
-		}
+		for( uint32 i = 0; i < GeoDecodeJobCount; ++i ) decodeGeoStreamJob( &job, i );
+		for( uint32 i = 0; i < numBlocks; ++i ) decodeHandednessJob( &job, i );
 	}
 
 	// Load morph targets
 	uint32 numTargets;
+	if( !checkData( pData, dataEnd, 1, sizeof( uint32 ) ) ) { geo.error = "Invalid geometry resource"; return; }
 	memcpy( &numTargets, pData, sizeof( uint32 ) ); pData += sizeof( uint32 );
 
-	_morphTargets.resize( numTargets );
+	// The streams of all targets are located first, so that the deltas can be regrouped by vertex
+	// directly from the file data
+	std::vector< MorphDecodeStreams > targetStreams( numTargets );
+	std::vector< uint32 > vertSlots( numTargets > 0 ? streamSize : 0, 0 );
+	uint32 numDiffs = 0;
+	
+	geo.morphTargets.resize( numTargets );
 	for( uint32 i = 0; i < numTargets; ++i )
 	{
-		MorphTarget &mt = _morphTargets[i];
+		MorphTarget &mt = geo.morphTargets[i];
+		MorphDecodeStreams &mts = targetStreams[i];
 		char name[256];
 		
+		if( !checkData( pData, dataEnd, 1, 256 + sizeof( uint32 ) ) ) { geo.error = "Invalid geometry resource"; return; }
 		memcpy( name, pData, 256 ); pData += 256;
+		name[255] = '\0';
 		mt.name = name;
 		
-		// Read vertex indices
+		// Count vertex indices
 		uint32 morphStreamSize;
 		memcpy( &morphStreamSize, pData, sizeof( uint32 ) ); pData += sizeof( uint32 );
-		mt.diffs.resize( morphStreamSize );
+		if( !checkData( pData, dataEnd, morphStreamSize, sizeof( uint32 ) ) ) { geo.error = "Invalid geometry resource"; return; }
+		mt.numDiffs = morphStreamSize;
+		numDiffs += morphStreamSize;
+		
+		mts.indices = pData;
 		for( uint32 j = 0; j < morphStreamSize; ++j )
 		{
-			memcpy( &mt.diffs[j].vertIndex, pData, sizeof( uint32 ) ); pData += sizeof( uint32 );
+			uint32 index;
+			memcpy( &index, pData, sizeof( uint32 ) ); pData += sizeof( uint32 );
+			if( index >= streamSize )
+			{
+				geo.error = "Invalid morph target vertex index";
+				return;
+			}
+			++vertSlots[index];
 		}
 		
 		// Loop over streams
+		for( uint32 j = 0; j < 3; ++j ) mts.streams[j] = 0x0;
+		
+		if( !checkData( pData, dataEnd, 1, sizeof( uint32 ) ) ) { geo.error = "Invalid geometry resource"; return; }
 		memcpy( &count, pData, sizeof( uint32 ) ); pData += sizeof( uint32 );
 		for( uint32 j = 0; j < count; ++j )
 		{
 			uint32 streamID, streamElemSize;
+			if( !checkData( pData, dataEnd, 2, sizeof( uint32 ) ) ) { geo.error = "Invalid geometry resource"; return; }
 			memcpy( &streamID, pData, sizeof( uint32 ) ); pData += sizeof( uint32 );
 			memcpy( &streamElemSize, pData, sizeof( uint32 ) ); pData += sizeof( uint32 );
 
 			switch( streamID )
 			{
 			case 0:		// Position
-				if( streamElemSize != 12 ) return raiseError( "Invalid position morph stream" );
-				for( uint32 k = 0; k < morphStreamSize; ++k )
-				{
-					memcpy( &mt.diffs[k].posDiff.x, pData, sizeof( float ) ); pData += sizeof( float );
-					memcpy( &mt.diffs[k].posDiff.y, pData, sizeof( float ) ); pData += sizeof( float );
-					memcpy( &mt.diffs[k].posDiff.z, pData, sizeof( float ) ); pData += sizeof( float );
-				}
-				break;
 			case 1:		// Normal
-				if( streamElemSize != 12 ) return raiseError( "Invalid normal morph stream" );
-				for( uint32 k = 0; k < morphStreamSize; ++k )
-				{
-					memcpy( &mt.diffs[k].normDiff.x, pData, sizeof( float ) ); pData += sizeof( float );
-					memcpy( &mt.diffs[k].normDiff.y, pData, sizeof( float ) ); pData += sizeof( float );
-					memcpy( &mt.diffs[k].normDiff.z, pData, sizeof( float ) ); pData += sizeof( float );
-				}
-				break;
 			case 2:		// Tangent
-				if( streamElemSize != 12 ) return raiseError( "Invalid tangent morph stream" );
-				for( uint32 k = 0; k < morphStreamSize; ++k )
+			case 3:		// Bitangent
+				if( streamElemSize != 12 )
 				{
-					memcpy( &mt.diffs[k].tanDiff.x, pData, sizeof( float ) ); pData += sizeof( float );
-					memcpy( &mt.diffs[k].tanDiff.y, pData, sizeof( float ) ); pData += sizeof( float );
-					memcpy( &mt.diffs[k].tanDiff.z, pData, sizeof( float ) ); pData += sizeof( float );
+					static const char *errors[4] = { "Invalid position morph stream", "Invalid normal morph stream",
+						"Invalid tangent morph stream", "Invalid bitangent morph stream" };
+					geo.error = errors[streamID];
+					return;
 				}
 				break;
-			case 3:		// Bitangent
-				if( streamElemSize != 12 ) return raiseError( "Invalid bitangent morph stream" );
-				
-				// Skip data (TODO: remove from format)
-				pData += morphStreamSize * sizeof( float ) * 3;
-				break;
 			default:
-				pData += streamElemSize * morphStreamSize;
-				Modules::log().writeWarning( "Geometry resource '%s': Ignoring unsupported vertex morph stream", _name.c_str() );
-				continue;
+				geo.unsupportedMorphStreams = true;
+				break;
 			}
+			if( !checkData( pData, dataEnd, morphStreamSize, streamElemSize ) ) { geo.error = "Invalid geometry resource"; return; }
+
+			// Bitangent data is skipped (TODO: remove from format)
+			if( streamID < 3 ) mts.streams[streamID] = pData;
+			pData += streamElemSize * morphStreamSize;
 		}
 	}
 
-	// Find min/max morph target vertex indices
-	_minMorphIndex = (unsigned)_vertCount;
-	_maxMorphIndex = 0;
-	for( uint32 i = 0; i < _morphTargets.size(); ++i )
+	// Group deltas by vertex, keeping the target order for each vertex
+	MorphDeltaStreams &md = geo.morphDeltas;
+	if( numDiffs > 0 ) md.firstDelta.push_back( 0 );
+	for( uint32 i = 0; i < (uint32)vertSlots.size(); ++i )
 	{
-		for( uint32 j = 0; j < _morphTargets[i].diffs.size(); ++j )
+		if( vertSlots[i] == 0 ) continue;
+		
+		uint32 first = md.firstDelta.back();
+		md.verts.push_back( i );
+		md.firstDelta.push_back( first + vertSlots[i] );
+		vertSlots[i] = first;
+	}
+	
+	// Deltas of missing streams stay zero
+	md.targets.resize( numDiffs );
+	md.posDeltas.resize( numDiffs * 3 + 1 );
+	md.normDeltas.resize( numDiffs * 3 + 1 );
+	md.tanDeltas.resize( numDiffs * 3 + 1 );
+	if( numDiffs > 0 )
+	{
+		// Each stream is scattered by a different job, using the precomputed slot of each delta
+		std::vector< uint32 > diffSlots( numDiffs );
+		for( uint32 i = 0, diff = 0; i < numTargets; ++i )
 		{
-			_minMorphIndex = std::min( _minMorphIndex, _morphTargets[i].diffs[j].vertIndex );
-			_maxMorphIndex = std::max( _maxMorphIndex, _morphTargets[i].diffs[j].vertIndex );
+			for( uint32 j = 0; j < geo.morphTargets[i].numDiffs; ++j, ++diff )
+			{
+				uint32 index;
+				memcpy( &index, targetStreams[i].indices + j * sizeof( uint32 ), sizeof( uint32 ) );
+				diffSlots[diff] = vertSlots[index]++;
+			}
 		}
+
+		MorphScatterJob job = { &geo, &targetStreams[0], &diffSlots[0] };
+		if( parallel )
+			Modules::jobMan().run( scatterMorphDeltasJob, &job, 4 );
+		else
+			for( uint32 i = 0; i < 4; ++i ) scatterMorphDeltasJob( &job, i );
+	}
+}
+
+
+void *GeometryResource::decode( const char *data, int size )
+{
+	// Several resources are decoded in parallel, so the streams of each one are decoded serially
+	DecodedGeometry *geo = new DecodedGeometry();
+	decodeGeometry( data, size, *geo, false );
+	
+	return geo;
+}
+
+
+bool GeometryResource::load( const char *data, int size )
+{
+	// The streams are independent, so they are decoded in parallel if a single resource is loaded
+	DecodedGeometry *geo = 0x0;
+	if( !_loaded )
+	{
+		geo = new DecodedGeometry();
+		decodeGeometry( data, size, *geo, true );
+	}
+	
+	return loadDecoded( data, size, geo );
+}
+
+
+bool GeometryResource::loadDecoded( const char *data, int size, void *decoded )
+{
+	DecodedGeometry *geo = (DecodedGeometry *)decoded;
+	
+	if( !Resource::load( data, size ) )
+	{
+		delete geo;
+		return false;
 	}
-	if( _minMorphIndex > _maxMorphIndex )
+	if( geo == 0x0 || !geo->error.empty() )
+	{
+		string msg = geo != 0x0 ? geo->error : "Invalid geometry resource";
+		delete geo;
+		return raiseError( msg );
+	}
+
+	if( geo->tooManyJoints )
+		Modules::log().writeWarning( "Geometry resource '%s': Model has more than 75 joints; this may cause defective behavior", _name.c_str() );
+	if( geo->unsupportedBaseStreams )
+		Modules::log().writeWarning( "Geometry resource '%s': Ignoring unsupported vertex base stream", _name.c_str() );
+	if( geo->unsupportedMorphStreams )
+		Modules::log().writeWarning( "Geometry resource '%s': Ignoring unsupported vertex morph stream", _name.c_str() );
+
+	// Take over decoded data
+	_joints.swap( geo->joints );
+	_morphTargets.swap( geo->morphTargets );
+	_morphDeltas.swap( geo->morphDeltas );
+	_vertCount = geo->vertCount;
+	_indexCount = geo->indexCount;
+	_16BitIndices = _indexCount <= 65535;
+	_vertPosData = geo->vertPosData; geo->vertPosData = 0x0;
+	_vertTanData = geo->vertTanData; geo->vertTanData = 0x0;
+	_vertStaticData = geo->vertStaticData; geo->vertStaticData = 0x0;
+	_indexData = geo->indexData; geo->indexData = 0x0;
+	delete geo;
+
+	// Find min/max morph target vertex indices
+	if( !_morphDeltas.verts.empty() )
+	{
+		_minMorphIndex = _morphDeltas.verts.front();
+		_maxMorphIndex = _morphDeltas.verts.back();
+	}
+	else
 	{
 		_minMorphIndex = 0; _maxMorphIndex = 0;
 	}
@@ -440,6 +897,13 @@ bool GeometryResource::load( const char *data, int size )
 		_posVBuf = gRDI->createVertexBuffer(_vertCount * sizeof( Vec3f ), _vertPosData );
 		_tanVBuf = gRDI->createVertexBuffer( _vertCount * sizeof( VertexDataTan ), _vertTanData );
 		_staticVBuf = gRDI->createVertexBuffer( _vertCount * sizeof( VertexDataStatic ), _vertStaticData );
+
+		// Morph targets are applied on the CPU, so geometry with morph targets keeps all data
+		if( ((_flags & ResourceFlags::GeoReleaseCPUData) || Modules::config().releaseGeoCPUData) &&
+		    _morphTargets.empty() )
+		{
+			releaseCPUData();
+		}
 	}
 	
 	return true;
@@ -491,16 +955,26 @@ void *GeometryResource::mapStream( int elem, int elemIdx, int stream, bool read,
 			switch( stream )
 			{
 			case GeometryResData::GeoIndexStream:
-				if( write ) mappedWriteStream = GeometryResData::GeoIndexStream;
+				if( write )
+				{
+					unshareStreams();
+					mappedWriteStream = GeometryResData::GeoIndexStream;
+				}
 				return _indexData;
 			case GeometryResData::GeoVertPosStream:
 				if( write ) mappedWriteStream = GeometryResData::GeoVertPosStream;
 				return _vertPosData != 0x0 ? _vertPosData : 0x0;
 			case GeometryResData::GeoVertTanStream:
+				restoreCPUData();
 				if( write ) mappedWriteStream = GeometryResData::GeoVertTanStream;
 				return _vertTanData != 0x0 ? _vertTanData : 0x0;
 			case GeometryResData::GeoVertStaticStream:
-				if( write ) mappedWriteStream = GeometryResData::GeoVertStaticStream;
+				restoreCPUData();
+				if( write )
+				{
+					unshareStreams();
+					mappedWriteStream = GeometryResData::GeoVertStaticStream;
+				}
 				return _vertStaticData != 0x0 ? _vertStaticData : 0x0;
 			}
 		}
@@ -539,17 +1013,59 @@ void GeometryResource::unmapStream()
 }
 
 
+void GeometryResource::getMemUsage( uint32 &cpuMem, uint32 &gpuMem )
+{
+	// Streams shared with clones are split between their users so that they are counted once
+	uint32 dataSize = _vertCount * (sizeof( Vec3f ) + sizeof( VertexDataTan ));
+	dataSize += _sharedStreams != 0x0 ? getSharedDataSize() / _sharedStreams->refCount : getSharedDataSize();
+
+	// Tangent space and static streams may have been released after upload
+	cpuMem = dataSize;
+	if( _indexData == 0x0 ) cpuMem = 0;
+	else if( _vertTanData == 0x0 || _vertStaticData == 0x0 )
+		cpuMem = _indexCount * (_16BitIndices ? 2 : 4) + _vertCount * sizeof( Vec3f );
+	cpuMem += (uint32)((_morphDeltas.verts.size() + _morphDeltas.firstDelta.size() +
+	                    _morphDeltas.targets.size()) * sizeof( uint32 ));
+	cpuMem += (uint32)((_morphDeltas.posDeltas.size() + _morphDeltas.normDeltas.size() +
+	                    _morphDeltas.tanDeltas.size()) * sizeof( float ));
+	cpuMem += (uint32)(_joints.size() * sizeof( Joint ));
+	
+	gpuMem = _indexBuf != 0 && _indexBuf != defIndexBuffer ? dataSize : 0;
+}
+
+
+void GeometryResource::addDirtyRange( int stream, uint32 firstVert, uint32 lastVert )
+{
+	if( lastVert > _vertCount ) lastVert = _vertCount;
+	
+	switch( stream )
+	{
+	case GeometryResData::GeoVertPosStream:
+		_dirtyPosRange.add( firstVert, lastVert );
+		break;
+	case GeometryResData::GeoVertTanStream:
+		_dirtyTanRange.add( firstVert, lastVert );
+		break;
+	}
+}
+
+
 void GeometryResource::updateDynamicVertData()
 {
-	// Upload dynamic stream data
-	if( _vertPosData != 0x0 )
+	// Upload modified ranges of dynamic stream data
+	if( _vertPosData != 0x0 && !_dirtyPosRange.empty() && _posVBuf != defVertBuffer )
 	{
-		gRDI->updateBufferData( _posVBuf, 0, _vertCount * sizeof( Vec3f ), _vertPosData );
+		gRDI->streamBufferData( _posVBuf, _dirtyPosRange.begin * sizeof( Vec3f ),
+			(_dirtyPosRange.end - _dirtyPosRange.begin) * sizeof( Vec3f ), &_vertPosData[_dirtyPosRange.begin] );
 	}
-	if( _vertTanData != 0x0 )
+	if( _vertTanData != 0x0 && !_dirtyTanRange.empty() && _tanVBuf != defVertBuffer )
 	{
-		gRDI->updateBufferData( _tanVBuf, 0, _vertCount * sizeof( VertexDataTan ), _vertTanData );
+		gRDI->streamBufferData( _tanVBuf, _dirtyTanRange.begin * sizeof( VertexDataTan ),
+			(_dirtyTanRange.end - _dirtyTanRange.begin) * sizeof( VertexDataTan ), &_vertTanData[_dirtyTanRange.begin] );
 	}
+
+	_dirtyPosRange.clear();
+	_dirtyTanRange.clear();
 }
 
 }  // namespace
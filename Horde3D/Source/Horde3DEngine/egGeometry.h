@@ -64,18 +64,60 @@ struct Joint
 };
 
 
-struct MorphDiff
+struct MorphTarget
 {
-	uint32  vertIndex;
-	Vec3f   posDiff;
-	Vec3f   normDiff, tanDiff;
+	std::string  name;
+	uint32       numDiffs;
 };
 
 
-struct MorphTarget
+struct MorphDeltaStreams	// Deltas of all morph targets, grouped by vertex
+{
+	// The deltas of vertex verts[i] are stored in the range [firstDelta[i], firstDelta[i + 1]),
+	// ordered by morph target; the delta streams have one float of padding at the end, so that
+	// each delta can be loaded as a four component vector with an undefined w
+	std::vector< uint32 >  verts;
+	std::vector< uint32 >  firstDelta;
+	std::vector< uint32 >  targets;
+	std::vector< float >   posDeltas, normDeltas, tanDeltas;
+
+	void swap( MorphDeltaStreams &other )
+	{
+		verts.swap( other.verts );
+		firstDelta.swap( other.firstDelta );
+		targets.swap( other.targets );
+		posDeltas.swap( other.posDeltas );
+		normDeltas.swap( other.normDeltas );
+		tanDeltas.swap( other.tanDeltas );
+	}
+};
+
+
+struct VertexRange	// Half-open range of vertex indices
+{
+	uint32  begin, end;
+
+	VertexRange() : begin( 0 ), end( 0 ) {}
+	
+	bool empty() const { return begin >= end; }
+	void clear() { begin = 0; end = 0; }
+	void add( uint32 first, uint32 last )
+	{
+		if( first >= last ) return;
+		if( empty() ) { begin = first; end = last; return; }
+		if( first < begin ) begin = first;
+		if( last > end ) end = last;
+	}
+};
+
+
+struct GeometrySharedStreams	// Immutable streams shared between a geometry and its clones
 {
-	std::string               name;
-	std::vector< MorphDiff >  diffs;
+	char              *indexData;
+	VertexDataStatic  *vertStaticData;
+	uint32            indexBuf, staticVBuf;
+	uint32            dataSize;
+	uint32            refCount;
 };
 
 // =================================================================================================
@@ -95,12 +137,16 @@ public:
 	void initDefault();
 	void release();
 	bool load( const char *data, int size );
+	void *decode( const char *data, int size );
+	bool loadDecoded( const char *data, int size, void *decoded );
 
 	int getElemCount( int elem );
 	int getElemParamI( int elem, int elemIdx, int param );
 	void *mapStream( int elem, int elemIdx, int stream, bool read, bool write );
 	void unmapStream();
+	void getMemUsage( uint32 &cpuMem, uint32 &gpuMem );
 
+	void addDirtyRange( int stream, uint32 firstVert, uint32 lastVert );
 	void updateDynamicVertData();
 
 	uint32 getVertCount() { return _vertCount; }
@@ -114,14 +160,24 @@ public:
 	uint32 getIndexBuf() { return _indexBuf; }
 	Matrix4f &getInvBindMat( uint32 jointIndex ) { return _joints[jointIndex].invBindMat; }
 
+	static uint64 getSharedMemSaving() { return sharedMemSaving; }
+
 public:
 	static uint32 defVertBuffer, defIndexBuffer;
 
 private:
 	bool raiseError( const std::string &msg );
+	uint32 getSharedDataSize();
+	void releaseSharedStreams();
+	void unshareStreams();
+	void releaseCPUData();
+	bool restoreCPUData();
 
 private:
 	static int                  mappedWriteStream;
+	static uint64               sharedMemSaving;
+	
+	GeometrySharedStreams       *_sharedStreams;  // Index and static streams if shared with clones
 	
 	uint32                      _indexBuf, _posVBuf, _tanVBuf, _staticVBuf;
 
@@ -135,7 +191,9 @@ private:
 	std::vector< Joint >        _joints;
 	BoundingBox                 _skelAABB;
 	std::vector< MorphTarget >  _morphTargets;
+	MorphDeltaStreams           _morphDeltas;
 	uint32                      _minMorphIndex, _maxMorphIndex;
+	VertexRange                 _dirtyPosRange, _dirtyTanRange;  // Dynamic data not yet uploaded
 
 	friend class Renderer;
 	friend class ModelNode;
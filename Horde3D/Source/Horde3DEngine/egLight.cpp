@@ -29,6 +29,8 @@ LightNode::LightNode( const LightNodeTpl &lightTpl ) :
 	_materialRes = lightTpl.matRes;
 	_lightingContext = lightTpl.lightingContext;
 	_shadowContext = lightTpl.shadowContext;
+	_lightingContextId = ShaderResource::getContextId( _lightingContext );
+	_shadowContextId = ShaderResource::getContextId( _shadowContext );
 	_radius = lightTpl.radius; _fov = lightTpl.fov;
 	_diffuseCol = Vec3f( lightTpl.col_R, lightTpl.col_G, lightTpl.col_B );
 	_diffuseColMult = lightTpl.colMult;
@@ -40,11 +42,6 @@ LightNode::LightNode( const LightNodeTpl &lightTpl ) :
 
 LightNode::~LightNode()
 {
-	for( uint32 i = 0; i < _occQueries.size(); ++i )
-	{
-		if( _occQueries[i] != 0 )
-			gRDI->destroyQuery( _occQueries[i] );
-	}
 }
 
 
@@ -221,9 +218,11 @@ void LightNode::setParamStr( int param, const char *value )
 	{
 	case LightNodeParams::LightingContextStr:
 		_lightingContext = value;
+		_lightingContextId = ShaderResource::getContextId( _lightingContext );
 		return;
 	case LightNodeParams::ShadowContextStr:
 		_shadowContext = value;
+		_shadowContextId = ShaderResource::getContextId( _shadowContext );
 		return;
 	}
 
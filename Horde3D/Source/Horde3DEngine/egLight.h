@@ -96,15 +96,13 @@ private:
 
 	PMaterialResource      _materialRes;
 	std::string            _lightingContext, _shadowContext;
+	uint32                 _lightingContextId, _shadowContextId;
 	float                  _radius, _fov;
 	Vec3f                  _diffuseCol;
 	float                  _diffuseColMult;
 	uint32                 _shadowMapCount;
 	float                  _shadowSplitLambda, _shadowMapBias;
 
-	std::vector< uint32 >  _occQueries;
-	std::vector< uint32 >  _lastVisited;
-
 	friend class SceneManager;
 	friend class Renderer;
 };
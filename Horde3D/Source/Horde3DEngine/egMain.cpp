@@ -114,6 +114,32 @@ DLLEXP void h3dRender( NodeHandle cameraNode )
 }
 
 
+DLLEXP void h3dRenderViews( const NodeHandle *cameraNodes, int count )
+{
+	if( count <= 0 ) return;
+	if( cameraNodes == 0x0 )
+	{
+		Modules::setError( "Invalid pointer in h3dRenderViews" );
+		return;
+	}
+	if( count > (int)MaxRenderViews )
+	{
+		Modules::setError( "Too many cameras in h3dRenderViews" );
+		return;
+	}
+
+	CameraNode *camNodes[MaxRenderViews];
+	for( int i = 0; i < count; ++i )
+	{
+		SceneNode *sn = Modules::sceneMan().resolveNodeHandle( cameraNodes[i] );
+		APIFUNC_VALIDATE_NODE_TYPE( sn, SceneNodeTypes::Camera, "h3dRenderViews", APIFUNC_RET_VOID );
+		camNodes[i] = (CameraNode *)sn;
+	}
+	
+	Modules::renderer().renderViews( camNodes, (uint32)count );
+}
+
+
 DLLEXP void h3dFinalizeFrame()
 {
 	Modules::renderer().finalizeFrame();
@@ -263,6 +289,27 @@ DLLEXP bool h3dLoadResource( ResHandle res, const char *data, int size )
 }
 
 
+DLLEXP bool h3dLoadResourceBatch( int count, const ResHandle *resources, const char **data, const int *sizes )
+{
+	if( count <= 0 ) return true;
+	if( resources == 0x0 || data == 0x0 || sizes == 0x0 )
+	{	
+		Modules::setError( "Invalid pointer in h3dLoadResourceBatch" );
+		return false;
+	}
+
+	static vector< Resource * > resObjs;
+	resObjs.resize( count );
+	for( int i = 0; i < count; ++i )
+	{
+		resObjs[i] = Modules::resMan().resolveResHandle( resources[i] );
+		if( resObjs[i] == 0x0 ) Modules::setError( "Invalid resource handle in h3dLoadResourceBatch" );
+	}
+	
+	return Modules::resMan().loadResources( count, &resObjs[0], data, sizes );
+}
+
+
 DLLEXP void h3dUnloadResource( ResHandle res )
 {
 	Resource *resObj = Modules::resMan().resolveResHandle( res );
@@ -374,6 +421,29 @@ DLLEXP void h3dReleaseUnusedResources()
 }
 
 
+DLLEXP void h3dGetResMemUsage( int type, float *cpuMem, float *gpuMem )
+{
+	uint64 resCPUMem, resGPUMem;
+	Modules::resMan().getMemUsage( type, resCPUMem, resGPUMem );
+
+	if( cpuMem != 0x0 ) *cpuMem = (resCPUMem / 1024) / 1024.0f;
+	if( gpuMem != 0x0 ) *gpuMem = (resGPUMem / 1024) / 1024.0f;
+}
+
+
+DLLEXP ResHandle h3dQueryResMemConsumer( int type, int index, float *cpuMem, float *gpuMem )
+{
+	uint32 resCPUMem = 0, resGPUMem = 0;
+	Resource *res = Modules::resMan().queryMemConsumer( type, index );
+	if( res != 0x0 ) res->getMemUsage( resCPUMem, resGPUMem );
+
+	if( cpuMem != 0x0 ) *cpuMem = (resCPUMem / 1024) / 1024.0f;
+	if( gpuMem != 0x0 ) *gpuMem = (resGPUMem / 1024) / 1024.0f;
+	
+	return res != 0x0 ? res->getHandle() : 0;
+}
+
+
 DLLEXP ResHandle h3dCreateTexture( const char *name, int width, int height, int fmt, int flags )
 {
 	TextureResource *texRes = new TextureResource( safeStr( name, 0 ), (uint32)width,
@@ -396,6 +466,24 @@ DLLEXP void h3dSetShaderPreambles( const char *vertPreamble, const char *fragPre
 }
 
 
+DLLEXP const char *h3dGetShaderManifest()
+{
+	return ShaderResource::getManifest().c_str();
+}
+
+
+DLLEXP void h3dPrecompileShaders( const char *manifest )
+{
+	if( manifest == 0x0 )
+	{
+		Modules::setError( "Invalid pointer in h3dPrecompileShaders" );
+		return;
+	}
+	
+	ShaderResource::precompileManifest( manifest );
+}
+
+
 DLLEXP bool h3dSetMaterialUniform( ResHandle materialRes, const char *name, float a, float b, float c, float d )
 {
 	Resource *resObj = Modules::resMan().resolveResHandle( materialRes );
@@ -567,6 +655,70 @@ DLLEXP void h3dSetNodeTransMat( NodeHandle node, const float *mat4x4 )
 }
 
 
+DLLEXP void h3dSetNodeTransMatBatch( int count, const NodeHandle *nodes, const float *mat4x4s )
+{
+	if( count <= 0 ) return;
+	if( nodes == 0x0 || mat4x4s == 0x0 )
+	{	
+		Modules::setError( "Invalid pointer in h3dSetNodeTransMatBatch" );
+		return;
+	}
+	
+	static Matrix4f mat;
+	SceneManager &sceneMan = Modules::sceneMan();
+
+	sceneMan.beginDeferredDirty();
+	for( int i = 0; i < count; ++i )
+	{
+		SceneNode *sn = sceneMan.resolveNodeHandle( nodes[i] );
+		if( sn == 0x0 )
+		{
+			Modules::setError( "Invalid node handle in h3dSetNodeTransMatBatch" );
+			continue;
+		}
+
+		memcpy( mat.c, mat4x4s + i * 16, 16 * sizeof( float ) );
+		sn->setTransform( mat );
+	}
+	sceneMan.endDeferredDirty();
+}
+
+
+DLLEXP void h3dSetNodeTransformBatch( int count, const NodeHandle *nodes, const float *positions,
+                                      const float *rotations, const float *scales )
+{
+	if( count <= 0 ) return;
+	if( nodes == 0x0 || positions == 0x0 || rotations == 0x0 )
+	{	
+		Modules::setError( "Invalid pointer in h3dSetNodeTransformBatch" );
+		return;
+	}
+	
+	SceneManager &sceneMan = Modules::sceneMan();
+	Vec3f scale( 1, 1, 1 );
+
+	sceneMan.beginDeferredDirty();
+	for( int i = 0; i < count; ++i )
+	{
+		SceneNode *sn = sceneMan.resolveNodeHandle( nodes[i] );
+		if( sn == 0x0 )
+		{
+			Modules::setError( "Invalid node handle in h3dSetNodeTransformBatch" );
+			continue;
+		}
+
+		const float *pos = positions + i * 3, *rot = rotations + i * 4;
+		if( scales != 0x0 )
+		{
+			scale.x = scales[i * 3]; scale.y = scales[i * 3 + 1]; scale.z = scales[i * 3 + 2];
+		}
+		
+		sn->setTransform( Vec3f( pos[0], pos[1], pos[2] ), Quaternion( rot[0], rot[1], rot[2], rot[3] ), scale );
+	}
+	sceneMan.endDeferredDirty();
+}
+
+
 DLLEXP int h3dGetNodeParamI( NodeHandle node, int param )
 {
 	SceneNode *sn = Modules::sceneMan().resolveNodeHandle( node );
@@ -671,6 +823,18 @@ DLLEXP NodeHandle h3dGetNodeFindResult( int index )
 }
 
 
+DLLEXP int h3dQueryNodesInBox( float minX, float minY, float minZ, float maxX, float maxY, float maxZ, int type )
+{
+	return Modules::sceneMan().queryNodesInBox( Vec3f( minX, minY, minZ ), Vec3f( maxX, maxY, maxZ ), type );
+}
+
+
+DLLEXP int h3dQueryNodesInSphere( float cx, float cy, float cz, float radius, int type )
+{
+	return Modules::sceneMan().queryNodesInSphere( Vec3f( cx, cy, cz ), radius, type );
+}
+
+
 DLLEXP void h3dSetNodeUniforms( NodeHandle node, float *uniformData, int count )
 {
 	SceneNode *sn = Modules::sceneMan().resolveNodeHandle( node );
@@ -679,6 +843,31 @@ DLLEXP void h3dSetNodeUniforms( NodeHandle node, float *uniformData, int count )
 }
 
 
+DLLEXP void h3dSetNodeUniformsBatch( int count, const NodeHandle *nodes, float *uniformData, int stride )
+{
+	if( count <= 0 ) return;
+	if( nodes == 0x0 || uniformData == 0x0 || stride <= 0 )
+	{	
+		Modules::setError( "Invalid argument in h3dSetNodeUniformsBatch" );
+		return;
+	}
+
+	SceneManager &sceneMan = Modules::sceneMan();
+	
+	for( int i = 0; i < count; ++i )
+	{
+		SceneNode *sn = sceneMan.resolveNodeHandle( nodes[i] );
+		if( sn == 0x0 )
+		{
+			Modules::setError( "Invalid node handle in h3dSetNodeUniformsBatch" );
+			continue;
+		}
+		
+		sn->setCustomInstData( uniformData + i * stride, (uint32)stride );
+	}
+}
+
+
 DLLEXP NodeHandle h3dCastRay( NodeHandle node, float ox, float oy, float oz, float dx, float dy, float dz, int numNearest )
 {
 	SceneNode *sn = Modules::sceneMan().resolveNodeHandle( node );
@@ -773,6 +962,34 @@ DLLEXP void h3dSetModelAnimParams( NodeHandle modelNode, int stage, float time,
 }
 
 
+DLLEXP void h3dSetModelAnimParamsBatch( int count, const NodeHandle *modelNodes, int stage,
+                                        const float *times, const float *weights )
+{
+	if( count <= 0 ) return;
+	if( modelNodes == 0x0 || times == 0x0 )
+	{	
+		Modules::setError( "Invalid pointer in h3dSetModelAnimParamsBatch" );
+		return;
+	}
+	
+	SceneManager &sceneMan = Modules::sceneMan();
+
+	sceneMan.beginDeferredDirty();
+	for( int i = 0; i < count; ++i )
+	{
+		SceneNode *sn = sceneMan.resolveNodeHandle( modelNodes[i] );
+		if( sn == 0x0 || sn->getType() != SceneNodeTypes::Model )
+		{
+			Modules::setError( "Invalid node handle in h3dSetModelAnimParamsBatch" );
+			continue;
+		}
+
+		((ModelNode *)sn)->setAnimParams( stage, times[i], weights != 0x0 ? weights[i] : 1.0f );
+	}
+	sceneMan.endDeferredDirty();
+}
+
+
 DLLEXP bool h3dSetModelMorpher( NodeHandle modelNode, const char *target, float weight )
 {
 	SceneNode *sn = Modules::sceneMan().resolveNodeHandle( modelNode );
@@ -791,6 +1008,33 @@ DLLEXP void h3dUpdateModel( NodeHandle modelNode, int flags )
 }
 
 
+DLLEXP void h3dUpdateModelBatch( int count, const NodeHandle *modelNodes, int flags )
+{
+	if( count <= 0 ) return;
+	if( modelNodes == 0x0 )
+	{	
+		Modules::setError( "Invalid pointer in h3dUpdateModelBatch" );
+		return;
+	}
+
+	static vector< ModelNode * > models;
+	models.resize( 0 );
+	for( int i = 0; i < count; ++i )
+	{
+		SceneNode *sn = Modules::sceneMan().resolveNodeHandle( modelNodes[i] );
+		if( sn == 0x0 || sn->getType() != SceneNodeTypes::Model )
+		{
+			Modules::setError( "Invalid node handle in h3dUpdateModelBatch" );
+			continue;
+		}
+
+		models.push_back( (ModelNode *)sn );
+	}
+
+	if( !models.empty() ) ModelNode::updateBatch( &models[0], (uint32)models.size(), flags );
+}
+
+
 DLLEXP NodeHandle h3dAddMeshNode( NodeHandle parent, const char *name, ResHandle materialRes,
                                   int batchStart, int batchCount, int vertRStart, int vertREnd )
 {
@@ -25,6 +25,9 @@ namespace Horde3D {
 using namespace std;
 
 
+map< string, uint32 > MaterialResource::_classIds;
+
+
 MaterialResource::MaterialResource( const string &name, int flags ) :
 	Resource( ResourceTypes::Material, name, flags )
 {
@@ -43,6 +46,7 @@ Resource *MaterialResource::clone()
 	MaterialResource *res = new MaterialResource( "", _flags );
 
 	*res = *this;
+	res->_bindingTables.clear();
 	
 	return res;
 }
@@ -54,6 +58,7 @@ void MaterialResource::initDefault()
 	_combMask = 0;
 	_matLink = 0x0;
 	_class = "";
+	updateClassBits();
 }
 
 
@@ -66,6 +71,7 @@ void MaterialResource::release()
 	_samplers.clear();
 	_uniforms.clear();
 	_shaderFlags.clear();
+	_bindingTables.clear();
 }
 
 
@@ -99,6 +105,7 @@ bool MaterialResource::load( const char *data, int size )
 
 	// Class
     _class = rootNode.getAttribute( "class", "" );
+	updateClassBits();
 
 	// Link
 	if( strcmp( rootNode.getAttribute( "link", "" ), "" ) != 0 )
@@ -212,41 +219,50 @@ bool MaterialResource::setUniform( const string &name, float a, float b, float c
 }
 
 
-bool MaterialResource::isOfClass( const string &theClass )
+int MaterialResource::getClassFilter( const string &theClass )
 {
-	static string theClass2;
+	if( theClass.empty() ) return 0;
 	
-	if( theClass != "" )
-	{
-		if( theClass[0]	!= '~' )
-		{
-			if( _class.find( theClass, 0 ) != 0 ) return false;
-			if( _class.length() > theClass.length() && _class[theClass.length()] != '.' ) return false;
-		}
-		else	// Not operator
-		{
-			theClass2 = theClass.substr( 1, theClass.length() - 1);
-			
-			if( _class.find( theClass2, 0 ) == 0 )
-			{
-				if( _class.length() == theClass2.length() )
-				{
-					return false;
-				}
-				else
-				{
-					if( _class[theClass2.length()] == '.' ) return false;
-				}
-			}
-		}
-	}
-	else
+	// Not operator
+	if( theClass[0] == '~' ) return -(int)getClassId( theClass.substr( 1, theClass.length() - 1 ) );
+
+	return (int)getClassId( theClass );
+}
+
+
+uint32 MaterialResource::getClassId( const string &name )
+{
+	// Class names are interned so that class tests are simple bit tests; 0 is reserved for the empty name
+	if( name.empty() ) return 0;
+	
+	map< string, uint32 >::iterator itr = _classIds.find( name );
+	if( itr != _classIds.end() ) return itr->second;
+
+	uint32 id = (uint32)_classIds.size() + 1;
+	_classIds[name] = id;
+
+	return id;
+}
+
+
+void MaterialResource::updateClassBits()
+{
+	_classBits.clear();
+	
+	// Special name which is hidden when drawing objects of "all classes"
+	_debugClass = (_class == "_DEBUG_");
+
+	if( _class.empty() ) return;
+	
+	// Set bits of the class and all parent classes, e.g. "Translucent" and "Translucent.Glass"
+	for( size_t pos = 0; pos != string::npos; )
 	{
-		// Special name which is hidden when drawing objects of "all classes"
-		if( _class == "_DEBUG_" ) return false;
+		pos = _class.find( '.', pos + 1 );
+		uint32 classId = getClassId( _class.substr( 0, pos ) );
+		
+		if( (classId >> 5) >= _classBits.size() ) _classBits.resize( (classId >> 5) + 1, 0 );
+		_classBits[classId >> 5] |= 1u << (classId & 31);
 	}
-
-	return true;
 }
 
 
@@ -328,7 +344,10 @@ void MaterialResource::setElemParamI( int elem, int elemIdx, int param, int valu
 			{
 				Resource *res = Modules::resMan().resolveResHandle( value );
 				if( res != 0x0 && res->getType() == ResourceTypes::Shader )
+				{
 					_shaderRes = (ShaderResource *)res;
+					_bindingTables.clear();
+				}
 				else
 					Modules::setError( "Invalid handle in h3dSetResParamI for H3DMatRes::MatShaderI" );
 				return;
@@ -344,7 +363,10 @@ void MaterialResource::setElemParamI( int elem, int elemIdx, int param, int valu
 			case MaterialResData::SampTexResI:
 				Resource *res = Modules::resMan().resolveResHandle( value );
 				if( res != 0x0 && res->getType() == ResourceTypes::Texture )
+				{
 					_samplers[elemIdx].texRes = (TextureResource *)res;
+					_bindingTables.clear();
+				}
 				else
 					Modules::setError( "Invalid handle in h3dSetResParamI for H3DMatRes::SampTexResI" );
 				return;
@@ -449,6 +471,7 @@ void MaterialResource::setElemParamStr( int elem, int elemIdx, int param, const
 		{
 		case MaterialResData::MatClassStr:
 			_class = value;
+			updateClassBits();
 			return;
 		}
 		break;
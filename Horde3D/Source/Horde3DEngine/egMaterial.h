@@ -17,6 +17,7 @@
 #include "egResource.h"
 #include "egShader.h"
 #include "egTexture.h"
+#include <map>
 
 
 namespace Horde3D {
@@ -63,6 +64,27 @@ struct MatUniform
 	}
 };
 
+struct MatSamplerBinding
+{
+	uint32            shaderSampler;  // Index of shader sampler
+	TextureResource   *texRes;  // Texture of material or 0x0 if sampler is not set by material
+};
+
+
+struct MatUniformBinding
+{
+	uint32  shaderUniform;  // Index of shader uniform
+	float   *values;  // Values of material or 0x0 if uniform is not set by material
+};
+
+
+struct MatBindingTable
+{
+	uint32                            shaderCombId;
+	std::vector< MatSamplerBinding >  samplers;  // Only samplers used by shader combination
+	std::vector< MatUniformBinding >  uniforms;  // Only uniforms used by shader combination
+};
+
 // =================================================================================================
 
 class MaterialResource;
@@ -73,6 +95,8 @@ class MaterialResource : public Resource
 public:
 	static Resource *factoryFunc( const std::string &name, int flags )
 		{ return new MaterialResource( name, flags ); }
+
+	static int getClassFilter( const std::string &theClass );
 	
 	MaterialResource( const std::string &name, int flags );
 	~MaterialResource();
@@ -82,7 +106,17 @@ public:
 	void release();
 	bool load( const char *data, int size );
 	bool setUniform( const std::string &name, float a, float b, float c, float d );
-	bool isOfClass( const std::string &theClass );
+	
+	bool isOfClass( int classFilter ) const
+	{
+		// Filter 0 matches all classes except for the special debug class
+		if( classFilter == 0 ) return !_debugClass;
+		
+		uint32 classId = classFilter > 0 ? classFilter : -classFilter;
+		bool member = (classId >> 5) < _classBits.size() && (_classBits[classId >> 5] & (1u << (classId & 31))) != 0;
+		
+		return classFilter > 0 ? member : !member;  // Negative filters use the not operator
+	}
 
 	int getElemCount( int elem );
 	int getElemParamI( int elem, int elemIdx, int param );
@@ -93,17 +127,28 @@ public:
 	void setElemParamStr( int elem, int elemIdx, int param, const char *value );
 
 private:
+	static uint32 getClassId( const std::string &name );
+	
 	bool raiseError( const std::string &msg, int line = -1 );
+	void updateClassBits();
 
 private:
 	PShaderResource             _shaderRes;
 	uint32                      _combMask;
 	std::string                 _class;
+	std::vector< uint32 >       _classBits;  // Ids of class and all parent classes
+	bool                        _debugClass;
 	std::vector< MatSampler >   _samplers;
 	std::vector< MatUniform >   _uniforms;
 	std::vector< std::string >  _shaderFlags;
 	PMaterialResource           _matLink;
 
+	// Bindings resolved by the renderer for each shader combination; uniform values are referenced
+	// and not copied, so tables only need to be invalidated when samplers or uniforms are added or replaced
+	std::vector< MatBindingTable >  _bindingTables;
+
+	static std::map< std::string, uint32 >  _classIds;
+
 	friend class ResourceManager;
 	friend class Renderer;
 	friend class MeshNode;
@@ -15,6 +15,7 @@
 #include "egModules.h"
 #include "egRenderer.h"
 #include "egCom.h"
+#include "utThreads.h"
 #include <cstring>
 
 #include "utDebug.h"
@@ -29,9 +30,18 @@ ModelNode::ModelNode( const ModelNodeTpl &modelTpl ) :
 	SceneNode( modelTpl ), _geometryRes( modelTpl.geoRes ), _baseGeoRes( 0x0 ),
 	_lodDist1( modelTpl.lodDist1 ), _lodDist2( modelTpl.lodDist2 ),
 	_lodDist3( modelTpl.lodDist3 ), _lodDist4( modelTpl.lodDist4 ),
+	_animOffscreenInterval( modelTpl.animOffscreenInterval ), _animLodJointDepth( modelTpl.animLodJointDepth ),
+	_animInterval( 1 ), _animPhase( 0 ), _visFrame( 0 ), _visLod( 0 ),
+	_geoUpdateFirst( 0 ), _geoUpdateLast( 0 ), _geoUpdateSkinning( false ),
 	_softwareSkinning( modelTpl.softwareSkinning ), _skinningDirty( false ),
 	_nodeListDirty( false ), _morpherUsed( false ), _morpherDirty( false )
 {
+	static uint32 nextAnimPhase = 0;
+	
+	for( uint32 i = 0; i < 4; ++i ) _animLodIntervals[i] = modelTpl.animLodIntervals[i];
+	_animPhase = nextAnimPhase++;
+	_visFrame = Modules::renderer().getFrameID();
+	
 	if( _geometryRes != 0x0 )
 		setParamI( ModelNodeParams::GeoResI, _geometryRes->getHandle() );
 }
@@ -76,6 +86,19 @@ SceneNodeTpl *ModelNode::parsingFunc( map< string, string > &attribs )
 	itr = attribs.find( "lodDist4" );
 	if( itr != attribs.end() ) modelTpl->lodDist4 = (float)atof( itr->second.c_str() );
 
+	itr = attribs.find( "animLodInterval1" );
+	if( itr != attribs.end() ) modelTpl->animLodIntervals[0] = (uint32)std::max( atoi( itr->second.c_str() ), 1 );
+	itr = attribs.find( "animLodInterval2" );
+	if( itr != attribs.end() ) modelTpl->animLodIntervals[1] = (uint32)std::max( atoi( itr->second.c_str() ), 1 );
+	itr = attribs.find( "animLodInterval3" );
+	if( itr != attribs.end() ) modelTpl->animLodIntervals[2] = (uint32)std::max( atoi( itr->second.c_str() ), 1 );
+	itr = attribs.find( "animLodInterval4" );
+	if( itr != attribs.end() ) modelTpl->animLodIntervals[3] = (uint32)std::max( atoi( itr->second.c_str() ), 1 );
+	itr = attribs.find( "animOffscreenInterval" );
+	if( itr != attribs.end() ) modelTpl->animOffscreenInterval = (uint32)std::max( atoi( itr->second.c_str() ), 1 );
+	itr = attribs.find( "animLodJointDepth" );
+	if( itr != attribs.end() ) modelTpl->animLodJointDepth = (uint32)std::max( atoi( itr->second.c_str() ), 0 );
+
 	if( !result )
 	{
 		delete modelTpl; modelTpl = 0x0;
@@ -241,6 +264,9 @@ void ModelNode::setGeometryRes( GeometryResource &geoRes )
 			Modules::resMan().cloneResource( geoRes, "" ) );
 		_geometryRes = (GeometryResource *)clonedRes;
 		_baseGeoRes = &geoRes;
+
+		// Clone is only referenced by the model, so it can be released together with it
+		Modules::resMan().removeResource( *clonedRes, true );
 	}
 	else
 	{
@@ -261,6 +287,15 @@ int ModelNode::getParamI( int param )
 		return _geometryRes != 0x0 ? _geometryRes->_handle : 0;
 	case ModelNodeParams::SWSkinningI:
 		return _softwareSkinning ? 1 : 0;
+	case ModelNodeParams::AnimLodInterval1I:
+	case ModelNodeParams::AnimLodInterval2I:
+	case ModelNodeParams::AnimLodInterval3I:
+	case ModelNodeParams::AnimLodInterval4I:
+		return (int)_animLodIntervals[param - ModelNodeParams::AnimLodInterval1I];
+	case ModelNodeParams::AnimOffscreenIntervalI:
+		return (int)_animOffscreenInterval;
+	case ModelNodeParams::AnimLodJointDepthI:
+		return (int)_animLodJointDepth;
 	}
 
 	return SceneNode::getParamI( param );
@@ -289,6 +324,38 @@ void ModelNode::setParamI( int param, int value )
 		else if( !_softwareSkinning && _morphers.empty() && _baseGeoRes != 0x0 )
 			// Remove the local resource copy by removing reference
 			setParamI( ModelNodeParams::GeoResI, _baseGeoRes->getHandle() );
+		else if( !_softwareSkinning && _baseGeoRes != 0x0 && _geometryRes != 0x0 &&
+		         _geometryRes->getVertPosData() != 0x0 && _baseGeoRes->getVertPosData() != 0x0 )
+		{
+			// Morph updates only touch the morph target range, so restore the skinned vertices
+			uint32 vertCount = _geometryRes->getVertCount();
+			memcpy( _geometryRes->getVertPosData(), _baseGeoRes->getVertPosData(), vertCount * sizeof( Vec3f ) );
+			memcpy( _geometryRes->getVertTanData(), _baseGeoRes->getVertTanData(), vertCount * sizeof( VertexDataTan ) );
+			_geometryRes->addDirtyRange( GeometryResData::GeoVertPosStream, 0, vertCount );
+			_geometryRes->addDirtyRange( GeometryResData::GeoVertTanStream, 0, vertCount );
+			_morpherDirty = true;
+		}
+		return;
+	case ModelNodeParams::AnimLodInterval1I:
+	case ModelNodeParams::AnimLodInterval2I:
+	case ModelNodeParams::AnimLodInterval3I:
+	case ModelNodeParams::AnimLodInterval4I:
+		if( value > 0 )
+			_animLodIntervals[param - ModelNodeParams::AnimLodInterval1I] = (uint32)value;
+		else
+			Modules::setError( "Invalid value in h3dSetNodeParamI for H3DModel::AnimLodIntervalI" );
+		return;
+	case ModelNodeParams::AnimOffscreenIntervalI:
+		if( value > 0 )
+			_animOffscreenInterval = (uint32)value;
+		else
+			Modules::setError( "Invalid value in h3dSetNodeParamI for H3DModel::AnimOffscreenIntervalI" );
+		return;
+	case ModelNodeParams::AnimLodJointDepthI:
+		if( value >= 0 )
+			_animLodJointDepth = (uint32)value;
+		else
+			Modules::setError( "Invalid value in h3dSetNodeParamI for H3DModel::AnimLodJointDepthI" );
 		return;
 	}
 
@@ -340,7 +407,7 @@ void ModelNode::update( int flags )
 {
 	if( flags & ModelUpdateFlags::Animation )
 	{
-		if( _animCtrl.animate() )
+		if( checkAnimUpdate() && _animCtrl.animate() )
 		{	
 			_skinningDirty = true;
 			markDirty();
@@ -356,7 +423,75 @@ void ModelNode::update( int flags )
 }
 
 
+void ModelNode::updateBatch( ModelNode **models, uint32 count, int flags )
+{
+	if( flags & ModelUpdateFlags::Animation )
+	{
+		for( uint32 i = 0; i < count; ++i )
+			models[i]->update( ModelUpdateFlags::Animation );
+	}
+
+	if( flags & ModelUpdateFlags::Geometry )
+	{
+		// Geometry of the models is independent, so only the upload needs to be serialized
+		static vector< ModelNode * > updates;
+		updates.resize( 0 );
+		for( uint32 i = 0; i < count; ++i )
+		{
+			if( models[i]->beginGeometryUpdate() ) updates.push_back( models[i] );
+		}
+		if( updates.empty() ) return;
+
+		Timer *timer = Modules::stats().getTimer( EngineStats::GeoUpdateTime );
+		if( Modules::config().gatherTimeStats ) timer->setEnabled( true );
+
+		Modules::jobMan().run( computeGeometryJob, &updates[0], (uint32)updates.size() );
+		for( size_t i = 0; i < updates.size(); ++i )
+			updates[i]->endGeometryUpdate();
+
+		timer->setEnabled( false );
+	}
+}
+
+
+bool ModelNode::checkAnimUpdate()
+{
+	// Distant and off-screen models are only animated every few frames; skipped frames leave the
+	// controller dirty, so the next update samples the latest stage times
+	uint32 frameID = Modules::renderer().getFrameID();
+	bool visible = _visFrame + 1 >= frameID;
+
+	uint32 targetInterval = _animOffscreenInterval;
+	if( visible ) targetInterval = _visLod > 0 ? _animLodIntervals[_visLod - 1] : 1;
+
+	// The rate is raised immediately but lowered one step per update for smooth transitions
+	if( targetInterval < _animInterval ) _animInterval = targetInterval;
+	if( _animInterval > 1 && (frameID + _animPhase) % _animInterval != 0 ) return false;
+	if( targetInterval > _animInterval ) ++_animInterval;
+
+	_animCtrl.setMaxNodeDepth( visible && _visLod == 0 ? 0 : _animLodJointDepth );
+
+	return true;
+}
+
+
 bool ModelNode::updateGeometry()
+{
+	if( !beginGeometryUpdate() ) return false;
+	
+	Timer *timer = Modules::stats().getTimer( EngineStats::GeoUpdateTime );
+	if( Modules::config().gatherTimeStats ) timer->setEnabled( true );
+	
+	computeGeometry();
+	endGeometryUpdate();
+
+	timer->setEnabled( false );
+
+	return true;
+}
+
+
+bool ModelNode::beginGeometryUpdate()
 {
 	_skinningDirty |= _morpherDirty;
 	_skinningDirty &= _softwareSkinning;
@@ -368,97 +503,164 @@ bool ModelNode::updateGeometry()
 	if( _geometryRes == 0x0 || _geometryRes->getVertPosData() == 0x0 ||
 		_geometryRes->getVertTanData() == 0x0 || _geometryRes->getVertStaticData() == 0x0 ) return false;
 	
-	Timer *timer = Modules::stats().getTimer( EngineStats::GeoUpdateTime );
-	if( Modules::config().gatherTimeStats ) timer->setEnabled( true );
-	
-	// Reset vertices to base data
-	memcpy( _geometryRes->getVertPosData(), _baseGeoRes->getVertPosData(),
-	        _geometryRes->_vertCount * sizeof( Vec3f ) );
-	memcpy( _geometryRes->getVertTanData(), _baseGeoRes->getVertTanData(),
-	        _geometryRes->_vertCount * sizeof( VertexDataTan ) );
+	// Without skinning only the vertices referenced by morph targets can differ from the base data
+	_geoUpdateSkinning = _skinningDirty;
+	_geoUpdateFirst = 0;
+	_geoUpdateLast = _geometryRes->getVertCount();
+	if( !_geoUpdateSkinning )
+	{
+		_geoUpdateFirst = std::min( _geometryRes->_minMorphIndex, _geoUpdateLast );
+		_geoUpdateLast = std::min( _geometryRes->_maxMorphIndex + 1, _geoUpdateLast );
+	}
+
+	_morpherDirty = false;
+	_skinningDirty = false;
+
+	return true;
+}
+
+
+void ModelNode::computeGeometryJob( void *userData, uint32 jobIndex )
+{
+	((ModelNode **)userData)[jobIndex]->computeGeometry();
+}
 
+
+void ModelNode::applyMorphTargets( bool renormalize )
+{
+	const MorphDeltaStreams &md = _geometryRes->_morphDeltas;
+	if( md.verts.empty() ) return;
+	
+	_morphWeights.assign( _geometryRes->_morphTargets.size(), 0.0f );
+	for( uint32 i = 0; i < _morphers.size(); ++i )
+	{
+		if( _morphers[i].weight > Math::Epsilon ) _morphWeights[_morphers[i].index] = _morphers[i].weight;
+	}
+	
+	const Vec3f *basePos = _baseGeoRes->getVertPosData();
+	const VertexDataTan *baseTan = _baseGeoRes->getVertTanData();
 	Vec3f *posData = _geometryRes->getVertPosData();
 	VertexDataTan *tanData = _geometryRes->getVertTanData();
-	VertexDataStatic *staticData = _geometryRes->getVertStaticData();
+	const float *weights = &_morphWeights[0];
 
-	if( _morpherUsed )
+	// Each affected vertex is computed from its base data and written once, so vertices of
+	// targets that were switched off are reset as well
+	for( uint32 i = 0, s = (uint32)md.verts.size(); i < s; ++i )
 	{
-		// Recalculate vertex positions for morph targets
-		for( uint32 i = 0; i < _morphers.size(); ++i )
+		uint32 v = md.verts[i];
+		bool morphed = false;
+
+#if defined( H3D_SIMD )
+		Math::SimdVec pos = Math::simdLoad3( &basePos[v].x );
+		Math::SimdVec norm = Math::simdLoad3( &baseTan[v].normal.x );
+		Math::SimdVec tan = Math::simdLoad3( &baseTan[v].tangent.x );
+		
+		for( uint32 j = md.firstDelta[i], e = md.firstDelta[i + 1]; j < e; ++j )
 		{
-			if( _morphers[i].weight > Math::Epsilon )
-			{
-				MorphTarget &mt = _geometryRes->_morphTargets[_morphers[i].index];
-				float weight = _morphers[i].weight;
-				
-				for( uint32 j = 0; j < mt.diffs.size(); ++j )
-				{
-					MorphDiff &md = mt.diffs[j];
-					
-					posData[md.vertIndex] += md.posDiff * weight;
-					tanData[md.vertIndex].normal += md.normDiff * weight;
-					tanData[md.vertIndex].tangent += md.tanDiff * weight;
-				}
-			}
+			// Inactive targets are added with a weight of zero, which is cheaper than branching
+			float weight = weights[md.targets[j]];
+			morphed |= weight != 0;
+
+			Math::SimdVec w = Math::simdSplat( weight );
+			pos = Math::simdAdd( pos, Math::simdMul( Math::simdLoad( &md.posDeltas[j * 3] ), w ) );
+			norm = Math::simdAdd( norm, Math::simdMul( Math::simdLoad( &md.normDeltas[j * 3] ), w ) );
+			tan = Math::simdAdd( tan, Math::simdMul( Math::simdLoad( &md.tanDeltas[j * 3] ), w ) );
 		}
-	}
-
-	if( _skinningDirty )
-	{
-		Matrix4f skinningMat;
-		Vec4f *rows = &_skinMatRows[0];
 
-		for( uint32 i = 0, s = _geometryRes->getVertCount(); i < s; ++i )
+		Math::simdStore3( &posData[v].x, pos );
+		Math::simdStore3( &tanData[v].normal.x, norm );
+		Math::simdStore3( &tanData[v].tangent.x, tan );
+#else
+		Vec3f pos = basePos[v], norm = baseTan[v].normal, tan = baseTan[v].tangent;
+		
+		for( uint32 j = md.firstDelta[i], e = md.firstDelta[i + 1]; j < e; ++j )
 		{
-			Vec4f *row0 = &rows[ftoi_r( staticData[i].jointVec[0] ) * 3];
-			Vec4f *row1 = &rows[ftoi_r( staticData[i].jointVec[1] ) * 3];
-			Vec4f *row2 = &rows[ftoi_r( staticData[i].jointVec[2] ) * 3];
-			Vec4f *row3 = &rows[ftoi_r( staticData[i].jointVec[3] ) * 3];
-
-			Vec4f weights = *((Vec4f *)&staticData[i].weightVec[0]);
-
-			skinningMat.x[0] = (row0)->x * weights.x + (row1)->x * weights.y + (row2)->x * weights.z + (row3)->x * weights.w;
-			skinningMat.x[1] = (row0+1)->x * weights.x + (row1+1)->x * weights.y + (row2+1)->x * weights.z + (row3+1)->x * weights.w;
-			skinningMat.x[2] = (row0+2)->x * weights.x + (row1+2)->x * weights.y + (row2+2)->x * weights.z + (row3+2)->x * weights.w;
-			skinningMat.x[4] = (row0)->y * weights.x + (row1)->y * weights.y + (row2)->y * weights.z + (row3)->y * weights.w;
-			skinningMat.x[5] = (row0+1)->y * weights.x + (row1+1)->y * weights.y + (row2+1)->y * weights.z + (row3+1)->y * weights.w;
-			skinningMat.x[6] = (row0+2)->y * weights.x + (row1+2)->y * weights.y + (row2+2)->y * weights.z + (row3+2)->y * weights.w;
-			skinningMat.x[8] = (row0)->z * weights.x + (row1)->z * weights.y + (row2)->z * weights.z + (row3)->z * weights.w;
-			skinningMat.x[9] = (row0+1)->z * weights.x + (row1+1)->z * weights.y + (row2 + 1)->z * weights.z + (row3+1)->z * weights.w;
-			skinningMat.x[10] = (row0+2)->z * weights.x + (row1+2)->z * weights.y + (row2+2)->z * weights.z + (row3+2)->z * weights.w;
-			skinningMat.x[12] = (row0)->w * weights.x + (row1)->w * weights.y + (row2)->w * weights.z + (row3)->w * weights.w;
-			skinningMat.x[13] = (row0+1)->w * weights.x + (row1+1)->w * weights.y + (row2+1)->w * weights.z + (row3+1)->w * weights.w;
-			skinningMat.x[14] = (row0+2)->w * weights.x + (row1+2)->w * weights.y + (row2+2)->w * weights.z + (row3+2)->w * weights.w;
-
-			// Skin position
-			posData[i] = skinningMat * posData[i];
-
-			// Skin tangent space basis
-			// Note: We skip the normalization of the tangent space basis for performance reasons;
-			//       the error is usually not huge and should be hardly noticable
-			tanData[i].normal = skinningMat.mult33Vec( tanData[i].normal ); //.normalized();
-			tanData[i].tangent = skinningMat.mult33Vec( tanData[i].tangent ); //.normalized();
+			float weight = weights[md.targets[j]];
+			if( weight == 0 ) continue;
+
+			const float *pd = &md.posDeltas[j * 3], *nd = &md.normDeltas[j * 3], *td = &md.tanDeltas[j * 3];
+			pos += Vec3f( pd[0], pd[1], pd[2] ) * weight;
+			norm += Vec3f( nd[0], nd[1], nd[2] ) * weight;
+			tan += Vec3f( td[0], td[1], td[2] ) * weight;
+			morphed = true;
 		}
-	}
-	else if( _morpherUsed )
-	{
-		// Renormalize tangent space basis
-		for( uint32 i = 0, s = _geometryRes->getVertCount(); i < s; ++i )
+
+		posData[v] = pos;
+		tanData[v].normal = norm;
+		tanData[v].tangent = tan;
+#endif
+
+		if( morphed && renormalize )
 		{
-			tanData[i].normal.normalize();
-			tanData[i].tangent.normalize();
+			tanData[v].normal.normalize();
+			tanData[v].tangent.normalize();
 		}
 	}
+}
 
-	_morpherDirty = false;
-	_skinningDirty = false;
+
+void ModelNode::computeGeometry()
+{
+	Vec3f *posData = _geometryRes->getVertPosData();
+	VertexDataTan *tanData = _geometryRes->getVertTanData();
+	VertexDataStatic *staticData = _geometryRes->getVertStaticData();
+
+	if( !_geoUpdateSkinning )
+	{
+		applyMorphTargets( _morpherUsed );
+		return;
+	}
 	
-	// Upload geometry
-	_geometryRes->updateDynamicVertData();
+	// Reset vertices to base data
+	memcpy( posData, _baseGeoRes->getVertPosData(), _geometryRes->getVertCount() * sizeof( Vec3f ) );
+	memcpy( tanData, _baseGeoRes->getVertTanData(), _geometryRes->getVertCount() * sizeof( VertexDataTan ) );
 
-	timer->setEnabled( false );
+	// The skinned tangent space basis is not normalized, so neither is the morphed one
+	if( _morpherUsed ) applyMorphTargets( false );
 
-	return true;
+	Matrix4f skinningMat;
+	Vec4f *rows = &_skinMatRows[0];
+
+	for( uint32 i = 0, s = _geometryRes->getVertCount(); i < s; ++i )
+	{
+		Vec4f *row0 = &rows[ftoi_r( staticData[i].jointVec[0] ) * 3];
+		Vec4f *row1 = &rows[ftoi_r( staticData[i].jointVec[1] ) * 3];
+		Vec4f *row2 = &rows[ftoi_r( staticData[i].jointVec[2] ) * 3];
+		Vec4f *row3 = &rows[ftoi_r( staticData[i].jointVec[3] ) * 3];
+
+		Vec4f weights = *((Vec4f *)&staticData[i].weightVec[0]);
+
+		skinningMat.x[0] = (row0)->x * weights.x + (row1)->x * weights.y + (row2)->x * weights.z + (row3)->x * weights.w;
+		skinningMat.x[1] = (row0+1)->x * weights.x + (row1+1)->x * weights.y + (row2+1)->x * weights.z + (row3+1)->x * weights.w;
+		skinningMat.x[2] = (row0+2)->x * weights.x + (row1+2)->x * weights.y + (row2+2)->x * weights.z + (row3+2)->x * weights.w;
+		skinningMat.x[4] = (row0)->y * weights.x + (row1)->y * weights.y + (row2)->y * weights.z + (row3)->y * weights.w;
+		skinningMat.x[5] = (row0+1)->y * weights.x + (row1+1)->y * weights.y + (row2+1)->y * weights.z + (row3+1)->y * weights.w;
+		skinningMat.x[6] = (row0+2)->y * weights.x + (row1+2)->y * weights.y + (row2+2)->y * weights.z + (row3+2)->y * weights.w;
+		skinningMat.x[8] = (row0)->z * weights.x + (row1)->z * weights.y + (row2)->z * weights.z + (row3)->z * weights.w;
+		skinningMat.x[9] = (row0+1)->z * weights.x + (row1+1)->z * weights.y + (row2 + 1)->z * weights.z + (row3+1)->z * weights.w;
+		skinningMat.x[10] = (row0+2)->z * weights.x + (row1+2)->z * weights.y + (row2+2)->z * weights.z + (row3+2)->z * weights.w;
+		skinningMat.x[12] = (row0)->w * weights.x + (row1)->w * weights.y + (row2)->w * weights.z + (row3)->w * weights.w;
+		skinningMat.x[13] = (row0+1)->w * weights.x + (row1+1)->w * weights.y + (row2+1)->w * weights.z + (row3+1)->w * weights.w;
+		skinningMat.x[14] = (row0+2)->w * weights.x + (row1+2)->w * weights.y + (row2+2)->w * weights.z + (row3+2)->w * weights.w;
+
+		// Skin position
+		posData[i] = skinningMat * posData[i];
+
+		// Skin tangent space basis
+		// Note: We skip the normalization of the tangent space basis for performance reasons;
+		//       the error is usually not huge and should be hardly noticable
+		tanData[i].normal = skinningMat.mult33Vec( tanData[i].normal ); //.normalized();
+		tanData[i].tangent = skinningMat.mult33Vec( tanData[i].tangent ); //.normalized();
+	}
+}
+
+
+void ModelNode::endGeometryUpdate()
+{
+	// Upload geometry
+	_geometryRes->addDirtyRange( GeometryResData::GeoVertPosStream, _geoUpdateFirst, _geoUpdateLast );
+	_geometryRes->addDirtyRange( GeometryResData::GeoVertTanStream, _geoUpdateFirst, _geoUpdateLast );
+	_geometryRes->updateDynamicVertData();
 }
 
 
@@ -477,6 +679,19 @@ uint32 ModelNode::calcLodLevel( const Vec3f &viewPoint )
 }
 
 
+void ModelNode::markVisible( uint32 lodLevel )
+{
+	// Keep the best LOD level of all views rendered in the current frame
+	uint32 frameID = Modules::renderer().getFrameID();
+	if( _visFrame != frameID )
+	{
+		_visFrame = frameID;
+		_visLod = lodLevel;
+	}
+	else if( lodLevel < _visLod ) _visLod = lodLevel;
+}
+
+
 void ModelNode::setCustomInstData( float *data, uint32 count )
 {
 	memcpy( _customInstData, data, std::min( count, ModelCustomVecCount * 4 ) * sizeof( float ) );
@@ -526,6 +741,7 @@ void ModelNode::onFinishedUpdate()
 			_meshList[i]->_bBox.min += dmin;
 			_meshList[i]->_bBox.max += dmax;
 			_meshList[i]->_bBox.transform( _meshList[i]->_absTrans );
+			Modules::sceneMan().updateSpatialNode( *_meshList[i] );
 		}
 	}
 
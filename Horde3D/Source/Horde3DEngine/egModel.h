@@ -39,7 +39,13 @@ struct ModelNodeParams
 		LodDist1F,
 		LodDist2F,
 		LodDist3F,
-		LodDist4F
+		LodDist4F,
+		AnimLodInterval1I,
+		AnimLodInterval2I,
+		AnimLodInterval3I,
+		AnimLodInterval4I,
+		AnimOffscreenIntervalI,
+		AnimLodJointDepthI
 	};
 };
 
@@ -58,14 +64,18 @@ struct ModelNodeTpl : public SceneNodeTpl
 {
 	PGeometryResource  geoRes;
 	float              lodDist1, lodDist2, lodDist3, lodDist4;
+	uint32             animLodIntervals[4];
+	uint32             animOffscreenInterval, animLodJointDepth;
 	bool               softwareSkinning;
 
 	ModelNodeTpl( const std::string &name, GeometryResource *geoRes ) :
 		SceneNodeTpl( SceneNodeTypes::Model, name ), geoRes( geoRes ),
 			lodDist1( Math::MaxFloat ), lodDist2( Math::MaxFloat ),
 			lodDist3( Math::MaxFloat ), lodDist4( Math::MaxFloat ),
+			animOffscreenInterval( 1 ), animLodJointDepth( 0 ),
 			softwareSkinning( false )
 	{
+		for( uint32 i = 0; i < 4; ++i ) animLodIntervals[i] = 1;
 	}
 };
 
@@ -100,7 +110,9 @@ public:
 	void setParamF( int param, int compIdx, float value );
 
 	void update( int flags );
+	static void updateBatch( ModelNode **models, uint32 count, int flags );
 	uint32 calcLodLevel( const Vec3f &viewPoint );
+	void markVisible( uint32 lodLevel );
 
 	void setCustomInstData( float *data, uint32 count );
 
@@ -119,7 +131,13 @@ protected:
 	void updateLocalMeshAABBs();
 	void setGeometryRes( GeometryResource &geoRes );
 
+	bool checkAnimUpdate();
 	bool updateGeometry();
+	bool beginGeometryUpdate();
+	void computeGeometry();
+	void endGeometryUpdate();
+	void applyMorphTargets( bool renormalize );
+	static void computeGeometryJob( void *userData, uint32 jobIndex );
 
 	void onPostUpdate();
 	void onFinishedUpdate();
@@ -129,6 +147,13 @@ protected:
 	PGeometryResource             _baseGeoRes;	// NULL if model does not have a private geometry copy
 	float                         _lodDist1, _lodDist2, _lodDist3, _lodDist4;
 	
+	// Update-rate LOD
+	uint32                        _animLodIntervals[4];  // Frames between animation updates for LOD1-4
+	uint32                        _animOffscreenInterval, _animLodJointDepth;
+	uint32                        _animInterval;  // Current interval, approaches the target interval
+	uint32                        _animPhase;  // Staggers updates of models with the same interval
+	uint32                        _visFrame, _visLod;  // Last rendered frame and best LOD level in it
+	
 	std::vector< MeshNode * >     _meshList;  // List of the model's meshes
 	std::vector< JointNode * >    _jointList;
 	std::vector< Vec4f >          _skinMatRows;
@@ -137,6 +162,9 @@ protected:
 	Vec4f                         _customInstData[ModelCustomVecCount];
 
 	std::vector< Morpher >        _morphers;
+	std::vector< float >          _morphWeights;  // Weight of each morph target, 0 if not applied
+	uint32                        _geoUpdateFirst, _geoUpdateLast;  // Vertex range of pending update
+	bool                          _geoUpdateSkinning;
 	bool                          _softwareSkinning, _skinningDirty;
 	bool                          _nodeListDirty;  // An animatable node has been attached to model
 	bool                          _morpherUsed, _morpherDirty;
@@ -34,6 +34,7 @@
 // +++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
 #endif
 
+#include "utThreads.h"
 #include "utDebug.h"
 
 
@@ -50,6 +51,7 @@ ResourceManager        *Modules::_resourceManager = 0x0;
 RenderDevice           *Modules::_renderDevice = 0x0;
 Renderer               *Modules::_renderer = 0x0;
 ExtensionManager       *Modules::_extensionManager = 0x0;
+JobManager             *Modules::_jobManager = 0x0;
 
 RenderDevice *gRDI = 0x0;
 
@@ -77,9 +79,11 @@ bool Modules::init()
 	gRDI = _renderDevice;
 	if( _renderer == 0x0 ) _renderer = new Renderer();
 	if( _statManager == 0x0 ) _statManager = new StatManager();
+	if( _jobManager == 0x0 ) _jobManager = new JobManager();
 
 	// Init modules
 	if( !renderer().init() ) return false;
+	jobMan().init( (uint32)config().workerThreads );
 
 	// Register resource types
 	resMan().registerResType( ResourceTypes::SceneGraph, "SceneGraph", 0x0, 0x0,
@@ -165,6 +169,7 @@ void Modules::release()
 	if( _renderer ) _renderer->clearOverlays();
 	
 	// Order of destruction is important
+	delete _jobManager; _jobManager = 0x0;
 	delete _extensionManager; _extensionManager = 0x0;
 	delete _sceneManager; _sceneManager = 0x0;
 	delete _resourceManager; _resourceManager = 0x0;
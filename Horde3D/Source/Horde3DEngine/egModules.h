@@ -27,6 +27,7 @@ class ResourceManager;
 class RenderDevice;
 class Renderer;
 class ExtensionManager;
+class JobManager;
 
 
 // =================================================================================================
@@ -49,6 +50,7 @@ public:
 	static ResourceManager &resMan() { return *_resourceManager; }
 	static Renderer &renderer() { return *_renderer; }
 	static ExtensionManager &extMan() { return *_extensionManager; }
+	static JobManager &jobMan() { return *_jobManager; }
 
 public:
 	static const char *versionString;
@@ -67,6 +69,7 @@ private:
 	static RenderDevice           *_renderDevice;
 	static Renderer               *_renderer;
 	static ExtensionManager       *_extensionManager;
+	static JobManager             *_jobManager;
 };
 
 extern RenderDevice  *gRDI;
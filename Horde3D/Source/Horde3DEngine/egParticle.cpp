@@ -16,6 +16,8 @@
 #include "egCom.h"
 #include "egRenderer.h"
 #include "utXML.h"
+#include <algorithm>
+#include <cstring>
 
 #include "utDebug.h"
 
@@ -302,6 +304,7 @@ EmitterNode::EmitterNode( const EmitterNodeTpl &emitterTpl ) :
 	_materialRes = emitterTpl.matRes;
 	_effectRes = emitterTpl.effectRes;
 	_particleCount = emitterTpl.maxParticleCount;
+	_liveParticleCount = 0;
 	_respawnCount = emitterTpl.respawnCount;
 	_delay = emitterTpl.delay;
 	_emissionRate = emitterTpl.emissionRate;
@@ -322,12 +325,6 @@ EmitterNode::EmitterNode( const EmitterNodeTpl &emitterTpl ) :
 
 EmitterNode::~EmitterNode()
 {
-	for( uint32 i = 0; i < _occQueries.size(); ++i )
-	{
-		if( _occQueries[i] != 0 )
-			gRDI->destroyQuery( _occQueries[i] );
-	}
-	
 	delete[] _particles;
 	delete[] _parPositions;
 	delete[] _parSizesANDRotations;
@@ -404,6 +401,7 @@ void EmitterNode::setMaxParticleCount( uint32 maxParticleCount )
 	
 	// Initialize particles
 	_particleCount = maxParticleCount;
+	_liveParticleCount = 0;
 	_particles = new ParticleData[_particleCount];
 	_parPositions = new float[_particleCount * 3];
 	_parSizesANDRotations = new float[_particleCount * 2];
@@ -551,10 +549,10 @@ void EmitterNode::update( float timeDelta )
 
 	// Check how many particles will be spawned
 	float spawnCount = 0;
-	for( uint32 i = 0; i < _particleCount; ++i )
+	for( uint32 i = _liveParticleCount; i < _particleCount; ++i )
 	{
 		ParticleData &p = _particles[i];
-		if( p.life <= 0 && ((int)p.respawnCounter < _respawnCount || _respawnCount < 0) )
+		if( (int)p.respawnCounter < _respawnCount || _respawnCount < 0 )
 		{
 			spawnCount += 1.0f;
 			if( spawnCount >= _emissionAccum ) break;
@@ -565,85 +563,95 @@ void EmitterNode::update( float timeDelta )
 	float curStep = 0, stepWidth = 0.5f;
 	if( spawnCount > 2.0f ) stepWidth = motionVec.length() / spawnCount;
 	
-	for( uint32 i = 0; i < _particleCount; ++i )
+	// Create particles; dead particles are moved to the end of the live range so that
+	// live particles always occupy the first _liveParticleCount slots
+	for( uint32 j = _liveParticleCount; j < _particleCount && _emissionAccum >= 1.0f; ++j )
 	{
+		if( (int)_particles[j].respawnCounter >= _respawnCount && _respawnCount >= 0 ) continue;
+		
+		uint32 i = _liveParticleCount++;
+		if( j != i ) swap( _particles[i], _particles[j] );
 		ParticleData &p = _particles[i];
 		
-		// Create particle
-		if( p.life <= 0 && ((int)p.respawnCounter < _respawnCount || _respawnCount < 0) )
-		{
-			if( _emissionAccum >= 1.0f )
-			{
-				// Respawn
-				p.maxLife = randomF( _effectRes->_lifeMin, _effectRes->_lifeMax );
-				p.life = p.maxLife;
-				float angle = degToRad( _spreadAngle / 2 );
-				Matrix4f m = _absTrans;
-				m.c[3][0] = 0; m.c[3][1] = 0; m.c[3][2] = 0;
-				m.rotate( randomF( -angle, angle ), randomF( -angle, angle ), randomF( -angle, angle ) );
-				p.dir = (m * Vec3f( 0, 0, -1 )).normalized();
-				p.dragVec = motionVec / timeDelta;
-				++p.respawnCounter;
-
-				// Generate start values
-				p.moveVel0 = randomF( _effectRes->_moveVel.startMin, _effectRes->_moveVel.startMax );
-				p.rotVel0 = randomF( _effectRes->_rotVel.startMin, _effectRes->_rotVel.startMax );
-				p.drag0 = randomF( _effectRes->_drag.startMin, _effectRes->_drag.startMax );
-				p.size0 = randomF( _effectRes->_size.startMin, _effectRes->_size.startMax );
-				p.r0 = randomF( _effectRes->_colR.startMin, _effectRes->_colR.startMax );
-				p.g0 = randomF( _effectRes->_colG.startMin, _effectRes->_colG.startMax );
-				p.b0 = randomF( _effectRes->_colB.startMin, _effectRes->_colB.startMax );
-				p.a0 = randomF( _effectRes->_colA.startMin, _effectRes->_colA.startMax );
-				
-				// Update arrays
-				_parPositions[i * 3 + 0] = _absTrans.c[3][0] - motionVec.x * curStep;
-				_parPositions[i * 3 + 1] = _absTrans.c[3][1] - motionVec.y * curStep;
-				_parPositions[i * 3 + 2] = _absTrans.c[3][2] - motionVec.z * curStep;
-				_parSizesANDRotations[i * 2 + 0] = p.size0;
-				_parSizesANDRotations[i * 2 + 1] = randomF( 0, 360 );
-				_parColors[i * 4 + 0] = p.r0;
-				_parColors[i * 4 + 1] = p.g0;
-				_parColors[i * 4 + 2] = p.b0;
-				_parColors[i * 4 + 3] = p.a0;
-
-				// Update emitter
-				_emissionAccum -= 1.f;
-				if( _emissionAccum < 0 ) _emissionAccum = 0.f;
-
-				curStep += stepWidth;
-			}
-		}
+		// Respawn
+		p.maxLife = randomF( _effectRes->_lifeMin, _effectRes->_lifeMax );
+		p.life = p.maxLife;
+		float angle = degToRad( _spreadAngle / 2 );
+		Matrix4f m = _absTrans;
+		m.c[3][0] = 0; m.c[3][1] = 0; m.c[3][2] = 0;
+		m.rotate( randomF( -angle, angle ), randomF( -angle, angle ), randomF( -angle, angle ) );
+		p.dir = (m * Vec3f( 0, 0, -1 )).normalized();
+		p.dragVec = motionVec / timeDelta;
+		++p.respawnCounter;
+
+		// Generate start values
+		p.moveVel0 = randomF( _effectRes->_moveVel.startMin, _effectRes->_moveVel.startMax );
+		p.rotVel0 = randomF( _effectRes->_rotVel.startMin, _effectRes->_rotVel.startMax );
+		p.drag0 = randomF( _effectRes->_drag.startMin, _effectRes->_drag.startMax );
+		p.size0 = randomF( _effectRes->_size.startMin, _effectRes->_size.startMax );
+		p.r0 = randomF( _effectRes->_colR.startMin, _effectRes->_colR.startMax );
+		p.g0 = randomF( _effectRes->_colG.startMin, _effectRes->_colG.startMax );
+		p.b0 = randomF( _effectRes->_colB.startMin, _effectRes->_colB.startMax );
+		p.a0 = randomF( _effectRes->_colA.startMin, _effectRes->_colA.startMax );
 		
-		// Update particle
-		if( p.life > 0 )
+		// Update arrays
+		_parPositions[i * 3 + 0] = _absTrans.c[3][0] - motionVec.x * curStep;
+		_parPositions[i * 3 + 1] = _absTrans.c[3][1] - motionVec.y * curStep;
+		_parPositions[i * 3 + 2] = _absTrans.c[3][2] - motionVec.z * curStep;
+		_parSizesANDRotations[i * 2 + 0] = p.size0;
+		_parSizesANDRotations[i * 2 + 1] = randomF( 0, 360 );
+		_parColors[i * 4 + 0] = p.r0;
+		_parColors[i * 4 + 1] = p.g0;
+		_parColors[i * 4 + 2] = p.b0;
+		_parColors[i * 4 + 3] = p.a0;
+
+		// Update emitter
+		_emissionAccum -= 1.f;
+		if( _emissionAccum < 0 ) _emissionAccum = 0.f;
+
+		curStep += stepWidth;
+	}
+	
+	// Update live particles
+	for( uint32 i = 0; i < _liveParticleCount; )
+	{
+		ParticleData &p = _particles[i];
+		
+		// Interpolate data
+		float fac = 1.0f - (p.life / p.maxLife);
+		
+		float moveVel = p.moveVel0 * (1.0f + (_effectRes->_moveVel.endRate - 1.0f) * fac);
+		float rotVel = p.rotVel0 * (1.0f + (_effectRes->_rotVel.endRate - 1.0f) * fac);
+		float drag = p.drag0 * (1.0f + (_effectRes->_drag.endRate - 1.0f) * fac);
+		_parSizesANDRotations[i * 2 + 0] = p.size0 * (1.0f + (_effectRes->_size.endRate - 1.0f) * fac);
+		_parSizesANDRotations[i * 2 + 0] *= 2;  // Keep compatibility with old particle vertex shader
+		_parColors[i * 4 + 0] = p.r0 * (1.0f + (_effectRes->_colR.endRate - 1.0f) * fac);
+		_parColors[i * 4 + 1] = p.g0 * (1.0f + (_effectRes->_colG.endRate - 1.0f) * fac);
+		_parColors[i * 4 + 2] = p.b0 * (1.0f + (_effectRes->_colB.endRate - 1.0f) * fac);
+		_parColors[i * 4 + 3] = p.a0 * (1.0f + (_effectRes->_colA.endRate - 1.0f) * fac);
+
+		// Update particle position and rotation
+		_parPositions[i * 3 + 0] += (p.dir.x * moveVel + p.dragVec.x * drag + _force.x) * timeDelta;
+		_parPositions[i * 3 + 1] += (p.dir.y * moveVel + p.dragVec.y * drag + _force.y) * timeDelta;
+		_parPositions[i * 3 + 2] += (p.dir.z * moveVel + p.dragVec.z * drag + _force.z) * timeDelta;
+		_parSizesANDRotations[i * 2 + 1] += degToRad( rotVel ) * timeDelta;
+
+		// Decrease lifetime
+		p.life -= timeDelta;
+		
+		// Check if particle is dying
+		if( p.life <= 0 )
 		{
-			// Interpolate data
-			float fac = 1.0f - (p.life / p.maxLife);
-			
-			float moveVel = p.moveVel0 * (1.0f + (_effectRes->_moveVel.endRate - 1.0f) * fac);
-			float rotVel = p.rotVel0 * (1.0f + (_effectRes->_rotVel.endRate - 1.0f) * fac);
-			float drag = p.drag0 * (1.0f + (_effectRes->_drag.endRate - 1.0f) * fac);
-			_parSizesANDRotations[i * 2 + 0] = p.size0 * (1.0f + (_effectRes->_size.endRate - 1.0f) * fac);
-			_parSizesANDRotations[i * 2 + 0] *= 2;  // Keep compatibility with old particle vertex shader
-			_parColors[i * 4 + 0] = p.r0 * (1.0f + (_effectRes->_colR.endRate - 1.0f) * fac);
-			_parColors[i * 4 + 1] = p.g0 * (1.0f + (_effectRes->_colG.endRate - 1.0f) * fac);
-			_parColors[i * 4 + 2] = p.b0 * (1.0f + (_effectRes->_colB.endRate - 1.0f) * fac);
-			_parColors[i * 4 + 3] = p.a0 * (1.0f + (_effectRes->_colA.endRate - 1.0f) * fac);
-
-			// Update particle position and rotation
-			_parPositions[i * 3 + 0] += (p.dir.x * moveVel + p.dragVec.x * drag + _force.x) * timeDelta;
-			_parPositions[i * 3 + 1] += (p.dir.y * moveVel + p.dragVec.y * drag + _force.y) * timeDelta;
-			_parPositions[i * 3 + 2] += (p.dir.z * moveVel + p.dragVec.z * drag + _force.z) * timeDelta;
-			_parSizesANDRotations[i * 2 + 1] += degToRad( rotVel ) * timeDelta;
-
-			// Decrease lifetime
-			p.life -= timeDelta;
-			
-			// Check if particle is dying
-			if( p.life <= 0 )
+			// Fill the gap with the last live particle which has not been updated yet
+			uint32 last = --_liveParticleCount;
+			if( i != last )
 			{
-				_parSizesANDRotations[i * 2 + 0] = 0.0f;
+				swap( _particles[i], _particles[last] );
+				memcpy( &_parPositions[i * 3], &_parPositions[last * 3], 3 * sizeof( float ) );
+				memcpy( &_parSizesANDRotations[i * 2], &_parSizesANDRotations[last * 2], 2 * sizeof( float ) );
+				memcpy( &_parColors[i * 4], &_parColors[last * 4], 4 * sizeof( float ) );
 			}
+			continue;
 		}
 
 		// Update bounding box
@@ -654,6 +662,15 @@ void EmitterNode::update( float timeDelta )
 		if( vertPos.x > bBMax.x ) bBMax.x = vertPos.x;
 		if( vertPos.y > bBMax.y ) bBMax.y = vertPos.y;
 		if( vertPos.z > bBMax.z ) bBMax.z = vertPos.z;
+
+		++i;
+	}
+
+	// Without live particles the box collapses to the emitter position
+	if( _liveParticleCount == 0 )
+	{
+		bBMin = _absTrans.getTrans();
+		bBMax = bBMin;
 	}
 
 	// Avoid zero box dimensions for planes
@@ -663,6 +680,7 @@ void EmitterNode::update( float timeDelta )
 	
 	_bBox.min = bBMin;
 	_bBox.max = bBMax;
+	Modules::sceneMan().updateSpatialNode( *this );
 
 	_prevAbsTrans = _absTrans;
 
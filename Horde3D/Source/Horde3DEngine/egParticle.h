@@ -180,6 +180,7 @@ protected:
 	PMaterialResource        _materialRes;
 	PParticleEffectResource  _effectRes;
 	uint32                   _particleCount;
+	uint32                   _liveParticleCount;  // Live particles are kept compacted at start of arrays
 	int                      _respawnCount;
 	float                    _delay, _emissionRate, _spreadAngle;
 	Vec3f                    _force;
@@ -190,9 +191,6 @@ protected:
 	float                    *_parSizesANDRotations;
 	float                    *_parColors;
 
-	std::vector< uint32 >    _occQueries;
-	std::vector< uint32 >    _lastVisited;
-
 	friend class SceneManager;
 	friend class Renderer;
 };
@@ -180,8 +180,8 @@ const string PipelineResource::parseStage( XMLNode &node, PipelineStage &stage )
 			stage.commands.push_back( PipelineCommand( PipelineCommands::DrawGeometry ) );
 			vector< PipeCmdParam > &params = stage.commands.back().params;
 			params.resize( 3 );			
-			params[0].setString( node1.getAttribute( "context" ) );
-			params[1].setString( node1.getAttribute( "class", "" ) );
+			params[0].setInt( ShaderResource::getContextId( node1.getAttribute( "context" ) ) );
+			params[1].setInt( MaterialResource::getClassFilter( node1.getAttribute( "class", "" ) ) );
 			params[2].setInt( order );
 		}
 		else if( strcmp( node1.getName(), "DrawOverlays" ) == 0 )
@@ -191,7 +191,7 @@ const string PipelineResource::parseStage( XMLNode &node, PipelineStage &stage )
 			stage.commands.push_back( PipelineCommand( PipelineCommands::DrawOverlays ) );
 			vector< PipeCmdParam > &params = stage.commands.back().params;
 			params.resize( 1 );
-			params[0].setString( node1.getAttribute( "context" ) );
+			params[0].setInt( ShaderResource::getContextId( node1.getAttribute( "context" ) ) );
 		}
 		else if( strcmp( node1.getName(), "DrawQuad" ) == 0 )
 		{
@@ -205,7 +205,7 @@ const string PipelineResource::parseStage( XMLNode &node, PipelineStage &stage )
 			vector< PipeCmdParam > &params = stage.commands.back().params;
 			params.resize( 2 );
 			params[0].setResource( Modules::resMan().resolveResHandle( matRes ) );
-			params[1].setString( node1.getAttribute( "context" ) );
+			params[1].setInt( ShaderResource::getContextId( node1.getAttribute( "context" ) ) );
 		}
 		else if( strcmp( node1.getName(), "DoForwardLightLoop" ) == 0 )
 		{
@@ -218,8 +218,8 @@ const string PipelineResource::parseStage( XMLNode &node, PipelineStage &stage )
 			stage.commands.push_back( PipelineCommand( PipelineCommands::DoForwardLightLoop ) );
 			vector< PipeCmdParam > &params = stage.commands.back().params;
 			params.resize( 4 );
-			params[0].setString( node1.getAttribute( "context", "" ) );
-			params[1].setString( node1.getAttribute( "class", "" ) );
+			params[0].setInt( ShaderResource::getContextId( node1.getAttribute( "context", "" ) ) );
+			params[1].setInt( MaterialResource::getClassFilter( node1.getAttribute( "class", "" ) ) );
 			params[2].setBool( _stricmp( node1.getAttribute( "noShadows", "false" ), "true" ) == 0 );
 			params[3].setInt( order );
 		}
@@ -228,7 +228,7 @@ const string PipelineResource::parseStage( XMLNode &node, PipelineStage &stage )
 			stage.commands.push_back( PipelineCommand( PipelineCommands::DoDeferredLightLoop ) );
 			vector< PipeCmdParam > &params = stage.commands.back().params;
 			params.resize( 2 );
-			params[0].setString( node1.getAttribute( "context", "" ) );
+			params[0].setInt( ShaderResource::getContextId( node1.getAttribute( "context", "" ) ) );
 			params[1].setBool( _stricmp( node1.getAttribute( "noShadows", "false" ), "true" ) == 0 );
 		}
 		else if( strcmp( node1.getName(), "SetUniform" ) == 0 )
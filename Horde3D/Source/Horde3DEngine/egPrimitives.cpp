@@ -193,6 +193,47 @@ bool Frustum::cullFrustum( const Frustum &frust ) const
 }
 
 
+int Frustum::classifyBox( const BoundingBox &b, float margin ) const
+{
+	// Boxes are only classified as inside or outside if they are further than margin from the
+	// planes, so that the classification stays valid while the planes move by less than margin
+	bool boundary = false;
+	
+	for( uint32 i = 0; i < 6; ++i )
+	{
+		const Vec3f &n = _planes[i].normal;
+		
+		Vec3f positive = b.min, negative = b.max;
+		if( n.x <= 0 ) { positive.x = b.max.x; negative.x = b.min.x; }
+		if( n.y <= 0 ) { positive.y = b.max.y; negative.y = b.min.y; }
+		if( n.z <= 0 ) { positive.z = b.max.z; negative.z = b.min.z; }
+
+		if( _planes[i].distToPoint( positive ) > margin ) return FrustumClass::Outside;
+		if( _planes[i].distToPoint( negative ) > -margin ) boundary = true;
+	}
+
+	return boundary ? FrustumClass::Boundary : FrustumClass::Inside;
+}
+
+
+float Frustum::calcMaxPlaneShift( const Frustum &frust, const Vec3f &center, float radius ) const
+{
+	// Upper bound for the change of the signed plane distance of any point within the sphere
+	float maxShift = 0;
+	
+	for( uint32 i = 0; i < 6; ++i )
+	{
+		Vec3f dn = frust._planes[i].normal - _planes[i].normal;
+		float dd = frust._planes[i].dist - _planes[i].dist;
+		float shift = fabsf( dn.dot( center ) + dd ) + dn.length() * radius;
+		
+		if( shift > maxShift ) maxShift = shift;
+	}
+
+	return maxShift;
+}
+
+
 void Frustum::calcAABB( Vec3f &mins, Vec3f &maxs ) const
 {
 	mins.x = Math::MaxFloat; mins.y = Math::MaxFloat; mins.z = Math::MaxFloat;
@@ -117,6 +117,16 @@ struct BoundingBox
 // Frustum
 // =================================================================================================
 
+struct FrustumClass
+{
+	enum List
+	{
+		Inside = 0,
+		Outside,
+		Boundary
+	};
+};
+
 class Frustum
 {
 public:
@@ -132,6 +142,8 @@ public:
 	bool cullSphere( Vec3f pos, float rad ) const;
 	bool cullBox( BoundingBox &b ) const;
 	bool cullFrustum( const Frustum &frust ) const;
+	int classifyBox( const BoundingBox &b, float margin ) const;
+	float calcMaxPlaneShift( const Frustum &frust, const Vec3f &center, float radius ) const;
 
 	void calcAABB( Vec3f &mins, Vec3f &maxs ) const;
 
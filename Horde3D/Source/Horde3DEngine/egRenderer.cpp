@@ -16,6 +16,7 @@
 #include "egCamera.h"
 #include "egModules.h"
 #include "egCom.h"
+#include "utThreads.h"
 #include <cstring>
 
 #include "utDebug.h"
@@ -25,7 +26,8 @@ namespace Horde3D {
 
 using namespace std;
 
-Renderer::Renderer()
+Renderer::Renderer() :
+	_visBuffer( _occDevice )
 {
 	_scratchBuf = 0x0;
 	_overlayVerts = 0x0;
@@ -34,18 +36,24 @@ Renderer::Renderer()
 	_defShadowMap = 0;
 	_quadIdxBuf = 0;
 	_particleVBO = 0;
+	_particleStreamVB = 0;
+	_particleStreamOffset = 0;
 	_curCamera = 0x0;
 	_curLight = 0x0;
 	_curShader = 0x0;
 	_curRenderTarget = 0x0;
 	_curShaderUpdateStamp = 1;
+	_pipeSamplerStamp = 1;
 	_maxAnisoMask = 0;
 	_smSize = 0;
 	_shadowRB = 0;
+	_curShadowRB = 0;
+	_numSharedShadowMaps = 0;
 	_vlPosOnly = 0;
 	_vlOverlay = 0;
 	_vlModel = 0;
 	_vlParticle = 0;
+	_vlParticleStream = 0;
 }
 
 
@@ -54,6 +62,7 @@ Renderer::~Renderer()
 	releaseShadowRB();
 	gRDI->destroyTexture( _defShadowMap );
 	gRDI->destroyBuffer( _particleVBO );
+	gRDI->destroyBuffer( _particleStreamVB );
 	releaseShaderComb( _defColorShader );
 
 	delete[] _scratchBuf;
@@ -128,6 +137,14 @@ bool Renderer::init()
 		{"parIdx", 0, 1, 8}
 	};
 	_vlParticle = gRDI->registerVertexLayout( 2, attribsParticle );
+
+	VertexLayoutAttrib attribsParticleStream[4] = {
+		{"texCoords0", 0, 2, 0},
+		{"parPos", 0, 3, 8},
+		{"parSizeAndRot", 0, 2, 20},
+		{"parColor", 0, 4, 28}
+	};
+	_vlParticleStream = gRDI->registerVertexLayout( 4, attribsParticleStream );
 	
 	// Upload default shaders
 	if( !createShaderComb( gRDI->getDefaultVSCode(), gRDI->getDefaultFSCode(), _defColorShader ) )
@@ -178,6 +195,10 @@ bool Renderer::init()
 	_particleVBO = gRDI->createVertexBuffer( ParticlesPerBatch * 4 * sizeof( ParticleVert ), (float *)parVerts );
 	delete[] parVerts; parVerts = 0x0;
 
+	// Create ring buffer for streamed particle vertices
+	ASSERT( ParticleStreamBufSize >= ParticlesPerStreamBatch * 4 * sizeof( ParticleStreamVert ) );
+	_particleStreamVB = gRDI->createVertexBuffer( ParticleStreamBufSize, 0x0 );
+
 	_overlayBatches.reserve( 64 );
 	_overlayVerts = new OverlayVert[MaxNumOverlayVerts];
 	_overlayVB = gRDI->createVertexBuffer( MaxNumOverlayVerts * sizeof( OverlayVert ), 0x0 );
@@ -489,19 +510,83 @@ void Renderer::commitGeneralUniforms()
 }
 
 
-bool Renderer::setMaterialRec( MaterialResource *materialRes, const string &shaderContext,
+MatBindingTable &Renderer::getMatBindingTable( MaterialResource &materialRes, ShaderResource &shaderRes )
+{
+	std::vector< MatBindingTable > &tables = materialRes._bindingTables;
+	
+	for( size_t i = 0, s = tables.size(); i < s; ++i )
+	{
+		if( tables[i].shaderCombId == _curShader->id ) return tables[i];
+	}
+
+	// Drop tables of shader combinations that are no longer used
+	if( tables.size() >= MaxMatBindingTables ) tables.clear();
+
+	// Resolve bindings by name
+	tables.push_back( MatBindingTable() );
+	MatBindingTable &table = tables.back();
+	table.shaderCombId = _curShader->id;
+
+	for( uint32 i = 0; i < shaderRes._samplers.size(); ++i )
+	{
+		if( _curShader->customSamplers[i] < 0 ) continue;
+		
+		MatSamplerBinding binding;
+		binding.shaderSampler = i;
+		binding.texRes = 0x0;
+		
+		for( size_t j = 0, sj = materialRes._samplers.size(); j < sj; ++j )
+		{
+			if( materialRes._samplers[j].name == shaderRes._samplers[i].id )
+			{
+				binding.texRes = materialRes._samplers[j].texRes;
+				break;
+			}
+		}
+
+		table.samplers.push_back( binding );
+	}
+
+	for( uint32 i = 0; i < shaderRes._uniforms.size(); ++i )
+	{
+		if( _curShader->customUniforms[i] < 0 ) continue;
+		
+		MatUniformBinding binding;
+		binding.shaderUniform = i;
+		binding.values = 0x0;
+		
+		for( size_t j = 0, sj = materialRes._uniforms.size(); j < sj; ++j )
+		{
+			if( materialRes._uniforms[j].name == shaderRes._uniforms[i].id )
+			{
+				binding.values = materialRes._uniforms[j].values;
+				break;
+			}
+		}
+
+		table.uniforms.push_back( binding );
+	}
+
+	return table;
+}
+
+
+bool Renderer::setMaterialRec( MaterialResource *materialRes, uint32 shaderContext,
                                ShaderResource *shaderRes )
 {
 	if( materialRes == 0x0 ) return false;
 	
 	bool firstRec = (shaderRes == 0x0);
 	bool result = true;
+
+	materialRes->markUsed( _frameID );
 	
 	// Set shader in first recursion step
 	if( firstRec )
 	{	
 		shaderRes = materialRes->_shaderRes;
 		if( shaderRes == 0x0 ) return false;	
+		shaderRes->markUsed( _frameID );
 	
 		// Find context
 		ShaderContext *context = shaderRes->findContext( shaderContext );
@@ -550,31 +635,47 @@ bool Renderer::setMaterialRec( MaterialResource *materialRes, const string &shad
 
 		// Configure alpha-to-coverage
 		gRDI->setAlphaToCoverage( context->alphaToCoverage && Modules::config().sampleCount > 0 );
+
+		// Resolve pipeline buffer bindings for shader combination
+		if( _curShader->pipeSamplerStamp != _pipeSamplerStamp )
+		{
+			_curShader->pipeSamplers.assign( shaderRes->_samplers.size(), -1 );
+			for( size_t i = 0, si = shaderRes->_samplers.size(); i < si; ++i )
+			{
+				for( size_t j = 0, sj = _pipeSamplerBindings.size(); j < sj; ++j )
+				{
+					if( strcmp( _pipeSamplerBindings[j].sampler, shaderRes->_samplers[i].id.c_str() ) == 0 )
+					{
+						_curShader->pipeSamplers[i] = (int)j;
+						break;
+					}
+				}
+			}
+			_curShader->pipeSamplerStamp = _pipeSamplerStamp;
+		}
 	}
 
+	// Get bindings of material resolved for current shader combination
+	MatBindingTable &bindings = getMatBindingTable( *materialRes, *shaderRes );
+
 	// Setup texture samplers
-	for( size_t i = 0, si = shaderRes->_samplers.size(); i < si; ++i )
+	for( size_t i = 0, si = bindings.samplers.size(); i < si; ++i )
 	{
-		if( _curShader->customSamplers[i] < 0 ) continue;
-		
-		ShaderSampler &sampler = shaderRes->_samplers[i];
+		MatSamplerBinding &binding = bindings.samplers[i];
+		ShaderSampler &sampler = shaderRes->_samplers[binding.shaderSampler];
 		TextureResource *texRes = 0x0;
 
 		// Use default texture
 		if( firstRec) texRes = sampler.defTex;
 		
-		// Find sampler in material
-		for( size_t j = 0, sj = materialRes->_samplers.size(); j < sj; ++j )
+		// Use texture of material
+		if( binding.texRes != 0x0 )
 		{
-			if( materialRes->_samplers[j].name == sampler.id )
-			{
-				if( materialRes->_samplers[j].texRes->isLoaded() )
-					texRes = materialRes->_samplers[j].texRes;
-				break;
-			}
+			binding.texRes->markUsed( _frameID );
+			if( binding.texRes->isLoaded() ) texRes = binding.texRes;
 		}
 
-		uint32 sampState = shaderRes->_samplers[i].sampState;
+		uint32 sampState = sampler.sampState;
 		if( (sampState & SS_FILTER_TRILINEAR) && !Modules::config().trilinearFiltering )
 			sampState = (sampState & ~SS_FILTER_TRILINEAR) | SS_FILTER_BILINEAR;
 		if( (sampState & SS_ANISO_MASK) > _maxAnisoMask )
@@ -589,72 +690,56 @@ bool Renderer::setMaterialRec( MaterialResource *materialRes, const string &shad
 			{
 				if( texRes->getRBObject() == 0 )
 				{
-					gRDI->setTexture( shaderRes->_samplers[i].texUnit, texRes->getTexObject(), sampState );
+					gRDI->setTexture( sampler.texUnit, texRes->getTexObject(), sampState );
 				}
 				else if( texRes->getRBObject() != gRDI->_curRendBuf )
 				{
-					gRDI->setTexture( shaderRes->_samplers[i].texUnit,
+					gRDI->setTexture( sampler.texUnit,
 					                  gRDI->getRenderBufferTex( texRes->getRBObject(), 0 ), sampState );
 				}
 				else  // Trying to bind active render buffer as texture
 				{
-					gRDI->setTexture( shaderRes->_samplers[i].texUnit, TextureResource::defTex2DObject, 0 );
+					gRDI->setTexture( sampler.texUnit, TextureResource::defTex2DObject, 0 );
 				}
 			}
 			else
 			{
-				gRDI->setTexture( shaderRes->_samplers[i].texUnit, texRes->getTexObject(), sampState );
+				gRDI->setTexture( sampler.texUnit, texRes->getTexObject(), sampState );
 			}
 		}
 
-		// Find sampler in pipeline
+		// Bind pipeline buffer
 		if( firstRec )
 		{
-			for( size_t j = 0, sj = _pipeSamplerBindings.size(); j < sj; ++j )
+			int pipeBinding = _curShader->pipeSamplers[binding.shaderSampler];
+			if( pipeBinding >= 0 )
 			{
-				if( strcmp( _pipeSamplerBindings[j].sampler, sampler.id.c_str() ) == 0 )
-				{
-					gRDI->setTexture( shaderRes->_samplers[i].texUnit, gRDI->getRenderBufferTex(
-						_pipeSamplerBindings[j].rbObj, _pipeSamplerBindings[j].bufIndex ), sampState );
-
-					break;
-				}
+				gRDI->setTexture( sampler.texUnit, gRDI->getRenderBufferTex(
+					_pipeSamplerBindings[pipeBinding].rbObj, _pipeSamplerBindings[pipeBinding].bufIndex ), sampState );
 			}
 		}
 	}
 
 	// Set custom uniforms
-	for( size_t i = 0, si = shaderRes->_uniforms.size(); i < si; ++i )
+	for( size_t i = 0, si = bindings.uniforms.size(); i < si; ++i )
 	{
-		if( _curShader->customUniforms[i] < 0 ) continue;
-		
-		float *unifData = 0x0;
-
-		// Find uniform in material
-		for( size_t j = 0, sj = materialRes->_uniforms.size(); j < sj; ++j )
-		{
-			MatUniform &matUniform = materialRes->_uniforms[j];
-			
-			if( matUniform.name == shaderRes->_uniforms[i].id )
-			{
-				unifData = matUniform.values;
-				break;
-			}
-		}
+		MatUniformBinding &binding = bindings.uniforms[i];
+		ShaderUniform &uniform = shaderRes->_uniforms[binding.shaderUniform];
+		float *unifData = binding.values;
 
-		// Use default values if not found
+		// Use default values if not set by material
 		if( unifData == 0x0 && firstRec )
-			unifData = shaderRes->_uniforms[i].defValues;
+			unifData = uniform.defValues;
 
 		if( unifData )
 		{
-			switch( shaderRes->_uniforms[i].size )
+			switch( uniform.size )
 			{
 			case 1:
-				gRDI->setShaderConst( _curShader->customUniforms[i], CONST_FLOAT, unifData );
+				gRDI->setShaderConst( _curShader->customUniforms[binding.shaderUniform], CONST_FLOAT, unifData );
 				break;
 			case 4:
-				gRDI->setShaderConst( _curShader->customUniforms[i], CONST_FLOAT4, unifData );
+				gRDI->setShaderConst( _curShader->customUniforms[binding.shaderUniform], CONST_FLOAT4, unifData );
 				break;
 			}
 		}
@@ -679,7 +764,7 @@ bool Renderer::setMaterialRec( MaterialResource *materialRes, const string &shad
 }
 
 
-bool Renderer::setMaterial( MaterialResource *materialRes, const string &shaderContext )
+bool Renderer::setMaterial( MaterialResource *materialRes, uint32 shaderContext )
 {
 	if( materialRes == 0x0 )
 	{	
@@ -692,13 +777,41 @@ bool Renderer::setMaterial( MaterialResource *materialRes, const string &shaderC
 		return false;
 	}
 
-	if( !setMaterialRec( materialRes, shaderContext, 0x0 ) )
+	Timer *timer = Modules::stats().getTimer( EngineStats::MaterialSetTime );
+	if( Modules::config().gatherTimeStats ) timer->setEnabled( true );
+
+	bool result = setMaterialRec( materialRes, shaderContext, 0x0 );
+	if( !result ) _curShader = 0x0;
+
+	timer->setEnabled( false );
+
+	return result;
+}
+
+
+void Renderer::requestTexStreaming( MaterialResource &materialRes, const BoundingBox &bBox )
+{
+	// Estimate projected size of bounding sphere in pixels
+	float radius = (bBox.max - bBox.min).length() * 0.5f;
+	float screenSize = radius * _curCamera->getProjMat().c[1][1] * (float)_curCamera->_vpHeight;
+	
+	if( !_curCamera->_orthographic )
 	{
-		_curShader = 0x0;
-		return false;
+		float dist = ((bBox.min + bBox.max) * 0.5f - _curCamera->getAbsPos()).length();
+		screenSize = dist > radius ? screenSize / dist : Math::MaxFloat;
 	}
 
-	return true;
+	// Pass size on to streamed textures of material and its links
+	MaterialResource *matRes = &materialRes;
+	for( uint32 depth = 0; matRes != 0x0 && depth < 8; ++depth )
+	{
+		for( size_t i = 0, s = matRes->_samplers.size(); i < s; ++i )
+		{
+			TextureResource *texRes = matRes->_samplers[i].texRes;
+			if( texRes != 0x0 && texRes->isStreamed() ) texRes->requestStreaming( screenSize );
+		}
+		matRes = matRes->_matLink;
+	}
 }
 
 
@@ -717,6 +830,11 @@ bool Renderer::createShadowRB( uint32 width, uint32 height )
 void Renderer::releaseShadowRB()
 {
 	if( _shadowRB ) gRDI->destroyRenderBuffer( _shadowRB );
+
+	// Shared shadow maps are recreated with the current size when they are needed
+	for( size_t i = 0; i < _sharedShadowRBs.size(); ++i )
+		gRDI->destroyRenderBuffer( _sharedShadowRBs[i] );
+	_sharedShadowRBs.clear();
 }
 
 
@@ -727,7 +845,7 @@ void Renderer::setupShadowMap( bool noShadows )
 	// Bind shadow map
 	if( !noShadows && _curLight->_shadowMapCount > 0 )
 	{
-		gRDI->setTexture( 12, gRDI->getRenderBufferTex( _shadowRB, 32 ), sampState );
+		gRDI->setTexture( 12, gRDI->getRenderBufferTex( _curShadowRB, 32 ), sampState );
 		_smSize = (float)Modules::config().shadowMapSize;
 	}
 	else
@@ -738,8 +856,10 @@ void Renderer::setupShadowMap( bool noShadows )
 }
 
 
-Matrix4f Renderer::calcCropMatrix( const Frustum &frustSlice, const Vec3f lightPos, const Matrix4f &lightViewProjMat )
+Matrix4f Renderer::calcCropMatrix( const Frustum *frustSlices, uint32 numSlices, const Vec3f lightPos,
+                                   const Matrix4f &lightViewProjMat, const Vec3f &camPos, RenderQueue &queue )
 {
+	// The crop matrix covers the union of all given frustum slices
 	float frustMinX =  Math::MaxFloat, bbMinX =  Math::MaxFloat;
 	float frustMinY =  Math::MaxFloat, bbMinY =  Math::MaxFloat;
 	float frustMinZ =  Math::MaxFloat, bbMinZ =  Math::MaxFloat;
@@ -747,62 +867,75 @@ Matrix4f Renderer::calcCropMatrix( const Frustum &frustSlice, const Vec3f lightP
 	float frustMaxY = -Math::MaxFloat, bbMaxY = -Math::MaxFloat;
 	float frustMaxZ = -Math::MaxFloat, bbMaxZ = -Math::MaxFloat;
 	
-	// Find post-projective space AABB of all objects in frustum
-	Modules::sceneMan().updateQueues( frustSlice, 0x0, RenderingOrder::None,
-		SceneNodeFlags::NoDraw | SceneNodeFlags::NoCastShadow, false, true );
-	RenderQueue &renderQueue = Modules::sceneMan().getRenderQueue();
+	bool lightInside = false;
 	
-	for( size_t i = 0, s = renderQueue.size(); i < s; ++i )
+	for( uint32 k = 0; k < numSlices && !lightInside; ++k )
 	{
-		const BoundingBox &aabb = renderQueue[i].node->getBBox();
+		const Frustum &frustSlice = frustSlices[k];
 		
-		// Check if light is inside AABB
-		if( lightPos.x >= aabb.min.x && lightPos.y >= aabb.min.y && lightPos.z >= aabb.min.z &&
-			lightPos.x <= aabb.max.x && lightPos.y <= aabb.max.y && lightPos.z <= aabb.max.z )
-		{
-			bbMinX = bbMinY = bbMinZ = -1;
-			bbMaxX = bbMaxY = bbMaxZ = 1;
-			break;
-		}
+		// Find post-projective space AABB of all objects in frustum
+		Modules::sceneMan().cullRenderables( frustSlice, 0x0, camPos, RenderingOrder::None,
+			SceneNodeFlags::NoDraw | SceneNodeFlags::NoCastShadow, queue );
 		
-		for( uint32 j = 0; j < 8; ++j )
+		for( size_t i = 0, s = queue.size(); i < s; ++i )
 		{
-			Vec4f v1 = lightViewProjMat * Vec4f( aabb.getCorner( j ) );
-			v1.w = 1.f / fabsf( v1.w );
-			v1.x *= v1.w; v1.y *= v1.w; v1.z *= v1.w;
+			const BoundingBox &aabb = queue[i].node->getBBox();
 			
-			if( v1.x < bbMinX ) bbMinX = v1.x;
-			if( v1.y < bbMinY ) bbMinY = v1.y;
-			if( v1.z < bbMinZ ) bbMinZ = v1.z;
-			if( v1.x > bbMaxX ) bbMaxX = v1.x;
-			if( v1.y > bbMaxY ) bbMaxY = v1.y;
-			if( v1.z > bbMaxZ ) bbMaxZ = v1.z;
+			// Check if light is inside AABB
+			if( lightPos.x >= aabb.min.x && lightPos.y >= aabb.min.y && lightPos.z >= aabb.min.z &&
+				lightPos.x <= aabb.max.x && lightPos.y <= aabb.max.y && lightPos.z <= aabb.max.z )
+			{
+				bbMinX = bbMinY = bbMinZ = -1;
+				bbMaxX = bbMaxY = bbMaxZ = 1;
+				lightInside = true;
+				break;
+			}
+			
+			for( uint32 j = 0; j < 8; ++j )
+			{
+				Vec4f v1 = lightViewProjMat * Vec4f( aabb.getCorner( j ) );
+				v1.w = 1.f / fabsf( v1.w );
+				v1.x *= v1.w; v1.y *= v1.w; v1.z *= v1.w;
+				
+				if( v1.x < bbMinX ) bbMinX = v1.x;
+				if( v1.y < bbMinY ) bbMinY = v1.y;
+				if( v1.z < bbMinZ ) bbMinZ = v1.z;
+				if( v1.x > bbMaxX ) bbMaxX = v1.x;
+				if( v1.y > bbMaxY ) bbMaxY = v1.y;
+				if( v1.z > bbMaxZ ) bbMaxZ = v1.z;
+			}
 		}
 	}
 
-	// Find post-projective space AABB of frustum slice if light is not inside
-	if( frustSlice.cullSphere( _curLight->_absPos, 0 ) )
+	// Find post-projective space AABB of frustum slices if light is not inside
+	for( uint32 k = 0; k < numSlices; ++k )
 	{
-		// Get frustum in post-projective space
-		for( uint32 i = 0; i < 8; ++i )
+		const Frustum &frustSlice = frustSlices[k];
+		
+		if( frustSlice.cullSphere( lightPos, 0 ) )
 		{
-			// Frustum slice
-			Vec4f v1 = lightViewProjMat * Vec4f( frustSlice.getCorner( i ) );
-			v1.w = 1.f / fabsf( v1.w );  // Use absolute value to reduce problems with back projection when v1.w < 0
-			v1.x *= v1.w; v1.y *= v1.w; v1.z *= v1.w;
-
-			if( v1.x < frustMinX ) frustMinX = v1.x;
-			if( v1.y < frustMinY ) frustMinY = v1.y;
-			if( v1.z < frustMinZ ) frustMinZ = v1.z;
-			if( v1.x > frustMaxX ) frustMaxX = v1.x;
-			if( v1.y > frustMaxY ) frustMaxY = v1.y;
-			if( v1.z > frustMaxZ ) frustMaxZ = v1.z;
+			// Get frustum in post-projective space
+			for( uint32 i = 0; i < 8; ++i )
+			{
+				// Frustum slice
+				Vec4f v1 = lightViewProjMat * Vec4f( frustSlice.getCorner( i ) );
+				v1.w = 1.f / fabsf( v1.w );  // Use absolute value to reduce problems with back projection when v1.w < 0
+				v1.x *= v1.w; v1.y *= v1.w; v1.z *= v1.w;
+
+				if( v1.x < frustMinX ) frustMinX = v1.x;
+				if( v1.y < frustMinY ) frustMinY = v1.y;
+				if( v1.z < frustMinZ ) frustMinZ = v1.z;
+				if( v1.x > frustMaxX ) frustMaxX = v1.x;
+				if( v1.y > frustMaxY ) frustMaxY = v1.y;
+				if( v1.z > frustMaxZ ) frustMaxZ = v1.z;
+			}
+		}
+		else
+		{
+			frustMinX = frustMinY = frustMinZ = -1;
+			frustMaxX = frustMaxY = frustMaxZ = 1;
+			break;
 		}
-	}
-	else
-	{
-		frustMinX = frustMinY = frustMinZ = -1;
-		frustMaxX = frustMaxY = frustMaxZ = 1;
 	}
 
 	// Merge frustum and AABB bounds and clamp to post-projective range [-1, 1]
@@ -832,54 +965,64 @@ Matrix4f Renderer::calcCropMatrix( const Frustum &frustSlice, const Vec3f lightP
 }
 
 
-void Renderer::updateShadowMap()
+float Renderer::calcLitFarDist( CameraNode *camNode, LightNode *light, RenderQueue &cullQueue )
 {
-	if( _curLight == 0x0 ) return;
-	
-	uint32 prevRendBuf = gRDI->_curRendBuf;
-	int prevVPX = gRDI->_vpX, prevVPY = gRDI->_vpY, prevVPWidth = gRDI->_vpWidth, prevVPHeight = gRDI->_vpHeight;
-	RDIRenderBuffer &shadowRT = gRDI->_rendBufs.getRef( _shadowRB );
-	gRDI->setViewport( 0, 0, shadowRT.width, shadowRT.height );
-	gRDI->setRenderBuffer( _shadowRB );
-	
-	gRDI->setColorWriteMask( false );
-	gRDI->setDepthMask( true );
-	gRDI->clear( CLR_DEPTH, 0x0, 1.f );
-
-	// ********************************************************************************************
-	// Cascaded Shadow Maps
-	// ********************************************************************************************
-	
 	// Find AABB of lit geometry
 	BoundingBox aabb;
-	Modules::sceneMan().updateQueues( _curCamera->getFrustum(), &_curLight->getFrustum(),
-		RenderingOrder::None, SceneNodeFlags::NoDraw | SceneNodeFlags::NoCastShadow, false, true );
-	for( size_t j = 0, s = Modules::sceneMan().getRenderQueue().size(); j < s; ++j )
+	Modules::sceneMan().cullRenderables( camNode->getFrustum(), &light->getFrustum(), camNode->getAbsPos(),
+		RenderingOrder::None, SceneNodeFlags::NoDraw | SceneNodeFlags::NoCastShadow, cullQueue );
+	for( size_t j = 0, s = cullQueue.size(); j < s; ++j )
 	{
-		aabb.makeUnion( Modules::sceneMan().getRenderQueue()[j].node->getBBox() );
+		aabb.makeUnion( cullQueue[j].node->getBBox() );
 	}
 
 	// Find depth range of lit geometry
-	float minDist = Math::MaxFloat, maxDist = 0.0f;
+	float maxDist = 0.0f;
 	for( uint32 i = 0; i < 8; ++i )
 	{
-		float dist = -(_curCamera->getViewMat() * aabb.getCorner( i )).z;
-		if( dist < minDist ) minDist = dist;
+		float dist = -(camNode->getViewMat() * aabb.getCorner( i )).z;
 		if( dist > maxDist ) maxDist = dist;
 	}
 
-	// Don't adjust near plane; this means less precision if scene is far away from viewer but that
+	// The near plane is not adjusted; this means less precision if scene is far away from viewer but that
 	// shouldn't be too noticeable and brings better performance since the nearer split volumes are empty
-	minDist = _curCamera->_frustNear;
+	return maxf( maxDist, camNode->_frustNear + 0.01f );
+}
+
+
+void Renderer::buildSliceFrustum( CameraNode *camNode, float nearDist, float farDist, Frustum &frustum )
+{
+	if( !camNode->_orthographic )
+	{
+		float newLeft = camNode->_frustLeft * nearDist / camNode->_frustNear;
+		float newRight = camNode->_frustRight * nearDist / camNode->_frustNear;
+		float newBottom = camNode->_frustBottom * nearDist / camNode->_frustNear;
+		float newTop = camNode->_frustTop * nearDist / camNode->_frustNear;
+		frustum.buildViewFrustum( camNode->_absTrans, newLeft, newRight, newBottom, newTop, nearDist, farDist );
+	}
+	else
+	{
+		frustum.buildBoxFrustum( camNode->_absTrans, camNode->_frustLeft, camNode->_frustRight,
+		                         camNode->_frustBottom, camNode->_frustTop, -nearDist, -farDist );
+	}
+}
+
+
+void Renderer::recordShadowMap( LightPassRecord &rec )
+{
+	// Note: This is called from worker threads and must not access any GL state
+	
+	LightNode *light = rec.light;
+	const Vec3f &camPos = _curCamera->getAbsPos();
 	
 	// Calculate split distances using PSSM scheme
-	const float nearDist = maxf( minDist, _curCamera->_frustNear );
-	const float farDist = maxf( maxDist, minDist + 0.01f );
-	const uint32 numMaps = _curLight->_shadowMapCount;
-	const float lambda = _curLight->_shadowSplitLambda;
+	const float nearDist = _curCamera->_frustNear;
+	const float farDist = calcLitFarDist( _curCamera, light, rec.cullQueue );
+	const uint32 numMaps = light->_shadowMapCount;
+	const float lambda = light->_shadowSplitLambda;
 	
-	_splitPlanes[0] = nearDist;
-	_splitPlanes[numMaps] = farDist;
+	rec.splitPlanes[0] = nearDist;
+	rec.splitPlanes[numMaps] = farDist;
 	
 	for( uint32 i = 1; i < numMaps; ++i )
 	{
@@ -887,86 +1030,365 @@ void Renderer::updateShadowMap()
 		float logDist = nearDist * powf( farDist / nearDist, f );
 		float uniformDist = nearDist + (farDist - nearDist) * f;
 		
-		_splitPlanes[i] = (1 - lambda) * uniformDist + lambda * logDist;  // Lerp
+		rec.splitPlanes[i] = (1 - lambda) * uniformDist + lambda * logDist;  // Lerp
 	}
 	
-	// Prepare shadow map rendering
-	gRDI->setDepthTest( true );
-	//gRDI->setCullMode( RS_CULL_FRONT );	// Front face culling reduces artefacts but produces more "peter-panning"
-	
-	// Split viewing frustum into slices and render shadow maps
-	Frustum frustum;
+	// Split viewing frustum into slices and find shadow casters
 	for( uint32 i = 0; i < numMaps; ++i )
 	{
+		ShadowSliceRecord &slice = rec.slices[i];
+		Frustum &frustum = slice.frustum;
+		
 		// Create frustum slice
-		if( !_curCamera->_orthographic )
-		{
-			float newLeft = _curCamera->_frustLeft * _splitPlanes[i] / _curCamera->_frustNear;
-			float newRight = _curCamera->_frustRight * _splitPlanes[i] / _curCamera->_frustNear;
-			float newBottom = _curCamera->_frustBottom * _splitPlanes[i] / _curCamera->_frustNear;
-			float newTop = _curCamera->_frustTop * _splitPlanes[i] / _curCamera->_frustNear;
-			frustum.buildViewFrustum( _curCamera->_absTrans, newLeft, newRight, newBottom, newTop,
-			                          _splitPlanes[i], _splitPlanes[i + 1] );
-		}
-		else
-		{
-			frustum.buildBoxFrustum( _curCamera->_absTrans, _curCamera->_frustLeft, _curCamera->_frustRight,
-			                         _curCamera->_frustBottom, _curCamera->_frustTop,
-			                         -_splitPlanes[i], -_splitPlanes[i + 1] );
-		}
+		buildSliceFrustum( _curCamera, rec.splitPlanes[i], rec.splitPlanes[i + 1], frustum );
 		
 		// Get light projection matrix
-		float ymax = _curCamera->_frustNear * tanf( degToRad( _curLight->_fov / 2 ) );
+		float ymax = _curCamera->_frustNear * tanf( degToRad( light->_fov / 2 ) );
 		float xmax = ymax * 1.0f;  // ymax * aspect
 		Matrix4f lightProjMat = Matrix4f::PerspectiveMat(
-			-xmax, xmax, -ymax, ymax, _curCamera->_frustNear, _curLight->_radius );
+			-xmax, xmax, -ymax, ymax, _curCamera->_frustNear, light->_radius );
 		
 		// Build optimized light projection matrix
-		Matrix4f lightViewProjMat = lightProjMat * _curLight->getViewMat();
-		lightProjMat = calcCropMatrix( frustum, _curLight->_absPos, lightViewProjMat ) * lightProjMat;
+		Matrix4f lightViewProjMat = lightProjMat * light->getViewMat();
+		lightProjMat = calcCropMatrix( &frustum, 1, light->_absPos, lightViewProjMat, camPos, rec.cullQueue ) *
+		               lightProjMat;
 		
 		// Generate render queue with shadow casters for current slice
-		frustum.buildViewFrustum( _curLight->getViewMat(), lightProjMat );
-		Modules::sceneMan().updateQueues( frustum, 0x0, RenderingOrder::None,
-			SceneNodeFlags::NoDraw | SceneNodeFlags::NoCastShadow, false, true );
+		frustum.buildViewFrustum( light->getViewMat(), lightProjMat );
+		Modules::sceneMan().cullRenderables( frustum, 0x0, camPos, RenderingOrder::None,
+			SceneNodeFlags::NoDraw | SceneNodeFlags::NoCastShadow, slice.queue );
 		
-		// Create texture atlas if several splits are enabled
+		// Select quadrant of shadow map texture atlas if several splits are enabled
 		if( numMaps > 1 )
 		{
-			const int hsm = Modules::config().shadowMapSize / 2;
-			const int scissorXY[8] = { 0, 0,  hsm, 0,  hsm, hsm,  0, hsm };
 			const float transXY[8] = { -0.5f, -0.5f,  0.5f, -0.5f,  0.5f, 0.5f,  -0.5f, 0.5f };
 			
-			gRDI->setScissorTest( true );
-
-			// Select quadrant of shadow map
 			lightProjMat.scale( 0.5f, 0.5f, 1.0f );
 			lightProjMat.translate( transXY[i * 2], transXY[i * 2 + 1], 0.0f );
-			gRDI->setScissorRect( scissorXY[i * 2], scissorXY[i * 2 + 1], hsm, hsm );
 		}
+
+		slice.lightProjMat = lightProjMat;
+	}
+}
+
+
+void Renderer::updateShadowMap( LightPassRecord &rec )
+{
+	if( _curLight == 0x0 ) return;
+
+	// Shadow maps shared by several views are only rendered for the first one
+	LightPassRecord *mapRec = &rec;
+	bool drawMap = true;
+	_curShadowRB = _shadowRB;
+	
+	SharedShadowMap *sharedMap = findSharedShadowMap( _curLight );
+	if( sharedMap != 0x0 )
+	{
+		mapRec = &sharedMap->rec;
+		drawMap = !sharedMap->rendered;
+		sharedMap->rendered = true;
+		_curShadowRB = sharedMap->rendBuf;
+	}
+	
+	// Slices and shadow casters were found by recordShadowMap
+	const uint32 numMaps = _curLight->_shadowMapCount;
+	for( uint32 i = 0; i <= numMaps; ++i ) _splitPlanes[i] = mapRec->splitPlanes[i];
 	
-		_lightMats[i] = lightProjMat * _curLight->getViewMat();
-		setupViewMatrices( _curLight->getViewMat(), lightProjMat );
+	if( drawMap )
+	{
+		uint32 prevRendBuf = gRDI->_curRendBuf;
+		int prevVPX = gRDI->_vpX, prevVPY = gRDI->_vpY, prevVPWidth = gRDI->_vpWidth, prevVPHeight = gRDI->_vpHeight;
+		RDIRenderBuffer &shadowRT = gRDI->_rendBufs.getRef( _curShadowRB );
+		gRDI->setViewport( 0, 0, shadowRT.width, shadowRT.height );
+		gRDI->setRenderBuffer( _curShadowRB );
 		
-		// Render
-		drawRenderables( _curLight->_shadowContext, "", false, &frustum, 0x0, RenderingOrder::None, -1 );
+		gRDI->setColorWriteMask( false );
+		gRDI->setDepthMask( true );
+		gRDI->clear( CLR_DEPTH, 0x0, 1.f );
+
+		// ****************************************************************************************
+		// Cascaded Shadow Maps
+		// ****************************************************************************************
+		
+		// Prepare shadow map rendering
+		gRDI->setDepthTest( true );
+		//gRDI->setCullMode( RS_CULL_FRONT );	// Front face culling reduces artefacts but produces more "peter-panning"
+		
+		// Render shadow maps of all slices
+		for( uint32 i = 0; i < numMaps; ++i )
+		{
+			ShadowSliceRecord &slice = mapRec->slices[i];
+			
+			// Create texture atlas if several splits are enabled
+			if( numMaps > 1 )
+			{
+				const int hsm = Modules::config().shadowMapSize / 2;
+				const int scissorXY[8] = { 0, 0,  hsm, 0,  hsm, hsm,  0, hsm };
+				
+				gRDI->setScissorTest( true );
+
+				// Select quadrant of shadow map
+				gRDI->setScissorRect( scissorXY[i * 2], scissorXY[i * 2 + 1], hsm, hsm );
+			}
+		
+			setupViewMatrices( _curLight->getViewMat(), slice.lightProjMat );
+			
+			// Render
+			drawRecordedQueue( slice.queue, _curLight->_shadowContextId, 0, false, &slice.frustum, 0x0,
+			                   RenderingOrder::None, -1 );
+		}
+
+		// ****************************************************************************************
+
+		gRDI->setCullMode( RS_CULL_BACK );
+		gRDI->setScissorTest( false );
+			
+		gRDI->setViewport( prevVPX, prevVPY, prevVPWidth, prevVPHeight );
+		gRDI->setRenderBuffer( prevRendBuf );
+		gRDI->setColorWriteMask( true );
 	}
 
 	// Map from post-projective space [-1,1] to texture space [0,1]
 	for( uint32 i = 0; i < numMaps; ++i )
 	{
+		_lightMats[i] = mapRec->slices[i].lightProjMat * _curLight->getViewMat();
 		_lightMats[i].scale( 0.5f, 0.5f, 1.0f );
 		_lightMats[i].translate( 0.5f, 0.5f, 0.0f );
 	}
+}
 
-	// ********************************************************************************************
 
-	gRDI->setCullMode( RS_CULL_BACK );
-	gRDI->setScissorTest( false );
+// =================================================================================================
+// Light Pass Recording
+// =================================================================================================
+
+struct LightPassJobData
+{
+	Renderer              *renderer;
+	bool                  shadows, lighting;
+	RenderingOrder::List  order;
+};
+
+
+uint32 Renderer::selectVisibleLights( int occSet )
+{
+	std::vector< SceneNode * > &lightQueue = Modules::sceneMan().getLightQueue();
+	if( _lightPassRecords.size() < lightQueue.size() ) _lightPassRecords.resize( lightQueue.size() );
+	
+	uint32 numLights = 0;
+	
+	for( size_t i = 0, s = lightQueue.size(); i < s; ++i )
+	{
+		LightNode *light = (LightNode *)lightQueue[i];
+
+		// Check if light is not visible
+		if( _curCamera->getFrustum().cullFrustum( light->getFrustum() ) ) continue;
+
+		// Check if light is occluded
+		if( occSet >= 0 )
+		{
+			Vec3f bbMin, bbMax;
+			light->getFrustum().calcAABB( bbMin, bbMax );
+			
+			if( !testOcclusion( OCCPROXYLIST_LIGHTS, occSet, *light, bbMin, bbMax,
+			                    _curCamera->getFrustum().getOrigin() ) )
+				continue;
+		}
+
+		_lightPassRecords[numLights++].light = light;
+	}
+
+	return numLights;
+}
+
+
+void Renderer::recordLightPassJob( void *userData, uint32 jobIndex )
+{
+	LightPassJobData &data = *(LightPassJobData *)userData;
+	Renderer &renderer = *data.renderer;
+	LightPassRecord &rec = renderer._lightPassRecords[jobIndex];
+	CameraNode *camera = renderer._curCamera;
+
+	// Shared shadow maps were recorded by renderViews
+	if( data.shadows && rec.light->_shadowMapCount > 0 && renderer.findSharedShadowMap( rec.light ) == 0x0 )
+		renderer.recordShadowMap( rec );
+
+	if( data.lighting )
+	{
+		Modules::sceneMan().cullRenderables( camera->getFrustum(), &rec.light->getFrustum(),
+			camera->getAbsPos(), data.order, SceneNodeFlags::NoDraw, rec.queue );
+	}
+}
+
+
+void Renderer::recordLightPasses( uint32 numLights, bool shadows, bool lighting, RenderingOrder::List order )
+{
+	// Culling and render queue generation of the passes are independent of each other and
+	// are distributed over the worker threads; the passes are replayed in order afterwards
+	Modules::sceneMan().updateNodes();
+	
+	LightPassJobData data;
+	data.renderer = this;
+	data.shadows = shadows;
+	data.lighting = lighting;
+	data.order = order;
+
+	Timer *timer = Modules::stats().getTimer( EngineStats::CullingTime );
+	if( Modules::config().gatherTimeStats ) timer->setEnabled( true );
+	
+	Modules::jobMan().run( recordLightPassJob, &data, numLights );
+
+	timer->setEnabled( false );
+}
+
+
+// =================================================================================================
+// Shared Shadow Maps
+// =================================================================================================
+
+bool Renderer::usesShadows( CameraNode *camNode )
+{
+	if( Modules::config().debugViewMode || camNode->_pipelineRes == 0x0 ) return false;
+	
+	std::vector< PipelineStage > &stages = camNode->_pipelineRes->_stages;
+	for( uint32 i = 0; i < stages.size(); ++i )
+	{
+		if( !stages[i].enabled ) continue;
+		
+		for( uint32 j = 0; j < stages[i].commands.size(); ++j )
+		{
+			PipelineCommand &pc = stages[i].commands[j];
+			
+			if( (pc.command == PipelineCommands::DoForwardLightLoop && !pc.params[2].getBool()) ||
+			    (pc.command == PipelineCommands::DoDeferredLightLoop && !pc.params[1].getBool()) )
+			{
+				return true;
+			}
+		}
+	}
+
+	return false;
+}
+
+
+void Renderer::selectSharedShadowMaps( CameraNode **camNodes, uint32 numViews )
+{
+	// Only lights with a single shadow map are shared, since the splits of several maps
+	// depend on the viewer
+	_numSharedShadowMaps = 0;
+	if( _sharedShadowMaps.size() < MaxSharedShadowMaps ) _sharedShadowMaps.resize( MaxSharedShadowMaps );
+
+	CameraNode *shadowViews[MaxRenderViews];
+	uint32 numShadowViews = 0;
+	for( uint32 i = 0; i < numViews; ++i )
+	{
+		if( usesShadows( camNodes[i] ) ) shadowViews[numShadowViews++] = camNodes[i];
+	}
+	if( numShadowViews < 2 ) return;
+	
+	std::vector< SceneNode * > &lightQueue = Modules::sceneMan().getLightQueue();
+	for( size_t i = 0, s = lightQueue.size(); i < s && _numSharedShadowMaps < MaxSharedShadowMaps; ++i )
+	{
+		LightNode *light = (LightNode *)lightQueue[i];
+		if( light->_shadowMapCount != 1 ) continue;
+
+		SharedShadowMap &sharedMap = _sharedShadowMaps[_numSharedShadowMaps];
+		sharedMap.numCameras = 0;
+		for( uint32 j = 0; j < numShadowViews; ++j )
+		{
+			if( !shadowViews[j]->getFrustum().cullFrustum( light->getFrustum() ) )
+				sharedMap.cameras[sharedMap.numCameras++] = shadowViews[j];
+		}
+		if( sharedMap.numCameras < 2 ) continue;
+
+		// Render buffers are kept for later frames
+		if( _numSharedShadowMaps == _sharedShadowRBs.size() )
+		{
+			uint32 size = Modules::config().shadowMapSize;
+			uint32 rb = gRDI->createRenderBuffer( size, size, TextureFormats::BGRA8, true, 0, 0 );
+			if( rb == 0 ) break;
+			_sharedShadowRBs.push_back( rb );
+		}
 		
-	gRDI->setViewport( prevVPX, prevVPY, prevVPWidth, prevVPHeight );
-	gRDI->setRenderBuffer( prevRendBuf );
-	gRDI->setColorWriteMask( true );
+		sharedMap.rec.light = light;
+		sharedMap.rendBuf = _sharedShadowRBs[_numSharedShadowMaps];
+		sharedMap.rendered = false;
+		++_numSharedShadowMaps;
+	}
+}
+
+
+SharedShadowMap *Renderer::findSharedShadowMap( LightNode *light )
+{
+	for( uint32 i = 0; i < _numSharedShadowMaps; ++i )
+	{
+		if( _sharedShadowMaps[i].rec.light == light ) return &_sharedShadowMaps[i];
+	}
+
+	return 0x0;
+}
+
+
+void Renderer::recordSharedShadowMap( SharedShadowMap &sharedMap )
+{
+	// Runs on the worker threads like recordShadowMap
+	
+	LightPassRecord &rec = sharedMap.rec;
+	LightNode *light = rec.light;
+	Frustum viewSlices[MaxRenderViews];
+	
+	// The single slice of the shadow map is the union of the lit parts of all views
+	float nearDist = Math::MaxFloat, farDist = 0;
+	for( uint32 i = 0; i < sharedMap.numCameras; ++i )
+	{
+		CameraNode *camNode = sharedMap.cameras[i];
+		float viewFarDist = calcLitFarDist( camNode, light, rec.cullQueue );
+		buildSliceFrustum( camNode, camNode->_frustNear, viewFarDist, viewSlices[i] );
+
+		nearDist = minf( nearDist, camNode->_frustNear );
+		farDist = maxf( farDist, viewFarDist );
+	}
+	rec.splitPlanes[0] = nearDist;
+	rec.splitPlanes[1] = farDist;
+
+	// Get light projection matrix
+	float ymax = nearDist * tanf( degToRad( light->_fov / 2 ) );
+	float xmax = ymax * 1.0f;  // ymax * aspect
+	Matrix4f lightProjMat = Matrix4f::PerspectiveMat( -xmax, xmax, -ymax, ymax, nearDist, light->_radius );
+	
+	// Build optimized light projection matrix; LODs of shadow casters are selected for the first view
+	const Vec3f &camPos = sharedMap.cameras[0]->getAbsPos();
+	Matrix4f lightViewProjMat = lightProjMat * light->getViewMat();
+	lightProjMat = calcCropMatrix( viewSlices, sharedMap.numCameras, light->_absPos, lightViewProjMat,
+	                               camPos, rec.cullQueue ) * lightProjMat;
+	
+	// Generate render queue with shadow casters
+	ShadowSliceRecord &slice = rec.slices[0];
+	slice.frustum.buildViewFrustum( light->getViewMat(), lightProjMat );
+	Modules::sceneMan().cullRenderables( slice.frustum, 0x0, camPos, RenderingOrder::None,
+		SceneNodeFlags::NoDraw | SceneNodeFlags::NoCastShadow, slice.queue );
+	slice.lightProjMat = lightProjMat;
+}
+
+
+void Renderer::recordSharedShadowMapJob( void *userData, uint32 jobIndex )
+{
+	Renderer &renderer = *(Renderer *)userData;
+	
+	renderer.recordSharedShadowMap( renderer._sharedShadowMaps[jobIndex] );
+}
+
+
+void Renderer::drawRecordedQueue( RenderQueue &queue, uint32 shaderContext, int theClass, bool debugView,
+                                  const Frustum *frust1, const Frustum *frust2, RenderingOrder::List order,
+                                  int occSet )
+{
+	// Render functions work on the render queue of the scene manager
+	RenderQueue &renderQueue = Modules::sceneMan().getRenderQueue();
+	
+	renderQueue.swap( queue );
+	drawRenderables( shaderContext, theClass, debugView, frust1, frust2, order, occSet );
+	renderQueue.swap( queue );
 }
 
 
@@ -974,6 +1396,19 @@ void Renderer::updateShadowMap()
 // Occlusion Culling
 // =================================================================================================
 
+// Occlusion queries and fences of the visibility buffer are forwarded to the render device
+
+uint32 RDIOcclusionDevice::createOcclusionQuery() { return gRDI->createOcclusionQuery(); }
+void RDIOcclusionDevice::destroyQuery( uint32 queryObj ) { gRDI->destroyQuery( queryObj ); }
+uint32 RDIOcclusionDevice::getQueryResult( uint32 queryObj ) { return gRDI->getQueryResult( queryObj ); }
+bool RDIOcclusionDevice::isQueryResultAvailable( uint32 queryObj ) { return gRDI->isQueryResultAvailable( queryObj ); }
+uint32 RDIOcclusionDevice::createFence() { return gRDI->createFence(); }
+void RDIOcclusionDevice::destroyFence( uint32 fenceObj ) { gRDI->destroyFence( fenceObj ); }
+bool RDIOcclusionDevice::isFenceSignaled( uint32 fenceObj ) { return gRDI->isFenceSignaled( fenceObj ); }
+
+
+// =================================================================================================
+
 int Renderer::registerOccSet()
 {
 	for( int i = 0; i < (int)_occSets.size(); ++i )
@@ -993,7 +1428,29 @@ int Renderer::registerOccSet()
 void Renderer::unregisterOccSet( int occSet )
 {
 	if( occSet >= 0 && occSet < (int)_occSets.size() )
+	{
 		_occSets[occSet] = 0;
+		_visBuffer.resetSet( occSet );
+	}
+}
+
+
+bool Renderer::testOcclusion( uint32 list, int occSet, SceneNode &node, const Vec3f &bbMin, const Vec3f &bbMax,
+                              const Vec3f &viewerPos )
+{
+	// Returns whether the node has to be drawn; the node is tested only once per frame and occlusion set
+	uint32 slot = node.getHandle() - 1;
+	
+	if( _visBuffer.markTested( occSet, slot, _frameID ) )
+	{
+		// Proxy can only be tested if viewer is outside of bounding box
+		if( nearestDistToAABB( viewerPos, bbMin, bbMax ) > 0 )
+			pushOccProxy( list, bbMin, bbMax, (uint32)occSet, slot );
+		else
+			_visBuffer.setVisible( occSet, slot );
+	}
+
+	return !_visBuffer.isOccluded( occSet, slot );
 }
 
 
@@ -1005,7 +1462,7 @@ void Renderer::drawOccProxies( uint32 list )
 	gRDI->getColorWriteMask( prevColorMask );
 	gRDI->getDepthMask( prevDepthMask );
 	
-	setMaterial( 0x0, "" );
+	setMaterial( 0x0, 0 );
 	gRDI->setColorWriteMask( false );
 	gRDI->setDepthMask( false );
 	
@@ -1020,7 +1477,8 @@ void Renderer::drawOccProxies( uint32 list )
 	{
 		OccProxy &proxy = _occProxies[list][i];
 
-		gRDI->beginQuery( proxy.queryObj );
+		uint32 queryObj = _visBuffer.addTest( proxy.occSet, proxy.slot );
+		gRDI->beginQuery( queryObj );
 		
 		Matrix4f mat = Matrix4f::TransMat( proxy.bbMin.x, proxy.bbMin.y, proxy.bbMin.z ) *
 			Matrix4f::ScaleMat( proxy.bbMax.x - proxy.bbMin.x, proxy.bbMax.y - proxy.bbMin.y, proxy.bbMax.z - proxy.bbMin.z );
@@ -1029,7 +1487,7 @@ void Renderer::drawOccProxies( uint32 list )
 		// Draw AABB
 		gRDI->drawIndexed( PRIM_TRILIST, 0, 36, 0, 8 );
 
-		gRDI->endQuery( proxy.queryObj );
+		gRDI->endQuery( queryObj );
 	}
 
 	setShaderComb( 0x0 );
@@ -1078,7 +1536,7 @@ void Renderer::clearOverlays()
 }
 
 
-void Renderer::drawOverlays( const string &shaderContext )
+void Renderer::drawOverlays( uint32 shaderContext )
 {
 	uint32 numOverlayVerts = 0;
 	if( !_overlayBatches.empty() )
@@ -1132,6 +1590,7 @@ void Renderer::bindPipeBuffer( uint32 rbObj, const string &sampler, uint32 bufIn
 	if( rbObj == 0 )
 	{
 		// Clear buffer bindings
+		if( !_pipeSamplerBindings.empty() ) ++_pipeSamplerStamp;
 		_pipeSamplerBindings.resize( 0 );
 	}
 	else
@@ -1148,6 +1607,7 @@ void Renderer::bindPipeBuffer( uint32 rbObj, const string &sampler, uint32 bufIn
 		}
 		
 		// Add binding
+		++_pipeSamplerStamp;
 		_pipeSamplerBindings.push_back( PipeSamplerBinding() );
 		size_t len = std::min( sampler.length(), (size_t)63 );
 		strncpy_s( _pipeSamplerBindings.back().sampler, 63, sampler.c_str(), len );
@@ -1184,7 +1644,7 @@ void Renderer::clear( bool depth, bool buf0, bool buf1, bool buf2, bool buf3,
 }
 
 
-void Renderer::drawFSQuad( Resource *matRes, const string &shaderContext )
+void Renderer::drawFSQuad( Resource *matRes, uint32 shaderContext )
 {
 	if( matRes == 0x0 || matRes->getType() != ResourceTypes::Material ) return;
 
@@ -1200,7 +1660,7 @@ void Renderer::drawFSQuad( Resource *matRes, const string &shaderContext )
 }
 
 
-void Renderer::drawGeometry( const string &shaderContext, const string &theClass,
+void Renderer::drawGeometry( uint32 shaderContext, int theClass,
                              RenderingOrder::List order, int occSet )
 {
 	Modules::sceneMan().updateQueues( _curCamera->getFrustum(), 0x0, order,
@@ -1211,7 +1671,7 @@ void Renderer::drawGeometry( const string &shaderContext, const string &theClass
 }
 
 
-void Renderer::drawLightGeometry( const string &shaderContext, const string &theClass,
+void Renderer::drawLightGeometry( uint32 shaderContext, int theClass,
                                   bool noShadows, RenderingOrder::List order, int occSet )
 {
 	Modules::sceneMan().updateQueues( _curCamera->getFrustum(), 0x0, RenderingOrder::None,
@@ -1220,49 +1680,14 @@ void Renderer::drawLightGeometry( const string &shaderContext, const string &the
 	GPUTimer *timer = Modules::stats().getGPUTimer( EngineStats::FwdLightsGPUTime );
 	if( Modules::config().gatherTimeStats ) timer->beginQuery( _frameID );
 	
-	for( size_t i = 0, s = Modules::sceneMan().getLightQueue().size(); i < s; ++i )
+	// Find visible lights and record their passes
+	uint32 numLights = selectVisibleLights( occSet );
+	recordLightPasses( numLights, !noShadows, true, order );
+	
+	for( uint32 i = 0; i < numLights; ++i )
 	{
-		_curLight = (LightNode *)Modules::sceneMan().getLightQueue()[i];
-
-		// Check if light is not visible
-		if( _curCamera->getFrustum().cullFrustum( _curLight->getFrustum() ) ) continue;
-
-		// Check if light is occluded
-		if( occSet >= 0 )
-		{
-			if( occSet > (int)_curLight->_occQueries.size() - 1 )
-			{
-				_curLight->_occQueries.resize( occSet + 1, 0 );
-				_curLight->_lastVisited.resize( occSet + 1, 0 );
-			}
-			if( _curLight->_occQueries[occSet] == 0 )
-			{
-				_curLight->_occQueries[occSet] = gRDI->createOcclusionQuery();
-				_curLight->_lastVisited[occSet] = 0;
-			}
-			else
-			{
-				if( _curLight->_lastVisited[occSet] != Modules::renderer().getFrameID() )
-				{
-					_curLight->_lastVisited[occSet] = Modules::renderer().getFrameID();
-				
-					Vec3f bbMin, bbMax;
-					_curLight->getFrustum().calcAABB( bbMin, bbMax );
-					
-					// Check that viewer is outside light bounds
-					if( nearestDistToAABB( _curCamera->getFrustum().getOrigin(), bbMin, bbMax ) > 0 )
-					{
-						Modules::renderer().pushOccProxy( 1, bbMin, bbMax, _curLight->_occQueries[occSet] );
-
-						// Check query result from previous frame
-						if( gRDI->getQueryResult( _curLight->_occQueries[occSet] ) < 1 )
-						{
-							continue;
-						}
-					}
-				}
-			}
-		}
+		LightPassRecord &rec = _lightPassRecords[i];
+		_curLight = rec.light;
 	
 		// Update shadow map
 		if( !noShadows && _curLight->_shadowMapCount > 0 )
@@ -1271,7 +1696,7 @@ void Renderer::drawLightGeometry( const string &shaderContext, const string &the
 			GPUTimer *timerShadows = Modules::stats().getGPUTimer( EngineStats::ShadowsGPUTime );
 			if( Modules::config().gatherTimeStats ) timerShadows->beginQuery( _frameID );
 
-			updateShadowMap();
+			updateShadowMap( rec );
 			setupShadowMap( false );
 
 			timerShadows->endQuery();
@@ -1296,12 +1721,10 @@ void Renderer::drawLightGeometry( const string &shaderContext, const string &the
 		}
 		
 		// Render
-		Modules::sceneMan().updateQueues( _curCamera->getFrustum(), &_curLight->getFrustum(),
-		                                  order, SceneNodeFlags::NoDraw, false, true );
 		setupViewMatrices( _curCamera->getViewMat(), _curCamera->getProjMat() );
-		drawRenderables( shaderContext.empty() ? _curLight->_lightingContext : shaderContext,
-		                 theClass, false, &_curCamera->getFrustum(),
-		                 &_curLight->getFrustum(), order, occSet );
+		drawRecordedQueue( rec.queue, shaderContext == 0 ? _curLight->_lightingContextId : shaderContext,
+		                   theClass, false, &_curCamera->getFrustum(),
+		                   &_curLight->getFrustum(), order, occSet );
 		Modules().stats().incStat( EngineStats::LightPassCount, 1 );
 
 		// Reset
@@ -1321,7 +1744,7 @@ void Renderer::drawLightGeometry( const string &shaderContext, const string &the
 }
 
 
-void Renderer::drawLightShapes( const string &shaderContext, bool noShadows, int occSet )
+void Renderer::drawLightShapes( uint32 shaderContext, bool noShadows, int occSet )
 {
 	MaterialResource *curMatRes = 0x0;
 	
@@ -1331,49 +1754,14 @@ void Renderer::drawLightShapes( const string &shaderContext, bool noShadows, int
 	GPUTimer *timer = Modules::stats().getGPUTimer( EngineStats::DefLightsGPUTime );
 	if( Modules::config().gatherTimeStats ) timer->beginQuery( _frameID );
 	
-	for( size_t i = 0, s = Modules::sceneMan().getLightQueue().size(); i < s; ++i )
+	// Find visible lights and record their shadow passes
+	uint32 numLights = selectVisibleLights( occSet );
+	recordLightPasses( numLights, !noShadows, false, RenderingOrder::None );
+	
+	for( uint32 i = 0; i < numLights; ++i )
 	{
-		_curLight = (LightNode *)Modules::sceneMan().getLightQueue()[i];
-		
-		// Check if light is not visible
-		if( _curCamera->getFrustum().cullFrustum( _curLight->getFrustum() ) ) continue;
-		
-		// Check if light is occluded
-		if( occSet >= 0 )
-		{
-			if( occSet > (int)_curLight->_occQueries.size() - 1 )
-			{
-				_curLight->_occQueries.resize( occSet + 1, 0 );
-				_curLight->_lastVisited.resize( occSet + 1, 0 );
-			}
-			if( _curLight->_occQueries[occSet] == 0 )
-			{
-				_curLight->_occQueries[occSet] = gRDI->createOcclusionQuery();
-				_curLight->_lastVisited[occSet] = 0;
-			}
-			else
-			{
-				if( _curLight->_lastVisited[occSet] != Modules::renderer().getFrameID() )
-				{
-					_curLight->_lastVisited[occSet] = Modules::renderer().getFrameID();
-				
-					Vec3f bbMin, bbMax;
-					_curLight->getFrustum().calcAABB( bbMin, bbMax );
-					
-					// Check that viewer is outside light bounds
-					if( nearestDistToAABB( _curCamera->getFrustum().getOrigin(), bbMin, bbMax ) > 0 )
-					{
-						Modules::renderer().pushOccProxy( 1, bbMin, bbMax, _curLight->_occQueries[occSet] );
-
-						// Check query result from previous frame
-						if( gRDI->getQueryResult( _curLight->_occQueries[occSet] ) < 1 )
-						{
-							continue;
-						}
-					}
-				}
-			}
-		}
+		LightPassRecord &rec = _lightPassRecords[i];
+		_curLight = rec.light;
 		
 		// Update shadow map
 		if( !noShadows && _curLight->_shadowMapCount > 0 )
@@ -1382,7 +1770,7 @@ void Renderer::drawLightShapes( const string &shaderContext, bool noShadows, int
 			GPUTimer *timerShadows = Modules::stats().getGPUTimer( EngineStats::ShadowsGPUTime );
 			if( Modules::config().gatherTimeStats ) timerShadows->beginQuery( _frameID );
 			
-			updateShadowMap();
+			updateShadowMap( rec );
 			setupShadowMap( false );
 			curMatRes = 0x0;
 			
@@ -1399,7 +1787,7 @@ void Renderer::drawLightShapes( const string &shaderContext, bool noShadows, int
 		if( curMatRes != _curLight->_materialRes )
 		{
 			if( !setMaterial( _curLight->_materialRes,
-				              shaderContext.empty() ? _curLight->_lightingContext : shaderContext ) )
+				              shaderContext == 0 ? _curLight->_lightingContextId : shaderContext ) )
 			{
 				continue;
 			}
@@ -1447,7 +1835,7 @@ void Renderer::drawLightShapes( const string &shaderContext, bool noShadows, int
 // Scene Node Rendering Functions
 // =================================================================================================
 
-void Renderer::drawRenderables( const string &shaderContext, const string &theClass, bool debugView,
+void Renderer::drawRenderables( uint32 shaderContext, int theClass, bool debugView,
                                 const Frustum *frust1, const Frustum *frust2, RenderingOrder::List order,
                                 int occSet )
 {
@@ -1495,7 +1883,7 @@ void Renderer::drawRenderables( const string &shaderContext, const string &theCl
 }
 
 
-void Renderer::drawMeshes( uint32 firstItem, uint32 lastItem, const string &shaderContext, const string &theClass,
+void Renderer::drawMeshes( uint32 firstItem, uint32 lastItem, uint32 shaderContext, int theClass,
                            bool debugView, const Frustum *frust1, const Frustum *frust2, RenderingOrder::List order,
                            int occSet )
 {
@@ -1505,6 +1893,10 @@ void Renderer::drawMeshes( uint32 firstItem, uint32 lastItem, const string &shad
 	GeometryResource *curGeoRes = 0x0;
 	MaterialResource *curMatRes = 0x0;
 
+	// Texture resolution is only requested for passes seen by the camera
+	bool streamTextures = !debugView && TextureResource::getStreamer().isActive() &&
+	                      frust1 == &Modules::renderer().getCurCamera()->getFrustum();
+
 	// Loop over mesh queue
 	for( size_t i = firstItem; i <= lastItem; ++i )
 	{
@@ -1518,48 +1910,18 @@ void Renderer::drawMeshes( uint32 firstItem, uint32 lastItem, const string &shad
 			continue;
 		
 		bool modelChanged = true;
-		uint32 queryObj = 0;
 
 		// Occlusion culling
-		if( occSet >= 0 )
-		{
-			if( occSet > (int)meshNode->_occQueries.size() - 1 )
-			{
-				meshNode->_occQueries.resize( occSet + 1, 0 );
-				meshNode->_lastVisited.resize( occSet + 1, 0 );
-			}
-			if( meshNode->_occQueries[occSet] == 0 )
-			{
-				queryObj = gRDI->createOcclusionQuery();
-				meshNode->_occQueries[occSet] = queryObj;
-				meshNode->_lastVisited[occSet] = 0;
-			}
-			else
-			{
-				if( meshNode->_lastVisited[occSet] != Modules::renderer().getFrameID() )
-				{
-					meshNode->_lastVisited[occSet] = Modules::renderer().getFrameID();
-				
-					// Check query result (viewer must be outside of bounding box)
-					if( nearestDistToAABB( frust1->getOrigin(), meshNode->getBBox().min,
-					                       meshNode->getBBox().max ) > 0 &&
-						gRDI->getQueryResult( meshNode->_occQueries[occSet] ) < 1 )
-					{
-						Modules::renderer().pushOccProxy( 0, meshNode->getBBox().min, meshNode->getBBox().max,
-						                                  meshNode->_occQueries[occSet] );
-						continue;
-					}
-					else
-						queryObj = meshNode->_occQueries[occSet];
-				}
-			}
-		}
+		if( occSet >= 0 && !Modules::renderer().testOcclusion( OCCPROXYLIST_RENDERABLES, occSet, *meshNode,
+			meshNode->getBBox().min, meshNode->getBBox().max, frust1->getOrigin() ) )
+			continue;
 		
 		// Bind geometry
 		if( curGeoRes != modelNode->getGeometryResource() )
 		{
 			curGeoRes = modelNode->getGeometryResource();
 			ASSERT( curGeoRes != 0x0 );
+			curGeoRes->markUsed( Modules::renderer().getFrameID() );
 		
 			// Indices
 			gRDI->setIndexBuffer( curGeoRes->getIndexBuf(),
@@ -1583,6 +1945,9 @@ void Renderer::drawMeshes( uint32 firstItem, uint32 lastItem, const string &shad
 		if( !debugView )
 		{
 			if( !meshNode->getMaterialRes()->isOfClass( theClass ) ) continue;
+
+			if( streamTextures )
+				Modules::renderer().requestTexStreaming( *meshNode->getMaterialRes(), meshNode->getBBox() );
 			
 			// Set material
 			if( curMatRes != meshNode->getMaterialRes() )
@@ -1638,12 +2003,7 @@ void Renderer::drawMeshes( uint32 firstItem, uint32 lastItem, const string &shad
 		}
 		if( curShader->uni_worldNormalMat >= 0 )
 		{
-			// TODO: Optimize this
-			Matrix4f normalMat4 = meshNode->_absTrans.inverted().transposed();
-			float normalMat[9] = { normalMat4.x[0], normalMat4.x[1], normalMat4.x[2],
-			                       normalMat4.x[4], normalMat4.x[5], normalMat4.x[6],
-			                       normalMat4.x[8], normalMat4.x[9], normalMat4.x[10] };
-			gRDI->setShaderConst( curShader->uni_worldNormalMat, CONST_FLOAT33, normalMat );
+			gRDI->setShaderConst( curShader->uni_worldNormalMat, CONST_FLOAT33, meshNode->getNormalMat() );
 		}
 		if( curShader->uni_nodeId >= 0 )
 		{
@@ -1656,17 +2016,11 @@ void Renderer::drawMeshes( uint32 firstItem, uint32 lastItem, const string &shad
 			                      &modelNode->_customInstData[0].x, ModelCustomVecCount );
 		}
 
-		if( queryObj )
-			gRDI->beginQuery( queryObj );
-		
 		// Render
 		gRDI->drawIndexed( PRIM_TRILIST, meshNode->getBatchStart(), meshNode->getBatchCount(),
 		                   meshNode->getVertRStart(), meshNode->getVertREnd() - meshNode->getVertRStart() + 1 );
 		Modules::stats().incStat( EngineStats::BatchCount, 1 );
 		Modules::stats().incStat( EngineStats::TriCount, meshNode->getBatchCount() / 3.0f );
-
-		if( queryObj )
-			gRDI->endQuery( queryObj );
 	}
 
 	// Draw occlusion proxies
@@ -1677,7 +2031,48 @@ void Renderer::drawMeshes( uint32 firstItem, uint32 lastItem, const string &shad
 }
 
 
-void Renderer::drawParticles( uint32 firstItem, uint32 lastItem, const string &shaderContext, const string &theClass,
+uint32 Renderer::streamParticles( EmitterNode *emitter, uint32 firstParticle, uint32 count )
+{
+	// Expand particles to quads in the scratch buffer
+	uint32 size = count * 4 * sizeof( ParticleStreamVert );
+	ParticleStreamVert *verts = (ParticleStreamVert *)useScratchBuf( size );
+	
+	const float *positions = emitter->_parPositions + firstParticle * 3;
+	const float *sizesAndRots = emitter->_parSizesANDRotations + firstParticle * 2;
+	const float *colors = emitter->_parColors + firstParticle * 4;
+	
+	for( uint32 i = 0; i < count; ++i )
+	{
+		ParticleStreamVert *v = &verts[i * 4];
+		v[0].x = positions[i * 3 + 0]; v[0].y = positions[i * 3 + 1]; v[0].z = positions[i * 3 + 2];
+		v[0].size = sizesAndRots[i * 2 + 0]; v[0].rot = sizesAndRots[i * 2 + 1];
+		v[0].r = colors[i * 4 + 0]; v[0].g = colors[i * 4 + 1];
+		v[0].b = colors[i * 4 + 2]; v[0].a = colors[i * 4 + 3];
+		v[1] = v[0]; v[2] = v[0]; v[3] = v[0];
+		
+		v[0].u = 0; v[0].v = 0;
+		v[1].u = 1; v[1].v = 0;
+		v[2].u = 1; v[2].v = 1;
+		v[3].u = 0; v[3].v = 1;
+	}
+
+	// Append data to ring buffer; when it is full the storage is orphaned so that the
+	// driver does not have to wait for draw calls still using the old data
+	if( _particleStreamOffset + size > ParticleStreamBufSize )
+	{
+		gRDI->updateBufferData( _particleStreamVB, 0, ParticleStreamBufSize, 0x0 );
+		_particleStreamOffset = 0;
+	}
+	
+	uint32 offset = _particleStreamOffset;
+	gRDI->updateBufferData( _particleStreamVB, offset, size, verts );
+	_particleStreamOffset += size;
+
+	return offset;
+}
+
+
+void Renderer::drawParticles( uint32 firstItem, uint32 lastItem, uint32 shaderContext, int theClass,
                               bool debugView, const Frustum *frust1, const Frustum * /*frust2*/, RenderingOrder::List /*order*/,
                               int occSet )
 {
@@ -1691,53 +2086,22 @@ void Renderer::drawParticles( uint32 firstItem, uint32 lastItem, const string &s
 	if( Modules::config().gatherTimeStats ) timer->beginQuery( Modules::renderer().getFrameID() );
 
 	// Bind particle geometry
-	gRDI->setVertexBuffer( 0, Modules::renderer().getParticleVBO(), 0, sizeof( ParticleVert ) );
 	gRDI->setIndexBuffer( Modules::renderer().getQuadIdxBuf(), IDXFMT_16 );
 	ASSERT( QuadIndexBufCount >= ParticlesPerBatch * 6 );
+	ASSERT( QuadIndexBufCount >= ParticlesPerStreamBatch * 6 );
 
 	// Loop through emitter queue
 	for( uint32 i = firstItem; i <= lastItem; ++i )
 	{
 		EmitterNode *emitter = (EmitterNode *)renderQueue[i].node;
 		
-		if( emitter->_particleCount == 0 ) continue;
+		if( emitter->_liveParticleCount == 0 ) continue;
 		if( !emitter->_materialRes->isOfClass( theClass ) ) continue;
 		
 		// Occlusion culling
-		uint32 queryObj = 0;
-		if( occSet >= 0 )
-		{
-			if( occSet > (int)emitter->_occQueries.size() - 1 )
-			{
-				emitter->_occQueries.resize( occSet + 1, 0 );
-				emitter->_lastVisited.resize( occSet + 1, 0 );
-			}
-			if( emitter->_occQueries[occSet] == 0 )
-			{
-				queryObj = gRDI->createOcclusionQuery();
-				emitter->_occQueries[occSet] = queryObj;
-				emitter->_lastVisited[occSet] = 0;
-			}
-			else
-			{
-				if( emitter->_lastVisited[occSet] != Modules::renderer().getFrameID() )
-				{
-					emitter->_lastVisited[occSet] = Modules::renderer().getFrameID();
-				
-					// Check query result (viewer must be outside of bounding box)
-					if( nearestDistToAABB( frust1->getOrigin(), emitter->getBBox().min,
-					                       emitter->getBBox().max ) > 0 &&
-						gRDI->getQueryResult( emitter->_occQueries[occSet] ) < 1 )
-					{
-						Modules::renderer().pushOccProxy( 0, emitter->getBBox().min,
-							emitter->getBBox().max, emitter->_occQueries[occSet] );
-						continue;
-					}
-					else
-						queryObj = emitter->_occQueries[occSet];
-				}
-			}
-		}
+		if( occSet >= 0 && !Modules::renderer().testOcclusion( OCCPROXYLIST_RENDERABLES, occSet, *emitter,
+			emitter->getBBox().min, emitter->getBBox().max, frust1->getOrigin() ) )
+			continue;
 		
 		// Set material
 		if( curMatRes != emitter->_materialRes )
@@ -1746,88 +2110,60 @@ void Renderer::drawParticles( uint32 firstItem, uint32 lastItem, const string &s
 			curMatRes = emitter->_materialRes;
 		}
 
-		// Set vertex layout
-		gRDI->setVertexLayout( Modules::renderer()._vlParticle );
+		// Shaders reading the particle attributes get the live particles as vertex stream,
+		// older shaders indexing the uniform arrays fall back to fixed size batches
+		ShaderCombination *curShader = Modules::renderer().getCurShader();
+		bool streamed = curShader->uni_parPosArray < 0 &&
+			gRDI->isVertexLayoutSupported( curShader->shaderObj, Modules::renderer()._vlParticleStream );
 		
-		if( queryObj )
-			gRDI->beginQuery( queryObj );
+		// Set vertex layout
+		gRDI->setVertexLayout( streamed ? Modules::renderer()._vlParticleStream : Modules::renderer()._vlParticle );
 		
 		// Shader uniforms
-		ShaderCombination *curShader = Modules::renderer().getCurShader();
 		if( curShader->uni_nodeId >= 0 )
 		{
 			float id = (float)emitter->getHandle();
 			gRDI->setShaderConst( curShader->uni_nodeId, CONST_FLOAT, &id );
 		}
 
-		// Divide particles in batches and render them
-		for( uint32 j = 0; j < emitter->_particleCount / ParticlesPerBatch; ++j )
+		if( streamed )
 		{
-			// Check if batch needs to be rendered
-			bool allDead = true;
-			for( uint32 k = 0; k < ParticlesPerBatch; ++k )
+			// Render live particles with one call per stream batch
+			for( uint32 j = 0; j < emitter->_liveParticleCount; j += ParticlesPerStreamBatch )
 			{
-				if( emitter->_particles[j*ParticlesPerBatch + k].life > 0 )
-				{
-					allDead = false;
-					break;
-				}
+				uint32 count = min( emitter->_liveParticleCount - j, ParticlesPerStreamBatch );
+				uint32 offset = Modules::renderer().streamParticles( emitter, j, count );
+				
+				gRDI->setVertexBuffer( 0, Modules::renderer()._particleStreamVB, offset, sizeof( ParticleStreamVert ) );
+				gRDI->drawIndexed( PRIM_TRILIST, 0, count * 6, 0, count * 4 );
+				Modules::stats().incStat( EngineStats::BatchCount, 1 );
+				Modules::stats().incStat( EngineStats::TriCount, count * 2.0f );
 			}
-			if( allDead ) continue;
-
-			// Render batch
-			if( curShader->uni_parPosArray >= 0 )
-				gRDI->setShaderConst( curShader->uni_parPosArray, CONST_FLOAT3,
-				                      (float *)emitter->_parPositions + j*ParticlesPerBatch*3, ParticlesPerBatch );
-			if( curShader->uni_parSizeAndRotArray >= 0 )
-				gRDI->setShaderConst( curShader->uni_parSizeAndRotArray, CONST_FLOAT2,
-				                      (float *)emitter->_parSizesANDRotations + j*ParticlesPerBatch*2, ParticlesPerBatch );
-			if( curShader->uni_parColorArray >= 0 )
-				gRDI->setShaderConst( curShader->uni_parColorArray, CONST_FLOAT4,
-				                      (float *)emitter->_parColors + j*ParticlesPerBatch*4, ParticlesPerBatch );
-
-			gRDI->drawIndexed( PRIM_TRILIST, 0, ParticlesPerBatch * 6, 0, ParticlesPerBatch * 4 );
-			Modules::stats().incStat( EngineStats::BatchCount, 1 );
-			Modules::stats().incStat( EngineStats::TriCount, ParticlesPerBatch * 2.0f );
 		}
-
-		uint32 count = emitter->_particleCount % ParticlesPerBatch;
-		if( count > 0 )
+		else
 		{
-			uint32 offset = (emitter->_particleCount / ParticlesPerBatch) * ParticlesPerBatch;
+			gRDI->setVertexBuffer( 0, Modules::renderer().getParticleVBO(), 0, sizeof( ParticleVert ) );
 			
-			// Check if batch needs to be rendered
-			bool allDead = true;
-			for( uint32 k = 0; k < count; ++k )
+			// Divide live particles in batches and render them
+			for( uint32 j = 0; j < emitter->_liveParticleCount; j += ParticlesPerBatch )
 			{
-				if( emitter->_particles[offset + k].life > 0 )
-				{
-					allDead = false;
-					break;
-				}
-			}
-			
-			if( !allDead )
-			{
-				// Render batch
+				uint32 count = min( emitter->_liveParticleCount - j, ParticlesPerBatch );
+				
 				if( curShader->uni_parPosArray >= 0 )
 					gRDI->setShaderConst( curShader->uni_parPosArray, CONST_FLOAT3,
-					                      (float *)emitter->_parPositions + offset*3, count );
+					                      (float *)emitter->_parPositions + j*3, count );
 				if( curShader->uni_parSizeAndRotArray >= 0 )
 					gRDI->setShaderConst( curShader->uni_parSizeAndRotArray, CONST_FLOAT2,
-					                      (float *)emitter->_parSizesANDRotations + offset*2, count );
+					                      (float *)emitter->_parSizesANDRotations + j*2, count );
 				if( curShader->uni_parColorArray >= 0 )
 					gRDI->setShaderConst( curShader->uni_parColorArray, CONST_FLOAT4,
-					                      (float *)emitter->_parColors + offset*4, count );
-				
+					                      (float *)emitter->_parColors + j*4, count );
+
 				gRDI->drawIndexed( PRIM_TRILIST, 0, count * 6, 0, count * 4 );
 				Modules::stats().incStat( EngineStats::BatchCount, 1 );
 				Modules::stats().incStat( EngineStats::TriCount, count * 2.0f );
 			}
 		}
-
-		if( queryObj )
-			gRDI->endQuery( queryObj );
 	}
 
 	timer->endQuery();
@@ -1925,26 +2261,26 @@ void Renderer::render( CameraNode *camNode )
 				break;
 
 			case PipelineCommands::DrawGeometry:
-				drawGeometry( pc.params[0].getString(), pc.params[1].getString(),
+				drawGeometry( pc.params[0].getInt(), pc.params[1].getInt(),
 				              (RenderingOrder::List)pc.params[2].getInt(), _curCamera->_occSet );
 				break;
 
 			case PipelineCommands::DrawOverlays:
-				drawOverlays( pc.params[0].getString() );
+				drawOverlays( pc.params[0].getInt() );
 				break;
 
 			case PipelineCommands::DrawQuad:
-				drawFSQuad( pc.params[0].getResource(), pc.params[1].getString() );
+				drawFSQuad( pc.params[0].getResource(), pc.params[1].getInt() );
 			break;
 
 			case PipelineCommands::DoForwardLightLoop:
-				drawLightGeometry( pc.params[0].getString(), pc.params[1].getString(),
+				drawLightGeometry( pc.params[0].getInt(), pc.params[1].getInt(),
 				                   pc.params[2].getBool(), (RenderingOrder::List)pc.params[3].getInt(),
 					_curCamera->_occSet );
 				break;
 
 			case PipelineCommands::DoDeferredLightLoop:
-				drawLightShapes( pc.params[0].getString(), pc.params[1].getBool(), _curCamera->_occSet );
+				drawLightShapes( pc.params[0].getInt(), pc.params[1].getBool(), _curCamera->_occSet );
 				break;
 
 			case PipelineCommands::SetUniform:
@@ -1963,9 +2299,65 @@ void Renderer::render( CameraNode *camNode )
 }
 
 
+void Renderer::renderViews( CameraNode **camNodes, uint32 numViews )
+{
+	if( numViews == 0 ) return;
+	if( numViews == 1 )
+	{
+		render( camNodes[0] );
+		return;
+	}
+	
+	// Cull all views in a single pass over the scene; the pipelines of the views
+	// take their render queues from the results
+	Modules::sceneMan().updateNodes();
+	
+	Timer *timer = Modules::stats().getTimer( EngineStats::CullingTime );
+	if( Modules::config().gatherTimeStats ) timer->setEnabled( true );
+	
+	const Frustum *frusta[MaxRenderViews];
+	Vec3f camPositions[MaxRenderViews];
+	for( uint32 i = 0; i < numViews; ++i )
+	{
+		frusta[i] = &camNodes[i]->getFrustum();
+		camPositions[i] = camNodes[i]->getAbsPos();
+	}
+	if( _viewQueues.size() < numViews ) _viewQueues.resize( numViews );
+	Modules::sceneMan().cullViews( frusta, camPositions, numViews, SceneNodeFlags::NoDraw, &_viewQueues[0] );
+
+	// Record shadow maps of lights that are visible in several views
+	selectSharedShadowMaps( camNodes, numViews );
+	Modules::jobMan().run( recordSharedShadowMapJob, this, _numSharedShadowMaps );
+
+	timer->setEnabled( false );
+
+	for( uint32 i = 0; i < numViews; ++i )
+	{
+		Modules::sceneMan().setViewQueue( frusta[i], &_viewQueues[i], SceneNodeFlags::NoDraw );
+		render( camNodes[i] );
+	}
+	
+	Modules::sceneMan().setViewQueue( 0x0, 0x0, 0 );
+	_numSharedShadowMaps = 0;
+}
+
+
 void Renderer::finalizeFrame()
 {
+	// Unload least recently used resources that exceed the memory budget
+	if( Modules::config().resourceMemBudget > 0 )
+	{
+		Modules::resMan().evictResources(
+			(uint64)(Modules::config().resourceMemBudget * 1024 * 1024), _frameID );
+	}
+	
+	// Read back occlusion results of previous frames
+	_visBuffer.finishFrame();
+	
 	++_frameID;
+
+	// Adjust resident mip levels of streamed textures
+	TextureResource::getStreamer().update();
 	
 	// Reset frame timer
 	Timer *timer = Modules::stats().getTimer( EngineStats::FrameTime );
@@ -1981,7 +2373,7 @@ void Renderer::renderDebugView()
 	float color[4] = { 0 };
 	
 	gRDI->setRenderBuffer( 0 );
-	setMaterial( 0x0, "" );
+	setMaterial( 0x0, 0 );
 	gRDI->setFillMode( RS_FILL_WIREFRAME );
 
 	gRDI->clear( CLR_DEPTH | CLR_COLOR_RT0 );
@@ -1991,14 +2383,15 @@ void Renderer::renderDebugView()
 
 	// Draw renderable nodes as wireframe
 	setupViewMatrices( _curCamera->getViewMat(), _curCamera->getProjMat() );
-	drawRenderables( "", "", true, &_curCamera->getFrustum(), 0x0, RenderingOrder::None, -1 );
+	drawRenderables( 0, 0, true, &_curCamera->getFrustum(), 0x0, RenderingOrder::None, -1 );
 
 	// Draw bounding boxes
 	gRDI->setCullMode( RS_CULL_NONE );
-	setMaterial( 0x0, "" );
+	setMaterial( 0x0, 0 );
 	setShaderComb( &_defColorShader );
 	commitGeneralUniforms();
-	gRDI->setShaderConst( _defColorShader.uni_worldMat, CONST_FLOAT44, &Matrix4f().x[0] );
+	Matrix4f identity;
+	gRDI->setShaderConst( _defColorShader.uni_worldMat, CONST_FLOAT44, &identity.x[0] );
 	color[0] = 0.4f; color[1] = 0.4f; color[2] = 0.4f; color[3] = 1;
 	gRDI->setShaderConst( Modules::renderer()._defColShader_color, CONST_FLOAT4, color );
 	for( uint32 i = 0, s = (uint32)Modules::sceneMan().getRenderQueue().size(); i < s; ++i )
@@ -2037,7 +2430,7 @@ void Renderer::renderDebugView()
 void Renderer::finishRendering()
 {
 	gRDI->setRenderBuffer( 0 );
-	setMaterial( 0x0, "" );
+	setMaterial( 0x0, 0 );
 	gRDI->resetStates();
 }
 
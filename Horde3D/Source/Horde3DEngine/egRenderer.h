@@ -17,6 +17,7 @@
 #include "egRendererBase.h"
 #include "egPrimitives.h"
 #include "egModel.h"
+#include "egVisibility.h"
 #include <vector>
 #include <algorithm>
 
@@ -24,13 +25,20 @@
 namespace Horde3D {
 
 class MaterialResource;
+struct MatBindingTable;
 class LightNode;
 class CameraNode;
+class EmitterNode;
 struct ShaderContext;
 
 const uint32 MaxNumOverlayVerts = 2048;
 const uint32 ParticlesPerBatch = 64;	// Warning: The GPU must have enough registers
-const uint32 QuadIndexBufCount = MaxNumOverlayVerts * 6;
+const uint32 ParticlesPerStreamBatch = 16384;  // Limited by 16 bit quad indices
+const uint32 ParticleStreamBufSize = 4 * 1024*1024;  // Size of particle vertex ring buffer in bytes
+const uint32 QuadIndexBufCount = ParticlesPerStreamBatch * 6;
+const uint32 MaxMatBindingTables = 64;  // Per material
+const uint32 MaxRenderViews = 16;  // Cameras rendered by a single renderViews call
+const uint32 MaxSharedShadowMaps = 8;  // Per renderViews call
 
 #define OCCPROXYLIST_RENDERABLES 0
 #define OCCPROXYLIST_LIGHTS 1
@@ -43,9 +51,9 @@ extern const char *fsOccBox;
 // Renderer
 // =================================================================================================
 
-typedef void (*RenderFunc)( uint32 firstItem, uint32 lastItem, const std::string &shaderContext,
-                            const std::string &theClass, bool debugView, const Frustum *frust1,
-                            const Frustum *frust2, RenderingOrder::List order, int occSet );
+typedef void (*RenderFunc)( uint32 firstItem, uint32 lastItem, uint32 shaderContext, int theClass,
+                            bool debugView, const Frustum *frust1, const Frustum *frust2,
+                            RenderingOrder::List order, int occSet );
 
 struct RenderFuncListItem
 {
@@ -91,20 +99,74 @@ struct ParticleVert
 	}
 };
 
+struct ParticleStreamVert
+{
+	float  u, v;            // Texture coordinates
+	float  x, y, z;         // Particle position
+	float  size, rot;       // Particle size and rotation
+	float  r, g, b, a;      // Particle color
+};
+
 // =================================================================================================
 
 struct OccProxy
 {
 	Vec3f   bbMin, bbMax;
-	uint32  queryObj;
+	uint32  occSet, slot;
 
 	OccProxy() {}
-	OccProxy( const Vec3f &bbMin, const Vec3f &bbMax, uint32 queryObj ) :
-		bbMin( bbMin ), bbMax( bbMax ), queryObj( queryObj )
+	OccProxy( const Vec3f &bbMin, const Vec3f &bbMax, uint32 occSet, uint32 slot ) :
+		bbMin( bbMin ), bbMax( bbMax ), occSet( occSet ), slot( slot )
 	{
 	}
 };
 
+// =================================================================================================
+
+// Forwards the occlusion queries and fences of the visibility buffer to the render device
+class RDIOcclusionDevice : public OcclusionDevice
+{
+public:
+	uint32 createOcclusionQuery();
+	void destroyQuery( uint32 queryObj );
+	uint32 getQueryResult( uint32 queryObj );
+	bool isQueryResultAvailable( uint32 queryObj );
+	uint32 createFence();
+	void destroyFence( uint32 fenceObj );
+	bool isFenceSignaled( uint32 fenceObj );
+};
+
+// =================================================================================================
+
+struct ShadowSliceRecord
+{
+	Frustum      frustum;  // Frustum of shadow casters
+	Matrix4f     lightProjMat;
+	RenderQueue  queue;
+};
+
+struct LightPassRecord
+{
+	LightNode          *light;
+	ShadowSliceRecord  slices[4];
+	RenderQueue        cullQueue;  // Temporary queue for finding lit geometry
+	RenderQueue        queue;  // Geometry of lighting pass
+	float              splitPlanes[5];
+	
+	LightPassRecord() : light( 0x0 ) {}
+};
+
+struct SharedShadowMap  // Shadow map of a light that is visible in several views
+{
+	CameraNode       *cameras[MaxRenderViews];  // Views in which the light is visible
+	uint32           numCameras;
+	uint32           rendBuf;
+	LightPassRecord  rec;
+	bool             rendered;
+	
+	SharedShadowMap() : numCameras( 0 ), rendBuf( 0 ), rendered( false ) {}
+};
+
 struct PipeSamplerBinding
 {
 	char    sampler[64];
@@ -134,7 +196,8 @@ public:
 	void releaseShaderComb( ShaderCombination &sc );
 	void setShaderComb( ShaderCombination *sc );
 	void commitGeneralUniforms();
-	bool setMaterial( MaterialResource *materialRes, const std::string &shaderContext );
+	bool setMaterial( MaterialResource *materialRes, uint32 shaderContext );
+	void requestTexStreaming( MaterialResource &materialRes, const BoundingBox &bBox );
 	
 	bool createShadowRB( uint32 width, uint32 height );
 	void releaseShadowRB();
@@ -142,19 +205,23 @@ public:
 	int registerOccSet();
 	void unregisterOccSet( int occSet );
 	void drawOccProxies( uint32 list );
-	void pushOccProxy( uint32 list, const Vec3f &bbMin, const Vec3f &bbMax, uint32 queryObj )
-		{ _occProxies[list].push_back( OccProxy( bbMin, bbMax, queryObj ) ); }
+	void pushOccProxy( uint32 list, const Vec3f &bbMin, const Vec3f &bbMax, uint32 occSet, uint32 slot )
+		{ _occProxies[list].push_back( OccProxy( bbMin, bbMax, occSet, slot ) ); }
+	bool testOcclusion( uint32 list, int occSet, SceneNode &node, const Vec3f &bbMin, const Vec3f &bbMax,
+	                    const Vec3f &viewerPos );
+	VisibilityBuffer &getVisibilityBuffer() { return _visBuffer; }
 	
 	void showOverlays( const float *verts, uint32 vertCount, float *colRGBA,
 	                   MaterialResource *matRes, int flags );
 	void clearOverlays();
 	
-	static void drawMeshes( uint32 firstItem, uint32 lastItem, const std::string &shaderContext, const std::string &theClass,
+	static void drawMeshes( uint32 firstItem, uint32 lastItem, uint32 shaderContext, int theClass,
 		bool debugView, const Frustum *frust1, const Frustum *frust2, RenderingOrder::List order, int occSet );
-	static void drawParticles( uint32 firstItem, uint32 lastItem, const std::string &shaderContext, const std::string &theClass,
+	static void drawParticles( uint32 firstItem, uint32 lastItem, uint32 shaderContext, int theClass,
 		bool debugView, const Frustum *frust1, const Frustum *frust2, RenderingOrder::List order, int occSet );
 
 	void render( CameraNode *camNode );
+	void renderViews( CameraNode **camNodes, uint32 numViews );
 	void finalizeFrame();
 
 	uint32 getFrameID() { return _frameID; }
@@ -162,30 +229,47 @@ public:
 	CameraNode *getCurCamera() { return _curCamera; }
 	uint32 getQuadIdxBuf() { return _quadIdxBuf; }
 	uint32 getParticleVBO() { return _particleVBO; }
+	uint32 streamParticles( EmitterNode *emitter, uint32 firstParticle, uint32 count );
 
 protected:
 	void setupViewMatrices( const Matrix4f &viewMat, const Matrix4f &projMat );
 	
 	void createPrimitives();
 	
-	bool setMaterialRec( MaterialResource *materialRes, const std::string &shaderContext, ShaderResource *shaderRes );
+	MatBindingTable &getMatBindingTable( MaterialResource &materialRes, ShaderResource &shaderRes );
+	bool setMaterialRec( MaterialResource *materialRes, uint32 shaderContext, ShaderResource *shaderRes );
 	
 	void setupShadowMap( bool noShadows );
-	Matrix4f calcCropMatrix( const Frustum &frustSlice, const Vec3f lightPos, const Matrix4f &lightViewProjMat );
-	void updateShadowMap();
+	Matrix4f calcCropMatrix( const Frustum *frustSlices, uint32 numSlices, const Vec3f lightPos,
+	                         const Matrix4f &lightViewProjMat, const Vec3f &camPos, RenderQueue &queue );
+	float calcLitFarDist( CameraNode *camNode, LightNode *light, RenderQueue &cullQueue );
+	void buildSliceFrustum( CameraNode *camNode, float nearDist, float farDist, Frustum &frustum );
+	void recordShadowMap( LightPassRecord &rec );
+	void updateShadowMap( LightPassRecord &rec );
+	
+	bool usesShadows( CameraNode *camNode );
+	void selectSharedShadowMaps( CameraNode **camNodes, uint32 numViews );
+	SharedShadowMap *findSharedShadowMap( LightNode *light );
+	void recordSharedShadowMap( SharedShadowMap &sharedMap );
+	static void recordSharedShadowMapJob( void *userData, uint32 jobIndex );
+	
+	uint32 selectVisibleLights( int occSet );
+	void recordLightPasses( uint32 numLights, bool shadows, bool lighting, RenderingOrder::List order );
+	static void recordLightPassJob( void *userData, uint32 jobIndex );
+	void drawRecordedQueue( RenderQueue &queue, uint32 shaderContext, int theClass, bool debugView,
+		const Frustum *frust1, const Frustum *frust2, RenderingOrder::List order, int occSet );
 
-	void drawOverlays( const std::string &shaderContext );
+	void drawOverlays( uint32 shaderContext );
 
 	void bindPipeBuffer( uint32 rbObj, const std::string &sampler, uint32 bufIndex );
 	void clear( bool depth, bool buf0, bool buf1, bool buf2, bool buf3, float r, float g, float b, float a );
-	void drawFSQuad( Resource *matRes, const std::string &shaderContext );
-	void drawGeometry( const std::string &shaderContext, const std::string &theClass,
-	                   RenderingOrder::List order, int occSet );
-	void drawLightGeometry( const std::string &shaderContext, const std::string &theClass,
-	                        bool noShadows, RenderingOrder::List order, int occSet );
-	void drawLightShapes( const std::string &shaderContext, bool noShadows, int occSet );
-	
-	void drawRenderables( const std::string &shaderContext, const std::string &theClass, bool debugView,
+	void drawFSQuad( Resource *matRes, uint32 shaderContext );
+	void drawGeometry( uint32 shaderContext, int theClass, RenderingOrder::List order, int occSet );
+	void drawLightGeometry( uint32 shaderContext, int theClass, bool noShadows,
+	                        RenderingOrder::List order, int occSet );
+	void drawLightShapes( uint32 shaderContext, bool noShadows, int occSet );
+	
+	void drawRenderables( uint32 shaderContext, int theClass, bool debugView,
 		const Frustum *frust1, const Frustum *frust2, RenderingOrder::List order, int occSet );
 	
 	void renderDebugView();
@@ -202,29 +286,40 @@ protected:
 	std::vector< PipeSamplerBinding >  _pipeSamplerBindings;
 	std::vector< char >                _occSets;  // Actually bool
 	std::vector< OccProxy >            _occProxies[2];  // 0: renderables, 1: lights
+	RDIOcclusionDevice                 _occDevice;
+	VisibilityBuffer                   _visBuffer;
 	
 	std::vector< OverlayBatch >        _overlayBatches;
 	OverlayVert                        *_overlayVerts;
 	uint32                             _overlayVB;
 	
 	uint32                             _shadowRB;
+	uint32                             _curShadowRB;  // Shadow map bound by setupShadowMap
 	uint32                             _frameID;
 	uint32                             _defShadowMap;
 	uint32                             _quadIdxBuf;
 	uint32                             _particleVBO;
+	uint32                             _particleStreamVB, _particleStreamOffset;
 	MaterialResource                   *_curStageMatLink;
 	CameraNode                         *_curCamera;
 	LightNode                          *_curLight;
 	ShaderCombination                  *_curShader;
 	RenderTarget                       *_curRenderTarget;
 	uint32                             _curShaderUpdateStamp;
+	uint32                             _pipeSamplerStamp;
 	
 	uint32                             _maxAnisoMask;
 	float                              _smSize;
 	float                              _splitPlanes[5];
 	Matrix4f                           _lightMats[4];
+	std::vector< LightPassRecord >     _lightPassRecords;
+	
+	std::vector< RenderQueue >         _viewQueues;  // Renderables of the views of renderViews
+	std::vector< SharedShadowMap >     _sharedShadowMaps;
+	uint32                             _numSharedShadowMaps;
+	std::vector< uint32 >              _sharedShadowRBs;  // Pool of render buffers for shared shadow maps
 
-	uint32                             _vlPosOnly, _vlOverlay, _vlModel, _vlParticle;
+	uint32                             _vlPosOnly, _vlOverlay, _vlModel, _vlParticle, _vlParticleStream;
 	ShaderCombination                  _defColorShader;
 	int                                _defColShader_color;  // Uniform location
 	
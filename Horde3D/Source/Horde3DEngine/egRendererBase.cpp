@@ -14,6 +14,7 @@
 #include "egModules.h"
 #include "egCom.h"
 #include "utOpenGL.h"
+#include <cstring>
 
 #include "utDebug.h"
 
@@ -26,6 +27,8 @@ namespace Horde3D {
 #	define CHECK_GL_ERROR
 #endif
 
+static const uint32 UnknownGLObj = 0xFFFFFFFF;  // Shadowed binding which has to be set in any case
+
 static const char *defaultShaderVS =
 	"uniform mat4 viewProjMat;\n"
 	"uniform mat4 worldMat;\n"
@@ -147,19 +150,34 @@ RenderDevice::RenderDevice()
 	_prevShaderId = _curShaderId = 0;
 	_curRendBuf = 0; _outputBufferIndex = 0;
 	_textureMem = 0; _bufferMem = 0;
+	_uploadedBytes = 0;
+	_streamBuf = 0; _streamOffset = 0;
 	_curRasterState.hash = _newRasterState.hash = 0;
 	_curBlendState.hash = _newBlendState.hash = 0;
 	_curDepthStencilState.hash = _newDepthStencilState.hash = 0;
 	_curVertLayout = _newVertLayout = 0;
-	_curIndexBuf = _newIndexBuf = 0;
+	_newIndexBuf = 0;
 	_defaultFBO = 0;
 	_indexFormat = (uint32)IDXFMT_16;
+	_activeVertexAttribsMask = 0;
 	_pendingMask = 0;
+	
+	_boundProgram = UnknownGLObj;
+	_boundArrayBuf = _boundIndexBuf = UnknownGLObj;
+	_activeTexUnit = UnknownGLObj;
+	for( uint32 i = 0; i < 16; ++i )
+	{
+		_boundTexTypes[i] = GL_TEXTURE_2D;
+		_boundTexObjs[i] = UnknownGLObj;
+		_vertAttribStates[i].glBuf = UnknownGLObj;
+	}
+	_issuedStateCalls = _elidedStateCalls = 0;
 }
 
 
 RenderDevice::~RenderDevice()
 {
+	if( _streamBuf != 0 ) glDeleteBuffers( 1, &_streamBuf );
 }
 
 
@@ -266,6 +284,15 @@ uint32 RenderDevice::registerVertexLayout( uint32 numAttribs, VertexLayoutAttrib
 }
 
 
+bool RenderDevice::isVertexLayoutSupported( uint32 shaderId, uint32 vlObj )
+{
+	// A layout is supported if it provides all attributes used by the shader
+	if( shaderId == 0 || vlObj == 0 ) return false;
+
+	return _shaders.getRef( shaderId ).inputLayouts[vlObj - 1].valid;
+}
+
+
 // =================================================================================================
 // Buffers
 // =================================================================================================
@@ -284,9 +311,9 @@ uint32 RenderDevice::createVertexBuffer( uint32 size, const void *data )
 	buf.type = GL_ARRAY_BUFFER;
 	buf.size = size;
 	glGenBuffers( 1, &buf.glObj );
-	glBindBuffer( buf.type, buf.glObj );
+	bindBuffer( buf.type, buf.glObj );
 	glBufferData( buf.type, size, data, GL_DYNAMIC_DRAW );
-	glBindBuffer( buf.type, 0 );
+	bindBuffer( buf.type, 0 );
 	
 	_bufferMem += size;
 	return _buffers.add( buf );
@@ -300,9 +327,9 @@ uint32 RenderDevice::createIndexBuffer( uint32 size, const void *data )
 	buf.type = GL_ELEMENT_ARRAY_BUFFER;
 	buf.size = size;
 	glGenBuffers( 1, &buf.glObj );
-	glBindBuffer( buf.type, buf.glObj );
+	bindBuffer( buf.type, buf.glObj );
 	glBufferData( buf.type, size, data, GL_DYNAMIC_DRAW );
-	glBindBuffer( buf.type, 0 );
+	bindBuffer( buf.type, 0 );
 	
 	_bufferMem += size;
 	return _buffers.add( buf );
@@ -316,6 +343,14 @@ void RenderDevice::destroyBuffer( uint32 bufObj )
 	RDIBuffer &buf = _buffers.getRef( bufObj );
 	glDeleteBuffers( 1, &buf.glObj );
 
+	// Deleting a buffer resets all bindings referring to it
+	if( _boundArrayBuf == buf.glObj ) _boundArrayBuf = 0;
+	if( _boundIndexBuf == buf.glObj ) _boundIndexBuf = 0;
+	for( uint32 i = 0; i < 16; ++i )
+	{
+		if( _vertAttribStates[i].glBuf == buf.glObj ) _vertAttribStates[i].glBuf = UnknownGLObj;
+	}
+
 	_bufferMem -= buf.size;
 	_buffers.remove( bufObj );
 }
@@ -326,7 +361,8 @@ void RenderDevice::updateBufferData( uint32 bufObj, uint32 offset, uint32 size,
 	const RDIBuffer &buf = _buffers.getRef( bufObj );
 	ASSERT( offset + size <= buf.size );
 	
-	glBindBuffer( buf.type, buf.glObj );
+	bindBuffer( buf.type, buf.glObj );
+	_uploadedBytes += size;
 	
 	if( offset == 0 &&  size == buf.size )
 	{
@@ -339,6 +375,83 @@ void RenderDevice::updateBufferData( uint32 bufObj, uint32 offset, uint32 size,
 }
 
 
+void RenderDevice::streamBufferData( uint32 bufObj, uint32 offset, uint32 size, const void *data )
+{
+	// Updates a range of a buffer that the GPU may still be reading from previous draw calls.
+	// The data is written to a streaming ring without synchronization and copied on the GPU, so
+	// the CPU never waits; when the ring is full, its storage is orphaned and writing starts over.
+	const RDIBuffer &buf = _buffers.getRef( bufObj );
+	ASSERT( offset + size <= buf.size );
+	if( size == 0 ) return;
+	
+	if( (offset == 0 && size == buf.size) || size > StreamBufferSize ||
+	    !glExt::ARB_map_buffer_range || !glExt::ARB_copy_buffer )
+	{
+		updateBufferData( bufObj, offset, size, (void *)data );
+		return;
+	}
+
+	if( _streamBuf == 0 )
+	{
+		glGenBuffers( 1, &_streamBuf );
+		glBindBuffer( GL_COPY_READ_BUFFER, _streamBuf );
+		glBufferData( GL_COPY_READ_BUFFER, StreamBufferSize, 0x0, GL_STREAM_DRAW );
+		_streamOffset = 0;
+	}
+	else
+	{
+		glBindBuffer( GL_COPY_READ_BUFFER, _streamBuf );
+	}
+
+	if( _streamOffset + size > StreamBufferSize )
+	{
+		glBufferData( GL_COPY_READ_BUFFER, StreamBufferSize, 0x0, GL_STREAM_DRAW );
+		_streamOffset = 0;
+	}
+
+	void *ptr = glMapBufferRange( GL_COPY_READ_BUFFER, _streamOffset, size,
+		GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT );
+	if( ptr == 0x0 )
+	{
+		glBindBuffer( GL_COPY_READ_BUFFER, 0 );
+		updateBufferData( bufObj, offset, size, (void *)data );
+		return;
+	}
+	memcpy( ptr, data, size );
+	glUnmapBuffer( GL_COPY_READ_BUFFER );
+
+	glBindBuffer( GL_COPY_WRITE_BUFFER, buf.glObj );
+	glCopyBufferSubData( GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, _streamOffset, offset, size );
+	glBindBuffer( GL_COPY_WRITE_BUFFER, 0 );
+	glBindBuffer( GL_COPY_READ_BUFFER, 0 );
+	
+	// Keep copies aligned for fast transfers
+	_streamOffset += (size + 15) & ~15u;
+	_uploadedBytes += size;
+}
+
+
+bool RenderDevice::getBufferData( uint32 bufObj, uint32 offset, uint32 size, void *dataBuffer )
+{
+	const RDIBuffer &buf = _buffers.getRef( bufObj );
+	if( offset + size > buf.size || glGetBufferSubData == 0x0 ) return false;
+
+	bindBuffer( buf.type, buf.glObj );
+	glGetBufferSubData( buf.type, offset, size, dataBuffer );
+
+	return true;
+}
+
+
+uint32 RenderDevice::getUploadedBytes( bool reset )
+{
+	uint32 value = _uploadedBytes;
+	if( reset ) _uploadedBytes = 0;
+
+	return value;
+}
+
+
 // =================================================================================================
 // Textures
 // =================================================================================================
@@ -417,8 +530,8 @@ uint32 RenderDevice::createTexture( TextureTypes::List type, int width, int heig
 	};
 	
 	glGenTextures( 1, &tex.glObj );
-	glActiveTexture( GL_TEXTURE15 );
-	glBindTexture( tex.type, tex.glObj );
+	setActiveTexUnit( 15 );
+	bindTexture( 15, tex.type, tex.glObj );
 	
 	float borderColor[] = { 1.0f, 1.0f, 1.0f, 1.0f };
 	glTexParameterfv( GL_TEXTURE_2D, GL_TEXTURE_BORDER_COLOR, borderColor );
@@ -426,9 +539,8 @@ uint32 RenderDevice::createTexture( TextureTypes::List type, int width, int heig
 	tex.samplerState = 0;
 	applySamplerState( tex );
 	
-	glBindTexture( tex.type, 0 );
-	if( _texSlots[15].texObj )
-		glBindTexture( _textures.getRef( _texSlots[15].texObj ).type, _textures.getRef( _texSlots[15].texObj ).glObj );
+	bindTexture( 15, tex.type, 0 );
+	_pendingMask |= PM_TEXTURES;  // Restore texture of slot 15
 
 	// Calculate memory requirements
 	tex.memSize = calcTextureSize( format, width, height, depth );
@@ -445,8 +557,8 @@ void RenderDevice::uploadTextureData( uint32 texObj, int slice, int mipLevel, co
 	const RDITexture &tex = _textures.getRef( texObj );
 	TextureFormats::List format = tex.format;
 
-	glActiveTexture( GL_TEXTURE15 );
-	glBindTexture( tex.type, tex.glObj );
+	setActiveTexUnit( 15 );
+	bindTexture( 15, tex.type, tex.glObj );
 	
 	int inputFormat = GL_BGRA, inputType = GL_UNSIGNED_BYTE;
 	bool compressed = (format == TextureFormats::DXT1) || (format == TextureFormats::DXT3) ||
@@ -501,9 +613,8 @@ void RenderDevice::uploadTextureData( uint32 texObj, int slice, int mipLevel, co
 		glDisable( tex.type );
 	}
 
-	glBindTexture( tex.type, 0 );
-	if( _texSlots[15].texObj )
-		glBindTexture( _textures.getRef( _texSlots[15].texObj ).type, _textures.getRef( _texSlots[15].texObj ).glObj );
+	bindTexture( 15, tex.type, 0 );
+	_pendingMask |= PM_TEXTURES;  // Restore texture of slot 15
 }
 
 
@@ -514,6 +625,12 @@ void RenderDevice::destroyTexture( uint32 texObj )
 	const RDITexture &tex = _textures.getRef( texObj );
 	glDeleteTextures( 1, &tex.glObj );
 
+	// Deleting a texture resets all bindings referring to it
+	for( uint32 i = 0; i < 16; ++i )
+	{
+		if( _boundTexObjs[i] == tex.glObj ) _boundTexObjs[i] = 0;
+	}
+
 	_textureMem -= tex.memSize;
 	_textures.remove( texObj );
 }
@@ -533,8 +650,8 @@ bool RenderDevice::getTextureData( uint32 texObj, int slice, int mipLevel, void
 	if( target == GL_TEXTURE_CUBE_MAP ) target = GL_TEXTURE_CUBE_MAP_POSITIVE_X + slice;
 	
 	int fmt, type, compressed = 0;
-	glActiveTexture( GL_TEXTURE15 );
-	glBindTexture( tex.type, tex.glObj );
+	setActiveTexUnit( 15 );
+	bindTexture( 15, tex.type, tex.glObj );
 
 	switch( tex.format )
 	{
@@ -561,9 +678,8 @@ bool RenderDevice::getTextureData( uint32 texObj, int slice, int mipLevel, void
 	else
 		glGetTexImage( target, mipLevel, fmt, type, buffer );
 
-	glBindTexture( tex.type, 0 );
-	if( _texSlots[15].texObj )
-		glBindTexture( _textures.getRef( _texSlots[15].texObj ).type, _textures.getRef( _texSlots[15].texObj ).glObj );
+	bindTexture( 15, tex.type, 0 );
+	_pendingMask |= PM_TEXTURES;  // Restore texture of slot 15
 
 	return true;
 }
@@ -719,24 +835,39 @@ void RenderDevice::destroyShader( uint32 shaderId )
 
 	RDIShader &shader = _shaders.getRef( shaderId );
 	glDeleteProgram( shader.oglProgramObj );
+	if( _boundProgram == shader.oglProgramObj ) _boundProgram = UnknownGLObj;
 	_shaders.remove( shaderId );
+
+	// The id can be reused by the next createShader, so it must not match the cached state
+	if( _curShaderId == shaderId )
+	{
+		_curShaderId = 0;
+		_pendingMask |= PM_VERTLAYOUT;
+	}
+	if( _prevShaderId == shaderId ) _prevShaderId = 0;
 }
 
 
 void RenderDevice::bindShader( uint32 shaderId )
 {
-	if( shaderId != 0 )
+	uint32 programObj = shaderId != 0 ? _shaders.getRef( shaderId ).oglProgramObj : 0;
+	
+	if( programObj != _boundProgram )
 	{
-		RDIShader &shader = _shaders.getRef( shaderId );
-		glUseProgram( shader.oglProgramObj );
+		glUseProgram( programObj );
+		_boundProgram = programObj;
+		++_issuedStateCalls;
 	}
 	else
 	{
-		glUseProgram( 0 );
+		++_elidedStateCalls;
 	}
 	
-	_curShaderId = shaderId;
-	_pendingMask |= PM_VERTLAYOUT;
+	if( shaderId != _curShaderId )
+	{
+		_curShaderId = shaderId;
+		_pendingMask |= PM_VERTLAYOUT;
+	}
 } 
 
 
@@ -754,27 +885,62 @@ int RenderDevice::getShaderSamplerLoc( uint32 shaderId, const char *name )
 }
 
 
-void RenderDevice::setShaderConst( int loc, RDIShaderConstType type, void *values, uint32 count )
+bool RenderDevice::isUniformCached( int loc, const void *values, uint32 size )
+{
+	// Uniform values are part of the program object, so the cache is kept per shader;
+	// it returns true if the values are already set and stores them otherwise
+	if( _curShaderId == 0 || loc < 0 || (uint32)loc >= MaxCachedUniformLocs ||
+	    size > MaxCachedUniformSize ) return false;
+	
+	RDIShader &shader = _shaders.getRef( _curShaderId );
+	if( (uint32)loc >= shader.uniformCacheEntries.size() )
+		shader.uniformCacheEntries.resize( loc + 1 );
+	
+	// Each location gets a slot of the maximum size on first use, so that arrays whose
+	// count changes between calls reuse it
+	RDIUniformCacheEntry &entry = shader.uniformCacheEntries[loc];
+	if( entry.offset < 0 )
+	{
+		entry.offset = (int)shader.uniformCache.size();
+		shader.uniformCache.resize( entry.offset + MaxCachedUniformSize );
+	}
+	else if( entry.size == size && memcmp( &shader.uniformCache[entry.offset], values, size ) == 0 )
+	{
+		++_elidedStateCalls;
+		return true;
+	}
+
+	entry.size = size;
+	memcpy( &shader.uniformCache[entry.offset], values, size );
+	return false;
+}
+
+
+void RenderDevice::setShaderConst( int loc, RDIShaderConstType type, const void *values, uint32 count )
 {
+	const uint32 typeSizes[] = { 1, 2, 3, 4, 16, 9 };
+	if( isUniformCached( loc, values, typeSizes[type] * count * sizeof( float ) ) ) return;
+	++_issuedStateCalls;
+	
 	switch( type )
 	{
 	case CONST_FLOAT:
-		glUniform1fv( loc, count, (float *)values );
+		glUniform1fv( loc, count, (const float *)values );
 		break;
 	case CONST_FLOAT2:
-		glUniform2fv( loc, count, (float *)values );
+		glUniform2fv( loc, count, (const float *)values );
 		break;
 	case CONST_FLOAT3:
-		glUniform3fv( loc, count, (float *)values );
+		glUniform3fv( loc, count, (const float *)values );
 		break;
 	case CONST_FLOAT4:
-		glUniform4fv( loc, count, (float *)values );
+		glUniform4fv( loc, count, (const float *)values );
 		break;
 	case CONST_FLOAT44:
-		glUniformMatrix4fv( loc, count, false, (float *)values );
+		glUniformMatrix4fv( loc, count, false, (const float *)values );
 		break;
 	case CONST_FLOAT33:
-		glUniformMatrix3fv( loc, count, false, (float *)values );
+		glUniformMatrix3fv( loc, count, false, (const float *)values );
 		break;
 	}
 }
@@ -782,7 +948,11 @@ void RenderDevice::setShaderConst( int loc, RDIShaderConstType type, void *value
 
 void RenderDevice::setShaderSampler( int loc, uint32 texUnit )
 {
-	glUniform1i( loc, (int)texUnit );
+	int unit = (int)texUnit;
+	if( isUniformCached( loc, &unit, sizeof( int ) ) ) return;
+	++_issuedStateCalls;
+	
+	glUniform1i( loc, unit );
 }
 
 
@@ -1156,6 +1326,51 @@ uint32 RenderDevice::getQueryResult( uint32 queryObj )
 }
 
 
+bool RenderDevice::isQueryResultAvailable( uint32 queryObj )
+{
+	uint32 available = 0;
+	glGetQueryObjectuiv( queryObj, GL_QUERY_RESULT_AVAILABLE, &available );
+	return available != 0;
+}
+
+
+// =================================================================================================
+// Fences
+// =================================================================================================
+
+uint32 RenderDevice::createFence()
+{
+	// Returns 0 if sync objects are not supported by the driver
+	if( !glExt::ARB_sync ) return 0;
+	
+	RDIFence fence;
+	fence.sync = glFenceSync( GL_SYNC_GPU_COMMANDS_COMPLETE, 0 );
+	if( fence.sync == 0x0 ) return 0;
+
+	return _fences.add( fence );
+}
+
+
+void RenderDevice::destroyFence( uint32 fenceObj )
+{
+	if( fenceObj == 0 ) return;
+	
+	RDIFence &fence = _fences.getRef( fenceObj );
+	glDeleteSync( (GLsync)fence.sync );
+	_fences.remove( fenceObj );
+}
+
+
+bool RenderDevice::isFenceSignaled( uint32 fenceObj )
+{
+	// Does not wait, but flushes the command stream so that the fence is eventually reached
+	RDIFence &fence = _fences.getRef( fenceObj );
+	GLenum result = glClientWaitSync( (GLsync)fence.sync, GL_SYNC_FLUSH_COMMANDS_BIT, 0 );
+	
+	return result == GL_ALREADY_SIGNALED || result == GL_CONDITION_SATISFIED;
+}
+
+
 // =================================================================================================
 // Internal state management
 // =================================================================================================
@@ -1171,6 +1386,61 @@ void RenderDevice::checkGLError()
 }
 
 
+void RenderDevice::bindBuffer( uint32 target, uint32 glObj )
+{
+	uint32 &boundObj = target == GL_ELEMENT_ARRAY_BUFFER ? _boundIndexBuf : _boundArrayBuf;
+	
+	if( glObj != boundObj )
+	{
+		glBindBuffer( target, glObj );
+		boundObj = glObj;
+		++_issuedStateCalls;
+	}
+	else
+	{
+		++_elidedStateCalls;
+	}
+	
+	// Make sure that the index buffer set for drawing gets restored
+	if( target == GL_ELEMENT_ARRAY_BUFFER ) _pendingMask |= PM_INDEXBUF;
+}
+
+
+void RenderDevice::setActiveTexUnit( uint32 unit )
+{
+	if( unit != _activeTexUnit )
+	{
+		glActiveTexture( GL_TEXTURE0 + unit );
+		_activeTexUnit = unit;
+		++_issuedStateCalls;
+	}
+}
+
+
+void RenderDevice::bindTexture( uint32 unit, uint32 target, uint32 glObj )
+{
+	if( target == _boundTexTypes[unit] && glObj == _boundTexObjs[unit] )
+	{
+		++_elidedStateCalls;
+		return;
+	}
+	
+	setActiveTexUnit( unit );
+	
+	// Keep at most one texture bound per unit
+	if( target != _boundTexTypes[unit] && _boundTexObjs[unit] != 0 && _boundTexObjs[unit] != UnknownGLObj )
+	{
+		glBindTexture( _boundTexTypes[unit], 0 );
+		++_issuedStateCalls;
+	}
+	
+	glBindTexture( target, glObj );
+	_boundTexTypes[unit] = target;
+	_boundTexObjs[unit] = glObj;
+	++_issuedStateCalls;
+}
+
+
 bool RenderDevice::applyVertexLayout()
 {
 	uint32 newVertexAttribMask = 0;
@@ -1198,9 +1468,28 @@ bool RenderDevice::applyVertexLayout()
 				ASSERT( _buffers.getRef( _vertBufSlots[attrib.vbSlot].vbObj ).glObj != 0 &&
 						_buffers.getRef( _vertBufSlots[attrib.vbSlot].vbObj ).type == GL_ARRAY_BUFFER );
 				
-				glBindBuffer( GL_ARRAY_BUFFER, _buffers.getRef( _vertBufSlots[attrib.vbSlot].vbObj ).glObj );
-				glVertexAttribPointer( attribIndex, attrib.size, GL_FLOAT, GL_FALSE,
-									   vbSlot.stride, (char *)0 + vbSlot.offset + attrib.offset );
+				// Only update attribute pointers that have changed
+				uint32 glBuf = _buffers.getRef( _vertBufSlots[attrib.vbSlot].vbObj ).glObj;
+				uint32 offset = vbSlot.offset + attrib.offset;
+				RDIVertAttribState &state = _vertAttribStates[attribIndex];
+				
+				if( state.glBuf != glBuf || state.size != attrib.size ||
+				    state.stride != vbSlot.stride || state.offset != offset )
+				{
+					bindBuffer( GL_ARRAY_BUFFER, glBuf );
+					glVertexAttribPointer( attribIndex, attrib.size, GL_FLOAT, GL_FALSE,
+										   vbSlot.stride, (char *)0 + offset );
+					++_issuedStateCalls;
+
+					state.glBuf = glBuf;
+					state.size = attrib.size;
+					state.stride = vbSlot.stride;
+					state.offset = offset;
+				}
+				else
+				{
+					++_elidedStateCalls;
+				}
 
 				newVertexAttribMask |= 1 << attribIndex;
 			}
@@ -1360,16 +1649,8 @@ bool RenderDevice::commitStates( uint32 filter )
 		// Bind index buffer
 		if( mask & PM_INDEXBUF )
 		{
-			if( _newIndexBuf != _curIndexBuf )
-			{
-				if( _newIndexBuf != 0 )
-					glBindBuffer( GL_ELEMENT_ARRAY_BUFFER, _buffers.getRef( _newIndexBuf ).glObj );
-				else
-					glBindBuffer( GL_ELEMENT_ARRAY_BUFFER, 0 );
-				
-				_curIndexBuf = _newIndexBuf;
-				_pendingMask &= ~PM_INDEXBUF;
-			}
+			bindBuffer( GL_ELEMENT_ARRAY_BUFFER, _newIndexBuf != 0 ? _buffers.getRef( _newIndexBuf ).glObj : 0 );
+			_pendingMask &= ~PM_INDEXBUF;
 		}
 
 		// Bind textures and set sampler state
@@ -1377,25 +1658,22 @@ bool RenderDevice::commitStates( uint32 filter )
 		{
 			for( uint32 i = 0; i < 16; ++i )
 			{
-				glActiveTexture( GL_TEXTURE0 + i );
-
 				if( _texSlots[i].texObj != 0 )
 				{
 					RDITexture &tex = _textures.getRef( _texSlots[i].texObj );
-					glBindTexture( tex.type, tex.glObj );
+					bindTexture( i, tex.type, tex.glObj );
 
 					// Apply sampler state
 					if( tex.samplerState != _texSlots[i].samplerState )
 					{
+						setActiveTexUnit( i );
 						tex.samplerState = _texSlots[i].samplerState;
 						applySamplerState( tex );
 					}
 				}
 				else
 				{
-					glBindTexture( GL_TEXTURE_CUBE_MAP, 0 );
-					glBindTexture( GL_TEXTURE_3D, 0 );
-					glBindTexture( GL_TEXTURE_2D, 0 );
+					bindTexture( i, _boundTexTypes[i], 0 );
 				}
 			}
 			
@@ -1424,7 +1702,23 @@ bool RenderDevice::commitStates( uint32 filter )
 
 void RenderDevice::resetStates()
 {
-	_curIndexBuf = 1; _newIndexBuf = 0;
+	// GL state might have been changed by the application, so the shadowed state is
+	// brought into a known state again
+	for( uint32 i = 0; i < 16; ++i )
+	{
+		glActiveTexture( GL_TEXTURE0 + i );
+		glBindTexture( GL_TEXTURE_CUBE_MAP, 0 );
+		glBindTexture( GL_TEXTURE_3D, 0 );
+		glBindTexture( GL_TEXTURE_2D, 0 );
+		_boundTexTypes[i] = GL_TEXTURE_2D;
+		_boundTexObjs[i] = 0;
+		_vertAttribStates[i].glBuf = UnknownGLObj;
+	}
+	_activeTexUnit = 15;
+	_boundProgram = UnknownGLObj;
+	_boundIndexBuf = UnknownGLObj;
+	
+	_newIndexBuf = 0;
 	_curVertLayout = 1; _newVertLayout = 0;
 	_curRasterState.hash = 0xFFFFFFFF; _newRasterState.hash = 0;
 	_curBlendState.hash = 0xFFFFFFFF; _newBlendState.hash = 0;
@@ -1438,10 +1732,21 @@ void RenderDevice::resetStates()
 	commitStates();
 
 	glBindBuffer( GL_ARRAY_BUFFER, 0 );
+	_boundArrayBuf = 0;
 	glBindFramebufferEXT( GL_FRAMEBUFFER_EXT, _defaultFBO );
 }
 
 
+uint32 RenderDevice::getStateCallCount( bool elided, bool reset )
+{
+	uint32 &counter = elided ? _elidedStateCalls : _issuedStateCalls;
+	uint32 value = counter;
+	if( reset ) counter = 0;
+
+	return value;
+}
+
+
 // =================================================================================================
 // Draw calls and clears
 // =================================================================================================
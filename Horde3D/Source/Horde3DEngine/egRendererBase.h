@@ -23,6 +23,9 @@
 namespace Horde3D {
 
 const uint32 MaxNumVertexLayouts = 16;
+const uint32 MaxCachedUniformSize = 64;  // Uniforms larger than this (in bytes) are always uploaded
+const uint32 MaxCachedUniformLocs = 1024;
+const uint32 StreamBufferSize = 4 * 1024 * 1024;  // Ring buffer for streamed buffer updates
 
 
 // =================================================================================================
@@ -137,7 +140,7 @@ struct RDIBuffer
 {
 	uint32  type;
 	uint32  glObj;
-	uint32  size;
+	uint32  size;  // Size of the cached values in bytes
 };
 
 struct RDIVertBufSlot
@@ -149,6 +152,17 @@ struct RDIVertBufSlot
 	RDIVertBufSlot() : vbObj( 0 ), offset( 0 ), stride( 0 ) {}
 	RDIVertBufSlot( uint32 vbObj, uint32 offset, uint32 stride ) :
 		vbObj( vbObj ), offset( offset ), stride( stride ) {}
+
+	bool operator==( const RDIVertBufSlot &v ) const
+		{ return vbObj == v.vbObj && offset == v.offset && stride == v.stride; }
+};
+
+struct RDIVertAttribState
+{
+	uint32  glBuf;  // GL buffer the attribute pointer refers to
+	uint32  size;  // Size of the cached values in bytes
+	uint32  stride;
+	uint32  offset;
 };
 
 
@@ -225,10 +239,20 @@ struct RDIInputLayout
 	int8  attribIndices[16];
 };
 
+struct RDIUniformCacheEntry
+{
+	int     offset;  // Offset of the slot in uniform cache of shader, -1 if nothing cached yet
+	uint32  size;  // Size of the cached values in bytes
+
+	RDIUniformCacheEntry() : offset( -1 ), size( 0 ) {}
+};
+
 struct RDIShader
 {
-	uint32          oglProgramObj;
-	RDIInputLayout  inputLayouts[MaxNumVertexLayouts];
+	uint32                               oglProgramObj;
+	RDIInputLayout                       inputLayouts[MaxNumVertexLayouts];
+	std::vector< RDIUniformCacheEntry >  uniformCacheEntries;  // Indexed by uniform location
+	std::vector< unsigned char >         uniformCache;  // Last values uploaded to small uniforms
 };
 
 
@@ -254,6 +278,18 @@ struct RDIRenderBuffer
 };
 
 
+// ---------------------------------------------------------
+// Fences
+// ---------------------------------------------------------
+
+struct RDIFence
+{
+	void  *sync;  // GL sync object
+
+	RDIFence() : sync( 0x0 ) {}
+};
+
+
 // ---------------------------------------------------------
 // Render states
 // ---------------------------------------------------------
@@ -421,6 +457,7 @@ public:
 
 	// Vertex layouts
 	uint32 registerVertexLayout( uint32 numAttribs, VertexLayoutAttrib *attribs );
+	bool isVertexLayoutSupported( uint32 shaderId, uint32 vlObj );
 	
 	// Buffers
 	void beginRendering();
@@ -428,7 +465,10 @@ public:
 	uint32 createIndexBuffer( uint32 size, const void *data );
 	void destroyBuffer( uint32 bufObj );
 	void updateBufferData( uint32 bufObj, uint32 offset, uint32 size, void *data );
+	void streamBufferData( uint32 bufObj, uint32 offset, uint32 size, const void *data );
+	bool getBufferData( uint32 bufObj, uint32 offset, uint32 size, void *dataBuffer );
 	uint32 getBufferMem() { return _bufferMem; }
+	uint32 getUploadedBytes( bool reset );
 
 	// Textures
 	uint32 calcTextureSize( TextureFormats::List format, int width, int height, int depth );
@@ -447,7 +487,7 @@ public:
 	std::string &getShaderLog() { return _shaderLog; }
 	int getShaderConstLoc( uint32 shaderId, const char *name );
 	int getShaderSamplerLoc( uint32 shaderId, const char *name );
-	void setShaderConst( int loc, RDIShaderConstType type, void *values, uint32 count = 1 );
+	void setShaderConst( int loc, RDIShaderConstType type, const void *values, uint32 count = 1 );
 	void setShaderSampler( int loc, uint32 texUnit );
 	const char *getDefaultVSCode();
 	const char *getDefaultFSCode();
@@ -467,6 +507,12 @@ public:
 	void beginQuery( uint32 queryObj );
 	void endQuery( uint32 queryObj );
 	uint32 getQueryResult( uint32 queryObj );
+	bool isQueryResultAvailable( uint32 queryObj );
+
+	// Fences
+	uint32 createFence();
+	void destroyFence( uint32 fenceObj );
+	bool isFenceSignaled( uint32 fenceObj );
 
 // -----------------------------------------------------------------------------
 // Commands
@@ -479,10 +525,10 @@ public:
 	void setIndexBuffer( uint32 bufObj, RDIIndexFormat idxFmt )
 		{ _indexFormat = (uint32)idxFmt; _newIndexBuf = bufObj; _pendingMask |= PM_INDEXBUF; }
 	void setVertexBuffer( uint32 slot, uint32 vbObj, uint32 offset, uint32 stride )
-		{ ASSERT( slot < 16 ); _vertBufSlots[slot] = RDIVertBufSlot( vbObj, offset, stride );
-	      _pendingMask |= PM_VERTLAYOUT; }
+		{ ASSERT( slot < 16 ); RDIVertBufSlot vbSlot( vbObj, offset, stride );
+	      if( !(_vertBufSlots[slot] == vbSlot) ) { _vertBufSlots[slot] = vbSlot; _pendingMask |= PM_VERTLAYOUT; } }
 	void setVertexLayout( uint32 vlObj )
-		{ _newVertLayout = vlObj; }
+		{ if( vlObj != _newVertLayout ) { _newVertLayout = vlObj; _pendingMask |= PM_VERTLAYOUT; } }
 	void setTexture( uint32 slot, uint32 texObj, uint16 samplerState )
 		{ ASSERT( slot < 16 ); _texSlots[slot] = RDITexSlot( texObj, samplerState );
 	      _pendingMask |= PM_TEXTURES; }
@@ -548,6 +594,7 @@ public:
 	const RDIBuffer &getBuffer( uint32 bufObj ) { return _buffers.getRef( bufObj ); }
 	const RDITexture &getTexture( uint32 texObj ) { return _textures.getRef( texObj ); }
 	const RDIRenderBuffer &getRenderBuffer( uint32 rbObj ) { return _rendBufs.getRef( rbObj ); }
+	uint32 getStateCallCount( bool elided, bool reset );
 
 	friend class Renderer;
 
@@ -570,6 +617,10 @@ protected:
 	void resolveRenderBuffer( uint32 rbObj );
 
 	void checkGLError();
+	void bindBuffer( uint32 target, uint32 glObj );
+	void bindTexture( uint32 unit, uint32 target, uint32 glObj );
+	void setActiveTexUnit( uint32 unit );
+	bool isUniformCached( int loc, const void *values, uint32 size );
 	bool applyVertexLayout();
 	void applySamplerState( RDITexture &tex );
 	void applyRenderStates();
@@ -586,6 +637,8 @@ protected:
 	uint32        _curRendBuf;
 	int           _outputBufferIndex;  // Left and right eye for stereo rendering
 	uint32        _textureMem, _bufferMem;
+	uint32        _uploadedBytes;
+	uint32        _streamBuf, _streamOffset;  // GL buffer and write position of streaming ring
 
 	int                            _defaultFBO;
 	uint32                         _numVertexLayouts;
@@ -594,6 +647,7 @@ protected:
 	RDIObjects< RDITexture >       _textures;
 	RDIObjects< RDIShader >        _shaders;
 	RDIObjects< RDIRenderBuffer >  _rendBufs;
+	RDIObjects< RDIFence >         _fences;
 
 	RDIVertBufSlot        _vertBufSlots[16];
 	RDITexSlot            _texSlots[16];
@@ -602,10 +656,18 @@ protected:
 	RDIDepthStencilState  _curDepthStencilState, _newDepthStencilState;
 	uint32                _prevShaderId, _curShaderId;
 	uint32                _curVertLayout, _newVertLayout;
-	uint32                _curIndexBuf, _newIndexBuf;
+	uint32                _newIndexBuf;
 	uint32                _indexFormat;
 	uint32                _activeVertexAttribsMask;
 	uint32                _pendingMask;
+
+	// Shadowed GL state, used to skip redundant calls
+	uint32                _boundProgram;
+	uint32                _boundArrayBuf, _boundIndexBuf;
+	uint32                _boundTexTypes[16], _boundTexObjs[16];
+	uint32                _activeTexUnit;
+	RDIVertAttribState    _vertAttribStates[16];
+	uint32                _issuedStateCalls, _elidedStateCalls;
 };
 
 }
@@ -13,8 +13,11 @@
 #include "egResource.h"
 #include "egModules.h"
 #include "egCom.h"
+#include "egRenderer.h"
+#include "utThreads.h"
 #include <sstream>
 #include <cstring>
+#include <algorithm>
 
 #include "utDebug.h"
 
@@ -35,6 +38,8 @@ Resource::Resource( int type, const string &name, int flags )
 	_loaded = false;
 	_refCount = 0;
 	_userRefCount = 0;
+	_lastUsedFrame = 0;
+	_reloadable = false;
 	_flags = flags;
 	
 	if( (flags & ResourceFlags::NoQuery) == ResourceFlags::NoQuery ) _noQuery = true;
@@ -80,6 +85,8 @@ bool Resource::load( const char *data, int size )
 	}
 
 	_loaded = true;
+	_reloadable = true;
+	_lastUsedFrame = Modules::renderer().getFrameID();
 	
 	return true;
 }
@@ -155,6 +162,12 @@ void Resource::unmapStream()
 	Modules::setError( "Invalid operation by h3dUnmapResStream" );
 }
 
+void Resource::getMemUsage( uint32 &cpuMem, uint32 &gpuMem )
+{
+	cpuMem = 0;
+	gpuMem = 0;
+}
+
 
 // **********************************************************************************
 // Class ResourceManager
@@ -317,6 +330,7 @@ ResHandle ResourceManager::cloneResource( Resource &sourceRes, const string &nam
 	newRes->_name = name != "" ? name : "|tmp|";
 	newRes->_userRefCount = 1;
 	newRes->_refCount = 0;
+	newRes->_reloadable = false;  // Clone data does not exist outside of memory
 	int handle = addResource( *newRes );
 	
 	if( name == "" )
@@ -375,6 +389,53 @@ ResHandle ResourceManager::queryUnloadedResource( int index )
 }
 
 
+struct ResDecodeJob
+{
+	Resource    *res;
+	const char  *data;
+	int         size;
+	void        *decoded;
+};
+
+
+static void decodeResourceJob( void *userData, uint32 jobIndex )
+{
+	ResDecodeJob &job = ((ResDecodeJob *)userData)[jobIndex];
+	if( job.res != 0x0 ) job.decoded = job.res->decode( job.data, job.size );
+}
+
+
+bool ResourceManager::loadResources( int count, Resource **resources, const char **data, const int *sizes )
+{
+	if( count <= 0 ) return true;
+	
+	// Decode data of all resources in parallel first
+	vector< ResDecodeJob > jobs( count );
+	for( int i = 0; i < count; ++i )
+	{
+		bool decode = resources[i] != 0x0 && !resources[i]->_loaded && data[i] != 0x0 && sizes[i] > 0;
+		
+		jobs[i].res = decode ? resources[i] : 0x0;
+		jobs[i].data = data[i];
+		jobs[i].size = sizes[i];
+		jobs[i].decoded = 0x0;
+	}
+	Modules::jobMan().run( decodeResourceJob, &jobs[0], (uint32)count );
+	
+	// Finish loading in the given order since resources can depend on each other
+	bool result = true;
+	for( int i = 0; i < count; ++i )
+	{
+		if( resources[i] == 0x0 ) { result = false; continue; }
+		
+		Modules::log().writeInfo( "Loading resource '%s'", resources[i]->_name.c_str() );
+		result &= resources[i]->loadDecoded( data[i], sizes[i], jobs[i].decoded );
+	}
+
+	return result;
+}
+
+
 void ResourceManager::releaseUnusedResources()
 {
 	vector< uint32 > killList;
@@ -400,4 +461,115 @@ void ResourceManager::releaseUnusedResources()
 	if( !killList.empty() ) releaseUnusedResources();
 }
 
+
+void ResourceManager::getMemUsage( int type, uint64 &cpuMem, uint64 &gpuMem )
+{
+	cpuMem = 0;
+	gpuMem = 0;
+	
+	for( size_t i = 0, s = _resources.size(); i < s; ++i )
+	{
+		Resource *res = _resources[i];
+		if( res == 0x0 || (type != ResourceTypes::Undefined && res->_type != type) ) continue;
+
+		uint32 resCPUMem, resGPUMem;
+		res->getMemUsage( resCPUMem, resGPUMem );
+		cpuMem += resCPUMem;
+		gpuMem += resGPUMem;
+	}
+}
+
+
+static uint64 getTotalMem( Resource *res )
+{
+	uint32 cpuMem, gpuMem;
+	res->getMemUsage( cpuMem, gpuMem );
+	return (uint64)cpuMem + gpuMem;
+}
+
+
+static bool MemConsumerCompFunc( Resource *a, Resource *b )
+{
+	uint64 memA = getTotalMem( a ), memB = getTotalMem( b );
+	if( memA != memB ) return memA > memB;
+	return a->getHandle() < b->getHandle();
+}
+
+
+Resource *ResourceManager::queryMemConsumer( int type, int index )
+{
+	// Sort consumers on first query and keep list for the following indices
+	if( index == 0 )
+	{
+		_memConsumers.resize( 0 );
+
+		for( size_t i = 0, s = _resources.size(); i < s; ++i )
+		{
+			Resource *res = _resources[i];
+			if( res == 0x0 || (type != ResourceTypes::Undefined && res->_type != type) ) continue;
+			if( getTotalMem( res ) > 0 ) _memConsumers.push_back( res );
+		}
+
+		std::sort( _memConsumers.begin(), _memConsumers.end(), MemConsumerCompFunc );
+	}
+
+	if( index < 0 || (unsigned)index >= _memConsumers.size() ) return 0x0;
+
+	// Resources could have been removed since the list was created
+	Resource *res = _memConsumers[index];
+	for( size_t i = 0, s = _resources.size(); i < s; ++i )
+	{
+		if( _resources[i] == res ) return res;
+	}
+	
+	return 0x0;
+}
+
+
+static bool EvictionCompFunc( Resource *a, Resource *b )
+{
+	// Least recently used first, larger resources first among equally old ones
+	if( a->getLastUsedFrame() != b->getLastUsedFrame() ) return a->getLastUsedFrame() < b->getLastUsedFrame();
+	uint64 memA = getTotalMem( a ), memB = getTotalMem( b );
+	if( memA != memB ) return memA > memB;
+	return a->getHandle() < b->getHandle();
+}
+
+
+void ResourceManager::evictResources( uint64 budget, uint32 curFrame )
+{
+	uint64 cpuMem, gpuMem;
+	getMemUsage( ResourceTypes::Undefined, cpuMem, gpuMem );
+	uint64 totalMem = cpuMem + gpuMem;
+	if( totalMem <= budget ) return;
+
+	// Collect resources that were not used in the current frame and can be loaded again;
+	// referenced resources are only evicted if they are textures that allow it explicitly
+	_evictionList.resize( 0 );
+	for( size_t i = 0, s = _resources.size(); i < s; ++i )
+	{
+		Resource *res = _resources[i];
+		if( res == 0x0 || !res->_loaded || !res->_reloadable || res->_noQuery ) continue;
+		if( res->_lastUsedFrame >= curFrame ) continue;
+		if( res->_refCount > 0 && !(res->_type == ResourceTypes::Texture &&
+		    (res->_flags & ResourceFlags::TexEvictable)) ) continue;
+
+		_evictionList.push_back( res );
+	}
+
+	std::sort( _evictionList.begin(), _evictionList.end(), EvictionCompFunc );
+
+	for( size_t i = 0, s = _evictionList.size(); i < s && totalMem > budget; ++i )
+	{
+		Resource *res = _evictionList[i];
+		uint64 resMem = getTotalMem( res );
+		if( resMem == 0 ) continue;
+		
+		Modules::log().writeInfo( "Evicted resource '%s'", res->_name.c_str() );
+		res->unload();
+		
+		totalMem -= std::min( resMem, totalMem );
+	}
+}
+
 }  // namespace
@@ -53,7 +53,9 @@ struct ResourceFlags
 		TexCubemap = 8,
 		TexDynamic = 16,
 		TexRenderable = 32,
-		TexSRGB = 64
+		TexSRGB = 64,
+		TexEvictable = 128,
+		GeoReleaseCPUData = 256
 	};
 };
 
@@ -69,6 +71,10 @@ public:
 	virtual void initDefault();
 	virtual void release();
 	virtual bool load( const char *data, int size );
+	// Optional first part of loading that is run on worker threads when several resources are loaded at
+	// once; it may not access any engine state and its result is passed to loadDecoded
+	virtual void *decode( const char * /*data*/, int /*size*/ ) { return 0x0; }
+	virtual bool loadDecoded( const char *data, int size, void * /*decoded*/ ) { return load( data, size ); }
 	void unload();
 	
 	int findElem( int elem, int param, const char *value );
@@ -81,6 +87,7 @@ public:
 	virtual void setElemParamStr( int elem, int elemIdx, int param, const char *value );
 	virtual void *mapStream( int elem, int elemIdx, int stream, bool read, bool write );
 	virtual void unmapStream();
+	virtual void getMemUsage( uint32 &cpuMem, uint32 &gpuMem );
 
 	int &getType() { return _type; }
 	int getFlags() { return _flags; }
@@ -89,6 +96,8 @@ public:
 	bool isLoaded() { return _loaded; }
 	void addRef() { ++_refCount; }
 	void subRef() { --_refCount; }
+	void markUsed( uint32 frameID ) { _lastUsedFrame = frameID; }
+	uint32 getLastUsedFrame() { return _lastUsedFrame; }
 
 protected:
 	int                  _type;
@@ -98,9 +107,11 @@ protected:
 	
 	uint32               _refCount;  // Number of other objects referencing this resource
 	uint32               _userRefCount;  // Number of handles created by user
+	uint32               _lastUsedFrame;
 
 	bool                 _loaded;
 	bool                 _noQuery;
+	bool                 _reloadable;  // Loaded from data, so it can be reloaded after eviction
 
 	friend class ResourceManager;
 };
@@ -174,7 +185,11 @@ public:
 	int removeResource( Resource &resource, bool userCall );
 	void clear();
 	ResHandle queryUnloadedResource( int index );
+	bool loadResources( int count, Resource **resources, const char **data, const int *sizes );
 	void releaseUnusedResources();
+	void getMemUsage( int type, uint64 &cpuMem, uint64 &gpuMem );
+	Resource *queryMemConsumer( int type, int index );
+	void evictResources( uint64 budget, uint32 curFrame );
 
 	Resource *resolveResHandle( ResHandle handle )
 		{ return (handle != 0 && (unsigned)(handle - 1) < _resources.size()) ? _resources[handle - 1] : 0x0; }
@@ -187,6 +202,8 @@ protected:
 protected:
 	std::vector < Resource * >         _resources;
 	std::map< int, ResourceRegEntry >  _registry;  // Registry of resource types
+	std::vector< Resource * >          _memConsumers;  // Sorted resources of last memory query
+	std::vector< Resource * >          _evictionList;
 };
 
 }
@@ -31,7 +31,7 @@ using namespace std;
 // *************************************************************************************************
 
 SceneNode::SceneNode( const SceneNodeTpl &tpl ) :
-	_parent( 0x0 ), _type( tpl.type ), _handle( 0 ), _sgHandle( 0 ), _flags( 0 ), _sortKey( 0 ),
+	_parent( 0x0 ), _type( tpl.type ), _handle( 0 ), _sgHandle( 0 ), _sqHandle( 0 ), _flags( 0 ), _sortKey( 0 ),
 	_dirty( true ), _transformed( true ), _renderable( false ),
 	_name( tpl.name ), _attachment( tpl.attachmentString )
 {
@@ -87,6 +87,25 @@ void SceneNode::setTransform( const Matrix4f &mat )
 }
 
 
+void SceneNode::setTransform( const Vec3f &trans, const Quaternion &rot, const Vec3f &scale )
+{
+	// Hack to avoid making setTransform virtual
+	if( _type == SceneNodeTypes::Joint )
+	{
+		((JointNode *)this)->_parentModel->_skinningDirty = true;
+	}
+	
+	// Equivalent to T * R * S but without the full matrix products
+	_relTrans = Matrix4f( rot );
+	_relTrans.c[0][0] *= scale.x; _relTrans.c[0][1] *= scale.x; _relTrans.c[0][2] *= scale.x;
+	_relTrans.c[1][0] *= scale.y; _relTrans.c[1][1] *= scale.y; _relTrans.c[1][2] *= scale.y;
+	_relTrans.c[2][0] *= scale.z; _relTrans.c[2][1] *= scale.z; _relTrans.c[2][2] *= scale.z;
+	_relTrans.c[3][0] = trans.x; _relTrans.c[3][1] = trans.y; _relTrans.c[3][2] = trans.z;
+	
+	markDirty();
+}
+
+
 void SceneNode::getTransMatrices( const float **relMat, const float **absMat ) const
 {
 	if( relMat != 0x0 )
@@ -198,6 +217,14 @@ void SceneNode::markChildrenDirty()
 
 void SceneNode::markDirty()
 {
+	SceneManager &sceneMan = Modules::sceneMan();
+	if( sceneMan.isDirtyDeferred() )
+	{
+		// Propagation is done once for all queued nodes in endDeferredDirty
+		sceneMan.queueDirtyNode( *this );
+		return;
+	}
+	
 	_dirty = true;
 	_transformed = true;
 	
@@ -222,7 +249,7 @@ void SceneNode::updateTree()
 	else
 		_absTrans = _relTrans;
 	
-	Modules::sceneMan().updateSpatialNode( _sgHandle );
+	Modules::sceneMan().updateSpatialNode( *this );
 
 	onPostUpdate();
 
@@ -275,7 +302,10 @@ SceneNode *GroupNode::factoryFunc( const SceneNodeTpl &nodeTpl )
 // Class SpatialGraph
 // =================================================================================================
 
-SpatialGraph::SpatialGraph()
+const uint32 MaxCoherentCullCaches = 4;
+
+SpatialGraph::SpatialGraph() :
+	_logConsumed( 0 ), _cullFrame( 0 ), _viewFrustum( 0x0 ), _viewQueue( 0x0 ), _viewFilter( 0 )
 {
 	_lightQueue.reserve( 20 );
 	_renderQueue.reserve( 500 );
@@ -300,6 +330,8 @@ void SpatialGraph::addNode( SceneNode &sceneNode )
 		_nodes.push_back( &sceneNode );
 		sceneNode._sgHandle = (uint32)_nodes.size();
 	}
+
+	logUpdate( sceneNode._sgHandle - 1 );
 }
 
 
@@ -314,13 +346,40 @@ void SpatialGraph::removeNode( uint32 sgHandle )
 	_nodes[sgHandle - 1]->_sgHandle = 0;
 	_nodes[sgHandle - 1] = 0x0;
 	_freeList.push_back( sgHandle - 1 );
+
+	logUpdate( sgHandle - 1 );
 }
 
 
 void SpatialGraph::updateNode( uint32 sgHandle )
 {
-	// Since the spatial graph is just a flat list of objects,
-	// there is nothing to do at the moment
+	// Since the spatial graph is just a flat list of objects, only the coherent culling caches
+	// need to know about the change
+	if( sgHandle != 0 ) logUpdate( sgHandle - 1 );
+}
+
+
+void SpatialGraph::logUpdate( uint32 slot )
+{
+	if( _cullCaches.empty() ) return;
+
+	if( _logIndices.size() < _nodes.size() ) _logIndices.resize( _nodes.size(), 0 );
+	
+	// Skip slots that are already logged but were not yet seen by any cache
+	uint32 index = _logIndices[slot];
+	if( index >= _logConsumed && index < _updateLog.size() && _updateLog[index] == slot ) return;
+
+	// Caches that are not used for a long time would let the log grow without limit
+	if( _updateLog.size() > _nodes.size() * 2 + 256 )
+	{
+		for( size_t i = 0; i < _cullCaches.size(); ++i ) _cullCaches[i].valid = false;
+		_updateLog.resize( 0 );
+		_logConsumed = 0;
+		return;
+	}
+
+	_logIndices[slot] = (uint32)_updateLog.size();
+	_updateLog.push_back( slot );
 }
 
 
@@ -336,58 +395,612 @@ void SpatialGraph::updateQueues( const Frustum &frustum1, const Frustum *frustum
 {
 	Modules::sceneMan().updateNodes();
 	
+	Timer *timer = Modules::stats().getTimer( EngineStats::CullingTime );
+	if( Modules::config().gatherTimeStats ) timer->setEnabled( true );
+	
 	Vec3f camPos( frustum1.getOrigin() );
 	if( Modules::renderer().getCurCamera() != 0x0 )
 		camPos = Modules::renderer().getCurCamera()->getAbsPos();
 	
+	// The queues of views rendered together are built by cullViews
+	bool useViewQueue = _viewQueue != 0x0 && (filterIgnore & _viewFilter) == _viewFilter;
+	
+	if( lightQueue && !(useViewQueue && filterIgnore == _viewFilter) )
+	{
+		// Clear without affecting capacity
+		_lightQueue.resize( 0 );
+
+		for( size_t i = 0, s = _nodes.size(); i < s; ++i )
+		{
+			SceneNode *node = _nodes[i];
+			if( node == 0x0 || (node->_flags & filterIgnore) ) continue;
+
+			if( node->_type == SceneNodeTypes::Light ) _lightQueue.push_back( node );
+		}
+	}
+
+	if( Modules::config().coherentCullMargin <= 0 && !_cullCaches.empty() )
+	{
+		_cullCaches.clear();
+		_updateLog.clear();
+		_logConsumed = 0;
+	}
+
+	if( renderQueue )
+	{
+		CameraNode *camera = Modules::renderer().getCurCamera();
+		
+		// Coherent culling is only used for the plain camera queue, other queues are built
+		// for changing frusta anyway
+		if( Modules::config().coherentCullMargin > 0 && camera != 0x0 && frustum2 == 0x0 && !useViewQueue )
+		{
+			cullCoherent( camera->getHandle(), frustum1, camPos, order, filterIgnore, _renderQueue );
+			
+			// The check is not part of the culling time
+			if( Modules::config().checkCoherentCulling )
+			{
+				timer->setEnabled( false );
+				checkCoherentQueue( frustum1, camPos, filterIgnore, _renderQueue );
+				if( Modules::config().gatherTimeStats ) timer->setEnabled( true );
+			}
+		}
+		else
+			cullRenderables( frustum1, frustum2, camPos, order, filterIgnore, _renderQueue );
+
+		// Culling may run in parallel, so the visibility used for update-rate LOD is recorded here
+		for( size_t i = 0, s = _renderQueue.size(); i < s; ++i )
+		{
+			if( _renderQueue[i].type == SceneNodeTypes::Mesh )
+			{
+				MeshNode *mesh = (MeshNode *)_renderQueue[i].node;
+				mesh->getParentModel()->markVisible( mesh->getLodLevel() );
+			}
+		}
+	}
+
+	timer->setEnabled( false );
+}
+
+
+void SpatialGraph::cullRenderables( const Frustum &frustum1, const Frustum *frustum2, const Vec3f &camPos,
+                                    RenderingOrder::List order, uint32 filterIgnore, RenderQueue &queue ) const
+{
+	// Note: This function does not modify any nodes so that it can be called from several threads
+	// at the same time with different queues; the nodes need to be updated by the caller
+	
 	// Clear without affecting capacity
-	if( lightQueue ) _lightQueue.resize( 0 );
-	if( renderQueue ) _renderQueue.resize( 0 );
+	queue.resize( 0 );
 
-	// Culling
-	for( size_t i = 0, s = _nodes.size(); i < s; ++i )
+	if( _viewQueue != 0x0 && &frustum1 == _viewFrustum && (filterIgnore & _viewFilter) == _viewFilter )
 	{
-		SceneNode *node = _nodes[i];
-		if( node == 0x0 || (node->_flags & filterIgnore) ) continue;
+		// The nodes in the frustum of the view that is currently rendered were found by cullViews
+		for( size_t i = 0, s = _viewQueue->size(); i < s; ++i )
+		{
+			SceneNode *node = (*_viewQueue)[i].node;
+			if( node->_flags & filterIgnore ) continue;
 
-		if( renderQueue && node->_renderable )
+			if( frustum2 == 0x0 || !frustum2->cullBox( node->_bBox ) )
+				queueRenderable( node, frustum1, camPos, order, queue );
+		}
+	}
+	else
+	{
+		// Culling
+		for( size_t i = 0, s = _nodes.size(); i < s; ++i )
 		{
+			SceneNode *node = _nodes[i];
+			if( node == 0x0 || (node->_flags & filterIgnore) || !node->_renderable ) continue;
+
 			if( !frustum1.cullBox( node->_bBox ) &&
 				(frustum2 == 0x0 || !frustum2->cullBox( node->_bBox )) )
 			{
-				if( node->_type == SceneNodeTypes::Mesh )  // TODO: Generalize and optimize this
-				{
-					uint32 curLod = ((MeshNode *)node)->getParentModel()->calcLodLevel( camPos );
-					if( ((MeshNode *)node)->getLodLevel() != curLod ) continue;
-				}
-				
-				float sortKey = 0;
-
-				switch( order )
-				{
-				case RenderingOrder::StateChanges:
-					sortKey = node->_sortKey;
-					break;
-				case RenderingOrder::FrontToBack:
-					sortKey = nearestDistToAABB( frustum1.getOrigin(), node->_bBox.min, node->_bBox.max );
-					break;
-				case RenderingOrder::BackToFront:
-					sortKey = -nearestDistToAABB( frustum1.getOrigin(), node->_bBox.min, node->_bBox.max );
-					break;
-				}
-				
-				_renderQueue.push_back( RenderQueueItem( node->_type, sortKey, node ) );
+				queueRenderable( node, frustum1, camPos, order, queue );
 			}
 		}
-		else if( lightQueue && node->_type == SceneNodeTypes::Light )
+	}
+
+	// Sort
+	if( order != RenderingOrder::None )
+		std::sort( queue.begin(), queue.end(), RenderQueueItemCompFunc() );
+}
+
+
+void SpatialGraph::cullViews( const Frustum **frusta, const Vec3f *camPositions, uint32 numViews,
+                              uint32 filterIgnore, RenderQueue *queues )
+{
+	// Builds the light queue and the render queues of several views in a single pass over the nodes;
+	// the nodes need to be updated by the caller
+	
+	// Find bounds of all view frusta for early rejection of nodes that are outside of all views
+	Vec3f unionMin( Math::MaxFloat, Math::MaxFloat, Math::MaxFloat );
+	Vec3f unionMax( -Math::MaxFloat, -Math::MaxFloat, -Math::MaxFloat );
+	for( uint32 i = 0; i < numViews; ++i )
+	{
+		Vec3f bbMin, bbMax;
+		frusta[i]->calcAABB( bbMin, bbMax );
+		unionMin = Vec3f( minf( unionMin.x, bbMin.x ), minf( unionMin.y, bbMin.y ), minf( unionMin.z, bbMin.z ) );
+		unionMax = Vec3f( maxf( unionMax.x, bbMax.x ), maxf( unionMax.y, bbMax.y ), maxf( unionMax.z, bbMax.z ) );
+		
+		// Clear without affecting capacity
+		queues[i].resize( 0 );
+	}
+	_lightQueue.resize( 0 );
+
+	for( size_t i = 0, s = _nodes.size(); i < s; ++i )
+	{
+		SceneNode *node = _nodes[i];
+		if( node == 0x0 || (node->_flags & filterIgnore) ) continue;
+
+		if( node->_type == SceneNodeTypes::Light ) _lightQueue.push_back( node );
+		if( !node->_renderable ) continue;
+
+		const BoundingBox &b = node->_bBox;
+		if( b.min.x > unionMax.x || b.min.y > unionMax.y || b.min.z > unionMax.z ||
+		    b.max.x < unionMin.x || b.max.y < unionMin.y || b.max.z < unionMin.z ) continue;
+		
+		for( uint32 j = 0; j < numViews; ++j )
 		{
-			_lightQueue.push_back( node );
+			if( !frusta[j]->cullBox( node->_bBox ) )
+				queueRenderable( node, *frusta[j], camPositions[j], RenderingOrder::None, queues[j] );
+		}
+	}
+}
+
+
+void SpatialGraph::setViewQueue( const Frustum *frustum, const RenderQueue *queue, uint32 filterIgnore )
+{
+	// While a view queue is set, queues for the frustum of the view are built from it instead of
+	// culling all nodes
+	_viewFrustum = frustum;
+	_viewQueue = queue;
+	_viewFilter = filterIgnore;
+}
+
+
+void SpatialGraph::queueRenderable( SceneNode *node, const Frustum &frustum, const Vec3f &camPos,
+                                    RenderingOrder::List order, RenderQueue &queue )
+{
+	if( node->_type == SceneNodeTypes::Mesh )  // TODO: Generalize and optimize this
+	{
+		uint32 curLod = ((MeshNode *)node)->getParentModel()->calcLodLevel( camPos );
+		if( ((MeshNode *)node)->getLodLevel() != curLod ) return;
+	}
+	
+	float sortKey = 0;
+
+	switch( order )
+	{
+	case RenderingOrder::StateChanges:
+		sortKey = node->_sortKey;
+		break;
+	case RenderingOrder::FrontToBack:
+		sortKey = nearestDistToAABB( frustum.getOrigin(), node->_bBox.min, node->_bBox.max );
+		break;
+	case RenderingOrder::BackToFront:
+		sortKey = -nearestDistToAABB( frustum.getOrigin(), node->_bBox.min, node->_bBox.max );
+		break;
+	}
+	
+	queue.push_back( RenderQueueItem( node->_type, sortKey, node ) );
+}
+
+
+void SpatialGraph::setCacheState( CoherentCullCache &cache, uint32 slot, unsigned char state )
+{
+	unsigned char oldState = cache.states[slot];
+	if( oldState == state ) return;
+
+	// Remove slot from its old list by swapping the last element into its place
+	if( oldState != FrustumClass::Outside )
+	{
+		vector< uint32 > &list = oldState == FrustumClass::Inside ? cache.insideList : cache.boundaryList;
+		uint32 pos = cache.listPos[slot];
+		list[pos] = list.back();
+		cache.listPos[list[pos]] = pos;
+		list.pop_back();
+	}
+
+	if( state != FrustumClass::Outside )
+	{
+		vector< uint32 > &list = state == FrustumClass::Inside ? cache.insideList : cache.boundaryList;
+		cache.listPos[slot] = (uint32)list.size();
+		list.push_back( slot );
+	}
+
+	cache.states[slot] = state;
+}
+
+
+void SpatialGraph::rebuildCullCache( CoherentCullCache &cache, const Frustum &frustum )
+{
+	cache.refFrustum = frustum;
+	cache.margin = Modules::config().coherentCullMargin;
+	cache.boundsMin = Vec3f( Math::MaxFloat, Math::MaxFloat, Math::MaxFloat );
+	cache.boundsMax = Vec3f( -Math::MaxFloat, -Math::MaxFloat, -Math::MaxFloat );
+	cache.states.assign( _nodes.size(), (unsigned char)FrustumClass::Outside );
+	cache.listPos.resize( _nodes.size() );
+	cache.insideList.resize( 0 );
+	cache.boundaryList.resize( 0 );
+	cache.logPos = (uint32)_updateLog.size();
+	cache.valid = true;
+
+	for( size_t i = 0, s = _nodes.size(); i < s; ++i )
+	{
+		SceneNode *node = _nodes[i];
+		if( node == 0x0 || !node->_renderable ) continue;
+
+		BoundingBox &b = node->_bBox;
+		cache.boundsMin = Vec3f( minf( cache.boundsMin.x, b.min.x ), minf( cache.boundsMin.y, b.min.y ),
+		                         minf( cache.boundsMin.z, b.min.z ) );
+		cache.boundsMax = Vec3f( maxf( cache.boundsMax.x, b.max.x ), maxf( cache.boundsMax.y, b.max.y ),
+		                         maxf( cache.boundsMax.z, b.max.z ) );
+		setCacheState( cache, (uint32)i, (unsigned char)frustum.classifyBox( b, cache.margin ) );
+	}
+}
+
+
+void SpatialGraph::updateCullCache( CoherentCullCache &cache, const Frustum &frustum )
+{
+	cache.states.resize( _nodes.size(), (unsigned char)FrustumClass::Outside );
+	cache.listPos.resize( _nodes.size() );
+
+	// Classify nodes that were added, removed or moved since the last update
+	for( size_t i = cache.logPos, s = _updateLog.size(); i < s; ++i )
+	{
+		uint32 slot = _updateLog[i];
+		SceneNode *node = _nodes[slot];
+		
+		if( node != 0x0 && node->_renderable )
+		{
+			BoundingBox &b = node->_bBox;
+			cache.boundsMin = Vec3f( minf( cache.boundsMin.x, b.min.x ), minf( cache.boundsMin.y, b.min.y ),
+			                         minf( cache.boundsMin.z, b.min.z ) );
+			cache.boundsMax = Vec3f( maxf( cache.boundsMax.x, b.max.x ), maxf( cache.boundsMax.y, b.max.y ),
+			                         maxf( cache.boundsMax.z, b.max.z ) );
+			setCacheState( cache, slot, (unsigned char)cache.refFrustum.classifyBox( b, cache.margin ) );
+		}
+		else
+		{
+			setCacheState( cache, slot, FrustumClass::Outside );
+		}
+	}
+	cache.logPos = (uint32)_updateLog.size();
+
+	// The classification stays valid as long as no plane has moved by more than the margin
+	// within the extents of the classified nodes
+	Vec3f center, extent;
+	if( cache.boundsMin.x <= cache.boundsMax.x )
+	{
+		center = (cache.boundsMin + cache.boundsMax) * 0.5f;
+		extent = (cache.boundsMax - cache.boundsMin) * 0.5f;
+	}
+	float radius = extent.length();
+	float shift = cache.refFrustum.calcMaxPlaneShift( frustum, center, radius );
+	
+	// Leave some room for rounding errors which grow with the distance from the origin
+	shift += (center.length() + radius) * 1.0e-5f;
+
+	if( shift >= cache.margin ) rebuildCullCache( cache, frustum );
+}
+
+
+void SpatialGraph::cullCoherent( NodeHandle camera, const Frustum &frustum, const Vec3f &camPos,
+                                 RenderingOrder::List order, uint32 filterIgnore, RenderQueue &queue )
+{
+	++_cullFrame;
+	
+	// Find cache of camera or replace least recently used one
+	CoherentCullCache *cache = 0x0;
+	for( size_t i = 0; i < _cullCaches.size(); ++i )
+	{
+		if( _cullCaches[i].camera == camera ) { cache = &_cullCaches[i]; break; }
+	}
+	if( cache == 0x0 )
+	{
+		if( _cullCaches.size() < MaxCoherentCullCaches )
+		{
+			_cullCaches.push_back( CoherentCullCache() );
+			cache = &_cullCaches.back();
+		}
+		else
+		{
+			cache = &_cullCaches[0];
+			for( size_t i = 1; i < _cullCaches.size(); ++i )
+			{
+				if( _cullCaches[i].lastUse < cache->lastUse ) cache = &_cullCaches[i];
+			}
 		}
+		cache->camera = camera;
+		cache->valid = false;
+	}
+	cache->lastUse = _cullFrame;
+
+	if( !cache->valid || cache->margin != Modules::config().coherentCullMargin )
+		rebuildCullCache( *cache, frustum );
+	else
+		updateCullCache( *cache, frustum );
+
+	// Clear without affecting capacity
+	queue.resize( 0 );
+
+	// Nodes inside the frustum need no test, nodes close to the planes are tested as usual
+	for( size_t i = 0, s = cache->insideList.size(); i < s; ++i )
+	{
+		SceneNode *node = _nodes[cache->insideList[i]];
+		if( node->_flags & filterIgnore ) continue;
+
+		queueRenderable( node, frustum, camPos, order, queue );
+	}
+	for( size_t i = 0, s = cache->boundaryList.size(); i < s; ++i )
+	{
+		SceneNode *node = _nodes[cache->boundaryList[i]];
+		if( (node->_flags & filterIgnore) || frustum.cullBox( node->_bBox ) ) continue;
+
+		queueRenderable( node, frustum, camPos, order, queue );
 	}
 
 	// Sort
 	if( order != RenderingOrder::None )
-		std::sort( _renderQueue.begin(), _renderQueue.end(), RenderQueueItemCompFunc() );
+		std::sort( queue.begin(), queue.end(), RenderQueueItemCompFunc() );
+
+	// Drop log entries once all caches have seen them
+	uint32 minPos = (uint32)_updateLog.size(), maxPos = 0;
+	for( size_t i = 0; i < _cullCaches.size(); ++i )
+	{
+		if( !_cullCaches[i].valid ) continue;
+		minPos = std::min( minPos, _cullCaches[i].logPos );
+		maxPos = std::max( maxPos, _cullCaches[i].logPos );
+	}
+	if( minPos == _updateLog.size() )
+	{
+		for( size_t i = 0; i < _cullCaches.size(); ++i ) _cullCaches[i].logPos = 0;
+		_updateLog.resize( 0 );
+		maxPos = 0;
+	}
+	_logConsumed = maxPos;
+}
+
+
+struct RenderQueueNodeCompFunc
+{
+	bool operator()( const RenderQueueItem &a, const RenderQueueItem &b ) const
+		{ return a.node < b.node; }
+};
+
+
+void SpatialGraph::checkCoherentQueue( const Frustum &frustum, const Vec3f &camPos, uint32 filterIgnore,
+                                       const RenderQueue &queue )
+{
+	// Debug path that compares the queue built by coherent culling with culling all nodes
+	cullRenderables( frustum, 0x0, camPos, RenderingOrder::None, filterIgnore, _checkQueue );
+	
+	RenderQueue coherentQueue( queue );
+	std::sort( coherentQueue.begin(), coherentQueue.end(), RenderQueueNodeCompFunc() );
+	std::sort( _checkQueue.begin(), _checkQueue.end(), RenderQueueNodeCompFunc() );
+
+	int missing = 0, superfluous = 0;
+	size_t i = 0, j = 0;
+	while( i < _checkQueue.size() || j < coherentQueue.size() )
+	{
+		if( j == coherentQueue.size() || (i < _checkQueue.size() && _checkQueue[i].node < coherentQueue[j].node) )
+		{
+			++missing; ++i;
+		}
+		else if( i == _checkQueue.size() || coherentQueue[j].node < _checkQueue[i].node )
+		{
+			++superfluous; ++j;
+		}
+		else
+		{
+			++i; ++j;
+		}
+	}
+
+	if( missing + superfluous > 0 )
+	{
+		Modules::log().writeWarning( "Coherent culling differs from regular culling: %i nodes missing, %i nodes too many",
+		                             missing, superfluous );
+		Modules::stats().incStat( EngineStats::CullMismatches, (float)(missing + superfluous) );
+	}
+}
+
+
+// *************************************************************************************************
+// Class SpatialQueryGrid
+// *************************************************************************************************
+
+SpatialQueryGrid::SpatialQueryGrid() :
+	_numNodes( 0 )
+{
+	_cellSize = Modules::config().queryGridCellSize;
+	_invCellSize = 1.0f / _cellSize;
+	_buckets.resize( 1024 );
+}
+
+
+int SpatialQueryGrid::calcCell( float coord ) const
+{
+	// Clamp to avoid integer overflow for nodes that are very far away
+	float cell = floorf( coord * _invCellSize );
+	if( cell > (float)(1 << 30) ) return 1 << 30;
+	if( cell < -(float)(1 << 30) ) return -(1 << 30);
+	return (int)cell;
+}
+
+
+uint32 SpatialQueryGrid::calcBucket( int cellX, int cellY, int cellZ ) const
+{
+	uint32 hash = ((uint32)cellX * 73856093u) ^ ((uint32)cellY * 19349663u) ^ ((uint32)cellZ * 83492791u);
+	return hash & ((uint32)_buckets.size() - 1);
+}
+
+
+void SpatialQueryGrid::insertEntry( uint32 entryIndex )
+{
+	SpatialQueryEntry &entry = _entries[entryIndex];
+
+	entry.cellX = calcCell( entry.pos.x );
+	entry.cellY = calcCell( entry.pos.y );
+	entry.cellZ = calcCell( entry.pos.z );
+	entry.bucket = calcBucket( entry.cellX, entry.cellY, entry.cellZ );
+	_buckets[entry.bucket].push_back( entryIndex );
+}
+
+
+void SpatialQueryGrid::removeEntry( uint32 entryIndex )
+{
+	SpatialQueryEntry &entry = _entries[entryIndex];
+	if( entry.bucket == InvalidBucket ) return;
+	
+	std::vector< uint32 > &bucket = _buckets[entry.bucket];
+	for( size_t i = 0, s = bucket.size(); i < s; ++i )
+	{
+		if( bucket[i] == entryIndex )
+		{
+			bucket[i] = bucket.back();
+			bucket.pop_back();
+			break;
+		}
+	}
+
+	entry.bucket = InvalidBucket;
+}
+
+
+void SpatialQueryGrid::rebuild( uint32 numBuckets )
+{
+	_buckets.clear();
+	_buckets.resize( numBuckets );
+
+	for( uint32 i = 0; i < (uint32)_entries.size(); ++i )
+	{
+		if( _entries[i].node != 0x0 && _entries[i].bucket != InvalidBucket )
+			insertEntry( i );
+	}
+}
+
+
+void SpatialQueryGrid::setCellSize( float cellSize )
+{
+	if( cellSize == _cellSize ) return;
+	
+	_cellSize = cellSize;
+	_invCellSize = 1.0f / cellSize;
+	rebuild( (uint32)_buckets.size() );
+}
+
+
+void SpatialQueryGrid::addNode( SceneNode &node )
+{
+	// Meshes and joints are parts of models and would just add update overhead
+	if( node._type == SceneNodeTypes::Mesh || node._type == SceneNodeTypes::Joint ) return;
+
+	SpatialQueryEntry entry;
+	entry.node = &node;
+	entry.cellX = entry.cellY = entry.cellZ = 0;
+	entry.bucket = InvalidBucket;  // Node is inserted on first update when its position is known
+	
+	if( !_freeList.empty() )
+	{
+		uint32 slot = _freeList.back();
+		_freeList.pop_back();
+		_entries[slot] = entry;
+		node._sqHandle = slot + 1;
+	}
+	else
+	{
+		_entries.push_back( entry );
+		node._sqHandle = (uint32)_entries.size();
+	}
+
+	// Grow hash table to keep buckets short
+	if( ++_numNodes > _buckets.size() * 2 ) rebuild( (uint32)_buckets.size() * 2 );
+}
+
+
+void SpatialQueryGrid::removeNode( SceneNode &node )
+{
+	if( node._sqHandle == 0 ) return;
+
+	uint32 entryIndex = node._sqHandle - 1;
+	removeEntry( entryIndex );
+	_entries[entryIndex].node = 0x0;
+	_freeList.push_back( entryIndex );
+	node._sqHandle = 0;
+	--_numNodes;
+}
+
+
+void SpatialQueryGrid::updateNode( SceneNode &node )
+{
+	if( node._sqHandle == 0 ) return;
+
+	uint32 entryIndex = node._sqHandle - 1;
+	SpatialQueryEntry &entry = _entries[entryIndex];
+	entry.pos = Vec3f( node._absTrans.c[3][0], node._absTrans.c[3][1], node._absTrans.c[3][2] );
+
+	// Only touch the hash table if the node has moved to another cell
+	if( entry.bucket != InvalidBucket && entry.cellX == calcCell( entry.pos.x ) &&
+	    entry.cellY == calcCell( entry.pos.y ) && entry.cellZ == calcCell( entry.pos.z ) ) return;
+	
+	removeEntry( entryIndex );
+	insertEntry( entryIndex );
+}
+
+
+void SpatialQueryGrid::queryNodes( const Vec3f &min, const Vec3f &max, const Vec3f *sphereCenter, float radius,
+                                   int type, vector< SceneNode * > &results )
+{
+	float sqrRadius = radius * radius;
+	int minX = calcCell( min.x ), minY = calcCell( min.y ), minZ = calcCell( min.z );
+	int maxX = calcCell( max.x ), maxY = calcCell( max.y ), maxZ = calcCell( max.z );
+	double numCells = ((double)maxX - minX + 1) * ((double)maxY - minY + 1) * ((double)maxZ - minZ + 1);
+
+	if( numCells > (double)_buckets.size() )
+	{
+		// Query region covers more cells than there are buckets, so a linear scan is cheaper
+		for( size_t i = 0, s = _entries.size(); i < s; ++i )
+		{
+			const SpatialQueryEntry &entry = _entries[i];
+			if( entry.node == 0x0 || entry.bucket == InvalidBucket ) continue;
+			if( type != SceneNodeTypes::Undefined && entry.node->_type != type ) continue;
+			
+			const Vec3f &pos = entry.pos;
+			if( pos.x < min.x || pos.y < min.y || pos.z < min.z ||
+			    pos.x > max.x || pos.y > max.y || pos.z > max.z ) continue;
+			if( sphereCenter != 0x0 && (pos - *sphereCenter).dot( pos - *sphereCenter ) > sqrRadius ) continue;
+			
+			results.push_back( entry.node );
+		}
+		return;
+	}
+
+	for( int z = minZ; z <= maxZ; ++z )
+	{
+		for( int y = minY; y <= maxY; ++y )
+		{
+			for( int x = minX; x <= maxX; ++x )
+			{
+				const std::vector< uint32 > &bucket = _buckets[calcBucket( x, y, z )];
+				
+				for( size_t i = 0, s = bucket.size(); i < s; ++i )
+				{
+					const SpatialQueryEntry &entry = _entries[bucket[i]];
+					
+					// Skip entries of other cells that map to the same bucket
+					if( entry.cellX != x || entry.cellY != y || entry.cellZ != z ) continue;
+					if( type != SceneNodeTypes::Undefined && entry.node->_type != type ) continue;
+					
+					const Vec3f &pos = entry.pos;
+					if( pos.x < min.x || pos.y < min.y || pos.z < min.z ||
+					    pos.x > max.x || pos.y > max.y || pos.z > max.z ) continue;
+					if( sphereCenter != 0x0 && (pos - *sphereCenter).dot( pos - *sphereCenter ) > sqrRadius ) continue;
+
+					results.push_back( entry.node );
+				}
+			}
+		}
+	}
 }
 
 
@@ -395,7 +1008,8 @@ void SpatialGraph::updateQueues( const Frustum &frustum1, const Frustum *frustum
 // Class SceneManager
 // *************************************************************************************************
 
-SceneManager::SceneManager()
+SceneManager::SceneManager() :
+	_deferDirty( false )
 {
 	SceneNode *rootNode = GroupNode::factoryFunc( GroupNodeTpl( "RootNode" ) );
 	rootNode->_handle = RootNode;
@@ -457,6 +1071,39 @@ void SceneManager::updateNodes()
 }
 
 
+void SceneManager::endDeferredDirty()
+{
+	_deferDirty = false;
+	
+	for( size_t i = 0, s = _dirtyQueue.size(); i < s; ++i )
+	{
+		SceneNode *node = _dirtyQueue[i];
+		node->_dirty = true;
+		node->_transformed = true;
+
+		// A dirty node always has dirty ancestors, so the upward walk can stop at the first one
+		// that was already marked, either before or by a previously processed node of the queue
+		SceneNode *parent = node->_parent;
+		while( parent != 0x0 && !parent->_dirty )
+		{
+			parent->_dirty = true;
+			parent = parent->_parent;
+		}
+
+		node->markChildrenDirty();
+	}
+
+	_dirtyQueue.resize( 0 );
+}
+
+
+void SceneManager::updateSpatialNode( SceneNode &node )
+{
+	_spatialGraph->updateNode( node._sgHandle );
+	_queryGrid.updateNode( node );
+}
+
+
 void SceneManager::updateQueues( const Frustum &frustum1, const Frustum *frustum2, RenderingOrder::List order,
                                  uint32 filterIgnore, bool lightQueue, bool renderableQueue )
 {
@@ -524,8 +1171,9 @@ NodeHandle SceneManager::addNode( SceneNode *node, SceneNode &parent )
 	// Mark tree as dirty
 	node->markDirty();
 
-	// Register node in spatial graph
+	// Register node in spatial graph and query grid
 	_spatialGraph->addNode( *node );
+	_queryGrid.addNode( *node );
 	
 	// Insert node in free slot
 	if( !_freeList.empty() )
@@ -571,6 +1219,8 @@ void SceneManager::removeNodeRec( SceneNode &node )
 	if( handle != RootNode )
 	{
 		_spatialGraph->removeNode( node._sgHandle );
+		_queryGrid.removeNode( node );
+		Modules::renderer().getVisibilityBuffer().resetSlot( handle - 1 );
 		delete _nodes[handle - 1]; _nodes[handle - 1] = 0x0;
 		_freeList.push_back( handle - 1 );
 	}
@@ -705,6 +1355,29 @@ void SceneManager::castRayInternal( SceneNode &node )
 }
 
 
+int SceneManager::queryNodesInBox( const Vec3f &min, const Vec3f &max, int type )
+{
+	updateNodes();
+	
+	_findResults.resize( 0 );  // Clear without affecting capacity
+	_queryGrid.queryNodes( min, max, 0x0, 0, type, _findResults );
+
+	return (int)_findResults.size();
+}
+
+
+int SceneManager::queryNodesInSphere( const Vec3f &center, float radius, int type )
+{
+	updateNodes();
+	
+	_findResults.resize( 0 );  // Clear without affecting capacity
+	Vec3f extents( radius, radius, radius );
+	_queryGrid.queryNodes( center - extents, center + extents, &center, radius, type, _findResults );
+
+	return (int)_findResults.size();
+}
+
+
 int SceneManager::castRay( SceneNode &node, const Vec3f &rayOrig, const Vec3f &rayDir, int numNearest )
 {
 	_castRayResults.resize( 0 );  // Clear without affecting capacity
@@ -743,21 +1416,8 @@ int SceneManager::checkNodeVisibility( SceneNode &node, CameraNode &cam, bool ch
 	// Check occlusion
 	if( checkOcclusion && cam._occSet >= 0 )
 	{
-		if( node.getType() == SceneNodeTypes::Mesh && cam._occSet < (int)((MeshNode *)&node)->_occQueries.size() )
-		{
-			if( gRDI->getQueryResult( ((MeshNode *)&node)->_occQueries[cam._occSet] ) < 1 )
-				return -1;
-		}
-		else if( node.getType() == SceneNodeTypes::Emitter && cam._occSet < (int)((EmitterNode *)&node)->_occQueries.size() )
-		{
-			if( gRDI->getQueryResult( ((EmitterNode *)&node)->_occQueries[cam._occSet] ) < 1 )
-				return -1;
-		}
-		else if( node.getType() == SceneNodeTypes::Light && cam._occSet < (int)((LightNode *)&node)->_occQueries.size() )
-		{
-			if( gRDI->getQueryResult( ((LightNode *)&node)->_occQueries[cam._occSet] ) < 1 )
-				return -1;
-		}
+		if( Modules::renderer().getVisibilityBuffer().isOccluded( cam._occSet, node._handle - 1 ) )
+			return -1;
 	}
 	
 	// Frustum culling
@@ -101,6 +101,7 @@ public:
 	void getTransform( Vec3f &trans, Vec3f &rot, Vec3f &scale );	// Not virtual for performance
 	void setTransform( Vec3f trans, Vec3f rot, Vec3f scale );	// Not virtual for performance
 	void setTransform( const Matrix4f &mat );
+	void setTransform( const Vec3f &trans, const Quaternion &rot, const Vec3f &scale );
 	void getTransMatrices( const float **relMat, const float **absMat ) const;
 
 	int getFlags() { return _flags; }
@@ -149,6 +150,7 @@ protected:
 	int                         _type;
 	NodeHandle                  _handle;
 	uint32                      _sgHandle;  // Spatial graph handle
+	uint32                      _sqHandle;  // Spatial query grid handle
 	uint32                      _flags;
 	float                       _sortKey;
 	bool                        _dirty;  // Does the node need to be updated?
@@ -163,6 +165,7 @@ protected:
 
 	friend class SceneManager;
 	friend class SpatialGraph;
+	friend class SpatialQueryGrid;
 	friend class Renderer;
 };
 
@@ -213,6 +216,22 @@ struct RenderQueueItem
 typedef std::vector< RenderQueueItem > RenderQueue;
 
 
+struct CoherentCullCache
+{
+	NodeHandle                    camera;
+	Frustum                       refFrustum;  // Frustum the nodes were classified against
+	Vec3f                         boundsMin, boundsMax;  // Extents of all classified nodes
+	float                         margin;
+	std::vector< unsigned char >  states;  // FrustumClass per spatial graph slot
+	std::vector< uint32 >         listPos;  // Position of slot in inside or boundary list
+	std::vector< uint32 >         insideList, boundaryList;
+	uint32                        logPos;  // Number of consumed entries of the update log
+	uint32                        lastUse;
+	bool                          valid;
+
+	CoherentCullCache() : camera( 0 ), margin( 0 ), logPos( 0 ), lastUse( 0 ), valid( false ) {}
+};
+
 class SpatialGraph
 {
 public:
@@ -224,15 +243,89 @@ public:
 
 	void updateQueues( const Frustum &frustum1, const Frustum *frustum2,
 	                   RenderingOrder::List order, uint32 filterIgnore, bool lightQueue, bool renderQueue );
+	void cullRenderables( const Frustum &frustum1, const Frustum *frustum2, const Vec3f &camPos,
+	                      RenderingOrder::List order, uint32 filterIgnore, RenderQueue &queue ) const;
+	void cullViews( const Frustum **frusta, const Vec3f *camPositions, uint32 numViews, uint32 filterIgnore,
+	                RenderQueue *queues );
+	void setViewQueue( const Frustum *frustum, const RenderQueue *queue, uint32 filterIgnore );
 
 	std::vector< SceneNode * > &getLightQueue() { return _lightQueue; }
 	RenderQueue &getRenderQueue() { return _renderQueue; }
 
+protected:
+	static void queueRenderable( SceneNode *node, const Frustum &frustum, const Vec3f &camPos,
+	                             RenderingOrder::List order, RenderQueue &queue );
+	void logUpdate( uint32 slot );
+	void setCacheState( CoherentCullCache &cache, uint32 slot, unsigned char state );
+	void rebuildCullCache( CoherentCullCache &cache, const Frustum &frustum );
+	void updateCullCache( CoherentCullCache &cache, const Frustum &frustum );
+	void cullCoherent( NodeHandle camera, const Frustum &frustum, const Vec3f &camPos,
+	                   RenderingOrder::List order, uint32 filterIgnore, RenderQueue &queue );
+	void checkCoherentQueue( const Frustum &frustum, const Vec3f &camPos, uint32 filterIgnore,
+	                         const RenderQueue &queue );
+
 protected:
 	std::vector< SceneNode * >     _nodes;		// Renderable nodes and lights
 	std::vector< uint32 >          _freeList;
 	std::vector< SceneNode * >     _lightQueue;
 	RenderQueue                    _renderQueue;
+
+	// Temporal coherence: slots of added, removed or moved nodes since the caches were updated
+	std::vector< CoherentCullCache >  _cullCaches;
+	std::vector< uint32 >          _updateLog;
+	std::vector< uint32 >          _logIndices;  // Last position of each slot in the update log
+	uint32                         _logConsumed;  // Log entries before this were seen by some cache
+	uint32                         _cullFrame;
+	RenderQueue                    _checkQueue;
+
+	// Precomputed queue of the view that is currently rendered by several views rendering
+	const Frustum                  *_viewFrustum;
+	const RenderQueue              *_viewQueue;
+	uint32                         _viewFilter;
+};
+
+
+// =================================================================================================
+// Spatial Query Grid
+// =================================================================================================
+
+struct SpatialQueryEntry
+{
+	Vec3f      pos;  // Cached absolute position of node
+	SceneNode  *node;
+	int        cellX, cellY, cellZ;
+	uint32     bucket;  // Bucket containing the entry or InvalidBucket if not yet inserted
+};
+
+
+class SpatialQueryGrid
+{
+public:
+	static const uint32 InvalidBucket = 0xFFFFFFFF;
+	
+	SpatialQueryGrid();
+
+	void addNode( SceneNode &node );
+	void removeNode( SceneNode &node );
+	void updateNode( SceneNode &node );
+	void setCellSize( float cellSize );
+
+	void queryNodes( const Vec3f &min, const Vec3f &max, const Vec3f *sphereCenter, float radius,
+	                 int type, std::vector< SceneNode * > &results );
+
+protected:
+	int calcCell( float coord ) const;
+	uint32 calcBucket( int cellX, int cellY, int cellZ ) const;
+	void insertEntry( uint32 entryIndex );
+	void removeEntry( uint32 entryIndex );
+	void rebuild( uint32 numBuckets );
+
+protected:
+	std::vector< SpatialQueryEntry >        _entries;
+	std::vector< uint32 >                   _freeList;
+	std::vector< std::vector< uint32 > >    _buckets;  // Spatial hash of cells, contains entry indices
+	float                                   _cellSize, _invCellSize;
+	uint32                                  _numNodes;
 };
 
 
@@ -271,9 +364,22 @@ public:
 	NodeRegEntry *findType( const std::string &typeString );
 	
 	void updateNodes();
-	void updateSpatialNode( uint32 sgHandle ) { _spatialGraph->updateNode( sgHandle ); }
+	void beginDeferredDirty() { _deferDirty = true; }
+	void endDeferredDirty();
+	bool isDirtyDeferred() { return _deferDirty; }
+	void queueDirtyNode( SceneNode &node ) { _dirtyQueue.push_back( &node ); }
+	void updateSpatialNode( SceneNode &node );
+	void setQueryGridCellSize( float cellSize ) { _queryGrid.setCellSize( cellSize ); }
 	void updateQueues( const Frustum &frustum1, const Frustum *frustum2,
 	                   RenderingOrder::List order, uint32 filterIgnore, bool lightQueue, bool renderableQueue );
+	void cullRenderables( const Frustum &frustum1, const Frustum *frustum2, const Vec3f &camPos,
+	                      RenderingOrder::List order, uint32 filterIgnore, RenderQueue &queue ) const
+		{ _spatialGraph->cullRenderables( frustum1, frustum2, camPos, order, filterIgnore, queue ); }
+	void cullViews( const Frustum **frusta, const Vec3f *camPositions, uint32 numViews, uint32 filterIgnore,
+	                RenderQueue *queues )
+		{ _spatialGraph->cullViews( frusta, camPositions, numViews, filterIgnore, queues ); }
+	void setViewQueue( const Frustum *frustum, const RenderQueue *queue, uint32 filterIgnore )
+		{ _spatialGraph->setViewQueue( frustum, queue, filterIgnore ); }
 	
 	NodeHandle addNode( SceneNode *node, SceneNode &parent );
 	NodeHandle addNodes( SceneNode &parent, SceneGraphResource &sgRes );
@@ -284,6 +390,9 @@ public:
 	void clearFindResults() { _findResults.resize( 0 ); }
 	SceneNode *getFindResult( int index ) { return (unsigned)index < _findResults.size() ? _findResults[index] : 0x0; }
 	
+	int queryNodesInBox( const Vec3f &min, const Vec3f &max, int type );
+	int queryNodesInSphere( const Vec3f &center, float radius, int type );
+	
 	int castRay( SceneNode &node, const Vec3f &rayOrig, const Vec3f &rayDir, int numNearest );
 	bool getCastRayResult( int index, CastRayResult &crr );
 
@@ -308,13 +417,16 @@ protected:
 	std::vector< uint32 >          _freeList;  // List of free slots
 	std::vector< SceneNode * >     _findResults;
 	std::vector< CastRayResult >   _castRayResults;
+	std::vector< SceneNode * >     _dirtyQueue;  // Nodes whose dirty flag propagation is deferred
 	SpatialGraph                   *_spatialGraph;
+	SpatialQueryGrid               _queryGrid;
 
 	std::map< int, NodeRegEntry >  _registry;  // Registry of node types
 
 	Vec3f                          _rayOrigin;  // Don't put these values on the stack during recursive search
 	Vec3f                          _rayDirection;  // Ditto
 	int                            _rayNum;  // Ditto
+	bool                           _deferDirty;
 
 	friend class Renderer;
 };
@@ -16,6 +16,8 @@
 #include "egRenderer.h"
 #include <fstream>
 #include <cstring>
+#include <cstdlib>
+#include <cstdio>
 
 #include "utDebug.h"
 
@@ -28,6 +30,9 @@ using namespace std;
 // Code Resource
 // =================================================================================================
 
+uint32 CodeResource::_codeStamp = 0;
+
+
 CodeResource::CodeResource( const string &name, int flags ) :
 	Resource( ResourceTypes::Code, name, flags )
 {
@@ -55,6 +60,9 @@ void CodeResource::initDefault()
 {
 	_flagMask = 0;
 	_code.clear();
+	_assembledCode.clear();
+	_assembledStamp = 0;
+	++_codeStamp;
 }
 
 
@@ -174,6 +182,9 @@ bool CodeResource::load( const char *data, int size )
 	_code = code;
 	delete[] code;
 
+	// Invalidate assembled code of all code resources, as they might include this one
+	++_codeStamp;
+
 	// Compile shaders that require this code block
 	updateShaders();
 
@@ -210,21 +221,25 @@ bool CodeResource::tryLinking( uint32 *flagMask )
 }
 
 
-std::string CodeResource::assembleCode()
+const std::string &CodeResource::assembleCode()
 {
-	if( !_loaded ) return "";
+	// The result is cached until any code resource is loaded or unloaded
+	if( !_loaded ) _assembledCode.clear();
+	if( !_loaded || _assembledStamp == _codeStamp ) return _assembledCode;
 
-	std::string finalCode = _code;
+	_assembledCode = _code;
 	uint32 offset = 0;
 	
 	for( uint32 i = 0; i < _includes.size(); ++i )
 	{
-		std::string depCode = _includes[i].first->assembleCode();
-		finalCode.insert( _includes[i].second + offset, depCode );
+		const std::string &depCode = _includes[i].first->assembleCode();
+		_assembledCode.insert( _includes[i].second + offset, depCode );
 		offset += (uint32)depCode.length();
 	}
 
-	return finalCode;
+	_assembledStamp = _codeStamp;
+	
+	return _assembledCode;
 }
 
 
@@ -381,6 +396,11 @@ string ShaderResource::_vertPreamble = "";
 string ShaderResource::_fragPreamble = "";
 string ShaderResource::_tmpCode0 = "";
 string ShaderResource::_tmpCode1 = "";
+uint32 ShaderResource::_combIdCounter = 0;
+map< string, uint32 > ShaderResource::_contextIds;
+map< string, set< uint32 > > ShaderResource::_manifest;
+map< string, set< uint32 > > ShaderResource::_pendingManifest;
+string ShaderResource::_manifestText;
 
 
 ShaderResource::ShaderResource( const string &name, int flags ) :
@@ -605,6 +625,7 @@ bool ShaderResource::parseFXSection( char *data )
 			_tmpCode0 = _tmpCode1 = "";
 			context.id = tok.getToken( identifier );
 			if( context.id == "" ) return raiseError( "FX: Invalid identifier", tok.getLine() );
+			context.nameId = getContextId( context.id );
 
 			// Skip annotations
 			if( tok.checkToken( "<" ) )
@@ -732,6 +753,14 @@ bool ShaderResource::load( const char *data, int size )
 {
 	if( !Resource::load( data, size ) ) return false;
 	
+	// Take over the combinations of a precompile manifest that was passed before loading
+	map< string, set< uint32 > >::iterator pending = _pendingManifest.find( _name );
+	if( pending != _pendingManifest.end() )
+	{
+		_preLoadList.insert( pending->second.begin(), pending->second.end() );
+		_pendingManifest.erase( pending );
+	}
+	
 	// Parse sections
 	const char *pData = data;
 	const char *eof = data + size;
@@ -799,8 +828,16 @@ void ShaderResource::preLoadCombination( uint32 combMask )
 	{
 		for( uint32 i = 0; i < _contexts.size(); ++i )
 		{
-			if( getCombination( _contexts[i], combMask ) == 0x0 )
+			ShaderContext &context = _contexts[i];
+			
+			if( !context.compiled )
+			{
 				_preLoadList.insert( combMask );
+			}
+			else if( findCombination( context, combMask & context.flagMask ) == 0x0 )
+			{
+				compileCombination( context, addCombination( context, combMask & context.flagMask ) );
+			}
 		}
 	}
 }
@@ -852,6 +889,10 @@ void ShaderResource::compileCombination( ShaderContext &context, ShaderCombinati
 		gRDI->destroyShader( sc.shaderObj );
 		sc.shaderObj = 0;
 	}
+
+	// Invalidate resolved material and pipeline bindings
+	sc.id = ++_combIdCounter;
+	sc.pipeSamplerStamp = 0;
 	
 	// Compile shader
 	if( !Modules::renderer().createShaderComb( _tmpCode0.c_str(), _tmpCode1.c_str(), sc ) )
@@ -922,21 +963,8 @@ void ShaderResource::compileContexts()
 				uint32 combMask = *itr & context.flagMask;
 				
 				// Check if combination already exists
-				bool found = false;
-				for( size_t j = 0; j < context.shaderCombs.size(); ++j )
-				{
-					if( context.shaderCombs[j].combMask == combMask )
-					{
-						found = true;
-						break;
-					}
-				}
-
-				if( !found )
-				{	
-					context.shaderCombs.push_back( ShaderCombination() );
-					context.shaderCombs.back().combMask = combMask;
-				}
+				if( findCombination( context, combMask ) == 0x0 )
+					addCombination( context, combMask );
 			}
 			
 			for( size_t j = 0; j < context.shaderCombs.size(); ++j )
@@ -958,18 +986,127 @@ ShaderCombination *ShaderResource::getCombination( ShaderContext &context, uint3
 	combMask &= context.flagMask;
 	
 	// Try to find combination
-	std::vector< ShaderCombination > &combs = context.shaderCombs;
-	for( size_t i = 0, s = combs.size(); i < s; ++i )
+	ShaderCombination *sc = findCombination( context, combMask );
+	if( sc == 0x0 )
+	{
+		sc = &addCombination( context, combMask );
+		compileCombination( context, *sc );
+	}
+
+	if( !sc->recorded ) recordCombination( *sc );
+
+	return sc;
+}
+
+
+static uint32 hashCombMask( uint32 combMask )
+{
+	uint32 hash = combMask * 2654435761u;  // Knuth's multiplicative hash
+	return hash ^ (hash >> 16);
+}
+
+
+ShaderCombination *ShaderResource::findCombination( ShaderContext &context, uint32 combMask )
+{
+	std::vector< uint32 > &lookup = context.combLookup;
+	if( lookup.empty() ) return 0x0;
+
+	// Linear probing, the table always has free entries
+	uint32 mask = (uint32)lookup.size() - 1;
+	for( uint32 i = hashCombMask( combMask ) & mask; lookup[i] != 0; i = (i + 1) & mask )
 	{
-		if( combs[i].combMask == combMask ) return &combs[i];
+		ShaderCombination &sc = context.shaderCombs[lookup[i] - 1];
+		if( sc.combMask == combMask ) return &sc;
 	}
 
-	// Add combination
+	return 0x0;
+}
+
+
+ShaderCombination &ShaderResource::addCombination( ShaderContext &context, uint32 combMask )
+{
+	std::vector< ShaderCombination > &combs = context.shaderCombs;
+	std::vector< uint32 > &lookup = context.combLookup;
+	
 	combs.push_back( ShaderCombination() );
 	combs.back().combMask = combMask;
-	compileCombination( context, combs.back() );
 
-	return &combs.back();
+	// Rebuild hash table if it gets more than half full
+	uint32 first = (uint32)combs.size() - 1;
+	if( combs.size() * 2 > lookup.size() )
+	{
+		uint32 size = 16;
+		while( size < combs.size() * 4 ) size *= 2;
+		lookup.assign( size, 0 );
+		first = 0;
+	}
+
+	uint32 mask = (uint32)lookup.size() - 1;
+	for( uint32 i = first; i < (uint32)combs.size(); ++i )
+	{
+		uint32 j = hashCombMask( combs[i].combMask ) & mask;
+		while( lookup[j] != 0 ) j = (j + 1) & mask;
+		lookup[j] = i + 1;
+	}
+
+	return combs.back();
+}
+
+
+void ShaderResource::recordCombination( ShaderCombination &sc )
+{
+	_manifest[_name].insert( sc.combMask );
+	sc.recorded = true;
+}
+
+
+const std::string &ShaderResource::getManifest()
+{
+	// One line per combination: combination mask followed by the name of the shader resource
+	_manifestText.clear();
+	
+	char buf[16];
+	for( map< string, set< uint32 > >::iterator itr = _manifest.begin(); itr != _manifest.end(); ++itr )
+	{
+		for( set< uint32 >::iterator itr2 = itr->second.begin(); itr2 != itr->second.end(); ++itr2 )
+		{
+			sprintf( buf, "%u ", *itr2 );
+			_manifestText += buf;
+			_manifestText += itr->first;
+			_manifestText += "\n";
+		}
+	}
+
+	return _manifestText;
+}
+
+
+void ShaderResource::precompileManifest( const char *manifest )
+{
+	// Combinations of shaders that are not loaded yet are kept until the shader gets loaded, so
+	// they survive even if the shader resource is not created or is released in the meantime
+	const char *p = manifest;
+	while( *p != '\0' )
+	{
+		const char *lineEnd = p;
+		while( *lineEnd != '\0' && *lineEnd != '\n' && *lineEnd != '\r' ) ++lineEnd;
+
+		char *nameStart;
+		unsigned long combMask = strtoul( p, &nameStart, 10 );
+		if( nameStart != p && nameStart < lineEnd && *nameStart == ' ' && nameStart + 1 < lineEnd )
+		{
+			string name( (const char *)nameStart + 1, lineEnd );
+			ShaderResource *shaderRes =
+				(ShaderResource *)Modules::resMan().findResource( ResourceTypes::Shader, name );
+			if( shaderRes != 0x0 && shaderRes->isLoaded() )
+				shaderRes->preLoadCombination( (uint32)combMask );
+			else
+				_pendingManifest[name].insert( (uint32)combMask );
+		}
+		
+		p = lineEnd;
+		while( *p == '\n' || *p == '\r' ) ++p;
+	}
 }
 
 
@@ -994,6 +1131,22 @@ uint32 ShaderResource::calcCombMask( const std::vector< std::string > &flags )
 }
 
 
+uint32 ShaderResource::getContextId( const string &name )
+{
+	// Context names are interned so that the renderer can find contexts without string comparisons;
+	// ids stay valid for the lifetime of the engine and 0 is reserved for the empty name
+	if( name.empty() ) return 0;
+	
+	map< string, uint32 >::iterator itr = _contextIds.find( name );
+	if( itr != _contextIds.end() ) return itr->second;
+
+	uint32 id = (uint32)_contextIds.size() + 1;
+	_contextIds[name] = id;
+
+	return id;
+}
+
+
 int ShaderResource::getElemCount( int elem )
 {
 	switch( elem )
@@ -17,6 +17,7 @@
 #include "egResource.h"
 #include "egTexture.h"
 #include <set>
+#include <map>
 
 
 namespace Horde3D {
@@ -44,7 +45,7 @@ public:
 
 	bool hasDependency( CodeResource *codeRes );
 	bool tryLinking( uint32 *flagMask );
-	std::string assembleCode();
+	const std::string &assembleCode();
 
 	bool isLoaded() { return _loaded; }
 	const std::string &getCode() { return _code; }
@@ -54,9 +55,13 @@ private:
 	void updateShaders();
 
 private:
+	static uint32                                      _codeStamp;  // Changes whenever any code resource changes
+
 	uint32                                             _flagMask;
 	std::string                                        _code;
 	std::vector< std::pair< PCodeResource, size_t > >  _includes;	// Pair: Included res and location in _code
+	std::string                                        _assembledCode;  // Cached result of assembleCode
+	uint32                                             _assembledStamp;
 
 	friend class Renderer;
 };
@@ -124,8 +129,11 @@ struct ShaderCombination
 {
 	uint32              combMask;
 	
+	uint32              id;  // Unique id, changes whenever the combination is compiled
 	uint32              shaderObj;
 	uint32              lastUpdateStamp;
+	uint32              pipeSamplerStamp;
+	bool                recorded;  // Added to shader manifest
 
 	// Engine uniforms
 	int                 uni_frameBufSize;
@@ -139,10 +147,11 @@ struct ShaderCombination
 
 	std::vector< int >  customSamplers;
 	std::vector< int >  customUniforms;
+	std::vector< int >  pipeSamplers;  // Index of pipeline buffer binding for each sampler or -1
 
 
 	ShaderCombination() :
-		combMask( 0 ), shaderObj( 0 ), lastUpdateStamp( 0 )
+		combMask( 0 ), id( 0 ), shaderObj( 0 ), lastUpdateStamp( 0 ), pipeSamplerStamp( 0 ), recorded( false )
 	{
 	}
 };
@@ -151,6 +160,7 @@ struct ShaderCombination
 struct ShaderContext
 {
 	std::string                       id;
+	uint32                            nameId;  // Interned id, see ShaderResource::getContextId
 	uint32                            flagMask;
 	
 	// RenderConfig
@@ -163,12 +173,13 @@ struct ShaderContext
 	
 	// Shaders
 	std::vector< ShaderCombination >  shaderCombs;
+	std::vector< uint32 >             combLookup;  // Hash table of shaderCombs indices + 1, keyed by combMask
 	int                               vertCodeIdx, fragCodeIdx;
 	bool                              compiled;
 
 
 	ShaderContext() :
-		blendMode( BlendModes::Replace ), depthFunc( TestModes::LessEqual ),
+		nameId( 0 ), blendMode( BlendModes::Replace ), depthFunc( TestModes::LessEqual ),
 		cullMode( CullModes::Back ), depthTest( true ), writeDepth( true ), alphaToCoverage( false ),
 		vertCodeIdx( -1 ), fragCodeIdx( -1 ), compiled( false )
 	{
@@ -210,6 +221,9 @@ public:
 		{ _vertPreamble = vertPreamble; _fragPreamble = fragPreamble; }
 
 	static uint32 calcCombMask( const std::vector< std::string > &flags );
+	static uint32 getContextId( const std::string &name );
+	static const std::string &getManifest();
+	static void precompileManifest( const char *manifest );
 	
 	ShaderResource( const std::string &name, int flags );
 	~ShaderResource();
@@ -227,10 +241,10 @@ public:
 	void setElemParamF( int elem, int elemIdx, int param, int compIdx, float value );
 	const char *getElemParamStr( int elem, int elemIdx, int param );
 
-	ShaderContext *findContext( const std::string &name )
+	ShaderContext *findContext( uint32 nameId )
 	{
 		for( uint32 i = 0; i < _contexts.size(); ++i )
-			if( _contexts[i].id == name ) return &_contexts[i];
+			if( _contexts[i].nameId == nameId ) return &_contexts[i];
 		
 		return 0x0;
 	}
@@ -242,10 +256,18 @@ private:
 	bool raiseError( const std::string &msg, int line = -1 );
 	bool parseFXSection( char *data );
 	void compileCombination( ShaderContext &context, ShaderCombination &sc );
+	ShaderCombination *findCombination( ShaderContext &context, uint32 combMask );
+	ShaderCombination &addCombination( ShaderContext &context, uint32 combMask );
+	void recordCombination( ShaderCombination &sc );
 	
 private:
 	static std::string            _vertPreamble, _fragPreamble;
 	static std::string            _tmpCode0, _tmpCode1;
+	static uint32                 _combIdCounter;
+	static std::map< std::string, uint32 >  _contextIds;
+	static std::map< std::string, std::set< uint32 > >  _manifest;  // Combinations used in this session
+	static std::map< std::string, std::set< uint32 > >  _pendingManifest;  // Precompiled when loaded
+	static std::string            _manifestText;
 	
 	std::vector< ShaderContext >  _contexts;
 	std::vector< ShaderSampler >  _samplers;
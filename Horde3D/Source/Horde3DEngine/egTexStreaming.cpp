@@ -0,0 +1,59 @@
+// *************************************************************************************************
+//
+// Horde3D
+//   Next-Generation Graphics Engine
+// --------------------------------------
+// Copyright (C) 2006-2011 Nicolas Schulz
+//
+// This software is distributed under the terms of the Eclipse Public License v1.0.
+// A copy of the license may be obtained at: http://www.eclipse.org/legal/epl-v10.html
+//
+// *************************************************************************************************
+
+#include "egTexStreaming.h"
+#include <algorithm>
+
+#include "utDebug.h"
+
+
+namespace Horde3D {
+
+uint64 planTexResidency( std::vector< TexStreamingRequest > &requests, uint64 budget )
+{
+	uint64 totalMem = 0;
+	for( size_t i = 0, s = requests.size(); i < s; ++i )
+	{
+		TexStreamingRequest &req = requests[i];
+		req.targetLevel = std::min( req.wantedLevel, req.coarsestLevel );
+		totalMem += req.residentMem[req.targetLevel];
+	}
+
+	if( budget == 0 || totalMem <= budget ) return totalMem;
+
+	// Drop one level of all textures per pass, starting with the least important ones,
+	// until the budget is met; this way quality degrades evenly
+	std::vector< uint32 > order( requests.size() );
+	for( uint32 i = 0; i < (uint32)order.size(); ++i ) order[i] = i;
+	std::sort( order.begin(), order.end(), TexStreamingPriorityCompFunc( requests, false ) );
+
+	bool dropped = true;
+	while( dropped && totalMem > budget )
+	{
+		dropped = false;
+		
+		for( size_t i = 0, s = order.size(); i < s && totalMem > budget; ++i )
+		{
+			TexStreamingRequest &req = requests[order[i]];
+			if( req.targetLevel >= req.coarsestLevel ) continue;
+
+			totalMem -= req.residentMem[req.targetLevel];
+			++req.targetLevel;
+			totalMem += req.residentMem[req.targetLevel];
+			dropped = true;
+		}
+	}
+
+	return totalMem;
+}
+
+}  // namespace
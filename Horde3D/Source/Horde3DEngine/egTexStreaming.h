@@ -0,0 +1,65 @@
+// *************************************************************************************************
+//
+// Horde3D
+//   Next-Generation Graphics Engine
+// --------------------------------------
+// Copyright (C) 2006-2011 Nicolas Schulz
+//
+// This software is distributed under the terms of the Eclipse Public License v1.0.
+// A copy of the license may be obtained at: http://www.eclipse.org/legal/epl-v10.html
+//
+// *************************************************************************************************
+
+#ifndef _egTexStreaming_H_
+#define _egTexStreaming_H_
+
+#include "egPrerequisites.h"
+#include <vector>
+
+
+namespace Horde3D {
+
+const uint32 MaxTexStreamingLevels = 16;
+
+
+// =================================================================================================
+// Texture Residency Planning
+// =================================================================================================
+
+// Streaming state of a texture as seen by the planning; it does not refer to the texture itself,
+// so the budget and priority logic can be used without a GPU
+struct TexStreamingRequest
+{
+	uint32  residentMem[MaxTexStreamingLevels];  // Memory of texture when level i is finest resident level
+	uint32  numLevels;
+	uint32  coarsestLevel;  // Coarsest level that can be the finest resident one
+	uint32  curLevel;  // Finest resident level
+	uint32  wantedLevel;  // Level required by projected size
+	uint32  targetLevel;  // Level chosen by planning
+	float   priority;
+};
+
+
+struct TexStreamingPriorityCompFunc
+{
+	const std::vector< TexStreamingRequest > *requests;
+	bool descending;
+
+	TexStreamingPriorityCompFunc( const std::vector< TexStreamingRequest > &requests, bool descending ) :
+		requests( &requests ), descending( descending ) {}
+
+	bool operator()( uint32 a, uint32 b ) const
+	{
+		float pa = (*requests)[a].priority, pb = (*requests)[b].priority;
+		if( pa != pb ) return descending ? pa > pb : pa < pb;
+		return a < b;  // Keep order deterministic
+	}
+};
+
+
+// Sets the target levels of the requests so that the textures fit into the budget (0 for no limit)
+// and returns the memory they need
+uint64 planTexResidency( std::vector< TexStreamingRequest > &requests, uint64 budget );
+
+}
+#endif // _egTexStreaming_H_
@@ -16,6 +16,7 @@
 #include "egRenderer.h"
 #include "utImage.h"
 #include <cstring>
+#include <algorithm>
 
 #include "utDebug.h"
 
@@ -24,6 +25,61 @@ namespace Horde3D {
 
 using namespace std;
 
+// *************************************************************************************************
+// Class TextureStreamer
+// *************************************************************************************************
+
+void TextureStreamer::addTexture( TextureResource *texRes )
+{
+	_textures.push_back( texRes );
+}
+
+
+void TextureStreamer::removeTexture( TextureResource *texRes )
+{
+	std::vector< TextureResource * >::iterator itr = std::find( _textures.begin(), _textures.end(), texRes );
+	if( itr != _textures.end() ) _textures.erase( itr );
+}
+
+
+void TextureStreamer::update()
+{
+	if( _textures.empty() ) return;
+
+	_requests.resize( _textures.size() );
+	for( size_t i = 0, s = _textures.size(); i < s; ++i )
+	{
+		_textures[i]->fillStreamingRequest( _requests[i] );
+	}
+
+	planTexResidency( _requests, (uint64)(Modules::config().texStreamingBudget * 1024 * 1024) );
+
+	// Apply downgrades first to free memory
+	_upgrades.resize( 0 );
+	for( uint32 i = 0; i < (uint32)_requests.size(); ++i )
+	{
+		if( _requests[i].targetLevel > _requests[i].curLevel )
+			_textures[i]->setResidentLevel( _requests[i].targetLevel );
+		else if( _requests[i].targetLevel < _requests[i].curLevel )
+			_upgrades.push_back( i );
+	}
+
+	// Upload finer levels of the most important textures first; the rest has to wait
+	std::sort( _upgrades.begin(), _upgrades.end(), TexStreamingPriorityCompFunc( _requests, true ) );
+	
+	uint32 uploadedMem = 0;
+	for( size_t i = 0, s = _upgrades.size(); i < s; ++i )
+	{
+		const TexStreamingRequest &req = _requests[_upgrades[i]];
+		uint32 mem = req.residentMem[req.targetLevel];
+		if( uploadedMem > 0 && uploadedMem + mem > TexStreamingUploadLimit ) break;
+
+		_textures[_upgrades[i]]->setResidentLevel( req.targetLevel );
+		uploadedMem += mem;
+	}
+}
+
+
 // *************************************************************************************************
 // Class TextureResource
 // *************************************************************************************************
@@ -76,10 +132,19 @@ int TextureResource::mappedWriteImage = -1;
 uint32 TextureResource::defTex2DObject = 0;
 uint32 TextureResource::defTex3DObject = 0;
 uint32 TextureResource::defTexCubeObject = 0;
+TextureStreamer TextureResource::_streamer;
 
 
 void TextureResource::initializationFunc()
 {
+	// Use the SIMD kernels of the image decoder if the target supports them
+	if( stbi_idct_sse2() != 0x0 )
+	{
+		stbi_install_idct( stbi_idct_sse2() );
+		stbi_install_YCbCr_to_RGB( stbi_YCbCr_to_RGB_sse2() );
+		stbi_install_YCbCr_to_BGR( stbi_YCbCr_to_BGR_sse2() );
+	}
+	
 	unsigned char texData[] = 
 		{ 128,192,255,255, 128,192,255,255, 128,192,255,255, 128,192,255,255,
 		  128,192,255,255, 128,192,255,255, 128,192,255,255, 128,192,255,255,
@@ -118,7 +183,7 @@ void TextureResource::releaseFunc()
 
 
 TextureResource::TextureResource( const string &name, int flags ) :
-	Resource( ResourceTypes::Texture, name, flags )
+	Resource( ResourceTypes::Texture, name, flags ), _streamData( 0x0 )
 {
 	_texType = TextureTypes::Tex2D;
 	initDefault();
@@ -128,7 +193,7 @@ TextureResource::TextureResource( const string &name, int flags ) :
 TextureResource::TextureResource( const string &name, uint32 width, uint32 height, uint32 depth,
                                   TextureFormats::List fmt, int flags ) :
 	Resource( ResourceTypes::Texture, name, flags ),
-	_width( width ), _height( height ), _depth( depth ), _rbObj( 0 )
+	_width( width ), _height( height ), _depth( depth ), _rbObj( 0 ), _streamData( 0x0 )
 {	
 	_loaded = true;
 	_texFormat = fmt;
@@ -191,6 +256,8 @@ void TextureResource::initDefault()
 
 void TextureResource::release()
 {
+	releaseStreamData();
+	
 	if( _rbObj != 0 )
 	{
 		// In this case _texObject is just points to the render buffer
@@ -205,6 +272,16 @@ void TextureResource::release()
 }
 
 
+void TextureResource::releaseStreamData()
+{
+	if( _streamData == 0x0 ) return;
+	
+	_streamer.removeTexture( this );
+	delete[] _streamData; _streamData = 0x0;
+	_streamMipOffsets.clear();
+}
+
+
 bool TextureResource::raiseError( const string &msg )
 {
 	// Reset
@@ -335,9 +412,27 @@ bool TextureResource::loadDDS( const char *data, int size )
 	if( _texFormat == TextureFormats::Unknown )
 		return raiseError( "Unsupported DDS pixel format" );
 
-	// Create texture
-	_texObject = gRDI->createTexture( _texType, _width, _height, _depth, _texFormat,
-	                                  mipCount > 1, false, false, _sRGB );
+	// Textures with a complete mip chain are streamed if a budget is set; in that case the mip
+	// levels are kept in memory and only the smallest ones are uploaded initially
+	if( Modules::config().texStreamingBudget > 0 && _texType == TextureTypes::Tex2D &&
+	    mipCount > 1 && mipCount == getMipCount() + 1 && mipCount <= (int)MaxTexStreamingLevels )
+	{
+		_streamMipOffsets.resize( mipCount + 1 );
+		uint32 offset = 0;
+		for( int j = 0; j < mipCount; ++j )
+		{
+			_streamMipOffsets[j] = offset;
+			offset += gRDI->calcTextureSize( _texFormat, std::max( _width >> j, 1 ), std::max( _height >> j, 1 ), 1 );
+		}
+		_streamMipOffsets[mipCount] = offset;
+		_streamData = new unsigned char[offset];
+	}
+	else
+	{
+		// Create texture
+		_texObject = gRDI->createTexture( _texType, _width, _height, _depth, _texFormat,
+		                                  mipCount > 1, false, false, _sRGB );
+	}
 	
 	// Upload texture subresources
 	int numSlices = _texType == TextureTypes::TexCube ? 6 : 1;
@@ -379,12 +474,18 @@ bool TextureResource::loadDDS( const char *data, int size )
 					for( uint32 k = 0; k < pixCount * 4; k += 4 )
 						*p++ = pixels[k+2] | pixels[k+1]<<8 | pixels[k+0]<<16 | pixels[k+3]<<24;
 				
-				gRDI->uploadTextureData( _texObject, i, j, dstBuf );
+				if( _streamData != 0x0 )
+					memcpy( _streamData + _streamMipOffsets[j], dstBuf, pixCount * 4 );
+				else
+					gRDI->uploadTextureData( _texObject, i, j, dstBuf );
 			}
 			else
 			{
 				// Upload DDS data directly
-				gRDI->uploadTextureData( _texObject, i, j, pixels );
+				if( _streamData != 0x0 )
+					memcpy( _streamData + _streamMipOffsets[j], pixels, mipSize );
+				else
+					gRDI->uploadTextureData( _texObject, i, j, pixels );
 			}
 
 			pixels += mipSize;
@@ -398,45 +499,79 @@ bool TextureResource::loadDDS( const char *data, int size )
 
 	ASSERT( pixels == (unsigned char *)data + size );
 
+	if( _streamData != 0x0 )
+	{
+		// Start with the coarsest levels
+		_streamCoarsestLevel = 0;
+		while( _streamCoarsestLevel + 1 < (uint32)mipCount &&
+		       std::max( _width >> _streamCoarsestLevel, _height >> _streamCoarsestLevel ) > TexStreamingMinSize )
+		{
+			++_streamCoarsestLevel;
+		}
+		_streamWantedLevel = _streamCoarsestLevel;
+		_streamIdleFrames = 0;
+		_streamScreenSize = 0;
+		_streamPriority = 0;
+		
+		setResidentLevel( _streamCoarsestLevel );
+		_streamer.addTexture( this );
+	}
+
 	return true;
 }
 
 
-bool TextureResource::loadSTBI( const char *data, int size )
+struct DecodedImage
 {
-	bool hdr = false;
-	if( stbi_is_hdr_from_memory( (unsigned char *)data, size ) > 0 ) hdr = true;
-	
+	void        *pixels;
+	int         width, height;
+	bool        hdr;
+	const char  *failureReason;
+};
+
+
+void *TextureResource::decode( const char *data, int size )
+{
+	// DDS data is uploaded as it is
+	if( data == 0x0 || size <= 0 || checkDDS( data, size ) ) return 0x0;
+
+	// Note: This can run on a worker thread, so only the image decoder may be used here
+	DecodedImage *img = new DecodedImage();
 	int comps;
-	void *pixels = 0x0;
-	if( hdr )
-		pixels = stbi_loadf_from_memory( (unsigned char *)data, size, &_width, &_height, &comps, 4 );
+	
+	img->hdr = stbi_is_hdr_from_memory( (unsigned char *)data, size ) > 0;
+	if( img->hdr )
+		img->pixels = stbi_loadf_from_memory( (unsigned char *)data, size, &img->width, &img->height, &comps, 4 );
 	else
-		pixels = stbi_load_from_memory( (unsigned char *)data, size, &_width, &_height, &comps, 4 );
-
-	if( pixels == 0x0 )
-		return raiseError( "Invalid image format (" + string( stbi_failure_reason() ) + ")" );
+		img->pixels = stbi_load_bgra_from_memory( (unsigned char *)data, size, &img->width, &img->height, &comps );
 
-	// Swizzle RGBA -> BGRA
-	uint32 *ptr = (uint32 *)pixels;
-	for( uint32 i = 0, si = _width * _height; i < si; ++i )
+	if( img->pixels == 0x0 )
 	{
-		uint32 col = *ptr;
-		*ptr++ = (col & 0xFF00FF00) | ((col & 0x000000FF) << 16) | ((col & 0x00FF0000) >> 16);
+		img->failureReason = stbi_failure_reason();
+		if( img->failureReason == 0x0 ) img->failureReason = "unknown error";
 	}
 	
+	return img;
+}
+
+
+bool TextureResource::loadSTBI( DecodedImage &img )
+{
+	if( img.pixels == 0x0 )
+		return raiseError( "Invalid image format (" + string( img.failureReason ) + ")" );
+
+	_width = img.width;
+	_height = img.height;
 	_depth = 1;
 	_texType = TextureTypes::Tex2D;
-	_texFormat = hdr ? TextureFormats::RGBA16F : TextureFormats::BGRA8;
+	_texFormat = img.hdr ? TextureFormats::RGBA16F : TextureFormats::BGRA8;
 	_sRGB = (_flags & ResourceFlags::TexSRGB) != 0;
 	_hasMipMaps = !(_flags & ResourceFlags::NoTexMipmaps);
 	
 	// Create and upload texture
 	_texObject = gRDI->createTexture( _texType, _width, _height, _depth, _texFormat,
 		_hasMipMaps, _hasMipMaps, !(_flags & ResourceFlags::NoTexCompression), _sRGB );
-	gRDI->uploadTextureData( _texObject, 0, 0, pixels );
-
-	stbi_image_free( pixels );
+	gRDI->uploadTextureData( _texObject, 0, 0, img.pixels );
 
 	return true;
 }
@@ -444,12 +579,84 @@ bool TextureResource::loadSTBI( const char *data, int size )
 
 bool TextureResource::load( const char *data, int size )
 {
-	if( !Resource::load( data, size ) ) return false;
+	return loadDecoded( data, size, _loaded ? 0x0 : decode( data, size ) );
+}
 
-	if( checkDDS( data, size ) )
-		return loadDDS( data, size );
-	else
-		return loadSTBI( data, size );
+
+bool TextureResource::loadDecoded( const char *data, int size, void *decoded )
+{
+	DecodedImage *img = (DecodedImage *)decoded;
+	bool result = Resource::load( data, size );
+	
+	if( result )
+	{
+		if( img != 0x0 )
+			result = loadSTBI( *img );
+		else
+			result = loadDDS( data, size );
+	}
+
+	if( img != 0x0 )
+	{
+		stbi_image_free( img->pixels );
+		delete img;
+	}
+	
+	return result;
+}
+
+
+void TextureResource::fillStreamingRequest( TexStreamingRequest &req )
+{
+	uint32 numLevels = (uint32)_streamMipOffsets.size() - 1;
+	
+	if( _streamScreenSize > 0 )
+	{
+		// Find level where a texel covers about one pixel; one level of margin is added
+		// since the texture mapping of the geometry is not known
+		float level = floorf( log( (float)std::max( _width, _height ) / _streamScreenSize ) / log( 2.0f ) ) - 1;
+		_streamWantedLevel = std::min( (uint32)std::max( ftoi_t( level ), 0 ), _streamCoarsestLevel );
+		_streamPriority = _streamScreenSize;
+		_streamIdleFrames = 0;
+	}
+	else if( ++_streamIdleFrames > TexStreamingKeepFrames )
+	{
+		// Texture was not visible for a while
+		_streamWantedLevel = _streamCoarsestLevel;
+		_streamPriority = 0;
+	}
+	_streamScreenSize = 0;
+
+	for( uint32 i = 0; i < numLevels; ++i )
+	{
+		// Same estimate as used by render device
+		uint32 size = gRDI->calcTextureSize( _texFormat, std::max( _width >> i, 1 ), std::max( _height >> i, 1 ), 1 );
+		req.residentMem[i] = size + ftoi_r( size * 1.0f / 3.0f );
+	}
+	
+	req.numLevels = numLevels;
+	req.coarsestLevel = _streamCoarsestLevel;
+	req.curLevel = _streamLevel;
+	req.wantedLevel = _streamWantedLevel;
+	req.targetLevel = _streamWantedLevel;
+	req.priority = _streamPriority;
+}
+
+
+void TextureResource::setResidentLevel( uint32 level )
+{
+	uint32 numLevels = (uint32)_streamMipOffsets.size() - 1;
+	
+	uint32 texObj = gRDI->createTexture( _texType, std::max( _width >> level, 1 ), std::max( _height >> level, 1 ),
+	                                     1, _texFormat, true, false, false, _sRGB );
+	for( uint32 i = level; i < numLevels; ++i )
+	{
+		gRDI->uploadTextureData( texObj, 0, i - level, _streamData + _streamMipOffsets[i] );
+	}
+
+	if( _texObject != 0 ) gRDI->destroyTexture( _texObject );
+	_texObject = texObj;
+	_streamLevel = level;
 }
 
 
@@ -528,7 +735,16 @@ void *TextureResource::mapStream( int elem, int elemIdx, int stream, bool read,
 			{	
 				int slice = elemIdx / (getMipCount() + 1);
 				int mipLevel = elemIdx % (getMipCount() + 1);
-				gRDI->getTextureData( _texObject, slice, mipLevel, mappedData );
+				if( _streamData != 0x0 )
+				{
+					// Streamed textures keep all levels in memory
+					memcpy( mappedData, _streamData + _streamMipOffsets[mipLevel],
+					        _streamMipOffsets[mipLevel + 1] - _streamMipOffsets[mipLevel] );
+				}
+				else
+				{
+					gRDI->getTextureData( _texObject, slice, mipLevel, mappedData );
+				}
 			}
 
 			if( write )
@@ -552,7 +768,17 @@ void TextureResource::unmapStream()
 		{
 			int slice = mappedWriteImage / (getMipCount() + 1);
 			int mipLevel = mappedWriteImage % (getMipCount() + 1);
-			gRDI->updateTextureData( _texObject, slice, mipLevel, mappedData );
+			if( _streamData != 0x0 )
+			{
+				memcpy( _streamData + _streamMipOffsets[mipLevel], mappedData,
+				        _streamMipOffsets[mipLevel + 1] - _streamMipOffsets[mipLevel] );
+				if( mipLevel >= (int)_streamLevel )
+					gRDI->updateTextureData( _texObject, slice, mipLevel - _streamLevel, mappedData );
+			}
+			else
+			{
+				gRDI->updateTextureData( _texObject, slice, mipLevel, mappedData );
+			}
 			mappedWriteImage = -1;
 		}
 		
@@ -563,4 +789,17 @@ void TextureResource::unmapStream()
 	Resource::unmapStream();
 }
 
+
+void TextureResource::getMemUsage( uint32 &cpuMem, uint32 &gpuMem )
+{
+	cpuMem = _streamData != 0x0 ? _streamMipOffsets.back() : 0;
+	gpuMem = 0;
+
+	if( _texObject != 0 && _texObject != defTex2DObject && _texObject != defTex3DObject &&
+	    _texObject != defTexCubeObject )
+	{
+		gpuMem = (uint32)gRDI->getTexture( _texObject ).memSize;
+	}
+}
+
 }  // namespace
@@ -16,11 +16,36 @@
 #include "egPrerequisites.h"
 #include "egResource.h"
 #include "egRendererBase.h"
+#include "egTexStreaming.h"
 
 
 namespace Horde3D {
 
 struct RenderBuffer;
+class TextureResource;
+
+const int TexStreamingMinSize = 64;  // Mip levels up to this size are always resident
+const uint32 TexStreamingKeepFrames = 60;  // Frames a texture keeps its resolution when it is not visible
+const uint32 TexStreamingUploadLimit = 8 * 1024*1024;  // Max bytes of texture data uploaded per frame
+
+
+// =================================================================================================
+// Texture Streamer
+// =================================================================================================
+
+class TextureStreamer
+{
+public:
+	void addTexture( TextureResource *texRes );
+	void removeTexture( TextureResource *texRes );
+	void update();
+	bool isActive() const { return !_textures.empty(); }
+
+protected:
+	std::vector< TextureResource * >    _textures;
+	std::vector< TexStreamingRequest >  _requests;
+	std::vector< uint32 >               _upgrades;
+};
 
 
 // =================================================================================================
@@ -43,6 +68,8 @@ struct TextureResData
 
 // =================================================================================================
 
+struct DecodedImage;
+
 class TextureResource : public Resource
 {
 public:
@@ -59,11 +86,14 @@ public:
 	void initDefault();
 	void release();
 	bool load( const char *data, int size );
+	void *decode( const char *data, int size );
+	bool loadDecoded( const char *data, int size, void *decoded );
 
 	int getElemCount( int elem );
 	int getElemParamI( int elem, int elemIdx, int param );
 	void *mapStream( int elem, int elemIdx, int stream, bool read, bool write );
 	void unmapStream();
+	void getMemUsage( uint32 &cpuMem, uint32 &gpuMem );
 
 	TextureTypes::List getTexType() { return _texType; }
 	TextureFormats::List getTexFormat() { return _texFormat; }
@@ -73,6 +103,11 @@ public:
 	uint32 getTexObject() { return _texObject; }
 	uint32 getRBObject()  { return _rbObj; }
 	bool hasMipMaps() { return _hasMipMaps; }
+	bool isStreamed() { return _streamData != 0x0; }
+	void requestStreaming( float screenSize )
+		{ if( screenSize > _streamScreenSize ) _streamScreenSize = screenSize; }
+
+	static TextureStreamer &getStreamer() { return _streamer; }
 
 public:
 	static uint32 defTex2DObject;
@@ -83,12 +118,16 @@ protected:
 	bool raiseError( const std::string &msg );
 	bool checkDDS( const char *data, int size );
 	bool loadDDS( const char *data, int size );
-	bool loadSTBI( const char *data, int size );
+	bool loadSTBI( DecodedImage &img );
 	int getMipCount();
+	void releaseStreamData();
+	void fillStreamingRequest( TexStreamingRequest &req );
+	void setResidentLevel( uint32 level );
 	
 protected:
 	static unsigned char  *mappedData;
 	static int            mappedWriteImage;
+	static TextureStreamer  _streamer;
 	
 	TextureTypes::List    _texType;
 	TextureFormats::List  _texFormat;
@@ -98,7 +137,15 @@ protected:
 	bool                  _sRGB;
 	bool                  _hasMipMaps;
 
+	unsigned char         *_streamData;  // CPU copy of all mip levels if texture is streamed
+	std::vector< uint32 > _streamMipOffsets;
+	uint32                _streamLevel;  // Finest resident mip level
+	uint32                _streamCoarsestLevel, _streamWantedLevel;
+	uint32                _streamIdleFrames;
+	float                 _streamScreenSize, _streamPriority;
+
 	friend class ResourceManager;
+	friend class TextureStreamer;
 };
 
 typedef SmartResPtr< TextureResource > PTextureResource;
@@ -0,0 +1,160 @@
+// *************************************************************************************************
+//
+// Horde3D
+//   Next-Generation Graphics Engine
+// --------------------------------------
+// Copyright (C) 2006-2011 Nicolas Schulz
+//
+// This software is distributed under the terms of the Eclipse Public License v1.0.
+// A copy of the license may be obtained at: http://www.eclipse.org/legal/epl-v10.html
+//
+// *************************************************************************************************
+
+#include "egVisibility.h"
+
+#include "utDebug.h"
+
+
+namespace Horde3D {
+
+using namespace std;
+
+// =================================================================================================
+// Visibility Buffer
+// =================================================================================================
+
+// The proxies of all occlusion tests of a frame are drawn with queries from a per-frame pool. At the
+// end of the frame a fence is inserted and the results are read back once the GPU has passed it, so
+// the CPU never waits for the GPU and visibility lags one or two frames behind.
+
+VisibilityBuffer::VisibilityBuffer( OcclusionDevice &device ) :
+	_device( &device ), _curBatch( 0 )
+{
+}
+
+
+VisibilityBuffer::~VisibilityBuffer()
+{
+	for( uint32 i = 0; i < MaxOccTestFrames; ++i )
+	{
+		for( size_t j = 0, s = _batches[i].queries.size(); j < s; ++j )
+			_device->destroyQuery( _batches[i].queries[j] );
+		_device->destroyFence( _batches[i].fence );
+	}
+}
+
+
+VisibilityEntry &VisibilityBuffer::getEntry( int occSet, uint32 slot )
+{
+	ASSERT( occSet >= 0 );
+	
+	if( (uint32)occSet >= _entries.size() ) _entries.resize( occSet + 1 );
+	std::vector< VisibilityEntry > &entries = _entries[occSet];
+	if( slot >= entries.size() ) entries.resize( slot + 1 );
+
+	return entries[slot];
+}
+
+
+bool VisibilityBuffer::markTested( int occSet, uint32 slot, uint32 frameID )
+{
+	// Returns false if the slot was already tested in the current frame
+	VisibilityEntry &entry = getEntry( occSet, slot );
+	if( entry.testFrame == frameID ) return false;
+
+	entry.testFrame = frameID;
+	return true;
+}
+
+
+uint32 VisibilityBuffer::addTest( int occSet, uint32 slot )
+{
+	// Returns the query object that has to enclose the proxy drawing
+	OccTestBatch &batch = _batches[_curBatch];
+	
+	if( batch.tests.size() == batch.queries.size() )
+		batch.queries.push_back( _device->createOcclusionQuery() );
+	batch.tests.push_back( OccTest( occSet, slot, getEntry( occSet, slot ).generation ) );
+	
+	return batch.queries[batch.tests.size() - 1];
+}
+
+
+bool VisibilityBuffer::isBatchFinished( OccTestBatch &batch )
+{
+	// Without sync objects the last query of the batch is used as fence
+	if( batch.fence != 0 ) return _device->isFenceSignaled( batch.fence );
+	else return _device->isQueryResultAvailable( batch.queries[batch.tests.size() - 1] );
+}
+
+
+void VisibilityBuffer::readResults( OccTestBatch &batch )
+{
+	for( size_t i = 0, s = batch.tests.size(); i < s; ++i )
+	{
+		const OccTest &test = batch.tests[i];
+		VisibilityEntry &entry = getEntry( test.occSet, test.slot );
+
+		if( entry.generation == test.generation )
+			entry.occluded = _device->getQueryResult( batch.queries[i] ) < 1;
+	}
+
+	_device->destroyFence( batch.fence );
+	batch.fence = 0;
+	batch.tests.resize( 0 );
+	batch.pending = false;
+}
+
+
+void VisibilityBuffer::finishFrame()
+{
+	OccTestBatch &batch = _batches[_curBatch];
+	if( !batch.tests.empty() )
+	{
+		batch.fence = _device->createFence();
+		batch.pending = true;
+	}
+	_curBatch = (_curBatch + 1) % MaxOccTestFrames;
+
+	// Read back finished batches from oldest to newest, so that newer results take precedence. The
+	// oldest batch is reused in the next frame and is read even if the GPU has not finished it yet.
+	for( uint32 i = 0; i < MaxOccTestFrames; ++i )
+	{
+		OccTestBatch &b = _batches[(_curBatch + i) % MaxOccTestFrames];
+		if( !b.pending ) continue;
+		if( i > 0 && !isBatchFinished( b ) ) break;
+
+		readResults( b );
+	}
+}
+
+
+void VisibilityBuffer::resetSlot( uint32 slot )
+{
+	for( size_t i = 0, s = _entries.size(); i < s; ++i )
+	{
+		if( slot < _entries[i].size() )
+		{
+			VisibilityEntry &entry = _entries[i][slot];
+			entry.testFrame = 0;
+			entry.occluded = false;
+			++entry.generation;
+		}
+	}
+}
+
+
+void VisibilityBuffer::resetSet( int occSet )
+{
+	if( occSet < 0 || occSet >= (int)_entries.size() ) return;
+	
+	std::vector< VisibilityEntry > &entries = _entries[occSet];
+	for( size_t i = 0, s = entries.size(); i < s; ++i )
+	{
+		entries[i].testFrame = 0;
+		entries[i].occluded = false;
+		++entries[i].generation;
+	}
+}
+
+}  // namespace
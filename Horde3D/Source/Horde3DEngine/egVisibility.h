@@ -0,0 +1,114 @@
+// *************************************************************************************************
+//
+// Horde3D
+//   Next-Generation Graphics Engine
+// --------------------------------------
+// Copyright (C) 2006-2011 Nicolas Schulz
+//
+// This software is distributed under the terms of the Eclipse Public License v1.0.
+// A copy of the license may be obtained at: http://www.eclipse.org/legal/epl-v10.html
+//
+// *************************************************************************************************
+
+#ifndef _egVisibility_H_
+#define _egVisibility_H_
+
+#include "egPrerequisites.h"
+#include <vector>
+
+
+namespace Horde3D {
+
+const uint32 MaxOccTestFrames = 3;  // Frames whose occlusion results can be in flight
+
+
+// =================================================================================================
+// Occlusion Device
+// =================================================================================================
+
+// Queries and fences used by the visibility buffer; the renderer forwards them to the render
+// device, tests can provide a fake implementation
+class OcclusionDevice
+{
+public:
+	virtual ~OcclusionDevice() {}
+
+	virtual uint32 createOcclusionQuery() = 0;
+	virtual void destroyQuery( uint32 queryObj ) = 0;
+	virtual uint32 getQueryResult( uint32 queryObj ) = 0;
+	virtual bool isQueryResultAvailable( uint32 queryObj ) = 0;
+
+	// createFence may return 0 if fences are not supported
+	virtual uint32 createFence() = 0;
+	virtual void destroyFence( uint32 fenceObj ) = 0;
+	virtual bool isFenceSignaled( uint32 fenceObj ) = 0;
+};
+
+
+// =================================================================================================
+// Visibility Buffer
+// =================================================================================================
+
+struct VisibilityEntry
+{
+	uint32  testFrame;   // Frame in which the last occlusion test was issued
+	uint32  generation;  // Incremented when the slot is reset, invalidates tests in flight
+	bool    occluded;    // Latest result that was read back
+	
+	VisibilityEntry() : testFrame( 0 ), generation( 0 ), occluded( false ) {}
+};
+
+struct OccTest
+{
+	uint32  occSet, slot, generation;
+
+	OccTest() {}
+	OccTest( uint32 occSet, uint32 slot, uint32 generation ) :
+		occSet( occSet ), slot( slot ), generation( generation )
+	{
+	}
+};
+
+struct OccTestBatch  // Occlusion tests issued during one frame
+{
+	std::vector< OccTest >  tests;
+	std::vector< uint32 >   queries;  // Query pool, the first tests.size() objects are in use
+	uint32                  fence;
+	bool                    pending;  // Results were not read back yet
+	
+	OccTestBatch() : fence( 0 ), pending( false ) {}
+};
+
+class VisibilityBuffer
+{
+public:
+	explicit VisibilityBuffer( OcclusionDevice &device );
+	~VisibilityBuffer();
+
+	bool isOccluded( int occSet, uint32 slot ) { return getEntry( occSet, slot ).occluded; }
+	bool markTested( int occSet, uint32 slot, uint32 frameID );
+	void setVisible( int occSet, uint32 slot ) { getEntry( occSet, slot ).occluded = false; }
+	uint32 addTest( int occSet, uint32 slot );
+	void finishFrame();
+
+	void resetSlot( uint32 slot );
+	void resetSet( int occSet );
+
+protected:
+	VisibilityEntry &getEntry( int occSet, uint32 slot );
+	bool isBatchFinished( OccTestBatch &batch );
+	void readResults( OccTestBatch &batch );
+
+private:
+	VisibilityBuffer( const VisibilityBuffer & );
+	VisibilityBuffer &operator=( const VisibilityBuffer & );
+
+protected:
+	OcclusionDevice                                *_device;
+	std::vector< std::vector< VisibilityEntry > >  _entries;  // Per occlusion set, indexed by node slot
+	OccTestBatch                                   _batches[MaxOccTestFrames];
+	uint32                                         _curBatch;
+};
+
+}
+#endif // _egVisibility_H_
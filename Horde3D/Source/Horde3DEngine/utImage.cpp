@@ -11,6 +11,7 @@
 // *************************************************************************************************
 
 #include "utImage.h"
+#include "utMath.h"
 
 
 /* stbi-1.29 - public domain JPEG/PNG reader - http://nothings.org/stb_image.c
@@ -100,6 +101,18 @@
 #include <assert.h>
 #include <stdarg.h>
 
+#if defined(STBI_SIMD) && defined(H3D_SIMD_SSE2)
+#define STBI_SSE2
+#endif
+
+#ifdef _MSC_VER
+#define STBI_THREAD_LOCAL      __declspec(thread)
+#define STBI_ALIGN16(decl)     __declspec(align(16)) decl
+#else
+#define STBI_THREAD_LOCAL      __thread
+#define STBI_ALIGN16(decl)     decl __attribute__((aligned(16)))
+#endif
+
 
 namespace Horde3D {
 
@@ -238,8 +251,8 @@ extern int      stbi_gif_info_from_file   (FILE *f,                  int *x, int
 #endif
 
 
-// this is not threadsafe
-static const char *failure_reason;
+// kept per thread so that images can be decoded in parallel
+static STBI_THREAD_LOCAL const char *failure_reason;
 
 const char *stbi_failure_reason(void)
 {
@@ -295,6 +308,9 @@ static float   *ldr_to_hdr(stbi_uc *data, int x, int y, int comp);
 static stbi_uc *hdr_to_ldr(float   *data, int x, int y, int comp);
 #endif
 
+static stbi_uc *jpeg_load_from_memory(stbi_uc const *buffer, int len, int *x, int *y, int *comp, int req_comp, int bgr);
+static stbi_uc *tga_load_from_memory(stbi_uc const *buffer, int len, int *x, int *y, int *comp, int req_comp, int bgr);
+
 #ifndef STBI_NO_STDIO
 unsigned char *stbi_load(char const *filename, int *x, int *y, int *comp, int req_comp)
 {
@@ -333,30 +349,66 @@ unsigned char *stbi_load_from_file(FILE *f, int *x, int *y, int *comp, int req_c
 }
 #endif
 
-unsigned char *stbi_load_from_memory(stbi_uc const *buffer, int len, int *x, int *y, int *comp, int req_comp)
+static void rgba_to_bgra(stbi_uc *data, int count)
+{
+   int i = 0;
+   #ifdef STBI_SSE2
+   __m128i ga_mask = _mm_set1_epi32(0xff00ff00);
+   for (; i+4 <= count; i += 4) {
+      __m128i col = _mm_loadu_si128((__m128i *) (data + i*4));
+      __m128i rb = _mm_andnot_si128(ga_mask, col);
+      // exchange r and b by swapping the 16-bit halves of every pixel
+      rb = _mm_shufflehi_epi16(_mm_shufflelo_epi16(rb, 0xb1), 0xb1);
+      _mm_storeu_si128((__m128i *) (data + i*4), _mm_or_si128(_mm_and_si128(col, ga_mask), rb));
+   }
+   #endif
+   for (; i < count; ++i) {
+      stbi_uc t = data[i*4+0];
+      data[i*4+0] = data[i*4+2];
+      data[i*4+2] = t;
+   }
+}
+
+static unsigned char *load_from_memory(stbi_uc const *buffer, int len, int *x, int *y, int *comp, int req_comp, int bgr)
 {
    int i;
-   if (stbi_jpeg_test_memory(buffer,len)) return stbi_jpeg_load_from_memory(buffer,len,x,y,comp,req_comp);
-   if (stbi_png_test_memory(buffer,len))  return stbi_png_load_from_memory(buffer,len,x,y,comp,req_comp);
-   if (stbi_bmp_test_memory(buffer,len))  return stbi_bmp_load_from_memory(buffer,len,x,y,comp,req_comp);
-   if (stbi_gif_test_memory(buffer,len))  return stbi_gif_load_from_memory(buffer,len,x,y,comp,req_comp);
-   if (stbi_psd_test_memory(buffer,len))  return stbi_psd_load_from_memory(buffer,len,x,y,comp,req_comp);
-   if (stbi_pic_test_memory(buffer,len))  return stbi_pic_load_from_memory(buffer,len,x,y,comp,req_comp);
-
+   unsigned char *result = NULL;
+   if (stbi_jpeg_test_memory(buffer,len)) return jpeg_load_from_memory(buffer,len,x,y,comp,req_comp,bgr);
+   if (stbi_png_test_memory(buffer,len))  result = stbi_png_load_from_memory(buffer,len,x,y,comp,req_comp);
+   else if (stbi_bmp_test_memory(buffer,len))  result = stbi_bmp_load_from_memory(buffer,len,x,y,comp,req_comp);
+   else if (stbi_gif_test_memory(buffer,len))  result = stbi_gif_load_from_memory(buffer,len,x,y,comp,req_comp);
+   else if (stbi_psd_test_memory(buffer,len))  result = stbi_psd_load_from_memory(buffer,len,x,y,comp,req_comp);
+   else if (stbi_pic_test_memory(buffer,len))  result = stbi_pic_load_from_memory(buffer,len,x,y,comp,req_comp);
    #ifndef STBI_NO_HDR
-   if (stbi_hdr_test_memory(buffer, len)) {
+   else if (stbi_hdr_test_memory(buffer, len)) {
       float *hdr = stbi_hdr_load_from_memory(buffer, len,x,y,comp,req_comp);
-      return hdr_to_ldr(hdr, *x, *y, req_comp ? req_comp : *comp);
+      result = hdr_to_ldr(hdr, *x, *y, req_comp ? req_comp : *comp);
    }
    #endif
+   else {
+      for (i=0; i < max_loaders; ++i)
+         if (loaders[i]->test_memory(buffer,len))
+            break;
+      if (i < max_loaders)
+         result = loaders[i]->load_from_memory(buffer,len,x,y,comp,req_comp);
+      // test tga last because it's a crappy test!
+      else if (stbi_tga_test_memory(buffer,len))
+         return tga_load_from_memory(buffer,len,x,y,comp,req_comp,bgr);
+      else
+         return epuc("unknown image type", "Image not of any known type, or corrupt");
+   }
+   if (result && bgr) rgba_to_bgra(result, *x * *y);
+   return result;
+}
 
-   for (i=0; i < max_loaders; ++i)
-      if (loaders[i]->test_memory(buffer,len))
-         return loaders[i]->load_from_memory(buffer,len,x,y,comp,req_comp);
-   // test tga last because it's a crappy test!
-   if (stbi_tga_test_memory(buffer,len))
-      return stbi_tga_load_from_memory(buffer,len,x,y,comp,req_comp);
-   return epuc("unknown image type", "Image not of any known type, or corrupt");
+unsigned char *stbi_load_bgra_from_memory(stbi_uc const *buffer, int len, int *x, int *y, int *comp)
+{
+   return load_from_memory(buffer,len,x,y,comp,4,1);
+}
+
+unsigned char *stbi_load_from_memory(stbi_uc const *buffer, int len, int *x, int *y, int *comp, int req_comp)
+{
+   return load_from_memory(buffer,len,x,y,comp,req_comp,0);
 }
 
 #ifndef STBI_NO_HDR
@@ -474,6 +526,7 @@ typedef struct
    int from_file;
    #endif
    uint8 *img_buffer, *img_buffer_end;
+   int bgr;  // output 4-component images in the order b,g,r,a
 } stbi;
 
 #ifndef STBI_NO_STDIO
@@ -484,6 +537,7 @@ static void start_file(stbi *s, FILE *f)
    s->img_buffer_end = s->buffer_start + s->buflen;
    s->img_buffer = s->img_buffer_end;
    s->from_file = 1;
+   s->bgr = 0;
 }
 #endif
 
@@ -495,6 +549,7 @@ static void start_mem(stbi *s, uint8 const *buffer, int len)
 #endif
    s->img_buffer = (uint8 *) buffer;
    s->img_buffer_end = (uint8 *) buffer+len;
+   s->bgr = 0;
 }
 
 #ifndef STBI_NO_STDIO
@@ -1108,6 +1163,147 @@ extern void stbi_install_idct(stbi_idct_8x8 func)
 }
 #endif
 
+#ifdef STBI_SSE2
+// SSE2 version of idct_block: each pass transforms all eight columns (rows) at once. The
+// multiplications are done with pmaddwd on pairs of inputs, with the constants of IDCT_1D
+// folded so that the 32-bit results are exactly the ones of the generic code. Coefficients
+// and intermediate values are kept in 16 bits, which is sufficient for valid baseline jpegs.
+
+typedef struct
+{
+   __m128i l, h;
+} dct_wide;
+
+static __forceinline __m128i dct_const(int c0, int c1)
+{
+   return _mm_setr_epi16((short)c0, (short)c1, (short)c0, (short)c1,
+                         (short)c0, (short)c1, (short)c0, (short)c1);
+}
+
+// a*c0 + b*c1 for all eight lanes as 32-bit values
+static __forceinline dct_wide dct_rot(__m128i a, __m128i b, __m128i c)
+{
+   dct_wide r;
+   r.l = _mm_madd_epi16(_mm_unpacklo_epi16(a, b), c);
+   r.h = _mm_madd_epi16(_mm_unpackhi_epi16(a, b), c);
+   return r;
+}
+
+// sign-extends to 32 bits and scales by 4096 like fsh
+static __forceinline dct_wide dct_widen(__m128i a)
+{
+   dct_wide r;
+   r.l = _mm_srai_epi32(_mm_unpacklo_epi16(_mm_setzero_si128(), a), 4);
+   r.h = _mm_srai_epi32(_mm_unpackhi_epi16(_mm_setzero_si128(), a), 4);
+   return r;
+}
+
+static __forceinline dct_wide dct_add(dct_wide a, dct_wide b)
+{
+   dct_wide r;
+   r.l = _mm_add_epi32(a.l, b.l);
+   r.h = _mm_add_epi32(a.h, b.h);
+   return r;
+}
+
+static __forceinline dct_wide dct_sub(dct_wide a, dct_wide b)
+{
+   dct_wide r;
+   r.l = _mm_sub_epi32(a.l, b.l);
+   r.h = _mm_sub_epi32(a.h, b.h);
+   return r;
+}
+
+// (a + b) >> shift and (a - b) >> shift, saturated to 16 bits
+static __forceinline void dct_bfly(__m128i *out0, __m128i *out1, dct_wide a, dct_wide b, __m128i shift)
+{
+   dct_wide sum = dct_add(a, b), dif = dct_sub(a, b);
+   *out0 = _mm_packs_epi32(_mm_sra_epi32(sum.l, shift), _mm_sra_epi32(sum.h, shift));
+   *out1 = _mm_packs_epi32(_mm_sra_epi32(dif.l, shift), _mm_sra_epi32(dif.h, shift));
+}
+
+static __forceinline void dct_pass(__m128i r[8], int bias, int shift)
+{
+   dct_wide t0, t1, t2, t3, x0, x1, x2, x3, y0, y1, y2, y3, y4, y5;
+   dct_wide b;
+   __m128i sh = _mm_cvtsi32_si128(shift);
+   b.l = b.h = _mm_set1_epi32(bias);
+
+   // even part
+   t2 = dct_rot(r[2], r[6], dct_const(f2f(0.5411961f), f2f(0.5411961f) + f2f(-1.847759065f)));
+   t3 = dct_rot(r[2], r[6], dct_const(f2f(0.5411961f) + f2f( 0.765366865f), f2f(0.5411961f)));
+   t0 = dct_add(dct_widen(_mm_add_epi16(r[0], r[4])), b);
+   t1 = dct_add(dct_widen(_mm_sub_epi16(r[0], r[4])), b);
+   x0 = dct_add(t0, t3);
+   x3 = dct_sub(t0, t3);
+   x1 = dct_add(t1, t2);
+   x2 = dct_sub(t1, t2);
+
+   // odd part
+   y0 = dct_rot(r[7], r[3], dct_const(f2f(-1.961570560f) + f2f( 0.298631336f), f2f(-1.961570560f)));
+   y2 = dct_rot(r[7], r[3], dct_const(f2f(-1.961570560f), f2f(-1.961570560f) + f2f( 3.072711026f)));
+   y1 = dct_rot(r[5], r[1], dct_const(f2f(-0.390180644f) + f2f( 2.053119869f), f2f(-0.390180644f)));
+   y3 = dct_rot(r[5], r[1], dct_const(f2f(-0.390180644f), f2f(-0.390180644f) + f2f( 1.501321110f)));
+   y4 = dct_rot(_mm_add_epi16(r[1], r[7]), _mm_add_epi16(r[3], r[5]),
+                dct_const(f2f( 1.175875602f) + f2f(-0.899976223f), f2f( 1.175875602f)));
+   y5 = dct_rot(_mm_add_epi16(r[1], r[7]), _mm_add_epi16(r[3], r[5]),
+                dct_const(f2f( 1.175875602f), f2f( 1.175875602f) + f2f(-2.562915447f)));
+
+   dct_bfly(&r[0], &r[7], x0, dct_add(y3, y4), sh);
+   dct_bfly(&r[1], &r[6], x1, dct_add(y2, y5), sh);
+   dct_bfly(&r[2], &r[5], x2, dct_add(y1, y5), sh);
+   dct_bfly(&r[3], &r[4], x3, dct_add(y0, y4), sh);
+}
+
+static __forceinline void dct_transpose(__m128i r[8])
+{
+   __m128i a0 = _mm_unpacklo_epi16(r[0], r[1]), a1 = _mm_unpackhi_epi16(r[0], r[1]);
+   __m128i a2 = _mm_unpacklo_epi16(r[2], r[3]), a3 = _mm_unpackhi_epi16(r[2], r[3]);
+   __m128i a4 = _mm_unpacklo_epi16(r[4], r[5]), a5 = _mm_unpackhi_epi16(r[4], r[5]);
+   __m128i a6 = _mm_unpacklo_epi16(r[6], r[7]), a7 = _mm_unpackhi_epi16(r[6], r[7]);
+   __m128i b0 = _mm_unpacklo_epi32(a0, a2), b1 = _mm_unpackhi_epi32(a0, a2);
+   __m128i b2 = _mm_unpacklo_epi32(a1, a3), b3 = _mm_unpackhi_epi32(a1, a3);
+   __m128i b4 = _mm_unpacklo_epi32(a4, a6), b5 = _mm_unpackhi_epi32(a4, a6);
+   __m128i b6 = _mm_unpacklo_epi32(a5, a7), b7 = _mm_unpackhi_epi32(a5, a7);
+   r[0] = _mm_unpacklo_epi64(b0, b4); r[1] = _mm_unpackhi_epi64(b0, b4);
+   r[2] = _mm_unpacklo_epi64(b1, b5); r[3] = _mm_unpackhi_epi64(b1, b5);
+   r[4] = _mm_unpacklo_epi64(b2, b6); r[5] = _mm_unpackhi_epi64(b2, b6);
+   r[6] = _mm_unpacklo_epi64(b3, b7); r[7] = _mm_unpackhi_epi64(b3, b7);
+}
+
+static void idct_block_sse2(uint8 *out, int out_stride, short data[64], unsigned short *dequantize)
+{
+   __m128i r[8];
+   int i;
+
+   for (i=0; i < 8; ++i)
+      r[i] = _mm_mullo_epi16(_mm_loadu_si128((__m128i *) (data + i*8)),
+                             _mm_loadu_si128((__m128i *) (dequantize + i*8)));
+
+   // columns; same rounding and scaling as in idct_block
+   dct_pass(r, 512, 10);
+   dct_transpose(r);
+   // rows, including the level shift by 128
+   dct_pass(r, 65536 + (128<<17), 17);
+   dct_transpose(r);
+
+   for (i=0; i < 8; i += 2) {
+      __m128i p = _mm_packus_epi16(r[i], r[i+1]);
+      _mm_storel_epi64((__m128i *) (out + i*out_stride), p);
+      _mm_storel_epi64((__m128i *) (out + (i+1)*out_stride), _mm_srli_si128(p, 8));
+   }
+}
+#endif
+
+stbi_idct_8x8 stbi_idct_sse2(void)
+{
+   #ifdef STBI_SSE2
+   return idct_block_sse2;
+   #else
+   return NULL;
+   #endif
+}
+
 #define MARKER_none  0xff
 // if there's a pending marker from the entropy stream, return that
 // otherwise, fetch from the stream and get a marker. if there's no
@@ -1146,10 +1342,7 @@ static int parse_entropy_coded_data(jpeg *z)
    reset(z);
    if (z->scan_n == 1) {
       int i,j;
-      #ifdef STBI_SIMD
-      __declspec(align(16))
-      #endif
-      short data[64];
+      STBI_ALIGN16(short data[64]);
       int n = z->order[0];
       // non-interleaved data, we just need to process one block at a time,
       // in trivial scanline order
@@ -1177,7 +1370,7 @@ static int parse_entropy_coded_data(jpeg *z)
       }
    } else { // interleaved!
       int i,j,k,x,y;
-      short data[64];
+      STBI_ALIGN16(short data[64]);
       for (j=0; j < z->img_mcu_y; ++j) {
          for (i=0; i < z->img_mcu_x; ++i) {
             // scan an interleaved mcu... process scan_n components in order
@@ -1533,7 +1726,7 @@ static uint8 *resample_row_generic(uint8 *out, uint8 *in_near, uint8 * /*in_far*
 
 // 0.38 seconds on 3*anemones.jpg   (0.25 with processor = Pro)
 // VC6 without processor=Pro is generating multiple LEAs per multiply!
-static void YCbCr_to_RGB_row(uint8 *out, const uint8 *y, const uint8 *pcb, const uint8 *pcr, int count, int step)
+static __forceinline void YCbCr_convert_row(uint8 *out, const uint8 *y, const uint8 *pcb, const uint8 *pcr, int count, int step, int bgr)
 {
    int i;
    for (i=0; i < count; ++i) {
@@ -1550,23 +1743,118 @@ static void YCbCr_to_RGB_row(uint8 *out, const uint8 *y, const uint8 *pcb, const
       if ((unsigned) r > 255) { if (r < 0) r = 0; else r = 255; }
       if ((unsigned) g > 255) { if (g < 0) g = 0; else g = 255; }
       if ((unsigned) b > 255) { if (b < 0) b = 0; else b = 255; }
-      out[0] = (uint8)r;
+      out[bgr ? 2 : 0] = (uint8)r;
       out[1] = (uint8)g;
-      out[2] = (uint8)b;
+      out[bgr ? 0 : 2] = (uint8)b;
       out[3] = 255;
       out += step;
    }
 }
 
+static void YCbCr_to_RGB_row(uint8 *out, const uint8 *y, const uint8 *pcb, const uint8 *pcr, int count, int step)
+{
+   YCbCr_convert_row(out, y, pcb, pcr, count, step, 0);
+}
+
+static void YCbCr_to_BGR_row(uint8 *out, const uint8 *y, const uint8 *pcb, const uint8 *pcr, int count, int step)
+{
+   YCbCr_convert_row(out, y, pcb, pcr, count, step, 1);
+}
+
 #ifdef STBI_SIMD
 static stbi_YCbCr_to_RGB_run stbi_YCbCr_installed = YCbCr_to_RGB_row;
+static stbi_YCbCr_to_RGB_run stbi_YCbCr_BGR_installed = YCbCr_to_BGR_row;
 
 void stbi_install_YCbCr_to_RGB(stbi_YCbCr_to_RGB_run func)
 {
    stbi_YCbCr_installed = func;
 }
+
+void stbi_install_YCbCr_to_BGR(stbi_YCbCr_to_RGB_run func)
+{
+   stbi_YCbCr_BGR_installed = func;
+}
 #endif
 
+#ifdef STBI_SSE2
+// SSE2 version of YCbCr_convert_row for 4-component output. Factors above 1 are split
+// into a multiple of 1<<16, which is added to y directly, and a remainder that fits into
+// 16 bits for pmaddwd; since the split-off part is a multiple of 1<<16, shifting the sum
+// gives exactly the same result as the generic code.
+#define YCC_PAIR(a,b)  (short)(a),(short)(b),(short)(a),(short)(b),(short)(a),(short)(b),(short)(a),(short)(b)
+
+static __forceinline void YCbCr_convert_row_sse2(uint8 *out, const uint8 *y, const uint8 *pcb, const uint8 *pcr, int count, int step, int bgr)
+{
+   int i = 0;
+   if (step == 4) {
+      __m128i zero = _mm_setzero_si128();
+      __m128i bias = _mm_set1_epi16(128);
+      __m128i round = _mm_set1_epi32(32768);
+      __m128i alpha = _mm_set1_epi8((char)255);
+      // factors for the (cr,cb) pairs
+      __m128i kr = _mm_setr_epi16(YCC_PAIR(float2fixed(1.40200f) - (1<<16), 0));
+      __m128i kg = _mm_setr_epi16(YCC_PAIR((1<<16) - float2fixed(0.71414f), -float2fixed(0.34414f)));
+      __m128i kb = _mm_setr_epi16(YCC_PAIR(0, float2fixed(1.77200f) - (2<<16)));
+
+      for (; i+8 <= count; i += 8) {
+         __m128i yv = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *) (y + i)), zero);
+         __m128i cb = _mm_sub_epi16(_mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *) (pcb + i)), zero), bias);
+         __m128i cr = _mm_sub_epi16(_mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *) (pcr + i)), zero), bias);
+         __m128i crcb_l = _mm_unpacklo_epi16(cr, cb);
+         __m128i crcb_h = _mm_unpackhi_epi16(cr, cb);
+         __m128i r, g, b, rg, ba;
+
+         #define YCC_TERM(k) _mm_packs_epi32( \
+            _mm_srai_epi32(_mm_add_epi32(_mm_madd_epi16(crcb_l, k), round), 16), \
+            _mm_srai_epi32(_mm_add_epi32(_mm_madd_epi16(crcb_h, k), round), 16))
+         r = _mm_add_epi16(_mm_add_epi16(yv, cr), YCC_TERM(kr));
+         g = _mm_add_epi16(_mm_sub_epi16(yv, cr), YCC_TERM(kg));
+         b = _mm_add_epi16(_mm_add_epi16(yv, _mm_add_epi16(cb, cb)), YCC_TERM(kb));
+         #undef YCC_TERM
+
+         // clamp to 0..255 and interleave
+         r = _mm_packus_epi16(r, r);
+         g = _mm_packus_epi16(g, g);
+         b = _mm_packus_epi16(b, b);
+         rg = _mm_unpacklo_epi8(bgr ? b : r, g);
+         ba = _mm_unpacklo_epi8(bgr ? r : b, alpha);
+         _mm_storeu_si128((__m128i *) out, _mm_unpacklo_epi16(rg, ba));
+         _mm_storeu_si128((__m128i *) (out + 16), _mm_unpackhi_epi16(rg, ba));
+         out += 32;
+      }
+   }
+   YCbCr_convert_row(out, y + i, pcb + i, pcr + i, count - i, step, bgr);
+}
+
+static void YCbCr_to_RGB_row_sse2(uint8 *out, const uint8 *y, const uint8 *pcb, const uint8 *pcr, int count, int step)
+{
+   YCbCr_convert_row_sse2(out, y, pcb, pcr, count, step, 0);
+}
+
+static void YCbCr_to_BGR_row_sse2(uint8 *out, const uint8 *y, const uint8 *pcb, const uint8 *pcr, int count, int step)
+{
+   YCbCr_convert_row_sse2(out, y, pcb, pcr, count, step, 1);
+}
+#endif
+
+stbi_YCbCr_to_RGB_run stbi_YCbCr_to_RGB_sse2(void)
+{
+   #ifdef STBI_SSE2
+   return YCbCr_to_RGB_row_sse2;
+   #else
+   return NULL;
+   #endif
+}
+
+stbi_YCbCr_to_RGB_run stbi_YCbCr_to_BGR_sse2(void)
+{
+   #ifdef STBI_SSE2
+   return YCbCr_to_BGR_row_sse2;
+   #else
+   return NULL;
+   #endif
+}
+
 
 // clean up the temporary component buffers
 static void cleanup_jpeg(jpeg *j)
@@ -1668,9 +1956,12 @@ static uint8 *load_jpeg_image(jpeg *z, int *out_x, int *out_y, int *comp, int re
             uint8 *y = coutput[0];
             if (z->s.img_n == 3) {
                #ifdef STBI_SIMD
-               stbi_YCbCr_installed(out, y, coutput[1], coutput[2], z->s.img_x, n);
+               if (z->s.bgr && n == 4)
+                  stbi_YCbCr_BGR_installed(out, y, coutput[1], coutput[2], z->s.img_x, n);
+               else
+                  stbi_YCbCr_installed(out, y, coutput[1], coutput[2], z->s.img_x, n);
                #else
-               YCbCr_to_RGB_row(out, y, coutput[1], coutput[2], z->s.img_x, n);
+               YCbCr_convert_row(out, y, coutput[1], coutput[2], z->s.img_x, n, z->s.bgr && n == 4);
                #endif
             } else
                for (i=0; i < z->s.img_x; ++i) {
@@ -1713,22 +2004,29 @@ unsigned char *stbi_jpeg_load(char const *filename, int *x, int *y, int *comp, i
 }
 #endif
 
-unsigned char *stbi_jpeg_load_from_memory(stbi_uc const *buffer, int len, int *x, int *y, int *comp, int req_comp)
+static stbi_uc *jpeg_load_from_memory(stbi_uc const *buffer, int len, int *x, int *y, int *comp, int req_comp, int bgr)
 {
    #ifdef STBI_SMALL_STACK
    unsigned char *result;
    jpeg *j = (jpeg *) malloc(sizeof(*j));
    start_mem(&j->s, buffer, len);
+   j->s.bgr = bgr;
    result = load_jpeg_image(j,x,y,comp,req_comp);
    free(j);
    return result;
    #else
    jpeg j;
    start_mem(&j.s, buffer,len);
+   j.s.bgr = bgr;
    return load_jpeg_image(&j, x,y,comp,req_comp);
    #endif
 }
 
+unsigned char *stbi_jpeg_load_from_memory(stbi_uc const *buffer, int len, int *x, int *y, int *comp, int req_comp)
+{
+   return jpeg_load_from_memory(buffer,len,x,y,comp,req_comp,0);
+}
+
 static int stbi_jpeg_info_raw(jpeg *j, int *x, int *y, int *comp)
 {
    if (!decode_jpeg_header(j, SCAN_header))
@@ -2097,18 +2395,25 @@ static int parse_zlib_header(zbuf *a)
    return 1;
 }
 
-// @TODO: should statically initialize these for optimal thread safety
-static uint8 default_length[288], default_distance[32];
-static void init_defaults(void)
+// fixed code lengths (use <= to match clearly with spec):
+//    0..143: 8, 144..255: 9, 256..279: 7, 280..287: 8, distances: 5
+// initialized statically so that PNGs can be decoded on several threads
+static uint8 default_length[288] =
+{
+   8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,
+   8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,
+   8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,
+   8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,
+   8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,
+   9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,
+   9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,
+   9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,
+   7,7,7,7,7,7,7,7,7,7,7,7,7,7,7,7,7,7,7,7,7,7,7,7,8,8,8,8,8,8,8,8
+};
+static uint8 default_distance[32] =
 {
-   int i;   // use <= to match clearly with spec
-   for (i=0; i <= 143; ++i)     default_length[i]   = 8;
-   for (   ; i <= 255; ++i)     default_length[i]   = 9;
-   for (   ; i <= 279; ++i)     default_length[i]   = 7;
-   for (   ; i <= 287; ++i)     default_length[i]   = 8;
-
-   for (i=0; i <=  31; ++i)     default_distance[i] = 5;
-}
+   5,5,5,5,5,5,5,5,5,5,5,5,5,5,5,5,5,5,5,5,5,5,5,5,5,5,5,5,5,5,5,5
+};
 
 int stbi_png_partial; // a quick hack to only allow decoding some of a PNG... I should implement real streaming support instead
 static int parse_zlib(zbuf *a, int parse_header)
@@ -2128,7 +2433,6 @@ static int parse_zlib(zbuf *a, int parse_header)
       } else {
          if (type == 1) {
             // use fixed code lengths
-            if (!default_distance[31]) init_defaults();
             if (!zbuild_huffman(&a->z_length  , default_length  , 288)) return 0;
             if (!zbuild_huffman(&a->z_distance, default_distance,  32)) return 0;
          } else {
@@ -3355,10 +3659,10 @@ static stbi_uc *tga_load(stbi *s, int *x, int *y, int *comp, int req_comp)
          tga_data[i*req_comp+2] = trans_data[2];
          break;
       case 4:
-         //   RGBA => RGBA
-         tga_data[i*req_comp+0] = trans_data[0];
+         //   RGBA => RGBA or BGRA
+         tga_data[i*req_comp+0] = trans_data[s->bgr ? 2 : 0];
          tga_data[i*req_comp+1] = trans_data[1];
-         tga_data[i*req_comp+2] = trans_data[2];
+         tga_data[i*req_comp+2] = trans_data[s->bgr ? 0 : 2];
          tga_data[i*req_comp+3] = trans_data[3];
          break;
       }
@@ -3414,13 +3718,19 @@ stbi_uc *stbi_tga_load_from_file   (FILE *f,                  int *x, int *y, in
 }
 #endif
 
-stbi_uc *stbi_tga_load_from_memory (stbi_uc const *buffer, int len, int *x, int *y, int *comp, int req_comp)
+static stbi_uc *tga_load_from_memory(stbi_uc const *buffer, int len, int *x, int *y, int *comp, int req_comp, int bgr)
 {
    stbi s;
    start_mem(&s, buffer, len);
+   s.bgr = bgr;
    return tga_load(&s, x,y,comp,req_comp);
 }
 
+stbi_uc *stbi_tga_load_from_memory (stbi_uc const *buffer, int len, int *x, int *y, int *comp, int req_comp)
+{
+   return tga_load_from_memory(buffer,len,x,y,comp,req_comp,0);
+}
+
 
 // *************************************************************************************************
 // Photoshop PSD loader -- PD by Thatcher Ulrich, integration by Nicolas Schulz, tweaked by STB
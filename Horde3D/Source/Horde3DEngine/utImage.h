@@ -16,6 +16,7 @@
 // Configuration
 #define STBI_NO_STDIO	1
 #define STBI_NO_WRITE	1
+#define STBI_SIMD		1
 
 
 // Limitations:
@@ -147,6 +148,10 @@ extern "C" {
 // load image by filename, open file, or memory buffer
 extern stbi_uc *stbi_load_from_memory(stbi_uc const *buffer, int len, int *x, int *y, int *comp, int req_comp);
 
+// load image from memory buffer with 4 components in the order blue, green, red, alpha;
+// jpeg and tga are decoded into this layout directly, other formats are swizzled
+extern stbi_uc *stbi_load_bgra_from_memory(stbi_uc const *buffer, int len, int *x, int *y, int *comp);
+
 #ifndef STBI_NO_STDIO
 extern stbi_uc *stbi_load            (char const *filename,     int *x, int *y, int *comp, int req_comp);
 extern stbi_uc *stbi_load_from_file  (FILE *f,                  int *x, int *y, int *comp, int req_comp);
@@ -169,7 +174,7 @@ extern stbi_uc *stbi_load_from_file  (FILE *f,                  int *x, int *y,
 #endif // STBI_NO_HDR
 
 // get a VERY brief reason for failure
-// NOT THREADSAFE
+// the reason is kept per thread if the compiler supports thread-local storage
 extern const char *stbi_failure_reason  (void); 
 
 // free the loaded image -- this is just free()
@@ -237,8 +242,17 @@ typedef void (*stbi_YCbCr_to_RGB_run)(stbi_uc *output, stbi_uc const  *y, stbi_u
 //     cb: Cb input channel; scale/biased to be 0..255
 //     cr: Cr input channel; scale/biased to be 0..255
 
+// same as above, but with output order B,G,R; used by stbi_load_bgra_from_memory
+
 extern void stbi_install_idct(stbi_idct_8x8 func);
 extern void stbi_install_YCbCr_to_RGB(stbi_YCbCr_to_RGB_run func);
+extern void stbi_install_YCbCr_to_BGR(stbi_YCbCr_to_RGB_run func);
+
+// SSE2 implementations of the operations above; they produce exactly the same results as the
+// generic code and are NULL if the library was not compiled for a target with SSE2
+extern stbi_idct_8x8         stbi_idct_sse2(void);
+extern stbi_YCbCr_to_RGB_run stbi_YCbCr_to_RGB_sse2(void);
+extern stbi_YCbCr_to_RGB_run stbi_YCbCr_to_BGR_sse2(void);
 #endif // STBI_SIMD
 
 
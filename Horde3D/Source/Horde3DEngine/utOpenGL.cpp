@@ -26,6 +26,9 @@ namespace glExt
 	bool ARB_texture_float = false;
 	bool ARB_texture_non_power_of_two = false;
 	bool ARB_timer_query = false;
+	bool ARB_map_buffer_range = false;
+	bool ARB_copy_buffer = false;
+	bool ARB_sync = false;
 
 	int	majorVersion = 1, minorVersion = 0;
 }
@@ -181,6 +184,18 @@ PFNGLRENDERBUFFERSTORAGEMULTISAMPLEEXTPROC glRenderbufferStorageMultisampleEXT =
 PFNGLQUERYCOUNTERPROC glQueryCounter = 0x0;
 PFNGLGETQUERYOBJECTI64VPROC glGetQueryObjecti64v = 0x0;
 PFNGLGETQUERYOBJECTUI64VPROC glGetQueryObjectui64v = 0x0;
+
+// GL_ARB_map_buffer_range
+PFNGLMAPBUFFERRANGEPROC glMapBufferRange = 0x0;
+PFNGLFLUSHMAPPEDBUFFERRANGEPROC glFlushMappedBufferRange = 0x0;
+
+// GL_ARB_copy_buffer
+PFNGLCOPYBUFFERSUBDATAPROC glCopyBufferSubData = 0x0;
+
+// GL_ARB_sync
+PFNGLFENCESYNCPROC glFenceSync = 0x0;
+PFNGLDELETESYNCPROC glDeleteSync = 0x0;
+PFNGLCLIENTWAITSYNCPROC glClientWaitSync = 0x0;
 }  // namespace h3dGL
 
 
@@ -437,5 +452,31 @@ bool initOpenGLExtensions()
 		r &= (glGetQueryObjectui64v = (PFNGLGETQUERYOBJECTUI64VPROC) platGetProcAddress( "glGetQueryObjectui64v" )) != 0x0;
 	}
 
+	// Core since OpenGL 3.0 and 3.1
+	glExt::ARB_map_buffer_range = isExtensionSupported( "GL_ARB_map_buffer_range" ) ||
+	                              glExt::majorVersion * 10 + glExt::minorVersion >= 30;
+	if( glExt::ARB_map_buffer_range )
+	{
+		r &= (glMapBufferRange = (PFNGLMAPBUFFERRANGEPROC) platGetProcAddress( "glMapBufferRange" )) != 0x0;
+		r &= (glFlushMappedBufferRange = (PFNGLFLUSHMAPPEDBUFFERRANGEPROC) platGetProcAddress( "glFlushMappedBufferRange" )) != 0x0;
+	}
+
+	glExt::ARB_copy_buffer = isExtensionSupported( "GL_ARB_copy_buffer" ) ||
+	                         glExt::majorVersion * 10 + glExt::minorVersion >= 31;
+	if( glExt::ARB_copy_buffer )
+	{
+		r &= (glCopyBufferSubData = (PFNGLCOPYBUFFERSUBDATAPROC) platGetProcAddress( "glCopyBufferSubData" )) != 0x0;
+	}
+
+	// Core since OpenGL 3.2
+	glExt::ARB_sync = isExtensionSupported( "GL_ARB_sync" ) ||
+	                  glExt::majorVersion * 10 + glExt::minorVersion >= 32;
+	if( glExt::ARB_sync )
+	{
+		r &= (glFenceSync = (PFNGLFENCESYNCPROC) platGetProcAddress( "glFenceSync" )) != 0x0;
+		r &= (glDeleteSync = (PFNGLDELETESYNCPROC) platGetProcAddress( "glDeleteSync" )) != 0x0;
+		r &= (glClientWaitSync = (PFNGLCLIENTWAITSYNCPROC) platGetProcAddress( "glClientWaitSync" )) != 0x0;
+	}
+
 	return r;
 }
@@ -55,6 +55,9 @@ namespace glExt
 	extern bool ARB_texture_float;
 	extern bool ARB_texture_non_power_of_two;
 	extern bool ARB_timer_query;
+	extern bool ARB_map_buffer_range;
+	extern bool ARB_copy_buffer;
+	extern bool ARB_sync;
 
 	extern int  majorVersion, minorVersion;
 }
@@ -1137,6 +1140,61 @@ extern PFNGLQUERYCOUNTERPROC glQueryCounter;
 extern PFNGLGETQUERYOBJECTI64VPROC glGetQueryObjecti64v;
 extern PFNGLGETQUERYOBJECTUI64VPROC glGetQueryObjectui64v;
 
+#endif
+
+
+// ARB_map_buffer_range
+#ifndef GL_ARB_map_buffer_range
+#define GL_ARB_map_buffer_range 1
+
+#define GL_MAP_READ_BIT               0x0001
+#define GL_MAP_WRITE_BIT              0x0002
+#define GL_MAP_INVALIDATE_RANGE_BIT   0x0004
+#define GL_MAP_INVALIDATE_BUFFER_BIT  0x0008
+#define GL_MAP_FLUSH_EXPLICIT_BIT     0x0010
+#define GL_MAP_UNSYNCHRONIZED_BIT     0x0020
+
+typedef GLvoid* (GLAPIENTRYP PFNGLMAPBUFFERRANGEPROC) (GLenum target, GLintptr offset, GLsizeiptr length, GLbitfield access);
+typedef void (GLAPIENTRYP PFNGLFLUSHMAPPEDBUFFERRANGEPROC) (GLenum target, GLintptr offset, GLsizeiptr length);
+extern PFNGLMAPBUFFERRANGEPROC glMapBufferRange;
+extern PFNGLFLUSHMAPPEDBUFFERRANGEPROC glFlushMappedBufferRange;
+
+#endif
+
+
+// ARB_copy_buffer
+#ifndef GL_ARB_copy_buffer
+#define GL_ARB_copy_buffer 1
+
+#define GL_COPY_READ_BUFFER   0x8F36
+#define GL_COPY_WRITE_BUFFER  0x8F37
+
+typedef void (GLAPIENTRYP PFNGLCOPYBUFFERSUBDATAPROC) (GLenum readTarget, GLenum writeTarget, GLintptr readOffset, GLintptr writeOffset, GLsizeiptr size);
+extern PFNGLCOPYBUFFERSUBDATAPROC glCopyBufferSubData;
+
+#endif
+
+
+// ARB_sync
+#ifndef GL_ARB_sync
+#define GL_ARB_sync 1
+
+typedef struct __GLsync *GLsync;
+
+#define GL_SYNC_GPU_COMMANDS_COMPLETE  0x9117
+#define GL_ALREADY_SIGNALED            0x911A
+#define GL_TIMEOUT_EXPIRED             0x911B
+#define GL_CONDITION_SATISFIED         0x911C
+#define GL_WAIT_FAILED                 0x911D
+#define GL_SYNC_FLUSH_COMMANDS_BIT     0x00000001
+
+typedef GLsync (GLAPIENTRYP PFNGLFENCESYNCPROC) (GLenum condition, GLbitfield flags);
+typedef void (GLAPIENTRYP PFNGLDELETESYNCPROC) (GLsync sync);
+typedef GLenum (GLAPIENTRYP PFNGLCLIENTWAITSYNCPROC) (GLsync sync, GLbitfield flags, GLuint64 timeout);
+extern PFNGLFENCESYNCPROC glFenceSync;
+extern PFNGLDELETESYNCPROC glDeleteSync;
+extern PFNGLCLIENTWAITSYNCPROC glClientWaitSync;
+
 #endif
 }  // namespace h3dGL
 
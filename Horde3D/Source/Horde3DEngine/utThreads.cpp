@@ -0,0 +1,329 @@
+// *************************************************************************************************
+//
+// Horde3D
+//   Next-Generation Graphics Engine
+// --------------------------------------
+// Copyright (C) 2006-2011 Nicolas Schulz
+//
+// This software is distributed under the terms of the Eclipse Public License v1.0.
+// A copy of the license may be obtained at: http://www.eclipse.org/legal/epl-v10.html
+//
+// *************************************************************************************************
+
+#include "utThreads.h"
+
+#if !defined( PLATFORM_WIN ) && !defined( PLATFORM_WIN_CE )
+#	include <unistd.h>
+#endif
+
+
+namespace Horde3D {
+
+// *************************************************************************************************
+// Class Mutex
+// *************************************************************************************************
+
+#if defined( PLATFORM_WIN ) || defined( PLATFORM_WIN_CE )
+
+Mutex::Mutex() { InitializeCriticalSection( &_cs ); }
+Mutex::~Mutex() { DeleteCriticalSection( &_cs ); }
+void Mutex::lock() { EnterCriticalSection( &_cs ); }
+void Mutex::unlock() { LeaveCriticalSection( &_cs ); }
+
+#else
+
+Mutex::Mutex() { pthread_mutex_init( &_mutex, 0x0 ); }
+Mutex::~Mutex() { pthread_mutex_destroy( &_mutex ); }
+void Mutex::lock() { pthread_mutex_lock( &_mutex ); }
+void Mutex::unlock() { pthread_mutex_unlock( &_mutex ); }
+
+#endif
+
+
+// *************************************************************************************************
+// Class Event
+// *************************************************************************************************
+
+#if defined( PLATFORM_WIN ) || defined( PLATFORM_WIN_CE )
+
+Event::Event() { _event = CreateEvent( 0x0, FALSE, FALSE, 0x0 ); }
+Event::~Event() { CloseHandle( _event ); }
+void Event::signal() { SetEvent( _event ); }
+void Event::wait() { WaitForSingleObject( _event, INFINITE ); }
+
+#else
+
+Event::Event() :
+	_signaled( false )
+{
+	pthread_cond_init( &_cond, 0x0 );
+}
+
+
+Event::~Event()
+{
+	pthread_cond_destroy( &_cond );
+}
+
+
+void Event::signal()
+{
+	ScopedLock lock( _mutex );
+	_signaled = true;
+	pthread_cond_signal( &_cond );
+}
+
+
+void Event::wait()
+{
+	ScopedLock lock( _mutex );
+	while( !_signaled ) pthread_cond_wait( &_cond, &_mutex._mutex );
+	_signaled = false;
+}
+
+#endif
+
+
+// *************************************************************************************************
+// Class Thread
+// *************************************************************************************************
+
+Thread::Thread() :
+	_func( 0x0 ), _userData( 0x0 ), _running( false )
+{
+}
+
+
+Thread::~Thread()
+{
+	join();
+}
+
+
+bool Thread::start( ThreadFunc func, void *userData )
+{
+	if( _running ) return false;
+	
+	_func = func;
+	_userData = userData;
+
+#if defined( PLATFORM_WIN ) || defined( PLATFORM_WIN_CE )
+	_thread = CreateThread( 0x0, 0, threadFunc, this, 0, 0x0 );
+	_running = _thread != 0x0;
+#else
+	_running = pthread_create( &_thread, 0x0, threadFunc, this ) == 0;
+#endif
+
+	return _running;
+}
+
+
+void Thread::join()
+{
+	if( !_running ) return;
+
+#if defined( PLATFORM_WIN ) || defined( PLATFORM_WIN_CE )
+	WaitForSingleObject( _thread, INFINITE );
+	CloseHandle( _thread );
+#else
+	pthread_join( _thread, 0x0 );
+#endif
+	_running = false;
+}
+
+
+void Thread::detach()
+{
+	if( !_running ) return;
+
+#if defined( PLATFORM_WIN ) || defined( PLATFORM_WIN_CE )
+	CloseHandle( _thread );
+#else
+	pthread_detach( _thread );
+#endif
+	_running = false;
+}
+
+
+#if defined( PLATFORM_WIN ) || defined( PLATFORM_WIN_CE )
+DWORD WINAPI Thread::threadFunc( LPVOID param )
+#else
+void *Thread::threadFunc( void *param )
+#endif
+{
+	Thread *thread = (Thread *)param;
+	thread->_func( thread->_userData );
+
+	return 0;
+}
+
+
+// *************************************************************************************************
+// Class JobManager
+// *************************************************************************************************
+
+JobManager::JobManager() :
+	_func( 0x0 ), _userData( 0x0 ), _numJobs( 0 ), _nextJob( 0 ), _finishedJobs( 0 ), _quit( false )
+{
+}
+
+
+JobManager::~JobManager()
+{
+	release();
+}
+
+
+uint32 JobManager::getNumCPUs()
+{
+#if defined( PLATFORM_WIN ) || defined( PLATFORM_WIN_CE )
+	SYSTEM_INFO sysInfo;
+	GetSystemInfo( &sysInfo );
+	return sysInfo.dwNumberOfProcessors > 0 ? (uint32)sysInfo.dwNumberOfProcessors : 1;
+#else
+	long count = sysconf( _SC_NPROCESSORS_ONLN );
+	return count > 0 ? (uint32)count : 1;
+#endif
+}
+
+
+void JobManager::init( uint32 numWorkers )
+{
+	release();
+
+	if( numWorkers > MaxWorkerThreads ) numWorkers = MaxWorkerThreads;
+
+	for( uint32 i = 0; i < numWorkers; ++i )
+	{
+	#if defined( PLATFORM_WIN ) || defined( PLATFORM_WIN_CE )
+		HANDLE thread = CreateThread( 0x0, 0, workerThreadFunc, this, 0, 0x0 );
+		if( thread == 0x0 ) break;
+	#else
+		pthread_t thread;
+		if( pthread_create( &thread, 0x0, workerThreadFunc, this ) != 0 ) break;
+	#endif
+		_workers.push_back( thread );
+	}
+}
+
+
+void JobManager::release()
+{
+	if( _workers.empty() ) return;
+
+	_mutex.lock();
+	_quit = true;
+	_mutex.unlock();
+
+	// Every worker passes the wake-up on to the next one before it exits
+	_wakeEvent.signal();
+
+	for( size_t i = 0; i < _workers.size(); ++i )
+	{
+	#if defined( PLATFORM_WIN ) || defined( PLATFORM_WIN_CE )
+		WaitForSingleObject( _workers[i], INFINITE );
+		CloseHandle( _workers[i] );
+	#else
+		pthread_join( _workers[i], 0x0 );
+	#endif
+	}
+	_workers.clear();
+
+	_quit = false;
+}
+
+
+bool JobManager::executeJob()
+{
+	_mutex.lock();
+	if( _nextJob >= _numJobs )
+	{
+		_mutex.unlock();
+		return false;
+	}
+	uint32 jobIndex = _nextJob++;
+	bool moreJobs = _nextJob < _numJobs;
+	JobFunc func = _func;
+	void *userData = _userData;
+	_mutex.unlock();
+
+	// Wake up another worker if there is still work left
+	if( moreJobs && !_workers.empty() ) _wakeEvent.signal();
+
+	func( userData, jobIndex );
+
+	_mutex.lock();
+	bool lastJob = ++_finishedJobs == _numJobs;
+	_mutex.unlock();
+
+	if( lastJob ) _doneEvent.signal();
+
+	return true;
+}
+
+
+#if defined( PLATFORM_WIN ) || defined( PLATFORM_WIN_CE )
+DWORD WINAPI JobManager::workerThreadFunc( LPVOID param )
+#else
+void *JobManager::workerThreadFunc( void *param )
+#endif
+{
+	JobManager *jobMan = (JobManager *)param;
+	
+	for(;;)
+	{
+		jobMan->_wakeEvent.wait();
+
+		jobMan->_mutex.lock();
+		bool quit = jobMan->_quit;
+		jobMan->_mutex.unlock();
+
+		if( quit )
+		{
+			jobMan->_wakeEvent.signal();
+			return 0;
+		}
+
+		while( jobMan->executeJob() ) {}
+	}
+}
+
+
+void JobManager::run( JobFunc func, void *userData, uint32 numJobs )
+{
+	if( numJobs == 0 ) return;
+
+	if( _workers.empty() || numJobs == 1 )
+	{
+		for( uint32 i = 0; i < numJobs; ++i ) func( userData, i );
+		return;
+	}
+
+	_mutex.lock();
+	_func = func;
+	_userData = userData;
+	_numJobs = numJobs;
+	_nextJob = 0;
+	_finishedJobs = 0;
+	_mutex.unlock();
+
+	// Calling thread works on the jobs as well
+	while( executeJob() ) {}
+
+	for(;;)
+	{
+		_mutex.lock();
+		bool done = _finishedJobs == _numJobs;
+		_mutex.unlock();
+
+		if( done ) break;
+		_doneEvent.wait();
+	}
+
+	_mutex.lock();
+	_numJobs = 0;
+	_nextJob = 0;
+	_mutex.unlock();
+}
+
+}  // namespace
@@ -0,0 +1,242 @@
+// *************************************************************************************************
+//
+// Horde3D
+//   Next-Generation Graphics Engine
+// --------------------------------------
+// Copyright (C) 2006-2011 Nicolas Schulz
+//
+// This software is distributed under the terms of the Eclipse Public License v1.0.
+// A copy of the license may be obtained at: http://www.eclipse.org/legal/epl-v10.html
+//
+// *************************************************************************************************
+
+#ifndef _utThreads_H_
+#define _utThreads_H_
+
+#include "utPlatform.h"
+#include <vector>
+
+#if defined( PLATFORM_WIN ) || defined( PLATFORM_WIN_CE )
+#   define WIN32_LEAN_AND_MEAN 1
+#	ifndef NOMINMAX
+#		define NOMINMAX
+#	endif
+#   include <windows.h>
+#else
+#	include <pthread.h>
+#endif
+
+
+namespace Horde3D {
+
+const uint32 MaxWorkerThreads = 15;
+
+
+// =================================================================================================
+// Atomic operations
+// =================================================================================================
+
+// All operations act as full memory barriers
+
+inline uint32 atomicLoad( volatile uint32 *value )
+{
+#if defined( PLATFORM_WIN ) || defined( PLATFORM_WIN_CE )
+	return (uint32)InterlockedCompareExchange( (volatile LONG *)value, 0, 0 );
+#else
+	return __sync_fetch_and_add( value, 0 );
+#endif
+}
+
+
+inline void atomicStore( volatile uint32 *value, uint32 newValue )
+{
+#if defined( PLATFORM_WIN ) || defined( PLATFORM_WIN_CE )
+	InterlockedExchange( (volatile LONG *)value, (LONG)newValue );
+#else
+	__sync_synchronize();
+	*value = newValue;
+	__sync_synchronize();
+#endif
+}
+
+
+inline uint32 atomicAdd( volatile uint32 *value, uint32 inc )
+{
+	// Returns the new value
+#if defined( PLATFORM_WIN ) || defined( PLATFORM_WIN_CE )
+	return (uint32)InterlockedExchangeAdd( (volatile LONG *)value, (LONG)inc ) + inc;
+#else
+	return __sync_add_and_fetch( value, inc );
+#endif
+}
+
+
+inline bool atomicCompareExchange( volatile uint32 *value, uint32 comparand, uint32 newValue )
+{
+	// Sets value to newValue if it is equal to comparand and returns whether that was the case
+#if defined( PLATFORM_WIN ) || defined( PLATFORM_WIN_CE )
+	return (uint32)InterlockedCompareExchange( (volatile LONG *)value, (LONG)newValue, (LONG)comparand ) == comparand;
+#else
+	return __sync_bool_compare_and_swap( value, comparand, newValue );
+#endif
+}
+
+
+// =================================================================================================
+// Mutex
+// =================================================================================================
+
+class Mutex
+{
+public:
+	Mutex();
+	~Mutex();
+
+	void lock();
+	void unlock();
+
+private:
+	Mutex( const Mutex & );
+	Mutex &operator=( const Mutex & );
+
+private:
+#if defined( PLATFORM_WIN ) || defined( PLATFORM_WIN_CE )
+	CRITICAL_SECTION  _cs;
+#else
+	pthread_mutex_t   _mutex;
+#endif
+
+	friend class Event;
+};
+
+
+class ScopedLock
+{
+public:
+	ScopedLock( Mutex &mutex ) : _mutex( mutex ) { _mutex.lock(); }
+	~ScopedLock() { _mutex.unlock(); }
+
+private:
+	ScopedLock &operator=( const ScopedLock & );
+
+private:
+	Mutex  &_mutex;
+};
+
+
+// =================================================================================================
+// Event
+// =================================================================================================
+
+// Auto-reset event: a signal wakes one waiting thread or is kept until the next wait
+class Event
+{
+public:
+	Event();
+	~Event();
+
+	void signal();
+	void wait();
+
+private:
+	Event( const Event & );
+	Event &operator=( const Event & );
+
+private:
+#if defined( PLATFORM_WIN ) || defined( PLATFORM_WIN_CE )
+	HANDLE            _event;
+#else
+	Mutex             _mutex;
+	pthread_cond_t    _cond;
+	bool              _signaled;
+#endif
+};
+
+
+// =================================================================================================
+// Thread
+// =================================================================================================
+
+typedef void (*ThreadFunc)( void *userData );
+
+class Thread
+{
+public:
+	Thread();
+	~Thread();
+
+	bool start( ThreadFunc func, void *userData );
+	void join();
+	void detach();  // Releases the thread without waiting for it; it keeps running on its own
+
+	bool isRunning() { return _running; }
+
+private:
+	Thread( const Thread & );
+	Thread &operator=( const Thread & );
+	
+#if defined( PLATFORM_WIN ) || defined( PLATFORM_WIN_CE )
+	static DWORD WINAPI threadFunc( LPVOID param );
+#else
+	static void *threadFunc( void *param );
+#endif
+
+private:
+#if defined( PLATFORM_WIN ) || defined( PLATFORM_WIN_CE )
+	HANDLE      _thread;
+#else
+	pthread_t   _thread;
+#endif
+	ThreadFunc  _func;
+	void        *_userData;
+	bool        _running;
+};
+
+
+// =================================================================================================
+// Job Manager
+// =================================================================================================
+
+typedef void (*JobFunc)( void *userData, uint32 jobIndex );
+
+class JobManager
+{
+public:
+	JobManager();
+	~JobManager();
+
+	void init( uint32 numWorkers );
+	void release();
+
+	// Executes func for all job indices in [0, numJobs) and returns when all of them are done;
+	// the calling thread takes part in the work, so numWorkers = 0 runs everything serially
+	void run( JobFunc func, void *userData, uint32 numJobs );
+
+	uint32 getNumWorkers() { return (uint32)_workers.size(); }
+
+	static uint32 getNumCPUs();
+
+private:
+	bool executeJob();
+#if defined( PLATFORM_WIN ) || defined( PLATFORM_WIN_CE )
+	static DWORD WINAPI workerThreadFunc( LPVOID param );
+#else
+	static void *workerThreadFunc( void *param );
+#endif
+
+private:
+#if defined( PLATFORM_WIN ) || defined( PLATFORM_WIN_CE )
+	std::vector< HANDLE >     _workers;
+#else
+	std::vector< pthread_t >  _workers;
+#endif
+	Mutex                     _mutex;
+	Event                     _wakeEvent, _doneEvent;
+	JobFunc                   _func;
+	void                      *_userData;
+	uint32                    _numJobs, _nextJob, _finishedJobs;
+	bool                      _quit;
+};
+
+}
+#endif  // _utThreads_H_
@@ -83,6 +83,12 @@ public:
 		return (float)_elapsedTime;
 	}
 
+	float peekElapsedTimeMS()
+	{
+		// Unlike getElapsedTimeMS this does not modify the timer, so it can be called from several threads
+		return (float)(_enabled ? _elapsedTime + getTime() - _startTime : _elapsedTime);
+	}
+
 protected:
 
 	double getTime()
@@ -14,6 +14,7 @@
 #include "Horde3D.h"
 #include "utPlatform.h"
 #include "utMath.h"
+#include "utThreads.h"
 #include <math.h>
 #ifdef PLATFORM_WIN
 #	define WIN32_LEAN_AND_MEAN 1
@@ -52,7 +53,6 @@ struct InfoBox
 	int     row;
 } infoBox;
 
-ofstream            outf;
 map< int, string >  resourcePaths;
 
 #ifdef PLATFORM_WIN
@@ -85,6 +85,305 @@ string cleanPath( string path )
 	return path;
 }
 
+
+// =================================================================================================
+// Log writer
+// =================================================================================================
+
+struct LogFormats  // Must match H3DUTLogFormats
+{
+	enum List
+	{
+		HTML = 0,
+		Text,
+		JSON
+	};
+};
+
+
+struct LogEntry
+{
+	string  text;
+	int     level;
+	float   time;
+};
+
+
+class LogWriter
+{
+public:
+	LogWriter() : _format( LogFormats::HTML ), _quit( false ), _abandoned( false ) {}
+	~LogWriter() { close(); }
+
+	bool open( const char *filename, int format );
+	void close();
+	void abandon( bool writeRemaining );
+	void post( vector< LogEntry > &entries );
+
+	bool isOpen() { return _thread.isRunning(); }
+
+private:
+	static void threadFunc( void *userData );
+	void writeHeader();
+	void writeEntries( const vector< LogEntry > &entries );
+	void writeFooter();
+
+private:
+	ofstream            _file;
+	int                 _format;
+	Thread              _thread;
+	Mutex               _mutex;
+	Mutex               _fileMutex;  // Held by the writer thread while it accesses the file
+	Event               _wakeEvent;
+	vector< LogEntry >  _pending;  // Entries not yet taken over by the writer thread
+	bool                _quit;
+	bool                _abandoned;  // File was completed by abandon, the thread may not touch it
+} logWriter;
+
+
+bool LogWriter::open( const char *filename, int format )
+{
+	close();
+	
+	_file.open( filename, ios::out );
+	if( !_file ) return false;
+	_file.setf( ios::fixed );
+	_file.precision( 3 );
+	_format = format;
+	writeHeader();
+	_file.flush();
+
+	_quit = false;
+	_abandoned = false;
+	if( !_thread.start( threadFunc, this ) )
+	{
+		_file.close();
+		return false;
+	}
+	
+	return true;
+}
+
+
+void LogWriter::close()
+{
+	if( !isOpen() ) return;
+
+	_mutex.lock();
+	_quit = true;
+	_mutex.unlock();
+	_wakeEvent.signal();
+	_thread.join();
+
+	writeEntries( _pending );
+	_pending.clear();
+	writeFooter();
+	_file.close();
+}
+
+
+void LogWriter::abandon( bool writeRemaining )
+{
+	// Used when the library is unloaded: the loader lock is held, so the writer thread can not be
+	// joined, and on process exit it may have been terminated while holding one of the mutexes
+	if( !isOpen() ) return;
+
+	if( writeRemaining )
+	{
+		_mutex.lock();
+		_quit = true;
+		vector< LogEntry > entries;
+		entries.swap( _pending );
+		_mutex.unlock();
+		
+		// Waits at most for the entries the thread is currently writing; the thread is not
+		// woken again, since it would run code of the library while it is being unloaded
+		_fileMutex.lock();
+		writeEntries( entries );
+		writeFooter();
+		_file.close();
+		_abandoned = true;
+		_fileMutex.unlock();
+	}
+
+	_thread.detach();
+}
+
+
+void LogWriter::post( vector< LogEntry > &entries )
+{
+	_mutex.lock();
+	if( _pending.empty() ) _pending.swap( entries );
+	else _pending.insert( _pending.end(), entries.begin(), entries.end() );
+	_mutex.unlock();
+
+	_wakeEvent.signal();
+}
+
+
+void LogWriter::threadFunc( void *userData )
+{
+	LogWriter *writer = (LogWriter *)userData;
+	vector< LogEntry > entries;
+
+	for(;;)
+	{
+		writer->_wakeEvent.wait();
+
+		writer->_mutex.lock();
+		entries.swap( writer->_pending );
+		bool quit = writer->_quit;
+		writer->_mutex.unlock();
+
+		// The file is flushed once for all messages that arrived since the last wake-up
+		if( !entries.empty() )
+		{
+			writer->_fileMutex.lock();
+			if( !writer->_abandoned )
+			{
+				writer->writeEntries( entries );
+				writer->_file.flush();
+			}
+			writer->_fileMutex.unlock();
+			entries.clear();
+		}
+		
+		if( quit ) break;
+	}
+}
+
+
+void LogWriter::writeHeader()
+{
+	switch( _format )
+	{
+	case LogFormats::HTML:
+		_file << "<html>\n";
+		_file << "<head>\n";
+		_file << "<meta http-equiv=\"Content-Type\" content=\"text/html; charset=utf-8\" />\n";
+		_file << "<title>Horde3D Log</title>\n";
+		_file << "<style type=\"text/css\">\n";
+		
+		_file << "body, html {\n";
+		_file << "background: #000000;\n";
+		_file << "width: 1000px;\n";
+		_file << "font-family: Arial;\n";
+		_file << "font-size: 16px;\n";
+		_file << "color: #C0C0C0;\n";
+		_file << "}\n";
+
+		_file << "h1 {\n";
+		_file << "color : #FFFFFF;\n";
+		_file << "border-bottom : 1px dotted #888888;\n";
+		_file << "}\n";
+
+		_file << "pre {\n";
+		_file << "font-family : arial;\n";
+		_file << "margin : 0;\n";
+		_file << "}\n";
+
+		_file << ".box {\n";
+		_file << "border : 1px dotted #818286;\n";
+		_file << "padding : 5px;\n";
+		_file << "margin: 5px;\n";
+		_file << "width: 950px;\n";
+		_file << "background-color : #292929;\n";
+		_file << "}\n";
+
+		_file << ".err {\n";
+		_file << "color: #EE1100;\n";
+		_file << "font-weight: bold\n";
+		_file << "}\n";
+
+		_file << ".warn {\n";
+		_file << "color: #FFCC00;\n";
+		_file << "font-weight: bold\n";
+		_file << "}\n";
+
+		_file << ".info {\n";
+		_file << "color: #C0C0C0;\n";
+		_file << "}\n";
+
+		_file << ".debug {\n";
+		_file << "color: #CCA0A0;\n";
+		_file << "}\n";
+
+		_file << "</style>\n";
+		_file << "</head>\n\n";
+
+		_file << "<body>\n";
+		_file << "<h1>Horde3D Log</h1>\n";
+		_file << "<h3>" << h3dGetVersionString() << "</h3>\n";
+		_file << "<div class=\"box\">\n";
+		_file << "<table>\n";
+		break;
+	case LogFormats::Text:
+		_file << "Horde3D Log - " << h3dGetVersionString() << "\n\n";
+		break;
+	}
+}
+
+
+void LogWriter::writeEntries( const vector< LogEntry > &entries )
+{
+	static const char *levelClasses[5] = { "debug", "err", "warn", "info", "debug" };
+	static const char *levelNames[5] = { "debug", "error", "warning", "info", "debug" };
+	
+	for( size_t i = 0; i < entries.size(); ++i )
+	{
+		const LogEntry &entry = entries[i];
+		int level = entry.level >= 1 && entry.level <= 3 ? entry.level : 4;
+		
+		switch( _format )
+		{
+		case LogFormats::HTML:
+			_file << "<tr>\n";
+			_file << "<td width=\"100\">";
+			_file << entry.time;
+			_file << "</td>\n";
+			_file << "<td class=\"" << levelClasses[level] << "\"><pre>\n";
+			_file << entry.text;
+			_file << "\n</pre></td>\n";
+			_file << "</tr>\n";
+			break;
+		case LogFormats::Text:
+			_file << entry.time << "\t" << levelNames[level] << "\t" << entry.text << "\n";
+			break;
+		case LogFormats::JSON:
+			// One object per line (JSON Lines)
+			_file << "{\"time\": " << entry.time << ", \"level\": " << entry.level << ", \"text\": \"";
+			for( size_t j = 0; j < entry.text.length(); ++j )
+			{
+				unsigned char c = (unsigned char)entry.text[j];
+				if( c == '"' ) _file << "\\\"";
+				else if( c == '\\' ) _file << "\\\\";
+				else if( c == '\n' ) _file << "\\n";
+				else if( c == '\t' ) _file << "\\t";
+				else if( c < 0x20 )
+				{
+					static const char *hexDigits = "0123456789abcdef";
+					_file << "\\u00" << hexDigits[c >> 4] << hexDigits[c & 15];
+				}
+				else _file << entry.text[j];
+			}
+			_file << "\"}\n";
+			break;
+		}
+	}
+}
+
+
+void LogWriter::writeFooter()
+{
+	if( _format == LogFormats::HTML )
+	{
+		_file << "</table>\n";
+		_file << "</div>\n";
+		_file << "</body>\n";
+		_file << "</html>";
+	}
+}
+
 }  // namespace
 
 
@@ -217,174 +516,99 @@ DLLEXP bool h3dutLoadResourcesFromDisk( const char *contentDir )
 			dir = "";
 		}
 	} while( *c++ != '\0' );
-	
-	// Get the first resource that needs to be loaded
-	int res = h3dQueryUnloadedResource( 0 );
-	
-	char *dataBuf = 0;
-	int bufSize = 0;
 
-	while( res != 0 )
+	// Resources are loaded in batches so that the engine can decode images in parallel; loaded
+	// resources can reference new ones, so this is repeated until no unloaded resources are left
+	vector< H3DRes > resources;
+	vector< const char * > dataBufs;
+	vector< int > sizes;
+
+	for(;;)
 	{
-		ifstream inf;
+		int res;
+		resources.clear();
+		for( int i = 0; (res = h3dQueryUnloadedResource( i )) != 0; ++i )
+			resources.push_back( res );
+		if( resources.empty() ) break;
+
+		dataBufs.assign( resources.size(), (const char *)0x0 );
+		sizes.assign( resources.size(), 0 );
 		
-		// Loop over search paths and try to open files
-		for( unsigned int i = 0; i < dirs.size(); ++i )
+		for( size_t j = 0; j < resources.size(); ++j )
 		{
-			string fileName = dirs[i] + resourcePaths[h3dGetResType( res )] + "/" + h3dGetResName( res );
-			inf.clear();
-			inf.open( fileName.c_str(), ios::binary );
-			if( inf.good() ) break;
-		}
+			ifstream inf;
+			
+			// Loop over search paths and try to open files
+			for( unsigned int i = 0; i < dirs.size(); ++i )
+			{
+				string fileName = dirs[i] + resourcePaths[h3dGetResType( resources[j] )] + "/" + h3dGetResName( resources[j] );
+				inf.clear();
+				inf.open( fileName.c_str(), ios::binary );
+				if( inf.good() ) break;
+			}
 
-		// Open resource file
-		if( inf.good() ) // Resource file found
-		{
-			// Find size of resource file
-			inf.seekg( 0, ios::end );
-			int fileSize = inf.tellg();
-			if( bufSize < fileSize  )
+			// Open resource file
+			if( inf.good() ) // Resource file found
 			{
-				delete[] dataBuf;				
-				dataBuf = new char[fileSize];
-				if( !dataBuf )
-				{
-					bufSize = 0;
-					continue;
-				}
-				bufSize = fileSize;
+				// Find size of resource file
+				inf.seekg( 0, ios::end );
+				int fileSize = inf.tellg();
+				if( fileSize <= 0 ) continue;
+				// Copy resource file to memory
+				char *dataBuf = new char[fileSize];
+				inf.seekg( 0 );
+				inf.read( dataBuf, fileSize );
+				inf.close();
+				dataBufs[j] = dataBuf;
+				sizes[j] = fileSize;
+			}
+			else // Resource file not found
+			{
+				// Tell engine to use the dafault resource by using NULL as data pointer
+				result = false;
 			}
-			if( fileSize == 0 )	continue;
-			// Copy resource file to memory
-			inf.seekg( 0 );
-			inf.read( dataBuf, fileSize );
-			inf.close();
-			// Send resource data to engine
-			result &= h3dLoadResource( res, dataBuf, fileSize );
-		}
-		else // Resource file not found
-		{
-			// Tell engine to use the dafault resource by using NULL as data pointer
-			h3dLoadResource( res, 0x0, 0 );
-			result = false;
 		}
-		// Get next unloaded resource
-		res = h3dQueryUnloadedResource( 0 );
+
+		// Send resource data to engine
+		result &= h3dLoadResourceBatch( (int)resources.size(), &resources[0], &dataBufs[0], &sizes[0] );
+
+		for( size_t j = 0; j < dataBufs.size(); ++j ) delete[] dataBufs[j];
 	}
-	delete[] dataBuf;
 
 	return result;
 }
 
 
+DLLEXP bool h3dutSetLogFile( const char *filename, int format )
+{
+	if( filename == 0x0 )
+	{
+		logWriter.close();
+		return true;
+	}
+	if( format < LogFormats::HTML || format > LogFormats::JSON ) return false;
+	
+	return logWriter.open( filename, format );
+}
+
+
 DLLEXP bool h3dutDumpMessages()
 {
-	if( !outf.is_open() )
-	{
-		// Reset log file
-		outf.setf( ios::fixed );
-		outf.precision( 3 );
-		outf.open( "Horde3D_Log.html", ios::out );
-		if( !outf ) return false;
-
-		outf << "<html>\n";
-		outf << "<head>\n";
-		outf << "<meta http-equiv=\"Content-Type\" content=\"text/html; charset=utf-8\" />\n";
-		outf << "<title>Horde3D Log</title>\n";
-		outf << "<style type=\"text/css\">\n";
-		
-		outf << "body, html {\n";
-		outf << "background: #000000;\n";
-		outf << "width: 1000px;\n";
-		outf << "font-family: Arial;\n";
-		outf << "font-size: 16px;\n";
-		outf << "color: #C0C0C0;\n";
-		outf << "}\n";
-
-		outf << "h1 {\n";
-		outf << "color : #FFFFFF;\n";
-		outf << "border-bottom : 1px dotted #888888;\n";
-		outf << "}\n";
-
-		outf << "pre {\n";
-		outf << "font-family : arial;\n";
-		outf << "margin : 0;\n";
-		outf << "}\n";
-
-		outf << ".box {\n";
-		outf << "border : 1px dotted #818286;\n";
-		outf << "padding : 5px;\n";
-		outf << "margin: 5px;\n";
-		outf << "width: 950px;\n";
-		outf << "background-color : #292929;\n";
-		outf << "}\n";
-
-		outf << ".err {\n";
-		outf << "color: #EE1100;\n";
-		outf << "font-weight: bold\n";
-		outf << "}\n";
-
-		outf << ".warn {\n";
-		outf << "color: #FFCC00;\n";
-		outf << "font-weight: bold\n";
-		outf << "}\n";
-
-		outf << ".info {\n";
-		outf << "color: #C0C0C0;\n";
-		outf << "}\n";
-
-		outf << ".debug {\n";
-		outf << "color: #CCA0A0;\n";
-		outf << "}\n";
-
-		outf << "</style>\n";
-		outf << "</head>\n\n";
-
-		outf << "<body>\n";
-		outf << "<h1>Horde3D Log</h1>\n";
-		outf << "<h3>" << h3dGetVersionString() << "</h3>\n";
-		outf << "<div class=\"box\">\n";
-		outf << "<table>\n";
-
-		outf.flush();
-	}
-
-	int level;
-	float time;
-	string text = h3dGetMessage( &level, &time );
+	if( !logWriter.isOpen() && !logWriter.open( "Horde3D_Log.html", LogFormats::HTML ) )
+		return false;
+
+	// Messages are only collected here, formatting and disk I/O are left to the writer thread
+	vector< LogEntry > entries;
+	LogEntry entry;
+	entry.text = h3dGetMessage( &entry.level, &entry.time );
 	
-	while( text != "" )
+	while( entry.text != "" )
 	{
-		outf << "<tr>\n";
-		outf << "<td width=\"100\">";
-		outf << time;
-		outf << "</td>\n";
-		outf << "<td class=\"";
-		
-		switch( level )
-		{
-		case 1:
-			outf << "err";
-			break;
-		case 2:
-			outf << "warn";
-			break;
-		case 3:
-			outf << "info";
-			break;
-		default:
-			outf << "debug";
-		}
-		
-		outf << "\"><pre>\n";
-		outf << text.c_str();
-		outf << "\n</pre></td>\n";
-		outf << "</tr>\n";
-
-		outf.flush();
-		
-		text = h3dGetMessage( &level, &time );
+		entries.push_back( entry );
+		entry.text = h3dGetMessage( &entry.level, &entry.time );
 	}
+
+	if( !entries.empty() ) logWriter.post( entries );
 	
 	return true;
 }
@@ -917,15 +1141,10 @@ BOOL APIENTRY DllMain( HANDLE hModule, DWORD ul_reason_for_call, LPVOID lpReserv
    switch( ul_reason_for_call )
 	{
 	case DLL_PROCESS_DETACH:
-		// Close log file
-		if( outf.is_open() )
-		{
-			outf << "</table>\n";
-			outf << "</div>\n";
-			outf << "</body>\n";
-			outf << "</html>";
-			outf.close();
-		}
+		// Applications should close the log with h3dutSetLogFile( 0x0, 0 ) before unloading the
+		// library; the writer thread can not be joined here. On process exit (lpReserved != 0x0)
+		// all other threads are already terminated and the file is left as it is.
+		logWriter.abandon( lpReserved == 0x0 );
 	break;
 	}
 	
@@ -21,6 +21,15 @@
 //	 axis towards the origin
 // - An unrotated view vector points along the negative z-axis
 //
+// SIMD:
+//
+// - Matrix operations use SSE or NEON if the compiler targets it; defining H3D_NO_SIMD selects
+//   the scalar reference implementation
+// - H3D_SIMD_SSE2 is defined if SSE2 is available as well, for integer kernels elsewhere; it is
+//   also disabled by H3D_NO_SIMD
+// - Products are accumulated in the same order as in the scalar code; the SSE matrix inversion
+//   uses blockwise elimination and rounds slightly differently than the scalar cofactor version
+//
 // -------------------------------------------------------------------------------------------------
 
 #ifndef _utMath_H_
@@ -28,6 +37,20 @@
 
 #include <cmath>
 
+#if !defined( H3D_NO_SIMD )
+#	if defined( __SSE__ ) || defined( _M_X64 ) || (defined( _M_IX86_FP ) && _M_IX86_FP >= 1)
+#		define H3D_SIMD_SSE
+#		include <xmmintrin.h>
+#		if defined( __SSE2__ ) || defined( _M_X64 ) || (defined( _M_IX86_FP ) && _M_IX86_FP >= 2)
+#			define H3D_SIMD_SSE2
+#			include <emmintrin.h>
+#		endif
+#	elif defined( __ARM_NEON__ ) || defined( __ARM_NEON )
+#		define H3D_SIMD_NEON
+#		include <arm_neon.h>
+#	endif
+#endif
+
 
 namespace Horde3D {
 
@@ -59,6 +82,86 @@ namespace Math
 };
 
 
+// -------------------------------------------------------------------------------------------------
+// SIMD
+// -------------------------------------------------------------------------------------------------
+
+#if defined( H3D_SIMD_SSE ) || defined( H3D_SIMD_NEON )
+#	define H3D_SIMD
+
+namespace Math
+{
+	// Thin wrappers for the operations shared by all SIMD implementations; loads and stores are
+	// unaligned since math objects are not guaranteed to be 16 byte aligned
+#if defined( H3D_SIMD_SSE )
+	typedef __m128 SimdVec;
+
+	static inline SimdVec simdLoad( const float *p ) { return _mm_loadu_ps( p ); }
+	static inline void simdStore( float *p, SimdVec v ) { _mm_storeu_ps( p, v ); }
+	static inline SimdVec simdSplat( float f ) { return _mm_set1_ps( f ); }
+	static inline SimdVec simdAdd( SimdVec a, SimdVec b ) { return _mm_add_ps( a, b ); }
+	static inline SimdVec simdMul( SimdVec a, SimdVec b ) { return _mm_mul_ps( a, b ); }
+	
+	// Three component versions that do not touch memory behind the vector, w is loaded as zero
+	static inline SimdVec simdLoad3( const float *p )
+		{ return _mm_movelh_ps( _mm_loadl_pi( _mm_setzero_ps(), (const __m64 *)p ), _mm_load_ss( p + 2 ) ); }
+	static inline void simdStore3( float *p, SimdVec v )
+		{ _mm_storel_pi( (__m64 *)p, v ); _mm_store_ss( p + 2, _mm_movehl_ps( v, v ) ); }
+#else
+	typedef float32x4_t SimdVec;
+
+	static inline SimdVec simdLoad( const float *p ) { return vld1q_f32( p ); }
+	static inline void simdStore( float *p, SimdVec v ) { vst1q_f32( p, v ); }
+	static inline SimdVec simdSplat( float f ) { return vdupq_n_f32( f ); }
+	static inline SimdVec simdAdd( SimdVec a, SimdVec b ) { return vaddq_f32( a, b ); }
+	static inline SimdVec simdMul( SimdVec a, SimdVec b ) { return vmulq_f32( a, b ); }
+	
+	static inline SimdVec simdLoad3( const float *p )
+		{ return vcombine_f32( vld1_f32( p ), vset_lane_f32( p[2], vdup_n_f32( 0.0f ), 0 ) ); }
+	static inline void simdStore3( float *p, SimdVec v )
+		{ vst1_f32( p, vget_low_f32( v ) ); vst1q_lane_f32( p + 2, v, 2 ); }
+#endif
+
+	// Linear combination of the columns c0 to c2 (and c3) with the weights a to c (and d)
+	static inline SimdVec simdCombine( SimdVec c0, SimdVec c1, SimdVec c2, float a, float b, float c )
+	{
+		SimdVec r = simdMul( c0, simdSplat( a ) );
+		r = simdAdd( r, simdMul( c1, simdSplat( b ) ) );
+		return simdAdd( r, simdMul( c2, simdSplat( c ) ) );
+	}
+
+	static inline SimdVec simdCombine( SimdVec c0, SimdVec c1, SimdVec c2, SimdVec c3,
+	                                   float a, float b, float c, float d )
+	{
+		return simdAdd( simdCombine( c0, c1, c2, a, b, c ), simdMul( c3, simdSplat( d ) ) );
+	}
+
+#if defined( H3D_SIMD_SSE )
+#	define H3D_SWIZZLE( v, x, y, z, w ) _mm_shuffle_ps( v, v, _MM_SHUFFLE( w, z, y, x ) )
+
+	// Products of 2x2 matrices stored row-wise in one vector: A * B, adj( A ) * B and A * adj( B )
+	static inline __m128 simdMat2Mul( __m128 a, __m128 b )
+	{
+		return _mm_add_ps( _mm_mul_ps( a, H3D_SWIZZLE( b, 0, 3, 0, 3 ) ),
+		                   _mm_mul_ps( H3D_SWIZZLE( a, 1, 0, 3, 2 ), H3D_SWIZZLE( b, 2, 1, 2, 1 ) ) );
+	}
+
+	static inline __m128 simdMat2AdjMul( __m128 a, __m128 b )
+	{
+		return _mm_sub_ps( _mm_mul_ps( H3D_SWIZZLE( a, 3, 3, 0, 0 ), b ),
+		                   _mm_mul_ps( H3D_SWIZZLE( a, 1, 1, 2, 2 ), H3D_SWIZZLE( b, 2, 3, 0, 1 ) ) );
+	}
+
+	static inline __m128 simdMat2MulAdj( __m128 a, __m128 b )
+	{
+		return _mm_sub_ps( _mm_mul_ps( a, H3D_SWIZZLE( b, 3, 0, 3, 0 ) ),
+		                   _mm_mul_ps( H3D_SWIZZLE( a, 1, 0, 3, 2 ), H3D_SWIZZLE( b, 2, 1, 2, 1 ) ) );
+	}
+#endif
+}
+#endif
+
+
 // -------------------------------------------------------------------------------------------------
 // General
 // -------------------------------------------------------------------------------------------------
@@ -310,7 +413,13 @@ public:
 
 	Vec4f operator+( const Vec4f &v ) const
 	{
+	#if defined( H3D_SIMD )
+		Vec4f r;
+		Math::simdStore( &r.x, Math::simdAdd( Math::simdLoad( &x ), Math::simdLoad( &v.x ) ) );
+		return r;
+	#else
 		return Vec4f( x + v.x, y + v.y, z + v.z, w + v.w );
+	#endif
 	}
 
 	Vec4f operator-() const
@@ -320,7 +429,13 @@ public:
 	
 	Vec4f operator*( const float f ) const
 	{
+	#if defined( H3D_SIMD )
+		Vec4f r;
+		Math::simdStore( &r.x, Math::simdMul( Math::simdLoad( &x ), Math::simdSplat( f ) ) );
+		return r;
+	#else
 		return Vec4f( x * f, y * f, z * f, w * f );
+	#endif
 	}
 };
 
@@ -536,7 +651,17 @@ public:
 		float *dstx = dst.x;
 		const float *m1x = m1.x;
 		const float *m2x = m2.x;
-		
+
+	#if defined( H3D_SIMD )
+		Math::SimdVec c0 = Math::simdLoad( &m1x[0] ), c1 = Math::simdLoad( &m1x[4] );
+		Math::SimdVec c2 = Math::simdLoad( &m1x[8] ), c3 = Math::simdLoad( &m1x[12] );
+
+		Math::simdStore( &dstx[0], Math::simdCombine( c0, c1, c2, m2x[0], m2x[1], m2x[2] ) );
+		Math::simdStore( &dstx[4], Math::simdCombine( c0, c1, c2, m2x[4], m2x[5], m2x[6] ) );
+		Math::simdStore( &dstx[8], Math::simdCombine( c0, c1, c2, m2x[8], m2x[9], m2x[10] ) );
+		Math::simdStore( &dstx[12], Math::simdCombine( c0, c1, c2, c3, m2x[12], m2x[13], m2x[14], m2x[15] ) );
+		dstx[3] = 0.0f; dstx[7] = 0.0f; dstx[11] = 0.0f; dstx[15] = 1.0f;
+	#else
 		dstx[0] = m1x[0] * m2x[0] + m1x[4] * m2x[1] + m1x[8] * m2x[2];
 		dstx[1] = m1x[1] * m2x[0] + m1x[5] * m2x[1] + m1x[9] * m2x[2];
 		dstx[2] = m1x[2] * m2x[0] + m1x[6] * m2x[1] + m1x[10] * m2x[2];
@@ -556,6 +681,7 @@ public:
 		dstx[13] = m1x[1] * m2x[12] + m1x[5] * m2x[13] + m1x[9] * m2x[14] + m1x[13] * m2x[15];
 		dstx[14] = m1x[2] * m2x[12] + m1x[6] * m2x[13] + m1x[10] * m2x[14] + m1x[14] * m2x[15];
 		dstx[15] = 1.0f;
+	#endif
 	}
 
 	// ------------
@@ -609,7 +735,11 @@ public:
 	Matrix4f operator+( const Matrix4f &m ) const 
 	{
 		Matrix4f mf( Math::NO_INIT );
-		
+
+	#if defined( H3D_SIMD )
+		for( unsigned int i = 0; i < 16; i += 4 )
+			Math::simdStore( &mf.x[i], Math::simdAdd( Math::simdLoad( &x[i] ), Math::simdLoad( &m.x[i] ) ) );
+	#else
 		mf.x[0] = x[0] + m.x[0];
 		mf.x[1] = x[1] + m.x[1];
 		mf.x[2] = x[2] + m.x[2];
@@ -626,6 +756,7 @@ public:
 		mf.x[13] = x[13] + m.x[13];
 		mf.x[14] = x[14] + m.x[14];
 		mf.x[15] = x[15] + m.x[15];
+	#endif
 
 		return mf;
 	}
@@ -641,7 +772,17 @@ public:
 	Matrix4f operator*( const Matrix4f &m ) const 
 	{
 		Matrix4f mf( Math::NO_INIT );
-		
+
+	#if defined( H3D_SIMD )
+		Math::SimdVec c0 = Math::simdLoad( &x[0] ), c1 = Math::simdLoad( &x[4] );
+		Math::SimdVec c2 = Math::simdLoad( &x[8] ), c3 = Math::simdLoad( &x[12] );
+
+		for( unsigned int i = 0; i < 16; i += 4 )
+		{
+			Math::simdStore( &mf.x[i],
+				Math::simdCombine( c0, c1, c2, c3, m.x[i], m.x[i + 1], m.x[i + 2], m.x[i + 3] ) );
+		}
+	#else
 		mf.x[0] = x[0] * m.x[0] + x[4] * m.x[1] + x[8] * m.x[2] + x[12] * m.x[3];
 		mf.x[1] = x[1] * m.x[0] + x[5] * m.x[1] + x[9] * m.x[2] + x[13] * m.x[3];
 		mf.x[2] = x[2] * m.x[0] + x[6] * m.x[1] + x[10] * m.x[2] + x[14] * m.x[3];
@@ -661,18 +802,27 @@ public:
 		mf.x[13] = x[1] * m.x[12] + x[5] * m.x[13] + x[9] * m.x[14] + x[13] * m.x[15];
 		mf.x[14] = x[2] * m.x[12] + x[6] * m.x[13] + x[10] * m.x[14] + x[14] * m.x[15];
 		mf.x[15] = x[3] * m.x[12] + x[7] * m.x[13] + x[11] * m.x[14] + x[15] * m.x[15];
+	#endif
 
 		return mf;
 	}
 
 	Matrix4f operator*( const float f ) const
 	{
+	#if defined( H3D_SIMD )
+		Matrix4f m( Math::NO_INIT );
+		Math::SimdVec s = Math::simdSplat( f );
+		
+		for( unsigned int i = 0; i < 16; i += 4 )
+			Math::simdStore( &m.x[i], Math::simdMul( Math::simdLoad( &x[i] ), s ) );
+	#else
 		Matrix4f m( *this );
 		
 		m.x[0]  *= f; m.x[1]  *= f; m.x[2]  *= f; m.x[3]  *= f;
 		m.x[4]  *= f; m.x[5]  *= f; m.x[6]  *= f; m.x[7]  *= f;
 		m.x[8]  *= f; m.x[9]  *= f; m.x[10] *= f; m.x[11] *= f;
 		m.x[12] *= f; m.x[13] *= f; m.x[14] *= f; m.x[15] *= f;
+	#endif
 
 		return m;
 	}
@@ -682,24 +832,45 @@ public:
 	// ----------------------------
 	Vec3f operator*( const Vec3f &v ) const
 	{
+	#if defined( H3D_SIMD )
+		float r[4];
+		Math::simdStore( r, Math::simdAdd( Math::simdCombine( Math::simdLoad( &x[0] ), Math::simdLoad( &x[4] ),
+			Math::simdLoad( &x[8] ), v.x, v.y, v.z ), Math::simdLoad( &x[12] ) ) );
+		return Vec3f( r[0], r[1], r[2] );
+	#else
 		return Vec3f( v.x * c[0][0] + v.y * c[1][0] + v.z * c[2][0] + c[3][0],
 		              v.x * c[0][1] + v.y * c[1][1] + v.z * c[2][1] + c[3][1],
 		              v.x * c[0][2] + v.y * c[1][2] + v.z * c[2][2] + c[3][2] );
+	#endif
 	}
 
 	Vec4f operator*( const Vec4f &v ) const
 	{
+	#if defined( H3D_SIMD )
+		Vec4f r;
+		Math::simdStore( &r.x, Math::simdCombine( Math::simdLoad( &x[0] ), Math::simdLoad( &x[4] ),
+			Math::simdLoad( &x[8] ), Math::simdLoad( &x[12] ), v.x, v.y, v.z, v.w ) );
+		return r;
+	#else
 		return Vec4f( v.x * c[0][0] + v.y * c[1][0] + v.z * c[2][0] + v.w * c[3][0],
 		              v.x * c[0][1] + v.y * c[1][1] + v.z * c[2][1] + v.w * c[3][1],
 		              v.x * c[0][2] + v.y * c[1][2] + v.z * c[2][2] + v.w * c[3][2],
 		              v.x * c[0][3] + v.y * c[1][3] + v.z * c[2][3] + v.w * c[3][3] );
+	#endif
 	}
 
 	Vec3f mult33Vec( const Vec3f &v ) const
 	{
+	#if defined( H3D_SIMD )
+		float r[4];
+		Math::simdStore( r, Math::simdCombine( Math::simdLoad( &x[0] ), Math::simdLoad( &x[4] ),
+			Math::simdLoad( &x[8] ), v.x, v.y, v.z ) );
+		return Vec3f( r[0], r[1], r[2] );
+	#else
 		return Vec3f( v.x * c[0][0] + v.y * c[1][0] + v.z * c[2][0],
 		              v.x * c[0][1] + v.y * c[1][1] + v.z * c[2][1],
 		              v.x * c[0][2] + v.y * c[1][2] + v.z * c[2][2] );
+	#endif
 	}
 	
 	// ---------------
@@ -726,6 +897,17 @@ public:
 
 	Matrix4f transposed() const
 	{
+	#if defined( H3D_SIMD_SSE )
+		Matrix4f m( Math::NO_INIT );
+		__m128 c0 = _mm_loadu_ps( &x[0] ), c1 = _mm_loadu_ps( &x[4] );
+		__m128 c2 = _mm_loadu_ps( &x[8] ), c3 = _mm_loadu_ps( &x[12] );
+
+		_MM_TRANSPOSE4_PS( c0, c1, c2, c3 );
+		_mm_storeu_ps( &m.x[0], c0 ); _mm_storeu_ps( &m.x[4], c1 );
+		_mm_storeu_ps( &m.x[8], c2 ); _mm_storeu_ps( &m.x[12], c3 );
+
+		return m;
+	#else
 		Matrix4f m( *this );
 		
 		for( unsigned int y = 0; y < 4; ++y )
@@ -739,6 +921,7 @@ public:
 		}
 
 		return m;
+	#endif
 	}
 
 	float determinant() const
@@ -756,6 +939,46 @@ public:
 	{
 		Matrix4f m( Math::NO_INIT );
 
+	#if defined( H3D_SIMD_SSE )
+		// Blockwise inversion using 2x2 sub matrices; the algorithm works on rows, so loading
+		// the columns inverts the transposed matrix and storing them back transposes the result again
+		__m128 c0 = _mm_loadu_ps( &x[0] ), c1 = _mm_loadu_ps( &x[4] );
+		__m128 c2 = _mm_loadu_ps( &x[8] ), c3 = _mm_loadu_ps( &x[12] );
+
+		__m128 a = _mm_movelh_ps( c0, c1 ), b = _mm_movehl_ps( c1, c0 );
+		__m128 c = _mm_movelh_ps( c2, c3 ), d = _mm_movehl_ps( c3, c2 );
+
+		// Determinants of sub matrices as (|A| |B| |C| |D|)
+		__m128 detSub = _mm_sub_ps(
+			_mm_mul_ps( _mm_shuffle_ps( c0, c2, _MM_SHUFFLE( 2, 0, 2, 0 ) ), _mm_shuffle_ps( c1, c3, _MM_SHUFFLE( 3, 1, 3, 1 ) ) ),
+			_mm_mul_ps( _mm_shuffle_ps( c0, c2, _MM_SHUFFLE( 3, 1, 3, 1 ) ), _mm_shuffle_ps( c1, c3, _MM_SHUFFLE( 2, 0, 2, 0 ) ) ) );
+		__m128 detA = H3D_SWIZZLE( detSub, 0, 0, 0, 0 ), detB = H3D_SWIZZLE( detSub, 1, 1, 1, 1 );
+		__m128 detC = H3D_SWIZZLE( detSub, 2, 2, 2, 2 ), detD = H3D_SWIZZLE( detSub, 3, 3, 3, 3 );
+
+		__m128 dc = Math::simdMat2AdjMul( d, c ), ab = Math::simdMat2AdjMul( a, b );
+		__m128 mx = _mm_sub_ps( _mm_mul_ps( detD, a ), Math::simdMat2Mul( b, dc ) );
+		__m128 mw = _mm_sub_ps( _mm_mul_ps( detA, d ), Math::simdMat2Mul( c, ab ) );
+		__m128 my = _mm_sub_ps( _mm_mul_ps( detB, c ), Math::simdMat2MulAdj( d, ab ) );
+		__m128 mz = _mm_sub_ps( _mm_mul_ps( detC, b ), Math::simdMat2MulAdj( a, dc ) );
+
+		// |M| = |A| * |D| + |B| * |C| - tr( adj( A ) * B * adj( D ) * C )
+		__m128 tr = _mm_mul_ps( ab, H3D_SWIZZLE( dc, 0, 2, 1, 3 ) );
+		tr = _mm_add_ps( tr, H3D_SWIZZLE( tr, 2, 3, 0, 1 ) );
+		tr = _mm_add_ps( tr, H3D_SWIZZLE( tr, 1, 0, 3, 2 ) );
+		__m128 detM = _mm_sub_ps( _mm_add_ps( _mm_mul_ps( detA, detD ), _mm_mul_ps( detB, detC ) ), tr );
+		if( _mm_cvtss_f32( detM ) == 0 ) return m;
+
+		__m128 rcpDetM = _mm_div_ps( _mm_setr_ps( 1.0f, -1.0f, -1.0f, 1.0f ), detM );
+		mx = _mm_mul_ps( mx, rcpDetM );
+		my = _mm_mul_ps( my, rcpDetM );
+		mz = _mm_mul_ps( mz, rcpDetM );
+		mw = _mm_mul_ps( mw, rcpDetM );
+
+		_mm_storeu_ps( &m.x[0], _mm_shuffle_ps( mx, my, _MM_SHUFFLE( 1, 3, 1, 3 ) ) );
+		_mm_storeu_ps( &m.x[4], _mm_shuffle_ps( mx, my, _MM_SHUFFLE( 0, 2, 0, 2 ) ) );
+		_mm_storeu_ps( &m.x[8], _mm_shuffle_ps( mz, mw, _MM_SHUFFLE( 1, 3, 1, 3 ) ) );
+		_mm_storeu_ps( &m.x[12], _mm_shuffle_ps( mz, mw, _MM_SHUFFLE( 0, 2, 0, 2 ) ) );
+	#else
 		float d = determinant();
 		if( d == 0 ) return m;
 		d = 1.0f / d;
@@ -776,6 +999,7 @@ public:
 		m.c[3][1] = d * (c[0][1]*c[2][2]*c[3][0] - c[0][2]*c[2][1]*c[3][0] + c[0][2]*c[2][0]*c[3][1] - c[0][0]*c[2][2]*c[3][1] - c[0][1]*c[2][0]*c[3][2] + c[0][0]*c[2][1]*c[3][2]);
 		m.c[3][2] = d * (c[0][2]*c[1][1]*c[3][0] - c[0][1]*c[1][2]*c[3][0] - c[0][2]*c[1][0]*c[3][1] + c[0][0]*c[1][2]*c[3][1] + c[0][1]*c[1][0]*c[3][2] - c[0][0]*c[1][1]*c[3][2]);
 		m.c[3][3] = d * (c[0][1]*c[1][2]*c[2][0] - c[0][2]*c[1][1]*c[2][0] + c[0][2]*c[1][0]*c[2][1] - c[0][0]*c[1][2]*c[2][1] - c[0][1]*c[1][0]*c[2][2] + c[0][0]*c[1][1]*c[2][2]);
+	#endif
 		
 		return m;
 	}
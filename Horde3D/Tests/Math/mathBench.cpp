@@ -0,0 +1,97 @@
+// *************************************************************************************************
+//
+// Horde3D
+//   Next-Generation Graphics Engine
+// --------------------------------------
+// Copyright (C) 2006-2011 Nicolas Schulz
+//
+// This software is distributed under the terms of the Eclipse Public License v1.0.
+// A copy of the license may be obtained at: http://www.eclipse.org/legal/epl-v10.html
+//
+// *************************************************************************************************
+
+// Microbenchmark for the math library: prints the time per operation for the SIMD and the scalar
+// path. Build with optimizations enabled (e.g. CMAKE_BUILD_TYPE=Release). Usage: MathBench [iterations]
+
+#include "mathKernels.h"
+#include "utTimer.h"
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+using namespace std;
+
+
+// Small enough to stay in the L1 cache, so that the arithmetic and not memory is measured
+static const int NumItems = 256;
+
+static vector< float > matA( NumItems * 16 ), matB( NumItems * 16 ), vecs( NumItems * 4 ), dst( NumItems * 16 );
+
+
+static double timeBinary( MathKernels::BinaryFunc func, const float *b, int iterations )
+{
+	Horde3D::Timer timer;
+	timer.setEnabled( true );
+	for( int i = 0; i < iterations; ++i ) func( &matA[0], b, &dst[0], NumItems );
+	
+	return timer.getElapsedTimeMS() * 1000000.0 / ((double)iterations * NumItems);
+}
+
+
+static double timeUnary( MathKernels::UnaryFunc func, int iterations )
+{
+	Horde3D::Timer timer;
+	timer.setEnabled( true );
+	for( int i = 0; i < iterations; ++i ) func( &matA[0], &dst[0], NumItems );
+	
+	return timer.getElapsedTimeMS() * 1000000.0 / ((double)iterations * NumItems);
+}
+
+
+int main( int argc, char **argv )
+{
+	int iterations = argc > 1 ? atoi( argv[1] ) : 4000;
+	if( iterations < 1 ) iterations = 1;
+
+	// Invertible transformations with a translation
+	for( int i = 0; i < NumItems * 16; ++i )
+	{
+		matA[i] = (i % 5 == 0 ? 2.0f : 0.0f) + (float)(i % 7) * 0.125f;
+		matB[i] = (i % 5 == 0 ? 1.0f : 0.0f) + (float)(i % 3) * 0.25f;
+	}
+	for( int i = 0; i < NumItems * 4; ++i ) vecs[i] = (float)(i % 11) - 5.0f;
+
+	const MathKernels *kernels[2] = { &simdKernels, &scalarKernels };
+	double times[2][12];
+
+	for( int k = 0; k < 2; ++k )
+	{
+		const MathKernels &m = *kernels[k];
+		
+		times[k][0] = timeBinary( m.vec4Add, &vecs[0], iterations );
+		times[k][1] = timeBinary( m.vec4Scale, &vecs[0], iterations );
+		times[k][2] = timeBinary( m.matAdd, &matB[0], iterations );
+		times[k][3] = timeBinary( m.matScale, &matB[0], iterations );
+		times[k][4] = timeBinary( m.matMult, &matB[0], iterations );
+		times[k][5] = timeBinary( m.fastMult43, &matB[0], iterations );
+		times[k][6] = timeBinary( m.transVec3, &vecs[0], iterations );
+		times[k][7] = timeBinary( m.transVec4, &vecs[0], iterations );
+		times[k][8] = timeBinary( m.mult33Vec, &vecs[0], iterations );
+		times[k][9] = timeUnary( m.transposed, iterations );
+		times[k][10] = timeUnary( m.inverted, iterations );
+		times[k][11] = timeUnary( m.normalMat, iterations );
+	}
+
+	const char *names[12] = { "vec4Add", "vec4Scale", "matAdd", "matScale", "matMult", "fastMult43",
+		"transVec3", "transVec4", "mult33Vec", "transposed", "inverted", "normalMat" };
+
+	if( !simdKernels.simd ) printf( "SIMD is not available for this target\n" );
+	printf( "%-12s %10s %10s %8s\n", "ns/op", "simd", "scalar", "speedup" );
+	for( int i = 0; i < 12; ++i )
+	{
+		printf( "%-12s %10.2f %10.2f %7.2fx\n", names[i], times[0][i], times[1][i],
+		        times[0][i] > 0 ? times[1][i] / times[0][i] : 0.0 );
+	}
+
+	return 0;
+}
@@ -0,0 +1,45 @@
+// *************************************************************************************************
+//
+// Horde3D
+//   Next-Generation Graphics Engine
+// --------------------------------------
+// Copyright (C) 2006-2011 Nicolas Schulz
+//
+// This software is distributed under the terms of the Eclipse Public License v1.0.
+// A copy of the license may be obtained at: http://www.eclipse.org/legal/epl-v10.html
+//
+// *************************************************************************************************
+
+#ifndef _mathKernels_H_
+#define _mathKernels_H_
+
+// The math library is compiled twice, once with SIMD and once with H3D_NO_SIMD, and both versions
+// are exposed through the same table; all kernels work on arrays of count elements so that the
+// call overhead does not dominate the timings
+
+struct MathKernels
+{
+	typedef void (*BinaryFunc)( const float *a, const float *b, float *dst, int count );
+	typedef void (*UnaryFunc)( const float *a, float *dst, int count );
+	
+	const char  *name;
+	bool        simd;   // False if the compiler target has no SIMD path and both tables are the same
+
+	BinaryFunc  vec4Add;      // Vec4f a + b
+	BinaryFunc  vec4Scale;    // Vec4f a * b[0]
+	BinaryFunc  matAdd;       // Matrix4f a + b
+	BinaryFunc  matScale;     // Matrix4f a * b[0]
+	BinaryFunc  matMult;      // Matrix4f a * b
+	BinaryFunc  fastMult43;   // Matrix4f::fastMult43( a, b )
+	BinaryFunc  transVec3;    // Matrix4f a * Vec3f b
+	BinaryFunc  transVec4;    // Matrix4f a * Vec4f b
+	BinaryFunc  mult33Vec;    // Matrix4f a .mult33Vec( Vec3f b )
+	UnaryFunc   transposed;   // Matrix4f a .transposed()
+	UnaryFunc   inverted;     // Matrix4f a .inverted()
+	UnaryFunc   normalMat;    // Matrix4f a .inverted().transposed(), as used for mesh normal matrices
+};
+
+extern const MathKernels scalarKernels;
+extern const MathKernels simdKernels;
+
+#endif // _mathKernels_H_
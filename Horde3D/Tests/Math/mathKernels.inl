@@ -0,0 +1,135 @@
+// *************************************************************************************************
+//
+// Horde3D
+//   Next-Generation Graphics Engine
+// --------------------------------------
+// Copyright (C) 2006-2011 Nicolas Schulz
+//
+// This software is distributed under the terms of the Eclipse Public License v1.0.
+// A copy of the license may be obtained at: http://www.eclipse.org/legal/epl-v10.html
+//
+// *************************************************************************************************
+
+// Included by mathScalar.cpp and mathSimd.cpp; MATH_KERNELS names the table that is defined.
+// The library namespace is renamed in the scalar unit, so that the two differently compiled
+// versions of the inline math functions do not collide at link time.
+
+#include "utMath.h"
+#include "mathKernels.h"
+
+using namespace Horde3D;
+
+namespace {
+
+// Inputs and outputs are tightly packed: 16 floats per matrix, 4 per Vec4f, 3 per Vec3f
+
+void vec4Add( const float *a, const float *b, float *dst, int count )
+{
+	for( int i = 0; i < count; ++i )
+	{
+		Vec4f r = Vec4f( a[i*4], a[i*4+1], a[i*4+2], a[i*4+3] ) + Vec4f( b[i*4], b[i*4+1], b[i*4+2], b[i*4+3] );
+		dst[i*4] = r.x; dst[i*4+1] = r.y; dst[i*4+2] = r.z; dst[i*4+3] = r.w;
+	}
+}
+
+void vec4Scale( const float *a, const float *b, float *dst, int count )
+{
+	for( int i = 0; i < count; ++i )
+	{
+		Vec4f r = Vec4f( a[i*4], a[i*4+1], a[i*4+2], a[i*4+3] ) * b[i*4];
+		dst[i*4] = r.x; dst[i*4+1] = r.y; dst[i*4+2] = r.z; dst[i*4+3] = r.w;
+	}
+}
+
+void storeMat( const Matrix4f &m, float *dst )
+{
+	for( int j = 0; j < 16; ++j ) dst[j] = m.x[j];
+}
+
+void matAdd( const float *a, const float *b, float *dst, int count )
+{
+	for( int i = 0; i < count; ++i )
+		storeMat( Matrix4f( &a[i*16] ) + Matrix4f( &b[i*16] ), &dst[i*16] );
+}
+
+void matScale( const float *a, const float *b, float *dst, int count )
+{
+	for( int i = 0; i < count; ++i )
+		storeMat( Matrix4f( &a[i*16] ) * b[i*16], &dst[i*16] );
+}
+
+void matMult( const float *a, const float *b, float *dst, int count )
+{
+	for( int i = 0; i < count; ++i )
+		storeMat( Matrix4f( &a[i*16] ) * Matrix4f( &b[i*16] ), &dst[i*16] );
+}
+
+void fastMult43( const float *a, const float *b, float *dst, int count )
+{
+	Matrix4f m( Math::NO_INIT );
+	
+	for( int i = 0; i < count; ++i )
+	{
+		Matrix4f::fastMult43( m, Matrix4f( &a[i*16] ), Matrix4f( &b[i*16] ) );
+		storeMat( m, &dst[i*16] );
+	}
+}
+
+void transVec3( const float *a, const float *b, float *dst, int count )
+{
+	for( int i = 0; i < count; ++i )
+	{
+		Vec3f r = Matrix4f( &a[i*16] ) * Vec3f( b[i*3], b[i*3+1], b[i*3+2] );
+		dst[i*3] = r.x; dst[i*3+1] = r.y; dst[i*3+2] = r.z;
+	}
+}
+
+void transVec4( const float *a, const float *b, float *dst, int count )
+{
+	for( int i = 0; i < count; ++i )
+	{
+		Vec4f r = Matrix4f( &a[i*16] ) * Vec4f( b[i*4], b[i*4+1], b[i*4+2], b[i*4+3] );
+		dst[i*4] = r.x; dst[i*4+1] = r.y; dst[i*4+2] = r.z; dst[i*4+3] = r.w;
+	}
+}
+
+void mult33Vec( const float *a, const float *b, float *dst, int count )
+{
+	for( int i = 0; i < count; ++i )
+	{
+		Vec3f r = Matrix4f( &a[i*16] ).mult33Vec( Vec3f( b[i*3], b[i*3+1], b[i*3+2] ) );
+		dst[i*3] = r.x; dst[i*3+1] = r.y; dst[i*3+2] = r.z;
+	}
+}
+
+void transposed( const float *a, float *dst, int count )
+{
+	for( int i = 0; i < count; ++i )
+		storeMat( Matrix4f( &a[i*16] ).transposed(), &dst[i*16] );
+}
+
+void inverted( const float *a, float *dst, int count )
+{
+	for( int i = 0; i < count; ++i )
+		storeMat( Matrix4f( &a[i*16] ).inverted(), &dst[i*16] );
+}
+
+void normalMat( const float *a, float *dst, int count )
+{
+	for( int i = 0; i < count; ++i )
+		storeMat( Matrix4f( &a[i*16] ).inverted().transposed(), &dst[i*16] );
+}
+
+}  // namespace
+
+
+const MathKernels MATH_KERNELS =
+{
+#if defined( H3D_SIMD )
+	"simd", true,
+#else
+	"scalar", false,
+#endif
+	vec4Add, vec4Scale, matAdd, matScale, matMult, fastMult43, transVec3, transVec4, mult33Vec,
+	transposed, inverted, normalMat
+};
@@ -0,0 +1,20 @@
+// *************************************************************************************************
+//
+// Horde3D
+//   Next-Generation Graphics Engine
+// --------------------------------------
+// Copyright (C) 2006-2011 Nicolas Schulz
+//
+// This software is distributed under the terms of the Eclipse Public License v1.0.
+// A copy of the license may be obtained at: http://www.eclipse.org/legal/epl-v10.html
+//
+// *************************************************************************************************
+
+// Reference build of the math library
+#ifndef H3D_NO_SIMD
+#	define H3D_NO_SIMD
+#endif
+#define Horde3D Horde3DScalar
+#define MATH_KERNELS scalarKernels
+
+#include "mathKernels.inl"
@@ -0,0 +1,16 @@
+// *************************************************************************************************
+//
+// Horde3D
+//   Next-Generation Graphics Engine
+// --------------------------------------
+// Copyright (C) 2006-2011 Nicolas Schulz
+//
+// This software is distributed under the terms of the Eclipse Public License v1.0.
+// A copy of the license may be obtained at: http://www.eclipse.org/legal/epl-v10.html
+//
+// *************************************************************************************************
+
+// Math library as built for the engine, with SIMD unless HORDE3D_USE_SIMD is off
+#define MATH_KERNELS simdKernels
+
+#include "mathKernels.inl"
@@ -0,0 +1,217 @@
+// *************************************************************************************************
+//
+// Horde3D
+//   Next-Generation Graphics Engine
+// --------------------------------------
+// Copyright (C) 2006-2011 Nicolas Schulz
+//
+// This software is distributed under the terms of the Eclipse Public License v1.0.
+// A copy of the license may be obtained at: http://www.eclipse.org/legal/epl-v10.html
+//
+// *************************************************************************************************
+
+// Compares the SIMD math paths with the scalar reference implementation.
+// Sums, scales and transposes must be bit-identical; products accumulate in the same order as the
+// scalar code, but the compiler may contract the scalar version to fused multiply-adds, so they
+// are compared with a tolerance of a few ulps. The inverse uses a different algorithm and is
+// checked against the reference with a relative tolerance.
+
+#include "mathKernels.h"
+#include <cmath>
+#include <cstdio>
+#include <vector>
+
+using namespace std;
+
+
+static const int NumItems = 4096;
+
+static unsigned int randState = 12345;
+
+static float randFloat( float min, float max )
+{
+	randState = randState * 1664525 + 1013904223;
+	return min + (max - min) * (float)(randState >> 8) / (float)(1 << 24);
+}
+
+
+static void fillRandom( vector< float > &v, float min, float max )
+{
+	for( size_t i = 0; i < v.size(); ++i ) v[i] = randFloat( min, max );
+}
+
+
+static void fillAffine( vector< float > &mats )
+{
+	// Rotation, non-uniform scale and translation, like node transformations
+	for( size_t i = 0; i < mats.size() / 16; ++i )
+	{
+		float *m = &mats[i * 16];
+		float ax = randFloat( -3, 3 ), ay = randFloat( -3, 3 ), az = randFloat( -3, 3 );
+		float sx = randFloat( 0.1f, 10 ), sy = randFloat( 0.1f, 10 ), sz = randFloat( 0.1f, 10 );
+		float cx = cosf( ax ), snx = sinf( ax ), cy = cosf( ay ), sny = sinf( ay );
+		float cz = cosf( az ), snz = sinf( az );
+
+		m[0] = (cy * cz) * sx; m[1] = (cy * snz) * sx; m[2] = -sny * sx; m[3] = 0;
+		m[4] = (snx * sny * cz - cx * snz) * sy; m[5] = (snx * sny * snz + cx * cz) * sy; m[6] = snx * cy * sy; m[7] = 0;
+		m[8] = (cx * sny * cz + snx * snz) * sz; m[9] = (cx * sny * snz - snx * cz) * sz; m[10] = cx * cy * sz; m[11] = 0;
+		m[12] = randFloat( -1000, 1000 ); m[13] = randFloat( -1000, 1000 ); m[14] = randFloat( -1000, 1000 ); m[15] = 1;
+	}
+}
+
+
+static void fillGeneral( vector< float > &mats )
+{
+	// Dense matrices with a dominant diagonal so that they are well conditioned
+	fillRandom( mats, -1, 1 );
+	for( size_t i = 0; i < mats.size() / 16; ++i )
+	{
+		for( int j = 0; j < 4; ++j ) mats[i * 16 + j * 5] += (randState & 1) ? 4.0f : -4.0f;
+	}
+}
+
+
+static int numFailures = 0;
+
+static void check( const char *name, const vector< float > &ref, const vector< float > &res,
+                   const vector< float > &scale, float relTolerance )
+{
+	// scale holds the magnitude of the terms that contributed to each result
+	float maxErr = 0;
+	int numMismatches = 0;
+	
+	for( size_t i = 0; i < ref.size(); ++i )
+	{
+		float err = fabsf( ref[i] - res[i] );
+		float allowed = relTolerance * scale[i];
+		if( err > allowed || ref[i] != ref[i] || res[i] != res[i] )
+		{
+			if( numMismatches++ == 0 )
+				printf( "  %s: element %i is %.9g, expected %.9g\n", name, (int)i, res[i], ref[i] );
+		}
+		if( scale[i] > 0 && err / scale[i] > maxErr ) maxErr = err / scale[i];
+	}
+
+	printf( "%-12s %s (max relative error %g)\n", name, numMismatches == 0 ? "ok    " : "FAILED", maxErr );
+	if( numMismatches > 0 ) ++numFailures;
+}
+
+
+// Magnitudes of the terms summed by a 4x4 product, used to scale the tolerance
+static void productScale( const vector< float > &a, const vector< float > &b, int aStride, int bStride,
+                          int numRows, int numCols, vector< float > &scale )
+{
+	for( int i = 0; i < NumItems; ++i )
+	{
+		for( int col = 0; col < numCols; ++col )
+		{
+			for( int row = 0; row < numRows; ++row )
+			{
+				float s = 0;
+				for( int k = 0; k < 4; ++k )
+				{
+					float bv = bStride == 16 ? b[i * 16 + col * 4 + k] : (k < bStride ? b[i * bStride + k] : 1.0f);
+					s += fabsf( a[i * aStride + k * 4 + row] * bv );
+				}
+				scale[i * numRows * numCols + col * numRows + row] = s;
+			}
+		}
+	}
+}
+
+
+int main()
+{
+	const MathKernels &ref = scalarKernels, &simd = simdKernels;
+
+	if( !simd.simd )
+		printf( "SIMD is not available for this target, comparing the scalar path with itself\n" );
+	
+	vector< float > matA( NumItems * 16 ), matB( NumItems * 16 ), vec3( NumItems * 3 ), vec4( NumItems * 4 );
+	fillRandom( matA, -100, 100 );
+	fillRandom( matB, -100, 100 );
+	fillRandom( vec3, -100, 100 );
+	fillRandom( vec4, -100, 100 );
+
+	vector< float > res0( NumItems * 16 ), res1( NumItems * 16 ), scale( NumItems * 16 );
+	vector< float > zeroScale( NumItems * 16, 0.0f );
+
+	// Exact operations
+	res0.resize( NumItems * 4 ); res1.resize( NumItems * 4 ); zeroScale.resize( NumItems * 4 );
+	ref.vec4Add( &vec4[0], &matA[0], &res0[0], NumItems );
+	simd.vec4Add( &vec4[0], &matA[0], &res1[0], NumItems );
+	check( "vec4Add", res0, res1, zeroScale, 0 );
+	ref.vec4Scale( &vec4[0], &matA[0], &res0[0], NumItems );
+	simd.vec4Scale( &vec4[0], &matA[0], &res1[0], NumItems );
+	check( "vec4Scale", res0, res1, zeroScale, 0 );
+
+	res0.resize( NumItems * 16 ); res1.resize( NumItems * 16 ); zeroScale.resize( NumItems * 16 );
+	ref.matAdd( &matA[0], &matB[0], &res0[0], NumItems );
+	simd.matAdd( &matA[0], &matB[0], &res1[0], NumItems );
+	check( "matAdd", res0, res1, zeroScale, 0 );
+	ref.matScale( &matA[0], &matB[0], &res0[0], NumItems );
+	simd.matScale( &matA[0], &matB[0], &res1[0], NumItems );
+	check( "matScale", res0, res1, zeroScale, 0 );
+	ref.transposed( &matA[0], &res0[0], NumItems );
+	simd.transposed( &matA[0], &res1[0], NumItems );
+	check( "transposed", res0, res1, zeroScale, 0 );
+
+	// Products
+	const float prodTolerance = 4.0f / (1 << 23);
+	
+	productScale( matA, matB, 16, 16, 4, 4, scale );
+	ref.matMult( &matA[0], &matB[0], &res0[0], NumItems );
+	simd.matMult( &matA[0], &matB[0], &res1[0], NumItems );
+	check( "matMult", res0, res1, scale, prodTolerance );
+	ref.fastMult43( &matA[0], &matB[0], &res0[0], NumItems );
+	simd.fastMult43( &matA[0], &matB[0], &res1[0], NumItems );
+	check( "fastMult43", res0, res1, scale, prodTolerance );
+
+	res0.resize( NumItems * 4 ); res1.resize( NumItems * 4 ); scale.resize( NumItems * 4 );
+	productScale( matA, vec4, 16, 4, 4, 1, scale );
+	ref.transVec4( &matA[0], &vec4[0], &res0[0], NumItems );
+	simd.transVec4( &matA[0], &vec4[0], &res1[0], NumItems );
+	check( "transVec4", res0, res1, scale, prodTolerance );
+
+	res0.resize( NumItems * 3 ); res1.resize( NumItems * 3 ); scale.resize( NumItems * 3 );
+	productScale( matA, vec3, 16, 3, 3, 1, scale );
+	ref.transVec3( &matA[0], &vec3[0], &res0[0], NumItems );
+	simd.transVec3( &matA[0], &vec3[0], &res1[0], NumItems );
+	check( "transVec3", res0, res1, scale, prodTolerance );
+	ref.mult33Vec( &matA[0], &vec3[0], &res0[0], NumItems );
+	simd.mult33Vec( &matA[0], &vec3[0], &res1[0], NumItems );
+	check( "mult33Vec", res0, res1, scale, prodTolerance );
+
+	// Inverse of node-like transformations and of general matrices; the tolerance is relative to
+	// the largest element of each inverse
+	res0.resize( NumItems * 16 ); res1.resize( NumItems * 16 ); scale.resize( NumItems * 16 );
+	const char *names[2] = { "inverted", "normalMat" };
+	for( int pass = 0; pass < 4; ++pass )
+	{
+		if( pass % 2 == 0 ) fillAffine( matA ); else fillGeneral( matA );
+		
+		MathKernels::UnaryFunc refFunc = pass < 2 ? ref.inverted : ref.normalMat;
+		MathKernels::UnaryFunc simdFunc = pass < 2 ? simd.inverted : simd.normalMat;
+		refFunc( &matA[0], &res0[0], NumItems );
+		simdFunc( &matA[0], &res1[0], NumItems );
+
+		for( int i = 0; i < NumItems; ++i )
+		{
+			float maxElem = 0;
+			for( int j = 0; j < 16; ++j ) maxElem = fabsf( res0[i * 16 + j] ) > maxElem ? fabsf( res0[i * 16 + j] ) : maxElem;
+			for( int j = 0; j < 16; ++j ) scale[i * 16 + j] = maxElem;
+		}
+		
+		char name[32];
+		sprintf( name, "%s/%s", names[pass / 2], pass % 2 == 0 ? "affine" : "dense" );
+		check( name, res0, res1, scale, 1e-5f );
+	}
+
+	if( numFailures > 0 )
+	{
+		printf( "%i of the math checks failed\n", numFailures );
+		return 1;
+	}
+
+	return 0;
+}
@@ -0,0 +1,167 @@
+// *************************************************************************************************
+//
+// Horde3D
+//   Next-Generation Graphics Engine
+// --------------------------------------
+// Copyright (C) 2006-2011 Nicolas Schulz
+//
+// This software is distributed under the terms of the Eclipse Public License v1.0.
+// A copy of the license may be obtained at: http://www.eclipse.org/legal/epl-v10.html
+//
+// *************************************************************************************************
+
+#include "utOpenGL.h"
+#include "glShim.h"
+#include <cstring>
+
+
+namespace glShim
+{
+	CallCounts calls;
+
+	static GLuint nextObject = 1;
+
+	static void genObjects( GLsizei n, GLuint *objects )
+	{
+		for( GLsizei i = 0; i < n; ++i ) objects[i] = nextObject++;
+	}
+}
+
+using namespace glShim;
+
+
+// =================================================================================================
+// GL 1.1 entry points
+// =================================================================================================
+
+extern "C"
+{
+void glBindTexture( GLenum, GLuint ) { ++calls.bindTexture; }
+void glBlendFunc( GLenum, GLenum ) {}
+void glClear( GLbitfield ) {}
+void glClearColor( GLclampf, GLclampf, GLclampf, GLclampf ) {}
+void glClearDepth( GLclampd ) {}
+void glColorMask( GLboolean, GLboolean, GLboolean, GLboolean ) {}
+void glCullFace( GLenum ) {}
+void glDeleteTextures( GLsizei, const GLuint * ) {}
+void glDepthFunc( GLenum ) {}
+void glDepthMask( GLboolean ) {}
+void glDisable( GLenum ) {}
+void glDrawArrays( GLenum, GLint, GLsizei ) {}
+void glDrawBuffer( GLenum ) {}
+void glEnable( GLenum ) {}
+void glFinish() {}
+void glGenTextures( GLsizei n, GLuint *textures ) { genObjects( n, textures ); }
+GLenum glGetError() { return GL_NO_ERROR; }
+void glGetIntegerv( GLenum, GLint *params ) { *params = 0; }
+void glGetTexImage( GLenum, GLint, GLenum, GLenum, GLvoid * ) {}
+void glPixelStorei( GLenum, GLint ) {}
+void glPolygonMode( GLenum, GLenum ) {}
+void glReadBuffer( GLenum ) {}
+void glReadPixels( GLint, GLint, GLsizei, GLsizei, GLenum, GLenum, GLvoid * ) {}
+void glScissor( GLint, GLint, GLsizei, GLsizei ) {}
+void glTexImage2D( GLenum, GLint, GLint, GLsizei, GLsizei, GLint, GLenum, GLenum, const GLvoid * ) {}
+void glTexParameterfv( GLenum, GLenum, const GLfloat * ) {}
+void glTexParameteri( GLenum, GLenum, GLint ) {}
+void glViewport( GLint, GLint, GLsizei, GLsizei ) {}
+
+const GLubyte *glGetString( GLenum name )
+{
+	// A GL 2.1 driver with the extensions required by the engine
+	switch( name )
+	{
+	case GL_VERSION:
+		return (const GLubyte *)"2.1 GL shim";
+	case GL_EXTENSIONS:
+		return (const GLubyte *)"GL_EXT_framebuffer_object GL_EXT_texture_filter_anisotropic "
+			"GL_EXT_texture_compression_s3tc GL_EXT_texture_sRGB";
+	default:
+		return (const GLubyte *)"";
+	}
+}
+}
+
+
+// =================================================================================================
+// Extension entry points
+// =================================================================================================
+
+static void shimUseProgram( GLuint ) { ++calls.useProgram; }
+static void shimBindBuffer( GLenum, GLuint ) { ++calls.bindBuffer; }
+static void shimActiveTexture( GLenum ) { ++calls.activeTexture; }
+static void shimUniformfv( GLint, GLsizei, const GLfloat * ) { ++calls.uniform; }
+static void shimUniformMatrixfv( GLint, GLsizei, GLboolean, const GLfloat * ) { ++calls.uniform; }
+static void shimUniform1i( GLint, GLint ) { ++calls.uniform; }
+static void shimVertexAttribPointer( GLuint, GLint, GLenum, GLboolean, GLsizei, const GLvoid * )
+	{ ++calls.vertexAttribPointer; }
+static void shimVertexAttribArray( GLuint ) {}
+
+static void shimGenBuffers( GLsizei n, GLuint *buffers ) { genObjects( n, buffers ); }
+static void shimBufferData( GLenum, GLsizeiptr, const GLvoid *, GLenum ) {}
+static void shimBufferSubData( GLenum, GLintptr, GLsizeiptr, const GLvoid * ) {}
+static void shimDeleteBuffers( GLsizei, const GLuint * ) {}
+static void shimBindFramebuffer( GLenum, GLuint ) {}
+
+static GLuint shimCreateObject() { return nextObject++; }
+static GLuint shimCreateShader( GLenum ) { return nextObject++; }
+static void shimShaderSource( GLuint, GLsizei, const GLchar **, const GLint * ) {}
+static void shimObjectOp( GLuint ) {}
+static void shimAttachShader( GLuint, GLuint ) {}
+
+static void shimGetObjectiv( GLuint, GLenum pname, GLint *params )
+{
+	// Everything compiles and links, there are no logs and no attributes
+	*params = pname == GL_COMPILE_STATUS || pname == GL_LINK_STATUS ? 1 : 0;
+}
+
+
+struct ShimFunc
+{
+	const char  *name;
+	void        (*func)();
+};
+
+#define SHIM_FUNC( name, func ) { name, (void (*)())func }
+
+static const ShimFunc shimFuncs[] = {
+	SHIM_FUNC( "glUseProgram", shimUseProgram ),
+	SHIM_FUNC( "glBindBuffer", shimBindBuffer ),
+	SHIM_FUNC( "glActiveTexture", shimActiveTexture ),
+	SHIM_FUNC( "glUniform1fv", shimUniformfv ),
+	SHIM_FUNC( "glUniform2fv", shimUniformfv ),
+	SHIM_FUNC( "glUniform3fv", shimUniformfv ),
+	SHIM_FUNC( "glUniform4fv", shimUniformfv ),
+	SHIM_FUNC( "glUniformMatrix3fv", shimUniformMatrixfv ),
+	SHIM_FUNC( "glUniformMatrix4fv", shimUniformMatrixfv ),
+	SHIM_FUNC( "glUniform1i", shimUniform1i ),
+	SHIM_FUNC( "glVertexAttribPointer", shimVertexAttribPointer ),
+	SHIM_FUNC( "glEnableVertexAttribArray", shimVertexAttribArray ),
+	SHIM_FUNC( "glDisableVertexAttribArray", shimVertexAttribArray ),
+	SHIM_FUNC( "glGenBuffers", shimGenBuffers ),
+	SHIM_FUNC( "glBufferData", shimBufferData ),
+	SHIM_FUNC( "glBufferSubData", shimBufferSubData ),
+	SHIM_FUNC( "glDeleteBuffers", shimDeleteBuffers ),
+	SHIM_FUNC( "glBindFramebufferEXT", shimBindFramebuffer ),
+	SHIM_FUNC( "glCreateProgram", shimCreateObject ),
+	SHIM_FUNC( "glCreateShader", shimCreateShader ),
+	SHIM_FUNC( "glShaderSource", shimShaderSource ),
+	SHIM_FUNC( "glCompileShader", shimObjectOp ),
+	SHIM_FUNC( "glLinkProgram", shimObjectOp ),
+	SHIM_FUNC( "glDeleteShader", shimObjectOp ),
+	SHIM_FUNC( "glDeleteProgram", shimObjectOp ),
+	SHIM_FUNC( "glAttachShader", shimAttachShader ),
+	SHIM_FUNC( "glGetShaderiv", shimGetObjectiv ),
+	SHIM_FUNC( "glGetProgramiv", shimGetObjectiv )
+};
+
+
+extern "C" void (*glXGetProcAddressARB( const unsigned char *procName ))( void )
+{
+	// Entry points that are not shimmed stay null, so using them crashes the test
+	for( size_t i = 0; i < sizeof( shimFuncs ) / sizeof( ShimFunc ); ++i )
+	{
+		if( strcmp( shimFuncs[i].name, (const char *)procName ) == 0 ) return shimFuncs[i].func;
+	}
+
+	return 0x0;
+}
@@ -0,0 +1,42 @@
+// *************************************************************************************************
+//
+// Horde3D
+//   Next-Generation Graphics Engine
+// --------------------------------------
+// Copyright (C) 2006-2011 Nicolas Schulz
+//
+// This software is distributed under the terms of the Eclipse Public License v1.0.
+// A copy of the license may be obtained at: http://www.eclipse.org/legal/epl-v10.html
+//
+// *************************************************************************************************
+
+#ifndef _glShim_H_
+#define _glShim_H_
+
+// Stands in for the GL library: the entry points do nothing except for handing out object names
+// and counting the state calls which the render device shadows.
+
+namespace glShim
+{
+	struct CallCounts
+	{
+		int  useProgram;
+		int  bindBuffer;
+		int  activeTexture;
+		int  bindTexture;
+		int  uniform;
+		int  vertexAttribPointer;
+
+		CallCounts() : useProgram( 0 ), bindBuffer( 0 ), activeTexture( 0 ), bindTexture( 0 ),
+			uniform( 0 ), vertexAttribPointer( 0 ) {}
+
+		int getStateCalls() const
+		{
+			return useProgram + bindBuffer + activeTexture + bindTexture + uniform + vertexAttribPointer;
+		}
+	};
+
+	extern CallCounts calls;
+}
+
+#endif // _glShim_H_
@@ -0,0 +1,279 @@
+// *************************************************************************************************
+//
+// Horde3D
+//   Next-Generation Graphics Engine
+// --------------------------------------
+// Copyright (C) 2006-2011 Nicolas Schulz
+//
+// This software is distributed under the terms of the Eclipse Public License v1.0.
+// A copy of the license may be obtained at: http://www.eclipse.org/legal/epl-v10.html
+//
+// *************************************************************************************************
+
+// Drives the render device on top of a GL shim through redundant texture, program, buffer and
+// uniform calls and checks the shadowed state against the GL calls that actually arrive.
+
+#include "egRendererBase.h"
+#include "egModules.h"
+#include "egCom.h"
+#include "glShim.h"
+#include <cstdio>
+
+using namespace Horde3D;
+
+
+// =================================================================================================
+// Engine modules used by the render device
+// =================================================================================================
+
+namespace Horde3D {
+
+EngineConfig::EngineConfig() : sRGBLinearization( false ) {}
+
+EngineLog::EngineLog() {}
+EngineLog::~EngineLog() {}
+void EngineLog::writeError( const char *, ... ) {}
+void EngineLog::writeWarning( const char *, ... ) {}
+void EngineLog::writeInfo( const char *, ... ) {}
+
+static EngineConfig engineConfig;
+static EngineLog engineLog;
+
+EngineConfig *Modules::_engineConfig = &engineConfig;
+EngineLog *Modules::_engineLog = &engineLog;
+
+}
+
+
+// =================================================================================================
+// Tests
+// =================================================================================================
+
+static int numFailures = 0;
+
+#define CHECK( exp ) \
+	if( !(exp) ) { printf( "  line %i: %s failed\n", __LINE__, #exp ); ++numFailures; }
+
+
+class StateCallCounter
+{
+public:
+	StateCallCounter( RenderDevice &rdi ) : _rdi( rdi ) { reset(); }
+
+	void reset()
+	{
+		_rdi.getStateCallCount( false, true );
+		_rdi.getStateCallCount( true, true );
+		glShim::calls = glShim::CallCounts();
+	}
+
+	// Every state call the device reports as issued must have reached GL
+	bool matchesGL() { return (int)_rdi.getStateCallCount( false, false ) == glShim::calls.getStateCalls(); }
+	int getIssued() { return (int)_rdi.getStateCallCount( false, false ); }
+	int getElided() { return (int)_rdi.getStateCallCount( true, false ); }
+
+private:
+	RenderDevice  &_rdi;
+};
+
+
+static void testTextures( RenderDevice &rdi )
+{
+	printf( "textures\n" );
+	uint32 tex0 = rdi.createTexture( TextureTypes::Tex2D, 64, 64, 1, TextureFormats::BGRA8, false, false, false, false );
+	uint32 tex1 = rdi.createTexture( TextureTypes::Tex2D, 64, 64, 1, TextureFormats::BGRA8, false, false, false, false );
+	StateCallCounter counter( rdi );
+
+	rdi.setTexture( 0, tex0, 0 );
+	rdi.setTexture( 1, tex1, 0 );
+	rdi.commitStates();
+	CHECK( glShim::calls.bindTexture == 2 );
+	CHECK( counter.matchesGL() );
+
+	// Same textures again
+	counter.reset();
+	for( int i = 0; i < 10; ++i )
+	{
+		rdi.setTexture( 0, tex0, 0 );
+		rdi.setTexture( 1, tex1, 0 );
+		rdi.commitStates();
+	}
+	CHECK( glShim::calls.getStateCalls() == 0 );
+	CHECK( counter.getIssued() == 0 );
+	CHECK( counter.getElided() == 10 * 16 );
+
+	// Swapped textures need two binds and a unit switch between them
+	counter.reset();
+	rdi.setTexture( 0, tex1, 0 );
+	rdi.setTexture( 1, tex0, 0 );
+	rdi.commitStates();
+	CHECK( glShim::calls.bindTexture == 2 );
+	CHECK( glShim::calls.activeTexture == 2 );
+	CHECK( counter.matchesGL() );
+
+	rdi.setTexture( 0, 0, 0 );
+	rdi.setTexture( 1, 0, 0 );
+	rdi.commitStates();
+	rdi.destroyTexture( tex0 );
+	rdi.destroyTexture( tex1 );
+}
+
+
+static void testPrograms( RenderDevice &rdi )
+{
+	printf( "programs\n" );
+	uint32 shader0 = rdi.createShader( rdi.getDefaultVSCode(), rdi.getDefaultFSCode() );
+	uint32 shader1 = rdi.createShader( rdi.getDefaultVSCode(), rdi.getDefaultFSCode() );
+	CHECK( shader0 != 0 && shader1 != 0 );
+	StateCallCounter counter( rdi );
+
+	for( int i = 0; i < 10; ++i ) rdi.bindShader( shader0 );
+	CHECK( glShim::calls.useProgram == 1 );
+	CHECK( counter.getElided() == 9 );
+	CHECK( counter.matchesGL() );
+
+	counter.reset();
+	rdi.bindShader( shader1 );
+	rdi.bindShader( shader0 );
+	rdi.bindShader( shader0 );
+	CHECK( glShim::calls.useProgram == 2 );
+	CHECK( counter.getElided() == 1 );
+	CHECK( counter.matchesGL() );
+
+	// A destroyed program must not match the shadowed binding, even if its id is reused
+	counter.reset();
+	rdi.destroyShader( shader0 );
+	shader0 = rdi.createShader( rdi.getDefaultVSCode(), rdi.getDefaultFSCode() );
+	rdi.bindShader( shader0 );
+	CHECK( glShim::calls.useProgram == 1 );
+	CHECK( counter.matchesGL() );
+
+	rdi.bindShader( 0 );
+	rdi.destroyShader( shader0 );
+	rdi.destroyShader( shader1 );
+}
+
+
+static void testBuffers( RenderDevice &rdi )
+{
+	printf( "buffers\n" );
+	uint32 vb = rdi.createVertexBuffer( 1024, 0x0 );
+	uint32 ib0 = rdi.createIndexBuffer( 256, 0x0 );
+	uint32 ib1 = rdi.createIndexBuffer( 256, 0x0 );
+	StateCallCounter counter( rdi );
+
+	for( int i = 0; i < 10; ++i )
+	{
+		rdi.setIndexBuffer( ib0, IDXFMT_16 );
+		rdi.commitStates();
+	}
+	CHECK( glShim::calls.bindBuffer == 1 );
+	CHECK( counter.getElided() == 9 );
+	CHECK( counter.matchesGL() );
+
+	counter.reset();
+	rdi.setIndexBuffer( ib1, IDXFMT_16 );
+	rdi.commitStates();
+	rdi.setIndexBuffer( ib0, IDXFMT_16 );
+	rdi.commitStates();
+	CHECK( glShim::calls.bindBuffer == 2 );
+	CHECK( counter.matchesGL() );
+
+	// Updating a buffer binds it, the index buffer set for drawing has to be restored afterwards
+	counter.reset();
+	float data[4] = { 0 };
+	rdi.updateBufferData( ib1, 0, sizeof( data ), data );
+	rdi.setIndexBuffer( ib0, IDXFMT_16 );
+	rdi.commitStates();
+	CHECK( counter.matchesGL() );
+
+	rdi.setIndexBuffer( 0, IDXFMT_16 );
+	rdi.commitStates();
+	rdi.destroyBuffer( vb );
+	rdi.destroyBuffer( ib0 );
+	rdi.destroyBuffer( ib1 );
+}
+
+
+static void testUniforms( RenderDevice &rdi )
+{
+	printf( "uniforms\n" );
+	uint32 shader0 = rdi.createShader( rdi.getDefaultVSCode(), rdi.getDefaultFSCode() );
+	uint32 shader1 = rdi.createShader( rdi.getDefaultVSCode(), rdi.getDefaultFSCode() );
+	const float values[16] = { 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 16 };
+	const float otherValues[4] = { 4, 3, 2, 1 };
+	StateCallCounter counter( rdi );
+
+	rdi.bindShader( shader0 );
+	for( int i = 0; i < 10; ++i )
+	{
+		rdi.setShaderConst( 0, CONST_FLOAT4, values );
+		rdi.setShaderConst( 1, CONST_FLOAT44, values );
+		rdi.setShaderSampler( 2, 3 );
+	}
+	CHECK( glShim::calls.uniform == 3 );
+	CHECK( counter.getElided() == 27 );
+	CHECK( counter.matchesGL() );
+
+	// Changed values are uploaded
+	counter.reset();
+	rdi.setShaderConst( 0, CONST_FLOAT4, otherValues );
+	rdi.setShaderSampler( 2, 4 );
+	CHECK( glShim::calls.uniform == 2 );
+	CHECK( counter.matchesGL() );
+
+	// Uniform values belong to the program, so the other one needs its own uploads
+	counter.reset();
+	rdi.bindShader( shader1 );
+	rdi.setShaderConst( 0, CONST_FLOAT4, otherValues );
+	rdi.bindShader( shader0 );
+	rdi.setShaderConst( 0, CONST_FLOAT4, otherValues );
+	CHECK( glShim::calls.uniform == 1 );
+	CHECK( counter.matchesGL() );
+
+	// Arrays whose count changes are uploaded whenever the size differs from the last upload
+	counter.reset();
+	for( int i = 0; i < 10; ++i )
+	{
+		rdi.setShaderConst( 3, CONST_FLOAT4, values, 1 + i % 4 );
+		rdi.setShaderConst( 3, CONST_FLOAT4, values, 1 + i % 4 );
+	}
+	CHECK( glShim::calls.uniform == 10 );
+	CHECK( counter.getElided() == 10 );
+	CHECK( counter.matchesGL() );
+
+	// Uniforms that exceed the cache are always uploaded
+	counter.reset();
+	float bigValues[8 * 16] = { 0 };
+	rdi.setShaderConst( 4, CONST_FLOAT44, bigValues, 8 );
+	rdi.setShaderConst( 4, CONST_FLOAT44, bigValues, 8 );
+	CHECK( glShim::calls.uniform == 2 );
+	CHECK( counter.matchesGL() );
+
+	rdi.bindShader( 0 );
+	rdi.destroyShader( shader0 );
+	rdi.destroyShader( shader1 );
+}
+
+
+int main()
+{
+	initOpenGLExtensions();
+
+	RenderDevice rdi;
+	rdi.beginRendering();
+
+	testTextures( rdi );
+	testPrograms( rdi );
+	testBuffers( rdi );
+	testUniforms( rdi );
+
+	if( numFailures > 0 )
+	{
+		printf( "%i render device checks failed\n", numFailures );
+		return 1;
+	}
+
+	printf( "all render device checks passed\n" );
+	return 0;
+}
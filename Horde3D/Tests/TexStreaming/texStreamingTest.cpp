@@ -0,0 +1,176 @@
+// *************************************************************************************************
+//
+// Horde3D
+//   Next-Generation Graphics Engine
+// --------------------------------------
+// Copyright (C) 2006-2011 Nicolas Schulz
+//
+// This software is distributed under the terms of the Eclipse Public License v1.0.
+// A copy of the license may be obtained at: http://www.eclipse.org/legal/epl-v10.html
+//
+// *************************************************************************************************
+
+// Checks the residency planning of the texture streaming, which decides the finest resident mip
+// level of each texture from the wanted levels, the priorities and the memory budget.
+
+#include "egTexStreaming.h"
+#include <cstdio>
+#include <vector>
+#include <algorithm>
+
+using namespace Horde3D;
+
+
+static int numFailures = 0;
+
+#define CHECK( exp ) \
+	if( !(exp) ) { printf( "  line %i: %s failed\n", __LINE__, #exp ); ++numFailures; }
+
+
+// Square texture with the given size of level 0; the memory includes the coarser mip levels
+static TexStreamingRequest makeRequest( uint32 size, uint32 coarsestLevel, uint32 wantedLevel, float priority )
+{
+	TexStreamingRequest req;
+	req.numLevels = 0;
+	for( uint32 i = 0; (size >> i) > 0 && i < MaxTexStreamingLevels; ++i )
+	{
+		uint32 mem = (size >> i) * (size >> i) * 4;
+		req.residentMem[i] = mem + mem / 3;
+		++req.numLevels;
+	}
+	req.coarsestLevel = coarsestLevel;
+	req.curLevel = coarsestLevel;
+	req.wantedLevel = wantedLevel;
+	req.targetLevel = coarsestLevel;
+	req.priority = priority;
+
+	return req;
+}
+
+
+static uint64 calcTargetMem( const std::vector< TexStreamingRequest > &requests )
+{
+	uint64 mem = 0;
+	for( size_t i = 0; i < requests.size(); ++i ) mem += requests[i].residentMem[requests[i].targetLevel];
+	return mem;
+}
+
+
+static void testUnlimited()
+{
+	printf( "unlimited budget\n" );
+	std::vector< TexStreamingRequest > requests;
+	requests.push_back( makeRequest( 1024, 4, 0, 10 ) );
+	requests.push_back( makeRequest( 1024, 4, 2, 5 ) );
+	requests.push_back( makeRequest( 512, 3, 3, 0 ) );
+	requests.push_back( makeRequest( 256, 2, 7, 1 ) );  // Wanted level coarser than allowed
+
+	uint64 mem = planTexResidency( requests, 0 );
+	CHECK( requests[0].targetLevel == 0 );
+	CHECK( requests[1].targetLevel == 2 );
+	CHECK( requests[2].targetLevel == 3 );
+	CHECK( requests[3].targetLevel == 2 );
+	CHECK( mem == calcTargetMem( requests ) );
+
+	// A budget that is large enough does not change anything either
+	std::vector< TexStreamingRequest > budgeted = requests;
+	CHECK( planTexResidency( budgeted, mem ) == mem );
+	for( size_t i = 0; i < requests.size(); ++i )
+		CHECK( budgeted[i].targetLevel == requests[i].targetLevel );
+}
+
+
+static void testPriorities()
+{
+	printf( "priorities\n" );
+	std::vector< TexStreamingRequest > requests;
+	requests.push_back( makeRequest( 1024, 4, 0, 2 ) );
+	requests.push_back( makeRequest( 1024, 4, 0, 3 ) );
+	requests.push_back( makeRequest( 1024, 4, 0, 1 ) );
+	const uint64 fullMem = 3 * (uint64)requests[0].residentMem[0];
+
+	// Dropping one level of the least important texture is enough
+	uint64 budget = fullMem - 1;
+	uint64 mem = planTexResidency( requests, budget );
+	CHECK( requests[0].targetLevel == 0 );
+	CHECK( requests[1].targetLevel == 0 );
+	CHECK( requests[2].targetLevel == 1 );
+	CHECK( mem <= budget );
+	CHECK( mem == calcTargetMem( requests ) );
+
+	// Two textures have to drop a level, the most important one keeps its resolution
+	budget = fullMem - requests[0].residentMem[0] + requests[0].residentMem[1] - 1;
+	mem = planTexResidency( requests, budget );
+	CHECK( requests[0].targetLevel == 1 );
+	CHECK( requests[1].targetLevel == 0 );
+	CHECK( requests[2].targetLevel == 1 );
+	CHECK( mem <= budget );
+	CHECK( mem == calcTargetMem( requests ) );
+
+	// Equal priorities are resolved by the order of the requests
+	for( size_t i = 0; i < requests.size(); ++i ) requests[i].priority = 1;
+	mem = planTexResidency( requests, fullMem - 1 );
+	CHECK( requests[0].targetLevel == 1 );
+	CHECK( requests[1].targetLevel == 0 );
+	CHECK( requests[2].targetLevel == 0 );
+}
+
+
+static void testBudget()
+{
+	printf( "budget\n" );
+	std::vector< TexStreamingRequest > requests;
+	for( uint32 i = 0; i < 20; ++i )
+		requests.push_back( makeRequest( 2048 >> (i % 3), 5 - i % 3, i % 2, (float)((i * 7) % 11) ) );
+
+	uint64 fullMem = planTexResidency( requests, 0 );
+	uint64 minMem = 0;
+	for( size_t i = 0; i < requests.size(); ++i ) minMem += requests[i].residentMem[requests[i].coarsestLevel];
+
+	for( uint32 step = 0; step <= 16; ++step )
+	{
+		uint64 budget = fullMem - (fullMem - minMem) * step / 16;
+		uint64 mem = planTexResidency( requests, budget );
+		CHECK( mem <= budget );
+		CHECK( mem == calcTargetMem( requests ) );
+
+		// Quality degrades evenly: a texture that could still drop levels has lost at most one
+		// level less than any other texture
+		for( size_t i = 0; i < requests.size(); ++i )
+		{
+			const TexStreamingRequest &req = requests[i];
+			uint32 drops = req.targetLevel - std::min( req.wantedLevel, req.coarsestLevel );
+			CHECK( req.targetLevel <= req.coarsestLevel );
+			if( req.targetLevel == req.coarsestLevel ) continue;
+			
+			for( size_t j = 0; j < requests.size(); ++j )
+			{
+				const TexStreamingRequest &other = requests[j];
+				CHECK( other.targetLevel - std::min( other.wantedLevel, other.coarsestLevel ) <= drops + 1 );
+			}
+		}
+	}
+
+	// Below the coarsest levels, the textures stay at their coarsest levels
+	uint64 mem = planTexResidency( requests, minMem / 2 );
+	CHECK( mem == minMem );
+	for( size_t i = 0; i < requests.size(); ++i )
+		CHECK( requests[i].targetLevel == requests[i].coarsestLevel );
+}
+
+
+int main()
+{
+	testUnlimited();
+	testPriorities();
+	testBudget();
+
+	if( numFailures > 0 )
+	{
+		printf( "%i texture streaming checks failed\n", numFailures );
+		return 1;
+	}
+
+	printf( "all texture streaming checks passed\n" );
+	return 0;
+}
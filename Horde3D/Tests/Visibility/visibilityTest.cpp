@@ -0,0 +1,366 @@
+// *************************************************************************************************
+//
+// Horde3D
+//   Next-Generation Graphics Engine
+// --------------------------------------
+// Copyright (C) 2006-2011 Nicolas Schulz
+//
+// This software is distributed under the terms of the Eclipse Public License v1.0.
+// A copy of the license may be obtained at: http://www.eclipse.org/legal/epl-v10.html
+//
+// *************************************************************************************************
+
+// Drives the visibility buffer of the occlusion culling with a fake device whose queries and
+// fences complete when the test says so, and checks when and in which order results are read back.
+
+#include "egVisibility.h"
+#include <cstdio>
+#include <vector>
+
+using namespace Horde3D;
+
+
+// =================================================================================================
+// Fake device
+// =================================================================================================
+
+class FakeOcclusionDevice : public OcclusionDevice
+{
+public:
+	FakeOcclusionDevice( bool supportFences ) :
+		_supportFences( supportFences ), _signalNewFences( false ), _liveQueries( 0 ), _liveFences( 0 ), _blockingReads( 0 )
+	{
+		// Object 0 is invalid
+		_queries.push_back( Query() );
+		_fences.push_back( Fence() );
+	}
+
+	uint32 createOcclusionQuery()
+	{
+		++_liveQueries;
+		_queries.push_back( Query() );
+		return (uint32)_queries.size() - 1;
+	}
+	
+	void destroyQuery( uint32 queryObj )
+	{
+		if( queryObj == 0 ) return;
+		--_liveQueries;
+		_queries[queryObj].destroyed = true;
+	}
+	
+	uint32 getQueryResult( uint32 queryObj )
+	{
+		// A real device stalls until the result is available
+		Query &query = _queries[queryObj];
+		if( !query.available ) ++_blockingReads;
+		query.available = true;
+		return query.samples;
+	}
+	
+	bool isQueryResultAvailable( uint32 queryObj ) { return _queries[queryObj].available; }
+
+	uint32 createFence()
+	{
+		if( !_supportFences ) return 0;
+		++_liveFences;
+		Fence fence;
+		fence.signaled = _signalNewFences;
+		_fences.push_back( fence );
+		return (uint32)_fences.size() - 1;
+	}
+	
+	void destroyFence( uint32 fenceObj )
+	{
+		if( fenceObj == 0 ) return;
+		--_liveFences;
+		_fences[fenceObj].destroyed = true;
+	}
+	
+	bool isFenceSignaled( uint32 fenceObj ) { return _fences[fenceObj].signaled; }
+
+	// Test controls
+	void setSamples( uint32 queryObj, uint32 samples )
+	{
+		// Issuing a query again makes its old result unavailable
+		_queries[queryObj].samples = samples;
+		_queries[queryObj].available = false;
+	}
+
+	void completeAll()
+	{
+		// The GPU catches up with all commands issued so far
+		for( size_t i = 1; i < _queries.size(); ++i ) _queries[i].available = true;
+		for( size_t i = 1; i < _fences.size(); ++i ) _fences[i].signaled = true;
+	}
+
+	void setSignalNewFences( bool signal ) { _signalNewFences = signal; }
+	int getLiveQueries() { return _liveQueries; }
+	int getLiveFences() { return _liveFences; }
+	int getBlockingReads() { return _blockingReads; }
+	int getCreatedQueries() { return (int)_queries.size() - 1; }
+
+private:
+	struct Query
+	{
+		uint32  samples;
+		bool    available, destroyed;
+		Query() : samples( 0 ), available( false ), destroyed( false ) {}
+	};
+
+	struct Fence
+	{
+		bool  signaled, destroyed;
+		Fence() : signaled( false ), destroyed( false ) {}
+	};
+
+	std::vector< Query >  _queries;
+	std::vector< Fence >  _fences;
+	bool                  _supportFences;
+	bool                  _signalNewFences;  // Fences are passed as soon as they are created
+	int                   _liveQueries, _liveFences;
+	int                   _blockingReads;
+};
+
+
+// =================================================================================================
+// Checks
+// =================================================================================================
+
+static int numFailures = 0;
+
+#define CHECK( exp ) \
+	if( !(exp) ) { printf( "  line %i: %s failed\n", __LINE__, #exp ); ++numFailures; }
+
+
+static void testSample( VisibilityBuffer &visBuf, FakeOcclusionDevice &device, uint32 frameID,
+                        int occSet, uint32 slot, uint32 samples )
+{
+	if( visBuf.markTested( occSet, slot, frameID ) )
+		device.setSamples( visBuf.addTest( occSet, slot ), samples );
+}
+
+
+static void testLag()
+{
+	printf( "lag\n" );
+	
+	// GPU one frame behind: the results of a frame are read at the end of the next one
+	{
+		FakeOcclusionDevice device( true );
+		VisibilityBuffer visBuf( device );
+
+		testSample( visBuf, device, 1, 0, 5, 0 );
+		visBuf.finishFrame();
+		CHECK( !visBuf.isOccluded( 0, 5 ) );
+		
+		device.completeAll();
+		visBuf.finishFrame();
+		CHECK( visBuf.isOccluded( 0, 5 ) );
+		CHECK( device.getBlockingReads() == 0 );
+	}
+
+	// Stalled GPU: the oldest batch is read when it is needed again, MaxOccTestFrames frames later,
+	// and only then the CPU waits
+	{
+		FakeOcclusionDevice device( true );
+		VisibilityBuffer visBuf( device );
+
+		testSample( visBuf, device, 1, 0, 5, 0 );
+		for( uint32 i = 0; i < MaxOccTestFrames - 1; ++i )
+		{
+			visBuf.finishFrame();
+			CHECK( !visBuf.isOccluded( 0, 5 ) );
+		}
+		CHECK( device.getBlockingReads() == 0 );
+		
+		visBuf.finishFrame();
+		CHECK( visBuf.isOccluded( 0, 5 ) );
+		CHECK( device.getBlockingReads() == 1 );
+	}
+	
+	// Without fences the last query of a batch tells whether the batch is finished
+	{
+		FakeOcclusionDevice device( false );
+		VisibilityBuffer visBuf( device );
+
+		testSample( visBuf, device, 1, 0, 1, 0 );
+		testSample( visBuf, device, 1, 0, 2, 0 );
+		visBuf.finishFrame();
+		visBuf.finishFrame();
+		CHECK( !visBuf.isOccluded( 0, 1 ) && !visBuf.isOccluded( 0, 2 ) );
+
+		device.completeAll();
+		visBuf.finishFrame();
+		CHECK( visBuf.isOccluded( 0, 1 ) && visBuf.isOccluded( 0, 2 ) );
+		CHECK( device.getBlockingReads() == 0 );
+	}
+}
+
+
+static void testOrder()
+{
+	printf( "read-back order\n" );
+	
+	// Occluded in frame 1, visible in frame 2: after both are read, the newer result wins
+	{
+		FakeOcclusionDevice device( true );
+		VisibilityBuffer visBuf( device );
+
+		testSample( visBuf, device, 1, 0, 3, 0 );
+		visBuf.finishFrame();
+		testSample( visBuf, device, 2, 0, 3, 100 );
+		device.completeAll();  // Before the fence of frame 2 is created
+		visBuf.finishFrame();
+		CHECK( visBuf.isOccluded( 0, 3 ) );
+
+		device.completeAll();
+		visBuf.finishFrame();
+		CHECK( !visBuf.isOccluded( 0, 3 ) );
+	}
+
+	// Both frames are finished when they are read back together: the newer result wins again
+	{
+		FakeOcclusionDevice device( true );
+		VisibilityBuffer visBuf( device );
+
+		testSample( visBuf, device, 1, 0, 3, 0 );
+		visBuf.finishFrame();
+		testSample( visBuf, device, 2, 0, 3, 100 );
+		device.completeAll();
+		device.setSignalNewFences( true );
+		visBuf.finishFrame();
+		CHECK( !visBuf.isOccluded( 0, 3 ) );
+	}
+
+	// A finished newer batch is not read before an unfinished older one
+	{
+		FakeOcclusionDevice device( true );
+		VisibilityBuffer visBuf( device );
+
+		testSample( visBuf, device, 1, 0, 3, 100 );
+		visBuf.finishFrame();
+		testSample( visBuf, device, 2, 0, 3, 0 );
+		device.setSignalNewFences( true );
+		visBuf.finishFrame();
+		CHECK( !visBuf.isOccluded( 0, 3 ) );
+
+		// The older batch is needed for the next frame and read anyway, then the newer one follows
+		visBuf.finishFrame();
+		CHECK( visBuf.isOccluded( 0, 3 ) );
+	}
+
+	// Several tests of the same slot in one frame are skipped
+	{
+		FakeOcclusionDevice device( true );
+		VisibilityBuffer visBuf( device );
+
+		CHECK( visBuf.markTested( 0, 7, 1 ) );
+		CHECK( !visBuf.markTested( 0, 7, 1 ) );
+		CHECK( visBuf.markTested( 1, 7, 1 ) );
+		CHECK( visBuf.markTested( 0, 7, 2 ) );
+	}
+}
+
+
+static void testGenerations()
+{
+	printf( "generations\n" );
+	
+	// A node is removed while its test is in flight and the handle is reused
+	{
+		FakeOcclusionDevice device( true );
+		VisibilityBuffer visBuf( device );
+
+		testSample( visBuf, device, 1, 0, 4, 0 );
+		testSample( visBuf, device, 1, 1, 4, 0 );
+		testSample( visBuf, device, 1, 0, 6, 0 );
+		visBuf.finishFrame();
+		visBuf.resetSlot( 4 );
+		
+		device.completeAll();
+		visBuf.finishFrame();
+		CHECK( !visBuf.isOccluded( 0, 4 ) );
+		CHECK( !visBuf.isOccluded( 1, 4 ) );
+		CHECK( visBuf.isOccluded( 0, 6 ) );
+
+		// The new node is tested normally
+		CHECK( visBuf.markTested( 0, 4, 1 ) );
+	}
+
+	// Resetting a slot clears results that were already read back
+	{
+		FakeOcclusionDevice device( true );
+		VisibilityBuffer visBuf( device );
+
+		testSample( visBuf, device, 1, 0, 4, 0 );
+		visBuf.finishFrame();
+		device.completeAll();
+		visBuf.finishFrame();
+		CHECK( visBuf.isOccluded( 0, 4 ) );
+		
+		visBuf.resetSlot( 4 );
+		CHECK( !visBuf.isOccluded( 0, 4 ) );
+	}
+	
+	// An occlusion set is unregistered and registered again while its tests are in flight
+	{
+		FakeOcclusionDevice device( true );
+		VisibilityBuffer visBuf( device );
+
+		testSample( visBuf, device, 1, 2, 4, 0 );
+		testSample( visBuf, device, 1, 3, 4, 0 );
+		visBuf.finishFrame();
+		visBuf.resetSet( 2 );
+		
+		device.completeAll();
+		visBuf.finishFrame();
+		CHECK( !visBuf.isOccluded( 2, 4 ) );
+		CHECK( visBuf.isOccluded( 3, 4 ) );
+	}
+}
+
+
+static void testPool()
+{
+	printf( "query pool\n" );
+	
+	FakeOcclusionDevice device( true );
+	{
+		VisibilityBuffer visBuf( device );
+
+		for( uint32 frame = 1; frame <= 100; ++frame )
+		{
+			for( uint32 slot = 0; slot < 10; ++slot )
+				testSample( visBuf, device, frame, 0, slot, slot & 1 );
+			visBuf.finishFrame();
+			if( frame % 3 == 0 ) device.completeAll();
+		}
+
+		// One pool per frame in flight, fences are destroyed once read
+		CHECK( device.getCreatedQueries() == (int)MaxOccTestFrames * 10 );
+		CHECK( device.getLiveFences() <= (int)MaxOccTestFrames );
+		CHECK( visBuf.isOccluded( 0, 0 ) && !visBuf.isOccluded( 0, 1 ) );
+	}
+	
+	CHECK( device.getLiveQueries() == 0 );
+	CHECK( device.getLiveFences() == 0 );
+}
+
+
+int main()
+{
+	testLag();
+	testOrder();
+	testGenerations();
+	testPool();
+
+	if( numFailures > 0 )
+	{
+		printf( "%i visibility buffer checks failed\n", numFailures );
+		return 1;
+	}
+	
+	printf( "all visibility buffer checks passed\n" );
+	return 0;
+}